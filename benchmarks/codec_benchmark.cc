@@ -0,0 +1,361 @@
+#include <algorithm>
+#include <cstdint>
+#include <ratio>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "src/device_map.h"
+#include "src/engineering_units.h"
+#include "src/modbus_ascii.h"
+#include "src/modbus_client.h"
+#include "src/modbus_functions.h"
+#include "src/tag_batch.h"
+#include "src/tag_database.h"
+
+namespace modbus {
+namespace {
+
+// Client that answers every request with a canned response, so the
+// functions' request encoding and response decoding are all that is measured.
+class CannedClient : public Client {
+public:
+  explicit CannedClient(std::vector<uint8_t> response)
+      : Client(0), response_(std::move(response)) {}
+
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t /*slave_id*/, FunctionCode /*function_code*/,
+              const std::vector<uint8_t> &request_data) override {
+    benchmark::DoNotOptimize(request_data.data());
+    return response_;
+  }
+
+private:
+  std::vector<uint8_t> response_;
+};
+
+// Builds a read bits response: function code, byte count, packed bits.
+std::vector<uint8_t> BitsResponse(FunctionCode function_code,
+                                  uint16_t quantity) {
+  uint8_t byte_count = (quantity + 7) / 8;
+  std::vector<uint8_t> response = {static_cast<uint8_t>(function_code),
+                                   byte_count};
+  for (uint8_t i = 0; i < byte_count; ++i) {
+    response.push_back(0xA5);
+  }
+  return response;
+}
+
+// Builds a read registers response: function code, byte count, registers.
+std::vector<uint8_t> RegistersResponse(FunctionCode function_code,
+                                       uint16_t quantity) {
+  std::vector<uint8_t> response = {static_cast<uint8_t>(function_code),
+                                   static_cast<uint8_t>(quantity * 2)};
+  for (uint16_t i = 0; i < quantity; ++i) {
+    response.push_back(static_cast<uint8_t>(i >> 8));
+    response.push_back(static_cast<uint8_t>(i & 0xFF));
+  }
+  return response;
+}
+
+// --- CRC and ADU ---
+
+void BM_CalculateCrc16(benchmark::State &state) {
+  std::vector<uint8_t> data(state.range(0));
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>(i * 31);
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(CalculateCrc16(data));
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_CalculateCrc16)->Arg(8)->Arg(64)->Arg(256)->Arg(4096);
+
+void BM_BuildAdu(benchmark::State &state) {
+  std::vector<uint8_t> data(state.range(0), 0x5A);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        BuildAdu(0x11, FunctionCode::kWriteMultipleRegisters, data));
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_BuildAdu)->Arg(4)->Arg(64)->Arg(251);
+
+// --- Modbus ASCII ---
+
+void BM_EncodeHex(benchmark::State &state) {
+  std::vector<uint8_t> data(state.range(0));
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>(i * 31);
+  }
+  std::vector<uint8_t> hex(2 * data.size());
+  for (auto _ : state) {
+    EncodeHex(data.data(), data.size(), hex.data());
+    benchmark::DoNotOptimize(hex.data());
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_EncodeHex)->Arg(8)->Arg(64)->Arg(255);
+
+void BM_DecodeHex(benchmark::State &state) {
+  std::vector<uint8_t> data(state.range(0));
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>(i * 31);
+  }
+  std::vector<uint8_t> hex(2 * data.size());
+  EncodeHex(data.data(), data.size(), hex.data());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(DecodeHex(hex.data(), data.size(), data.data()));
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_DecodeHex)->Arg(8)->Arg(64)->Arg(255);
+
+// Parses a Read Holding Registers response arriving in 'chunk' byte pieces.
+void BM_AsciiFrameParse(benchmark::State &state) {
+  std::vector<uint8_t> data = {250};
+  data.resize(251, 0xA5);
+  std::vector<uint8_t> frame =
+      BuildAsciiFrame(0x11, FunctionCode::kReadHoldingRegisters, data);
+  size_t chunk = state.range(0);
+  AsciiFrameParser parser;
+  for (auto _ : state) {
+    parser.Reset();
+    for (size_t i = 0; i < frame.size(); i += chunk) {
+      parser.Feed(&frame[i], std::min(chunk, frame.size() - i));
+    }
+    benchmark::DoNotOptimize(parser.frame());
+  }
+  state.SetBytesProcessed(state.iterations() * frame.size());
+}
+BENCHMARK(BM_AsciiFrameParse)->Arg(1)->Arg(16)->Arg(1024);
+
+// --- Request encoding and response decoding ---
+
+void BM_ReadCoils(benchmark::State &state) {
+  uint16_t quantity = state.range(0);
+  CannedClient client(BitsResponse(FunctionCode::kReadCoils, quantity));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ReadCoils(&client, 0x11, 0x0013, quantity));
+  }
+}
+BENCHMARK(BM_ReadCoils)->Arg(1)->Arg(64)->Arg(2000);
+
+void BM_ReadDiscreteInputs(benchmark::State &state) {
+  uint16_t quantity = state.range(0);
+  CannedClient client(
+      BitsResponse(FunctionCode::kReadDiscreteInputs, quantity));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        ReadDiscreteInputs(&client, 0x11, 0x00C4, quantity));
+  }
+}
+BENCHMARK(BM_ReadDiscreteInputs)->Arg(1)->Arg(64)->Arg(2000);
+
+void BM_ReadHoldingRegisters(benchmark::State &state) {
+  uint16_t quantity = state.range(0);
+  CannedClient client(
+      RegistersResponse(FunctionCode::kReadHoldingRegisters, quantity));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        ReadHoldingRegisters(&client, 0x11, 0x006B, quantity));
+  }
+}
+BENCHMARK(BM_ReadHoldingRegisters)->Arg(1)->Arg(10)->Arg(125);
+
+// Same as BM_ReadHoldingRegisters with the request prepared once.
+void BM_ReadPreparedRegisters(benchmark::State &state) {
+  uint16_t quantity = state.range(0);
+  CannedClient client(
+      RegistersResponse(FunctionCode::kReadHoldingRegisters, quantity));
+  PreparedRequest request =
+      PrepareRead(0x11, FunctionCode::kReadHoldingRegisters, 0x006B, quantity)
+          .value();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ReadRegisters(&client, request));
+  }
+}
+BENCHMARK(BM_ReadPreparedRegisters)->Arg(1)->Arg(10)->Arg(125);
+
+// Converts 1000 registers; the argument selects AVX2 (1) or scalar (0)
+// code.
+void BM_ConvertRegisters(benchmark::State &state) {
+  std::vector<uint16_t> registers(1000);
+  ConversionTable table;
+  for (uint32_t i = 0; i < registers.size(); ++i) {
+    registers[i] = i * 37;
+    Conversion conversion;
+    conversion.source = i;
+    conversion.is_signed = i % 2;
+    conversion.scale = 0.1f;
+    conversion.offset = -40;
+    conversion.min = -1000;
+    conversion.max = 1000;
+    table.Add(conversion).IgnoreError();
+  }
+  table.set_vectorized(state.range(0));
+  std::vector<float> values(table.size());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(table.Convert(registers, absl::MakeSpan(values)));
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * table.size());
+}
+BENCHMARK(BM_ConvertRegisters)->Arg(0)->Arg(1);
+
+// --- Device Maps ---
+
+struct Inverter {
+  float voltage_l1;
+  float voltage_l2;
+  float voltage_l3;
+  float current_l1;
+  float current_l2;
+  float current_l3;
+  double energy;
+  int32_t power;
+  float frequency;
+  uint16_t status;
+};
+
+using InverterMap = DeviceMap<
+    Inverter, FunctionCode::kReadHoldingRegisters, 8,
+    Tag<&Inverter::status, 0>,
+    Tag<&Inverter::frequency, 2, uint16_t, WordOrder::kHighWordFirst,
+        std::ratio<1, 100>>,
+    Tag<&Inverter::power, 4, int32_t, WordOrder::kLowWordFirst>,
+    Tag<&Inverter::energy, 8, uint32_t, WordOrder::kLowWordFirst,
+        std::ratio<1, 1000>>,
+    Tag<&Inverter::voltage_l1, 16>, Tag<&Inverter::voltage_l2, 18>,
+    Tag<&Inverter::voltage_l3, 20>, Tag<&Inverter::current_l1, 22>,
+    Tag<&Inverter::current_l2, 24>, Tag<&Inverter::current_l3, 26>>;
+
+void BM_DeviceMapDecode(benchmark::State &state) {
+  InverterMap::Responses responses;
+  for (size_t i = 0; i < InverterMap::kReadCount; ++i) {
+    responses[i] = RegistersResponse(FunctionCode::kReadHoldingRegisters,
+                                     InverterMap::kReads[i].quantity);
+  }
+  Inverter inverter;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(InverterMap::Decode(responses, &inverter));
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_DeviceMapDecode);
+
+// --- Tag Database ---
+
+void BM_TagDatabaseFind(benchmark::State &state) {
+  constexpr size_t kTags = 500000;
+  static const std::vector<std::string> *names = [] {
+    auto *names = new std::vector<std::string>();
+    for (size_t i = 0; i < kTags; ++i) {
+      names->push_back("plant/area" + std::to_string(i % 50) + "/device" +
+                       std::to_string(i % 997) + "/tag" + std::to_string(i));
+    }
+    return names;
+  }();
+  static const std::string *image = [] {
+    std::vector<TagDefinition> tags;
+    for (size_t i = 0; i < kTags; ++i) {
+      tags.push_back({(*names)[i], static_cast<uint8_t>(1 + i % 247),
+                      FunctionCode::kReadHoldingRegisters,
+                      static_cast<uint16_t>(i % 65000), TagType::kFloat32});
+    }
+    return new std::string(BuildTagImage(tags).value());
+  }();
+  auto database = TagDatabase::FromImage(*image);
+  if (!database.ok()) {
+    state.SkipWithError("Failed to load tag database.");
+    return;
+  }
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize((*database)->Find((*names)[i]));
+    i = (i + 7919) % kTags;
+  }
+}
+BENCHMARK(BM_TagDatabaseFind);
+
+// Polls 62 float tags, one read of 124 registers, into a reused batch.
+void BM_PollTagBatch(benchmark::State &state) {
+  std::vector<TagDefinition> definitions;
+  for (uint16_t i = 0; i < 62; ++i) {
+    definitions.push_back({"tag" + std::to_string(i), 0x11,
+                           FunctionCode::kReadHoldingRegisters,
+                           static_cast<uint16_t>(2 * i), TagType::kFloat32});
+  }
+  std::string image = BuildTagImage(definitions).value();
+  auto database = TagDatabase::FromImage(image).value();
+  std::vector<uint32_t> tags(database->size());
+  for (uint32_t i = 0; i < tags.size(); ++i) {
+    tags[i] = i;
+  }
+  std::vector<TagRead> plan = PlanTagReads(*database, tags, 0).value();
+  CannedClient client(
+      RegistersResponse(FunctionCode::kReadHoldingRegisters, 124));
+  TagBatch batch;
+  for (auto _ : state) {
+    batch.Clear();
+    benchmark::DoNotOptimize(PollTags(&client, *database, plan, &batch));
+  }
+  state.SetItemsProcessed(state.iterations() * tags.size());
+}
+BENCHMARK(BM_PollTagBatch);
+
+void BM_ReadInputRegisters(benchmark::State &state) {
+  uint16_t quantity = state.range(0);
+  CannedClient client(
+      RegistersResponse(FunctionCode::kReadInputRegisters, quantity));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        ReadInputRegisters(&client, 0x11, 0x0008, quantity));
+  }
+}
+BENCHMARK(BM_ReadInputRegisters)->Arg(1)->Arg(10)->Arg(125);
+
+void BM_WriteSingleCoil(benchmark::State &state) {
+  CannedClient client({0x05, 0x00, 0xAC, 0xFF, 0x00});
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(WriteSingleCoil(&client, 0x11, 0x00AC, true));
+  }
+}
+BENCHMARK(BM_WriteSingleCoil);
+
+void BM_WriteSingleRegister(benchmark::State &state) {
+  CannedClient client({0x06, 0x00, 0x01, 0x00, 0x03});
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        WriteSingleRegister(&client, 0x11, 0x0001, 0x0003));
+  }
+}
+BENCHMARK(BM_WriteSingleRegister);
+
+void BM_WriteMultipleCoils(benchmark::State &state) {
+  std::vector<bool> values(state.range(0), true);
+  CannedClient client({0x0F, 0x00, 0x13,
+                       static_cast<uint8_t>(values.size() >> 8),
+                       static_cast<uint8_t>(values.size() & 0xFF)});
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        WriteMultipleCoils(&client, 0x11, 0x0013, values));
+  }
+}
+BENCHMARK(BM_WriteMultipleCoils)->Arg(1)->Arg(64)->Arg(1968);
+
+void BM_WriteMultipleRegisters(benchmark::State &state) {
+  std::vector<uint16_t> values(state.range(0), 0x1234);
+  CannedClient client({0x10, 0x00, 0x01,
+                       static_cast<uint8_t>(values.size() >> 8),
+                       static_cast<uint8_t>(values.size() & 0xFF)});
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        WriteMultipleRegisters(&client, 0x11, 0x0001, values));
+  }
+}
+BENCHMARK(BM_WriteMultipleRegisters)->Arg(1)->Arg(10)->Arg(123);
+
+} // namespace
+} // namespace modbus
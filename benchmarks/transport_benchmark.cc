@@ -0,0 +1,510 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "benchmark/benchmark.h"
+#include "src/loopback_client.h"
+#include "src/modbus_client.h"
+#include "src/modbus_slave.h"
+#include "src/modbus_tcp_client.h"
+#include "src/modbus_tcp_server.h"
+#include "src/modbus_udp_client.h"
+#include "src/modbus_udp_server.h"
+#include "src/multiplexed_tcp_client.h"
+#include "src/rtu_over_tcp_client.h"
+#include "src/serial_client_posix.h"
+#include "src/serial_event_loop.h"
+#include "src/serial_posix.h"
+#include "src/tcp_batch_transport.h"
+#include "src/tcp_socket.h"
+
+namespace modbus {
+namespace {
+
+constexpr uint8_t kSlaveId = 0x11;
+
+// Reads exactly 'length' bytes, returning false on EOF or error.
+bool ReadFully(int fd, uint8_t *buffer, size_t length) {
+  size_t total = 0;
+  while (total < length) {
+    ssize_t received = read(fd, buffer + total, length - total);
+    if (received <= 0) {
+      return false;
+    }
+    total += received;
+  }
+  return true;
+}
+
+// Builds a Read Holding Registers response PDU (function code, byte count,
+// registers) for the quantity encoded in 'request_data'.
+std::vector<uint8_t> HoldingRegistersPdu(const uint8_t *request_data) {
+  uint16_t quantity = (request_data[2] << 8) | request_data[3];
+  std::vector<uint8_t> pdu = {
+      static_cast<uint8_t>(FunctionCode::kReadHoldingRegisters),
+      static_cast<uint8_t>(quantity * 2)};
+  pdu.resize(pdu.size() + quantity * 2, 0x42);
+  return pdu;
+}
+
+// Single-connection Modbus TCP server on the loopback interface that answers
+// every request as Read Holding Registers.
+class LoopbackTcpServer {
+public:
+  LoopbackTcpServer() {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    bind(listen_fd_, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+    listen(listen_fd_, 1);
+    socklen_t addr_len = sizeof(addr);
+    getsockname(listen_fd_, reinterpret_cast<struct sockaddr *>(&addr),
+                &addr_len);
+    port_ = ntohs(addr.sin_port);
+    thread_ = std::thread([this] { Serve(); });
+  }
+
+  ~LoopbackTcpServer() {
+    shutdown(listen_fd_, SHUT_RDWR);
+    close(listen_fd_);
+    thread_.join();
+  }
+
+  int port() const { return port_; }
+
+private:
+  void Serve() {
+    int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0) {
+      return;
+    }
+    uint8_t header[7];
+    uint8_t pdu[260];
+    while (ReadFully(fd, header, sizeof(header))) {
+      uint16_t length = (header[4] << 8) | header[5];
+      if (length < 2 || length - 1u > sizeof(pdu) ||
+          !ReadFully(fd, pdu, length - 1)) {
+        break;
+      }
+      std::vector<uint8_t> response_pdu = HoldingRegistersPdu(pdu + 1);
+      uint16_t response_length = response_pdu.size() + 1;
+      std::vector<uint8_t> response = {
+          header[0],
+          header[1],
+          0x00,
+          0x00,
+          static_cast<uint8_t>(response_length >> 8),
+          static_cast<uint8_t>(response_length & 0xFF),
+          header[6]};
+      response.insert(response.end(), response_pdu.begin(),
+                      response_pdu.end());
+      if (write(fd, response.data(), response.size()) !=
+          static_cast<ssize_t>(response.size())) {
+        break;
+      }
+    }
+    close(fd);
+  }
+
+  int listen_fd_ = -1;
+  int port_ = 0;
+  std::thread thread_;
+};
+
+// Modbus RTU slave attached to the master side of a pseudo terminal pair.
+class PtySlave {
+public:
+  PtySlave() {
+    master_fd_ = posix_openpt(O_RDWR | O_NOCTTY);
+    grantpt(master_fd_);
+    unlockpt(master_fd_);
+    port_ = ptsname(master_fd_);
+    thread_ = std::thread([this] { Serve(); });
+  }
+
+  ~PtySlave() {
+    stop_ = true;
+    thread_.join();
+    close(master_fd_);
+  }
+
+  const std::string &port() const { return port_; }
+
+private:
+  void Serve() {
+    // Read Holding Registers requests are always 8 bytes long.
+    uint8_t request[8];
+    size_t received = 0;
+    while (!stop_) {
+      struct pollfd pfd = {master_fd_, POLLIN, 0};
+      if (poll(&pfd, 1, 10) <= 0 || !(pfd.revents & POLLIN)) {
+        continue;
+      }
+      ssize_t n =
+          read(master_fd_, request + received, sizeof(request) - received);
+      if (n <= 0) {
+        continue;
+      }
+      received += n;
+      if (received < sizeof(request)) {
+        continue;
+      }
+      received = 0;
+      std::vector<uint8_t> response_pdu = HoldingRegistersPdu(request + 2);
+      std::vector<uint8_t> adu =
+          BuildAdu(request[0], FunctionCode::kReadHoldingRegisters,
+                   std::vector<uint8_t>(response_pdu.begin() + 1,
+                                        response_pdu.end()));
+      write(master_fd_, adu.data(), adu.size());
+    }
+  }
+
+  int master_fd_ = -1;
+  std::string port_;
+  std::atomic<bool> stop_ = false;
+  std::thread thread_;
+};
+
+std::vector<uint8_t> ReadRequest(uint16_t quantity) {
+  return {0x00, 0x00, static_cast<uint8_t>(quantity >> 8),
+          static_cast<uint8_t>(quantity & 0xFF)};
+}
+
+void BM_TcpClientRoundTrip(benchmark::State &state) {
+  LoopbackTcpServer server;
+  TcpClient client("127.0.0.1", server.port(), 1000);
+  if (!client.Connect().ok()) {
+    state.SkipWithError("Failed to connect to loopback server.");
+    return;
+  }
+  std::vector<uint8_t> request = ReadRequest(state.range(0));
+  for (auto _ : state) {
+    auto response = client.SendReceive(
+        kSlaveId, FunctionCode::kReadHoldingRegisters, request);
+    if (!response.ok()) {
+      state.SkipWithError(std::string(response.status().message()).c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(response);
+  }
+  state.SetItemsProcessed(state.iterations());
+  client.Disconnect().IgnoreError();
+}
+BENCHMARK(BM_TcpClientRoundTrip)->Arg(1)->Arg(125)->UseRealTime();
+
+void BM_TcpClientPreparedRoundTrip(benchmark::State &state) {
+  LoopbackTcpServer server;
+  TcpClient client("127.0.0.1", server.port(), 1000);
+  if (!client.Connect().ok()) {
+    state.SkipWithError("Failed to connect to loopback server.");
+    return;
+  }
+  PreparedRequest request(kSlaveId, FunctionCode::kReadHoldingRegisters,
+                          ReadRequest(state.range(0)));
+  for (auto _ : state) {
+    auto response = client.SendPrepared(request);
+    if (!response.ok()) {
+      state.SkipWithError(std::string(response.status().message()).c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(response);
+  }
+  state.SetItemsProcessed(state.iterations());
+  client.Disconnect().IgnoreError();
+}
+BENCHMARK(BM_TcpClientPreparedRoundTrip)->Arg(1)->Arg(125)->UseRealTime();
+
+void BM_RtuOverTcpClientRoundTrip(benchmark::State &state) {
+  SlaveDevice device({0, 0, 125, 0});
+  LoopbackServer slaves;
+  slaves.AddSlave(kSlaveId, &device);
+  TcpServer server(&slaves, TcpFraming::kRtu);
+  RtuOverTcpClient client("127.0.0.1", server.Start().value_or(0), 1000);
+  if (!client.Connect().ok()) {
+    state.SkipWithError("Failed to connect to loopback server.");
+    return;
+  }
+  std::vector<uint8_t> request = ReadRequest(state.range(0));
+  for (auto _ : state) {
+    auto response = client.SendReceive(
+        kSlaveId, FunctionCode::kReadHoldingRegisters, request);
+    if (!response.ok()) {
+      state.SkipWithError(std::string(response.status().message()).c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(response);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RtuOverTcpClientRoundTrip)->Arg(1)->Arg(125)->UseRealTime();
+
+void BM_UdpClientRoundTrip(benchmark::State &state) {
+  SlaveDevice device({0, 0, 125, 0});
+  LoopbackServer slaves;
+  slaves.AddSlave(kSlaveId, &device);
+  UdpServer server(&slaves);
+  UdpClient client("127.0.0.1", server.Start().value_or(0), 1000);
+  if (!client.Connect().ok()) {
+    state.SkipWithError("Failed to open socket.");
+    return;
+  }
+  std::vector<uint8_t> request = ReadRequest(state.range(0));
+  for (auto _ : state) {
+    auto response = client.SendReceive(
+        kSlaveId, FunctionCode::kReadHoldingRegisters, request);
+    if (!response.ok()) {
+      state.SkipWithError(std::string(response.status().message()).c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(response);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_UdpClientRoundTrip)->Arg(1)->Arg(125)->UseRealTime();
+
+// Many caller threads sharing one connection. Compare items per second
+// across thread counts.
+void BM_MultiplexedTcpClientRoundTrip(benchmark::State &state) {
+  static SlaveDevice *device;
+  static LoopbackServer *slaves;
+  static TcpServer *server;
+  static MultiplexedTcpClient *client;
+  if (state.thread_index() == 0) {
+    device = new SlaveDevice({0, 0, 125, 0});
+    slaves = new LoopbackServer;
+    slaves->AddSlave(kSlaveId, device);
+    server = new TcpServer(slaves);
+    client = new MultiplexedTcpClient("127.0.0.1", server->Start().value(),
+                                      1000, 64);
+    client->Connect().IgnoreError();
+  }
+  std::vector<uint8_t> request = ReadRequest(1);
+  for (auto _ : state) {
+    auto response = client->SendReceive(
+        kSlaveId, FunctionCode::kReadHoldingRegisters, request);
+    if (!response.ok()) {
+      state.SkipWithError(std::string(response.status().message()).c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(response);
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    delete client;
+    delete server;
+    delete slaves;
+    delete device;
+  }
+}
+BENCHMARK(BM_MultiplexedTcpClientRoundTrip)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+constexpr int kFleetSize = 32;
+
+// Servers for a fleet of devices on the loopback interface.
+class Fleet {
+public:
+  Fleet() : device_({0, 0, 125, 0}) {
+    slaves_.AddSlave(kSlaveId, &device_);
+    for (int i = 0; i < kFleetSize; ++i) {
+      servers_.push_back(std::make_unique<TcpServer>(&slaves_));
+      ports_.push_back(servers_.back()->Start().value_or(0));
+    }
+  }
+
+  const std::vector<int> &ports() const { return ports_; }
+
+private:
+  SlaveDevice device_;
+  LoopbackServer slaves_;
+  std::vector<std::unique_ptr<TcpServer>> servers_;
+  std::vector<int> ports_;
+};
+
+// Polls every device of the fleet once per iteration, one blocking
+// TcpClient per device.
+void BM_FleetBlockingPoll(benchmark::State &state) {
+  Fleet fleet;
+  std::vector<std::unique_ptr<TcpClient>> clients;
+  for (int port : fleet.ports()) {
+    clients.push_back(std::make_unique<TcpClient>("127.0.0.1", port, 1000));
+    if (!clients.back()->Connect().ok()) {
+      state.SkipWithError("Failed to connect to loopback server.");
+      return;
+    }
+  }
+  std::vector<uint8_t> request = ReadRequest(state.range(0));
+  for (auto _ : state) {
+    for (auto &client : clients) {
+      auto response = client->SendReceive(
+          kSlaveId, FunctionCode::kReadHoldingRegisters, request);
+      if (!response.ok()) {
+        state.SkipWithError(
+            std::string(response.status().message()).c_str());
+        return;
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kFleetSize);
+}
+BENCHMARK(BM_FleetBlockingPoll)->Arg(1)->Arg(125)->UseRealTime();
+
+// Polls every device of the fleet once per iteration as a single batch.
+// The second argument selects the backend.
+void BM_FleetBatchPoll(benchmark::State &state) {
+  auto backend = static_cast<TcpBackend>(state.range(1));
+  auto transport = CreateTcpBatchTransport(backend);
+  if (!transport.ok()) {
+    state.SkipWithError(std::string(transport.status().message()).c_str());
+    return;
+  }
+  state.SetLabel(transport.value()->name());
+  Fleet fleet;
+  std::vector<TcpBatchRequest> requests;
+  for (int port : fleet.ports()) {
+    auto sockfd = ConnectTcpSocket("127.0.0.1", port);
+    if (!sockfd.ok() || !transport.value()->AddConnection(*sockfd).ok()) {
+      state.SkipWithError("Failed to connect to loopback server.");
+      return;
+    }
+    requests.push_back({requests.size(), kSlaveId,
+                        FunctionCode::kReadHoldingRegisters,
+                        ReadRequest(state.range(0))});
+  }
+  for (auto _ : state) {
+    for (const auto &response : transport.value()->Transact(requests, 1000)) {
+      if (!response.ok()) {
+        state.SkipWithError(
+            std::string(response.status().message()).c_str());
+        return;
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kFleetSize);
+}
+BENCHMARK(BM_FleetBatchPoll)
+    ->ArgsProduct({{1, 125},
+                   {static_cast<int>(TcpBackend::kEpoll),
+                    static_cast<int>(TcpBackend::kIoUring)}})
+    ->UseRealTime();
+
+// Polls every device of a fleet speaking Modbus UDP once per iteration as a
+// single batch from one socket. Compare with BM_FleetBatchPoll.
+void BM_FleetUdpBatchPoll(benchmark::State &state) {
+  SlaveDevice device({0, 0, 125, 0});
+  LoopbackServer slaves;
+  slaves.AddSlave(kSlaveId, &device);
+  std::vector<std::unique_ptr<UdpServer>> servers;
+  UdpBatchTransport transport;
+  std::vector<UdpBatchRequest> requests;
+  for (int i = 0; i < kFleetSize; ++i) {
+    servers.push_back(std::make_unique<UdpServer>(&slaves));
+    auto port = servers.back()->Start();
+    if (!port.ok() || !transport.AddDevice("127.0.0.1", *port).ok()) {
+      state.SkipWithError("Failed to start loopback server.");
+      return;
+    }
+    requests.push_back({requests.size(), kSlaveId,
+                        FunctionCode::kReadHoldingRegisters,
+                        ReadRequest(state.range(0))});
+  }
+  for (auto _ : state) {
+    for (const auto &response : transport.Transact(requests, 1000)) {
+      if (!response.ok()) {
+        state.SkipWithError(
+            std::string(response.status().message()).c_str());
+        return;
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kFleetSize);
+}
+BENCHMARK(BM_FleetUdpBatchPoll)->Arg(1)->Arg(125)->UseRealTime();
+
+void BM_SerialClientRoundTrip(benchmark::State &state) {
+  PtySlave slave;
+  auto serial = std::make_unique<SerialPosix>();
+  if (!serial->Open({slave.port(), 9600, Parity::kNone, 8, 1}).ok()) {
+    state.SkipWithError("Failed to open pseudo terminal.");
+    return;
+  }
+  SerialClient client(std::move(serial), 1000);
+  std::vector<uint8_t> request = ReadRequest(state.range(0));
+  for (auto _ : state) {
+    auto response = client.SendReceive(
+        kSlaveId, FunctionCode::kReadHoldingRegisters, request);
+    if (!response.ok()) {
+      state.SkipWithError(std::string(response.status().message()).c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(response);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SerialClientRoundTrip)->Arg(1)->Arg(125)->UseRealTime();
+
+// Polls a fleet of serial ports once per iteration from one thread, a
+// transaction per port. Compare with BM_SerialClientRoundTrip, which blocks
+// a thread per port.
+void BM_FleetSerialEventLoopPoll(benchmark::State &state) {
+  std::vector<std::unique_ptr<PtySlave>> slaves;
+  SerialEventLoop loop;
+  std::vector<SerialBatchRequest> requests;
+  for (int i = 0; i < state.range(1); ++i) {
+    slaves.push_back(std::make_unique<PtySlave>());
+    auto fd = OpenSerialPort({slaves.back()->port(), 115200, Parity::kNone,
+                              8, 1});
+    // A pseudo terminal has no line to keep silent between frames.
+    if (!fd.ok() || !loop.AddPort(*fd, absl::ZeroDuration()).ok()) {
+      state.SkipWithError("Failed to open pseudo terminal.");
+      return;
+    }
+    requests.push_back({requests.size(), kSlaveId,
+                        FunctionCode::kReadHoldingRegisters,
+                        ReadRequest(state.range(0))});
+  }
+  for (auto _ : state) {
+    for (const auto &response : loop.Transact(requests, 1000)) {
+      if (!response.ok()) {
+        state.SkipWithError(
+            std::string(response.status().message()).c_str());
+        return;
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * requests.size());
+}
+BENCHMARK(BM_FleetSerialEventLoopPoll)
+    ->ArgsProduct({{1, 125}, {1, 16}})
+    ->UseRealTime();
+
+void BM_LoopbackClientRoundTrip(benchmark::State &state) {
+  SlaveDevice device({0, 0, 125, 0});
+  LoopbackServer server;
+  server.AddSlave(kSlaveId, &device);
+  LoopbackClient client(&server, 1000);
+  std::vector<uint8_t> request = ReadRequest(state.range(0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(client.SendReceive(
+        kSlaveId, FunctionCode::kReadHoldingRegisters, request));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LoopbackClientRoundTrip)->Arg(1)->Arg(125);
+
+} // namespace
+} // namespace modbus
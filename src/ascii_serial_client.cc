@@ -0,0 +1,66 @@
+#include "ascii_serial_client.h"
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+
+namespace modbus {
+
+AsciiSerialClient::AsciiSerialClient(std::unique_ptr<Serial> serial,
+                                     int timeout_ms)
+    : Client(timeout_ms), serial_(std::move(serial)) {}
+
+absl::StatusOr<std::vector<uint8_t>>
+AsciiSerialClient::SendReceive(uint8_t slave_id, FunctionCode function_code,
+                               const std::vector<uint8_t> &request_data) {
+  if (request_data.size() + 1 > kMaxAsciiFrameSize - 2) {
+    return absl::InvalidArgumentError("Request too long.");
+  }
+  std::vector<uint8_t> frame =
+      BuildAsciiFrame(slave_id, function_code, request_data);
+  absl::Time start = clock_->Now();
+  auto status = serial_->Write(frame.data(), frame.size());
+  if (!status.ok()) {
+    return status;
+  }
+
+  // Read whatever has arrived and feed it to the parser until a response
+  // frame is complete or the timeout expires.
+  absl::Time deadline = absl::Now() + absl::Milliseconds(TimeoutFor(slave_id));
+  parser_.Reset();
+  uint8_t buffer[2 * kMaxAsciiFrameSize + 3];
+  while (true) {
+    int timeout_ms = static_cast<int>(absl::ToInt64Milliseconds(
+        absl::Ceil(deadline - absl::Now(), absl::Milliseconds(1))));
+    absl::StatusOr<size_t> bytes_read =
+        timeout_ms > 0 ? serial_->Read(buffer, sizeof(buffer), timeout_ms)
+                       : absl::StatusOr<size_t>(0);
+    if (!bytes_read.ok()) {
+      return bytes_read.status();
+    }
+    if (bytes_read.value() == 0) {
+      RecordTimeout(slave_id);
+      return absl::DeadlineExceededError("Timed out waiting for response.");
+    }
+
+    size_t offset = 0;
+    while (offset < bytes_read.value()) {
+      offset += parser_.Feed(buffer + offset, bytes_read.value() - offset);
+      if (!parser_.done()) {
+        break;
+      }
+      auto response = parser_.frame();
+      if (!response.ok()) {
+        return response.status();
+      }
+      if (response->size() >= 2 && (*response)[0] == slave_id &&
+          ((*response)[1] & 0x7F) == static_cast<uint8_t>(function_code)) {
+        RecordRoundTrip(slave_id, clock_->Now() - start);
+        return std::vector<uint8_t>(response->begin() + 1, response->end());
+      }
+      parser_.Reset();
+    }
+  }
+}
+
+} // namespace modbus
@@ -0,0 +1,36 @@
+#ifndef ASCII_SERIAL_CLIENT_H_
+#define ASCII_SERIAL_CLIENT_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "modbus_ascii.h"
+#include "modbus_client.h"
+#include "serial.h"
+
+namespace modbus {
+
+// Modbus client speaking Modbus ASCII over a serial line. Responses are
+// decoded as the bytes arrive and returned as soon as their CR LF is
+// received, without waiting for the line to go quiet.
+class AsciiSerialClient : public Client {
+public:
+  // Constructor taking ownership of an open Serial object.
+  AsciiSerialClient(std::unique_ptr<Serial> serial, int timeout_ms);
+
+  // Sends a Modbus request and receives the response. Frames answering
+  // another slave or function, e.g. late responses, are skipped.
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t slave_id, FunctionCode function_code,
+              const std::vector<uint8_t> &request_data) override;
+
+private:
+  std::unique_ptr<Serial> serial_;
+  AsciiFrameParser parser_;
+};
+
+} // namespace modbus
+
+#endif // ASCII_SERIAL_CLIENT_H_
@@ -0,0 +1,132 @@
+#include "circuit_breaker_client.h"
+
+#include <algorithm>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace modbus {
+
+namespace {
+
+// Returns true if 'status' is an error of the transport or the slave, as
+// opposed to one of the caller.
+bool IsTransportError(const absl::Status &status) {
+  switch (status.code()) {
+  case absl::StatusCode::kUnavailable:
+  case absl::StatusCode::kDeadlineExceeded:
+  case absl::StatusCode::kDataLoss:
+  case absl::StatusCode::kInternal:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Returns the error of a request refused by an open circuit.
+absl::Status CircuitOpenError(uint8_t slave_id) {
+  return absl::UnavailableError("Circuit open for slave " +
+                                std::to_string(slave_id) + ".");
+}
+
+} // namespace
+
+CircuitBreakerClient::CircuitBreakerClient(Client *client,
+                                           const CircuitBreakerParams &params)
+    : ClientDecorator(client), params_(params) {}
+
+absl::StatusOr<std::vector<uint8_t>>
+CircuitBreakerClient::SendReceive(uint8_t slave_id, FunctionCode function_code,
+                                  const std::vector<uint8_t> &request_data) {
+  if (!Admit(slave_id)) {
+    return CircuitOpenError(slave_id);
+  }
+  auto response = client_->SendReceive(slave_id, function_code, request_data);
+  Record(slave_id, Classify(response));
+  return response;
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+CircuitBreakerClient::SendPrepared(const PreparedRequest &request) {
+  if (!Admit(request.slave_id())) {
+    return CircuitOpenError(request.slave_id());
+  }
+  auto response = client_->SendPrepared(request);
+  Record(request.slave_id(), Classify(response));
+  return response;
+}
+
+CircuitBreakerClient::Outcome CircuitBreakerClient::Classify(
+    const absl::StatusOr<std::vector<uint8_t>> &response) {
+  if (!response.ok()) {
+    return IsTransportError(response.status()) ? Outcome::kFailure
+                                               : Outcome::kNone;
+  }
+  const std::vector<uint8_t> &pdu = response.value();
+  if (pdu.size() >= 2 && (pdu[0] & 0x80)) {
+    auto exception_code = static_cast<ExceptionCode>(pdu[1]);
+    if (exception_code == ExceptionCode::kGatewayPathUnavailable ||
+        exception_code == ExceptionCode::kGatewayTargetDeviceFailedToRespond) {
+      return Outcome::kFailure;
+    }
+  }
+  return Outcome::kSuccess;
+}
+
+CircuitBreakerClient::State CircuitBreakerClient::GetState(uint8_t slave_id) {
+  absl::MutexLock lock(&mu_);
+  return breakers_[slave_id].state;
+}
+
+bool CircuitBreakerClient::Admit(uint8_t slave_id) {
+  absl::MutexLock lock(&mu_);
+  Breaker &breaker = breakers_[slave_id];
+  switch (breaker.state) {
+  case State::kClosed:
+    return true;
+  case State::kOpen:
+    if (clock_->Now() < breaker.next_probe) {
+      return false;
+    }
+    // Let this request through as the probe; others keep failing fast
+    // until it completes.
+    breaker.state = State::kHalfOpen;
+    return true;
+  case State::kHalfOpen:
+  default:
+    return false;
+  }
+}
+
+void CircuitBreakerClient::Record(uint8_t slave_id, Outcome outcome) {
+  absl::MutexLock lock(&mu_);
+  Breaker &breaker = breakers_[slave_id];
+  if (outcome == Outcome::kSuccess) {
+    breaker = Breaker();
+    return;
+  }
+  if (outcome == Outcome::kNone) {
+    // A probe that proved nothing lets the next request probe instead.
+    if (breaker.state == State::kHalfOpen) {
+      breaker.state = State::kOpen;
+    }
+    return;
+  }
+
+  ++breaker.consecutive_failures;
+  if (breaker.state == State::kHalfOpen) {
+    breaker.backoff = std::min(breaker.backoff * 2,
+                               absl::Milliseconds(params_.max_backoff_ms));
+  } else if (breaker.consecutive_failures >= params_.failure_threshold) {
+    breaker.backoff = absl::Milliseconds(params_.initial_backoff_ms);
+  } else {
+    return;
+  }
+  breaker.state = State::kOpen;
+  breaker.next_probe = clock_->Now() + breaker.backoff;
+}
+
+} // namespace modbus
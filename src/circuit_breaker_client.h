@@ -0,0 +1,85 @@
+#ifndef CIRCUIT_BREAKER_CLIENT_H_
+#define CIRCUIT_BREAKER_CLIENT_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "modbus_client.h"
+
+namespace modbus {
+
+// Struct representing when a circuit breaker trips and how it probes.
+struct CircuitBreakerParams {
+  // Consecutive failures after which a slave's circuit opens.
+  int failure_threshold;
+  // Time an open circuit waits before the first probe, in milliseconds.
+  int initial_backoff_ms;
+  // Ceiling of the backoff, which doubles after every failed probe.
+  int max_backoff_ms;
+};
+
+// Client decorator that stops sending requests to slaves that keep failing.
+// Breakers are kept per slave of the wrapped transport. While a slave's
+// circuit is open, requests to it fail immediately with an Unavailable
+// error instead of waiting out a timeout, so healthy slaves sharing the
+// transport keep their throughput. Once the backoff has elapsed a single
+// probe request is let through; its outcome closes the circuit or doubles
+// the backoff.
+//
+// Transport errors (Unavailable, DeadlineExceeded, DataLoss and Internal)
+// and gateway exceptions (0x0A, 0x0B) count as failures. Other exception
+// responses prove the slave is alive and count as successes. Other errors,
+// e.g. for a request too long to send, are the caller's and leave the
+// breaker as it is.
+class CircuitBreakerClient : public ClientDecorator {
+public:
+  enum class State { kClosed, kOpen, kHalfOpen };
+
+  // Constructor taking the wrapped client, which must outlive the decorator
+  // and whose timeout applies.
+  CircuitBreakerClient(Client *client, const CircuitBreakerParams &params);
+
+  // Sends a Modbus request and receives the response, unless the slave's
+  // circuit is open.
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t slave_id, FunctionCode function_code,
+              const std::vector<uint8_t> &request_data) override;
+  absl::StatusOr<std::vector<uint8_t>>
+  SendPrepared(const PreparedRequest &request) override;
+
+  // Returns the circuit state of 'slave_id'.
+  State GetState(uint8_t slave_id);
+
+private:
+  // What the outcome of a request tells about the slave.
+  enum class Outcome { kSuccess, kFailure, kNone };
+
+  struct Breaker {
+    State state = State::kClosed;
+    int consecutive_failures = 0;
+    absl::Duration backoff;
+    absl::Time next_probe;
+  };
+
+  // Returns what the outcome of a request tells about the slave.
+  static Outcome
+  Classify(const absl::StatusOr<std::vector<uint8_t>> &response);
+
+  // Returns true if a request to 'slave_id' may be sent now.
+  bool Admit(uint8_t slave_id);
+
+  // Updates the breaker of 'slave_id' with the outcome of a request.
+  void Record(uint8_t slave_id, Outcome outcome);
+
+  CircuitBreakerParams params_;
+  absl::Mutex mu_;
+  Breaker breakers_[256] ABSL_GUARDED_BY(mu_);
+};
+
+} // namespace modbus
+
+#endif // CIRCUIT_BREAKER_CLIENT_H_
@@ -0,0 +1,46 @@
+#include "clock.h"
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace modbus {
+
+namespace {
+
+class RealTimeClock : public Clock {
+public:
+  absl::Time Now() override { return absl::Now(); }
+  void SleepFor(absl::Duration duration) override {
+    absl::SleepFor(duration);
+  }
+};
+
+} // namespace
+
+Clock *Clock::RealClock() {
+  static Clock *clock = new RealTimeClock();
+  return clock;
+}
+
+// --- SimulatedClock ---
+
+SimulatedClock::SimulatedClock(absl::Time start) : now_(start) {}
+
+absl::Time SimulatedClock::Now() {
+  absl::MutexLock lock(&mu_);
+  return now_;
+}
+
+void SimulatedClock::SleepFor(absl::Duration duration) {
+  AdvanceTime(duration);
+}
+
+void SimulatedClock::AdvanceTime(absl::Duration duration) {
+  absl::MutexLock lock(&mu_);
+  if (duration > absl::ZeroDuration()) {
+    now_ += duration;
+  }
+}
+
+} // namespace modbus
@@ -0,0 +1,46 @@
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace modbus {
+
+// Abstract source of time. Library code that measures or waits out
+// durations goes through a Clock so that tests can substitute simulated time.
+class Clock {
+public:
+  virtual ~Clock() = default;
+
+  // Returns the current time.
+  virtual absl::Time Now() = 0;
+
+  // Blocks the caller for 'duration'.
+  virtual void SleepFor(absl::Duration duration) = 0;
+
+  // Returns the process-wide wall clock. Never deleted.
+  static Clock *RealClock();
+};
+
+// Clock whose time only moves when advanced. SleepFor advances the clock
+// instead of blocking, so a single-threaded simulation runs through virtual
+// time as fast as the CPU allows. Thread-safe.
+class SimulatedClock : public Clock {
+public:
+  explicit SimulatedClock(absl::Time start = absl::UnixEpoch());
+
+  absl::Time Now() override;
+  void SleepFor(absl::Duration duration) override;
+
+  // Moves the clock forward by 'duration'.
+  void AdvanceTime(absl::Duration duration);
+
+private:
+  absl::Mutex mu_;
+  absl::Time now_ ABSL_GUARDED_BY(mu_);
+};
+
+} // namespace modbus
+
+#endif // CLOCK_H_
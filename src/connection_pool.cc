@@ -0,0 +1,153 @@
+#include "connection_pool.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+
+namespace modbus {
+
+namespace {
+
+// Returns true if 'status' shows the connection is broken, as opposed to a
+// timeout or an invalid request, after which it can still be used.
+bool IsTransportError(const absl::Status &status) {
+  return absl::IsInternal(status) || absl::IsUnavailable(status) ||
+         absl::IsDataLoss(status);
+}
+
+} // namespace
+
+PooledTcpClient::PooledTcpClient(ConnectionPool *pool,
+                                 const std::string &hostname, int port,
+                                 int timeout_ms)
+    : Client(timeout_ms), pool_(pool), hostname_(hostname), port_(port),
+      client_(hostname, port, timeout_ms) {}
+
+absl::StatusOr<std::vector<uint8_t>>
+PooledTcpClient::SendReceive(uint8_t slave_id, FunctionCode function_code,
+                             const std::vector<uint8_t> &request_data) {
+  absl::Status status = EnsureConnected();
+  if (!status.ok()) {
+    return status;
+  }
+  auto response = client_.SendReceive(slave_id, function_code, request_data);
+  OnResponse(response.status());
+  return response;
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+PooledTcpClient::SendPrepared(const PreparedRequest &request) {
+  absl::Status status = EnsureConnected();
+  if (!status.ok()) {
+    return status;
+  }
+  auto response = client_.SendPrepared(request);
+  OnResponse(response.status());
+  return response;
+}
+
+absl::Status PooledTcpClient::EnsureConnected() {
+  if (client_.connected()) {
+    return absl::OkStatus();
+  }
+  if (clock_->Now() < next_attempt_) {
+    return absl::UnavailableError("Reconnecting to " + hostname_ + ":" +
+                                  std::to_string(port_) + ".");
+  }
+  pool_->Connect({this});
+  if (!client_.connected()) {
+    return absl::UnavailableError("Failed to connect to " + hostname_ + ":" +
+                                  std::to_string(port_) + ".");
+  }
+  return absl::OkStatus();
+}
+
+void PooledTcpClient::OnResponse(const absl::Status &status) {
+  if (IsTransportError(status)) {
+    // The stream may hold a partial response; start over.
+    client_.Disconnect().IgnoreError();
+  }
+}
+
+void PooledTcpClient::SetTimeout(int timeout_ms) {
+  Client::SetTimeout(timeout_ms);
+  client_.SetTimeout(timeout_ms);
+}
+
+void PooledTcpClient::SetClock(Clock *clock) {
+  Client::SetClock(clock);
+  client_.SetClock(clock);
+}
+
+void PooledTcpClient::EnableAdaptiveTimeouts(
+    const AdaptiveTimeoutParams &params) {
+  client_.EnableAdaptiveTimeouts(params);
+}
+
+int PooledTcpClient::TimeoutFor(uint8_t slave_id) const {
+  return client_.TimeoutFor(slave_id);
+}
+
+void PooledTcpClient::OnConnect(absl::StatusOr<int> sockfd) {
+  if (sockfd.ok()) {
+    client_.Attach(sockfd.value()).IgnoreError();
+    backoff_ = absl::ZeroDuration();
+    next_attempt_ = absl::InfinitePast();
+    return;
+  }
+  const ConnectionPoolParams &params = pool_->params_;
+  backoff_ = std::clamp(backoff_ * 2,
+                        absl::Milliseconds(params.initial_backoff_ms),
+                        absl::Milliseconds(params.max_backoff_ms));
+  next_attempt_ = clock_->Now() + backoff_;
+}
+
+ConnectionPool::ConnectionPool(const ConnectionPoolParams &params,
+                               int timeout_ms)
+    : params_(params), timeout_ms_(timeout_ms),
+      addresses_(absl::Seconds(params.address_ttl_s)) {}
+
+PooledTcpClient *ConnectionPool::AddDevice(const std::string &hostname,
+                                           int port) {
+  clients_.emplace_back(new PooledTcpClient(this, hostname, port, timeout_ms_));
+  return clients_.back().get();
+}
+
+int ConnectionPool::ConnectAll() {
+  std::vector<PooledTcpClient *> clients;
+  for (auto &client : clients_) {
+    if (!client->connected() &&
+        client->clock_->Now() >= client->next_attempt_) {
+      clients.push_back(client.get());
+    }
+  }
+  Connect(clients);
+  return std::count_if(clients_.begin(), clients_.end(),
+                       [](auto &client) { return client->connected(); });
+}
+
+void ConnectionPool::Connect(const std::vector<PooledTcpClient *> &clients) {
+  std::vector<PooledTcpClient *> resolved;
+  std::vector<std::vector<SocketAddress>> targets;
+  for (PooledTcpClient *client : clients) {
+    auto addresses = addresses_.Resolve(client->hostname_, client->port_);
+    if (!addresses.ok()) {
+      client->OnConnect(addresses.status());
+      continue;
+    }
+    resolved.push_back(client);
+    targets.push_back(std::move(addresses).value());
+  }
+
+  std::vector<absl::StatusOr<int>> sockets = ConnectTcpSockets(
+      targets, params_.socket, params_.max_concurrent_connects);
+  for (size_t i = 0; i < resolved.size(); ++i) {
+    resolved[i]->OnConnect(std::move(sockets[i]));
+  }
+}
+
+} // namespace modbus
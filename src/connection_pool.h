@@ -0,0 +1,123 @@
+#ifndef CONNECTION_POOL_H_
+#define CONNECTION_POOL_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "modbus_client.h"
+#include "modbus_tcp_client.h"
+#include "tcp_socket.h"
+
+namespace modbus {
+
+// Struct representing how a ConnectionPool connects and reconnects.
+struct ConnectionPoolParams {
+  TcpSocketParams socket;
+  // Connection attempts in progress at once during ConnectAll.
+  int max_concurrent_connects = 256;
+  // Wait before retrying a device that could not be connected, in
+  // milliseconds. Doubles after every failed attempt up to the maximum.
+  int initial_backoff_ms = 100;
+  int max_backoff_ms = 30000;
+  // How long resolved addresses are reused, in seconds.
+  int address_ttl_s = 300;
+};
+
+class ConnectionPool;
+
+// Modbus TCP client for one device of a ConnectionPool. Reconnects on
+// demand: after a transport error the connection is dropped, and the next
+// request connects again. While a failed device is backing off, requests
+// fail immediately with kUnavailable. Timeouts leave the connection open:
+// TcpClient skips the late response by its transaction ID. The timeout,
+// clock and adaptive timeouts are those of the underlying TcpClient, which
+// keeps them across reconnects. Not thread-safe, like TcpClient.
+class PooledTcpClient : public Client {
+public:
+  // Sends a Modbus request and receives the response, connecting first if
+  // needed.
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t slave_id, FunctionCode function_code,
+              const std::vector<uint8_t> &request_data) override;
+  absl::StatusOr<std::vector<uint8_t>>
+  SendPrepared(const PreparedRequest &request) override;
+
+  void SetTimeout(int timeout_ms) override;
+  void SetClock(Clock *clock) override;
+  void EnableAdaptiveTimeouts(const AdaptiveTimeoutParams &params) override;
+  int TimeoutFor(uint8_t slave_id) const override;
+
+  // Returns true while connected to the device.
+  bool connected() const { return client_.connected(); }
+
+  const std::string &hostname() const { return hostname_; }
+  int port() const { return port_; }
+
+private:
+  friend class ConnectionPool;
+
+  PooledTcpClient(ConnectionPool *pool, const std::string &hostname, int port,
+                  int timeout_ms);
+
+  // Connects unless connected or backing off.
+  absl::Status EnsureConnected();
+
+  // Drops the connection if 'status' shows it is broken.
+  void OnResponse(const absl::Status &status);
+
+  // Records the outcome of a connection attempt.
+  void OnConnect(absl::StatusOr<int> sockfd);
+
+  ConnectionPool *pool_;
+  std::string hostname_;
+  int port_;
+  TcpClient client_;
+  absl::Duration backoff_ = absl::ZeroDuration();
+  absl::Time next_attempt_ = absl::InfinitePast();
+};
+
+// Manages the connections to a fleet of Modbus TCP devices. Host names are
+// resolved once and cached, all devices are connected in parallel with
+// non-blocking sockets and connect timeouts, and every connection gets TCP
+// keepalive and TCP_NODELAY.
+class ConnectionPool {
+public:
+  // Constructor taking the parameters and the response timeout in
+  // milliseconds of every device.
+  ConnectionPool(const ConnectionPoolParams &params, int timeout_ms);
+
+  // Adds the device at 'hostname':'port' and returns its client, which is
+  // owned by the pool. The device is connected by ConnectAll or by its first
+  // request.
+  PooledTcpClient *AddDevice(const std::string &hostname, int port);
+
+  // Connects, in parallel, every device that is not connected and is not
+  // backing off. Returns the number of connected devices.
+  int ConnectAll();
+
+  // Returns the number of devices.
+  size_t size() const { return clients_.size(); }
+
+  // Returns the client of the 'index'th device added.
+  PooledTcpClient *client(size_t index) { return clients_[index].get(); }
+
+private:
+  friend class PooledTcpClient;
+
+  // Connects 'clients' in parallel.
+  void Connect(const std::vector<PooledTcpClient *> &clients);
+
+  ConnectionPoolParams params_;
+  int timeout_ms_;
+  AddressCache addresses_;
+  std::vector<std::unique_ptr<PooledTcpClient>> clients_;
+};
+
+} // namespace modbus
+
+#endif // CONNECTION_POOL_H_
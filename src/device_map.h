@@ -0,0 +1,299 @@
+#ifndef DEVICE_MAP_H_
+#define DEVICE_MAP_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ratio>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/base/casts.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "modbus_client.h"
+
+namespace modbus {
+
+// Enum class representing the order of the registers of a value that spans
+// several. The bytes of each register are big-endian either way.
+enum class WordOrder {
+  kHighWordFirst,
+  kLowWordFirst,
+};
+
+// Struct representing a range of registers read by one request.
+struct RegisterRange {
+  uint16_t address;
+  uint16_t quantity;
+};
+
+namespace device_map_internal {
+
+// Maximum number of registers one read returns.
+constexpr uint32_t kMaxReadRegisters = 125;
+
+template <typename T> struct MemberTraits;
+
+template <typename Struct, typename T> struct MemberTraits<T Struct::*> {
+  using StructType = Struct;
+  using Type = T;
+};
+
+template <auto Member>
+using MemberType = typename MemberTraits<decltype(Member)>::Type;
+
+template <auto Member>
+using MemberStruct = typename MemberTraits<decltype(Member)>::StructType;
+
+template <typename Raw>
+constexpr bool kIsRegisterType =
+    std::is_same_v<Raw, uint16_t> || std::is_same_v<Raw, int16_t> ||
+    std::is_same_v<Raw, uint32_t> || std::is_same_v<Raw, int32_t> ||
+    std::is_same_v<Raw, uint64_t> || std::is_same_v<Raw, int64_t> ||
+    std::is_same_v<Raw, float> || std::is_same_v<Raw, double>;
+
+// Decodes a 'Raw' value from the registers at 'data'.
+template <typename Raw, WordOrder Order> Raw DecodeRaw(const uint8_t *data) {
+  using Bits = std::conditional_t<
+      sizeof(Raw) == 2, uint16_t,
+      std::conditional_t<sizeof(Raw) == 4, uint32_t, uint64_t>>;
+  constexpr size_t kWords = sizeof(Raw) / 2;
+  Bits bits = 0;
+  for (size_t i = 0; i < kWords; ++i) {
+    size_t word = Order == WordOrder::kHighWordFirst ? i : kWords - 1 - i;
+    Bits value = (data[2 * word] << 8) | data[2 * word + 1];
+    bits = static_cast<Bits>(bits << 16 | value);
+  }
+  return absl::bit_cast<Raw>(bits);
+}
+
+// Returns 'ranges' sorted by address.
+template <size_t N>
+constexpr std::array<RegisterRange, N>
+SortRanges(std::array<RegisterRange, N> ranges) {
+  for (size_t i = 1; i < N; ++i) {
+    RegisterRange range = ranges[i];
+    size_t j = i;
+    for (; j > 0 && ranges[j - 1].address > range.address; --j) {
+      ranges[j] = ranges[j - 1];
+    }
+    ranges[j] = range;
+  }
+  return ranges;
+}
+
+// Merges 'sorted' into as few reads as possible, joining ranges at most
+// 'max_gap' registers apart. Returns the number of reads, and stores them
+// in 'reads' unless it is null.
+template <size_t N>
+constexpr size_t CoalesceRanges(const std::array<RegisterRange, N> &sorted,
+                                uint16_t max_gap, RegisterRange *reads) {
+  size_t count = 0;
+  uint32_t start = sorted[0].address;
+  uint32_t end = start + sorted[0].quantity;
+  for (size_t i = 1; i <= N; ++i) {
+    if (i < N) {
+      uint32_t range_end = sorted[i].address + sorted[i].quantity;
+      uint32_t merged_end = range_end > end ? range_end : end;
+      if (sorted[i].address <= end + max_gap &&
+          merged_end - start <= kMaxReadRegisters) {
+        end = merged_end;
+        continue;
+      }
+    }
+    if (reads != nullptr) {
+      reads[count] = {static_cast<uint16_t>(start),
+                      static_cast<uint16_t>(end - start)};
+    }
+    ++count;
+    if (i < N) {
+      start = sorted[i].address;
+      end = start + sorted[i].quantity;
+    }
+  }
+  return count;
+}
+
+template <size_t Count, size_t N>
+constexpr std::array<RegisterRange, Count>
+CoalescedReads(const std::array<RegisterRange, N> &sorted, uint16_t max_gap) {
+  std::array<RegisterRange, Count> reads = {};
+  CoalesceRanges(sorted, max_gap, reads.data());
+  return reads;
+}
+
+// Returns the index of the first read in 'reads' that contains all
+// 'quantity' registers at 'address', or N if none does. Reads may overlap
+// when a tag did not fit into the read before it, so the read that covers
+// a tag's first register does not always cover the whole tag.
+template <size_t N>
+constexpr size_t ReadOf(const std::array<RegisterRange, N> &reads,
+                        uint16_t address, uint16_t quantity) {
+  for (size_t i = 0; i < N; ++i) {
+    if (address >= reads[i].address &&
+        uint32_t{address} + quantity <=
+            uint32_t{reads[i].address} + reads[i].quantity) {
+      return i;
+    }
+  }
+  return N;
+}
+
+} // namespace device_map_internal
+
+// A tag of a device: the value of the registers at 'Address', stored in the
+// struct member 'Member'. 'Raw' is the type the registers hold, by default
+// that of the member; 16-bit, 32-bit and 64-bit integers, float and double
+// take one, two and four registers. The raw value is multiplied by 'Scale',
+// then converted to the type of the member.
+template <auto Member, uint16_t Address,
+          typename Raw = device_map_internal::MemberType<Member>,
+          WordOrder Order = WordOrder::kHighWordFirst,
+          typename Scale = std::ratio<1>>
+struct Tag {
+  using Struct = device_map_internal::MemberStruct<Member>;
+  using Type = device_map_internal::MemberType<Member>;
+
+  static_assert(device_map_internal::kIsRegisterType<Raw>,
+                "Unsupported register type.");
+  static_assert(Address + sizeof(Raw) / 2 <= 0x10000,
+                "Tag extends past the last register.");
+
+  static constexpr uint16_t kAddress = Address;
+  static constexpr uint16_t kQuantity = sizeof(Raw) / 2;
+
+  // Decodes the tag from the registers at 'data' into 'out'.
+  static void Decode(const uint8_t *data, Struct *out) {
+    Raw raw = device_map_internal::DecodeRaw<Raw, Order>(data);
+    if constexpr (std::is_same_v<Scale, std::ratio<1>>) {
+      out->*Member = static_cast<Type>(raw);
+    } else {
+      constexpr double kScale = static_cast<double>(Scale::num) / Scale::den;
+      out->*Member = static_cast<Type>(raw * kScale);
+    }
+  }
+};
+
+// The register map of a device, declared as a type: 'Tags' are read from
+// the holding or input registers, per 'ReadCode', into a 'Struct'. The reads
+// that cover the tags are planned at compile time, merging tags at most
+// 'MaxGap' registers apart into one read of up to 125 registers, and every
+// tag decodes from a fixed offset of its response, so decoding takes no
+// lookups, loops over tags or allocations.
+//
+//   struct Meter {
+//     float voltage;
+//     double energy;
+//     float temperature;
+//   };
+//   using MeterMap = DeviceMap<
+//       Meter, FunctionCode::kReadHoldingRegisters, 8,
+//       Tag<&Meter::voltage, 0>,
+//       Tag<&Meter::energy, 2, uint32_t, WordOrder::kLowWordFirst>,
+//       Tag<&Meter::temperature, 20, int16_t, WordOrder::kHighWordFirst,
+//           std::ratio<1, 10>>>;
+//
+//   auto requests = MeterMap::Prepare(slave_id);
+//   absl::StatusOr<Meter> meter = MeterMap::Read(client, requests);
+template <typename Struct, FunctionCode ReadCode, uint16_t MaxGap,
+          typename... Tags>
+class DeviceMap {
+  static_assert(ReadCode == FunctionCode::kReadHoldingRegisters ||
+                    ReadCode == FunctionCode::kReadInputRegisters,
+                "Device maps read holding or input registers.");
+  static_assert(sizeof...(Tags) > 0, "Device map has no tags.");
+  static_assert((std::is_same_v<typename Tags::Struct, Struct> && ...),
+                "Tag of a member of another struct.");
+
+  static constexpr std::array<RegisterRange, sizeof...(Tags)> kTagRanges =
+      device_map_internal::SortRanges<sizeof...(Tags)>(
+          {{{Tags::kAddress, Tags::kQuantity}...}});
+
+public:
+  // Number of reads that cover the tags.
+  static constexpr size_t kReadCount =
+      device_map_internal::CoalesceRanges(kTagRanges, MaxGap, nullptr);
+
+  // The reads, by address.
+  static constexpr std::array<RegisterRange, kReadCount> kReads =
+      device_map_internal::CoalescedReads<kReadCount>(kTagRanges, MaxGap);
+
+  using Requests = std::array<PreparedRequest, kReadCount>;
+  // Response PDUs to the reads, in the order of kReads.
+  using Responses = std::array<std::vector<uint8_t>, kReadCount>;
+
+  // Prepares the reads for polling 'slave_id'.
+  static Requests Prepare(uint8_t slave_id) {
+    return Prepare(slave_id, std::make_index_sequence<kReadCount>());
+  }
+
+  // Decodes the tags from 'responses' into 'out'. Fails if a response has
+  // the wrong function code or size.
+  static absl::Status Decode(const Responses &responses, Struct *out) {
+    if (!CheckSizes(responses, std::make_index_sequence<kReadCount>())) {
+      return absl::InternalError("Invalid response size.");
+    }
+    (DecodeTag<Tags>(responses, out), ...);
+    return absl::OkStatus();
+  }
+
+  // Sends 'requests', as returned by Prepare, and decodes the responses.
+  static absl::StatusOr<Struct> Read(Client *client,
+                                     const Requests &requests) {
+    Responses responses;
+    for (size_t i = 0; i < kReadCount; ++i) {
+      auto response = client->SendPrepared(requests[i]);
+      if (!response.ok()) {
+        return response.status();
+      }
+      absl::Status status = requests[i].CheckResponse(response.value());
+      if (!status.ok()) {
+        return status;
+      }
+      responses[i] = std::move(response).value();
+    }
+    Struct out = {};
+    absl::Status status = Decode(responses, &out);
+    if (!status.ok()) {
+      return status;
+    }
+    return out;
+  }
+
+private:
+  template <size_t... I>
+  static Requests Prepare(uint8_t slave_id, std::index_sequence<I...>) {
+    return {{PreparedRequest(slave_id, ReadCode, ReadData(kReads[I]))...}};
+  }
+
+  static std::vector<uint8_t> ReadData(const RegisterRange &range) {
+    return {static_cast<uint8_t>(range.address >> 8),
+            static_cast<uint8_t>(range.address),
+            static_cast<uint8_t>(range.quantity >> 8),
+            static_cast<uint8_t>(range.quantity)};
+  }
+
+  template <size_t... I>
+  static bool CheckSizes(const Responses &responses,
+                         std::index_sequence<I...>) {
+    return ((responses[I].size() == 2 + 2 * kReads[I].quantity &&
+             responses[I][0] == static_cast<uint8_t>(ReadCode) &&
+             responses[I][1] == 2 * kReads[I].quantity) &&
+            ...);
+  }
+
+  template <typename T>
+  static void DecodeTag(const Responses &responses, Struct *out) {
+    constexpr size_t kRead =
+        device_map_internal::ReadOf(kReads, T::kAddress, T::kQuantity);
+    static_assert(kRead < kReadCount, "Tag does not lie inside a read.");
+    constexpr size_t kOffset = 2 + 2 * (T::kAddress - kReads[kRead].address);
+    T::Decode(responses[kRead].data() + kOffset, out);
+  }
+};
+
+} // namespace modbus
+
+#endif // DEVICE_MAP_H_
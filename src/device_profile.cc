@@ -0,0 +1,565 @@
+#include "device_profile.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/functional/function_ref.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "modbus_functions.h"
+
+namespace modbus {
+
+namespace {
+
+constexpr FunctionCode kAllFunctions[] = {
+    FunctionCode::kReadCoils,
+    FunctionCode::kReadDiscreteInputs,
+    FunctionCode::kReadHoldingRegisters,
+    FunctionCode::kReadInputRegisters,
+    FunctionCode::kWriteSingleCoil,
+    FunctionCode::kWriteSingleRegister,
+    FunctionCode::kWriteMultipleCoils,
+    FunctionCode::kWriteMultipleRegisters,
+};
+
+bool IsBitFunction(FunctionCode function_code) {
+  return function_code == FunctionCode::kReadCoils ||
+         function_code == FunctionCode::kReadDiscreteInputs ||
+         function_code == FunctionCode::kWriteMultipleCoils;
+}
+
+void AppendUint16(std::vector<uint8_t> &data, uint16_t value) {
+  data.push_back(value >> 8);
+  data.push_back(value & 0xFF);
+}
+
+uint16_t GetUint16(const uint8_t *data) { return data[0] << 8 | data[1]; }
+
+void PackBits(const std::vector<bool> &bits, std::vector<uint8_t> &data) {
+  size_t start = data.size();
+  data.resize(start + (bits.size() + 7) / 8);
+  for (size_t i = 0; i < bits.size(); ++i) {
+    if (bits[i]) {
+      data[start + i / 8] |= 1 << (i % 8);
+    }
+  }
+}
+
+bool GetBit(const uint8_t *data, size_t i) {
+  return (data[i / 8] >> (i % 8)) & 1;
+}
+
+// Returns true if 'response' is a normal response.
+bool IsAccepted(const absl::StatusOr<std::vector<uint8_t>> &response) {
+  return response.ok() && !response->empty() && !((*response)[0] & 0x80);
+}
+
+// Returns true if 'response' is an Illegal Function exception response.
+bool IsIllegalFunction(const absl::StatusOr<std::vector<uint8_t>> &response) {
+  return response.ok() && response->size() >= 2 && ((*response)[0] & 0x80) &&
+         static_cast<ExceptionCode>((*response)[1]) ==
+             ExceptionCode::kIllegalFunction;
+}
+
+// Returns the largest quantity up to 'max' that 'accepted' holds for,
+// which it must for 1, assuming it holds for every smaller quantity too.
+uint16_t LargestAccepted(uint16_t max,
+                         absl::FunctionRef<bool(uint16_t)> accepted) {
+  if (max <= 1 || accepted(max)) {
+    return max;
+  }
+  uint16_t low = 1;
+  uint16_t high = max;
+  while (high - low > 1) {
+    uint16_t middle = low + (high - low) / 2;
+    (accepted(middle) ? low : high) = middle;
+  }
+  return low;
+}
+
+absl::StatusOr<std::vector<uint8_t>> SendRead(Client *client,
+                                              uint8_t slave_id,
+                                              FunctionCode function_code,
+                                              uint16_t address,
+                                              uint16_t quantity) {
+  std::vector<uint8_t> data;
+  AppendUint16(data, address);
+  AppendUint16(data, quantity);
+  return client->SendReceive(slave_id, function_code, data);
+}
+
+// Writes the current values of 'quantity' coils or holding registers from
+// 'address' back to them with 'function_code'. Fails if the values cannot
+// be read.
+absl::StatusOr<std::vector<uint8_t>>
+WriteBack(Client *client, uint8_t slave_id, FunctionCode function_code,
+          uint16_t address, uint16_t quantity) {
+  std::vector<uint8_t> data;
+  AppendUint16(data, address);
+  if (function_code == FunctionCode::kWriteSingleCoil ||
+      function_code == FunctionCode::kWriteMultipleCoils) {
+    auto coils = ReadCoils(client, slave_id, address, quantity);
+    if (!coils.ok()) {
+      return coils.status();
+    }
+    if (function_code == FunctionCode::kWriteSingleCoil) {
+      AppendUint16(data, (*coils)[0] ? 0xFF00 : 0x0000);
+    } else {
+      AppendUint16(data, quantity);
+      data.push_back((quantity + 7) / 8);
+      PackBits(*coils, data);
+    }
+  } else {
+    auto registers = ReadHoldingRegisters(client, slave_id, address, quantity);
+    if (!registers.ok()) {
+      return registers.status();
+    }
+    if (function_code == FunctionCode::kWriteSingleRegister) {
+      AppendUint16(data, (*registers)[0]);
+    } else {
+      AppendUint16(data, quantity);
+      data.push_back(quantity * 2);
+      for (uint16_t value : *registers) {
+        AppendUint16(data, value);
+      }
+    }
+  }
+  return client->SendReceive(slave_id, function_code, data);
+}
+
+// Returns true if 'depth' reads sent at once are all answered.
+bool AcceptsPipelined(Client *client, uint8_t slave_id,
+                      FunctionCode function_code, uint16_t address,
+                      int depth) {
+  std::vector<char> accepted(depth);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < depth; ++i) {
+    threads.emplace_back([&, i] {
+      accepted[i] =
+          IsAccepted(SendRead(client, slave_id, function_code, address, 1));
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  return std::all_of(accepted.begin(), accepted.end(),
+                     [](char ok) { return ok; });
+}
+
+} // namespace
+
+uint16_t DeviceProfile::MaxQuantity(FunctionCode function_code) const {
+  switch (function_code) {
+  case FunctionCode::kReadCoils:
+  case FunctionCode::kReadDiscreteInputs:
+    return max_read_bits;
+  case FunctionCode::kReadHoldingRegisters:
+  case FunctionCode::kReadInputRegisters:
+    return max_read_registers;
+  case FunctionCode::kWriteMultipleCoils:
+    return max_write_coils;
+  case FunctionCode::kWriteMultipleRegisters:
+    return max_write_registers;
+  default:
+    return 0;
+  }
+}
+
+bool DeviceProfile::operator==(const DeviceProfile &other) const {
+  return max_read_bits == other.max_read_bits &&
+         max_read_registers == other.max_read_registers &&
+         max_write_coils == other.max_write_coils &&
+         max_write_registers == other.max_write_registers &&
+         functions == other.functions &&
+         pipeline_depth == other.pipeline_depth;
+}
+
+absl::StatusOr<DeviceProfile> ProbeDevice(Client *client, uint8_t slave_id,
+                                          const ProbeParams &params) {
+  DeviceProfile profile;
+  absl::Status last_error = absl::OkStatus();
+  bool answered = false;
+  // A read the slave answered, for probing the pipeline depth.
+  FunctionCode echo_function = FunctionCode::kReadHoldingRegisters;
+  uint16_t echo_address = 0;
+  bool has_echo = false;
+
+  // Records the outcome of the first request of a function. Returns true if
+  // the function works, so its limit can be searched.
+  auto check_first = [&](FunctionCode function_code,
+                         const absl::StatusOr<std::vector<uint8_t>> &first) {
+    if (!first.ok()) {
+      last_error = first.status();
+      return false;
+    }
+    answered = true;
+    if (IsIllegalFunction(first)) {
+      profile.functions &= ~FunctionBit(function_code);
+    }
+    return IsAccepted(first);
+  };
+
+  struct ReadProbe {
+    FunctionCode function_code;
+    uint16_t address;
+    uint16_t *limit;
+  };
+  const ReadProbe reads[] = {
+      {FunctionCode::kReadCoils, params.coil_address, &profile.max_read_bits},
+      {FunctionCode::kReadDiscreteInputs, params.discrete_input_address,
+       &profile.max_read_bits},
+      {FunctionCode::kReadHoldingRegisters, params.holding_register_address,
+       &profile.max_read_registers},
+      {FunctionCode::kReadInputRegisters, params.input_register_address,
+       &profile.max_read_registers},
+  };
+  // Coils and discrete inputs, and both register tables, share a limit,
+  // which becomes the smaller of the two found.
+  uint16_t spec_read_bits = profile.max_read_bits;
+  uint16_t spec_read_registers = profile.max_read_registers;
+  for (const ReadProbe &read : reads) {
+    auto first = SendRead(client, slave_id, read.function_code, read.address,
+                          1);
+    if (!check_first(read.function_code, first)) {
+      continue;
+    }
+    if (!has_echo) {
+      echo_function = read.function_code;
+      echo_address = read.address;
+      has_echo = true;
+    }
+    bool bits = IsBitFunction(read.function_code);
+    uint16_t max = std::min<uint32_t>(bits ? spec_read_bits
+                                           : spec_read_registers,
+                                      0x10000 - read.address);
+    uint16_t largest = LargestAccepted(max, [&](uint16_t quantity) {
+      return IsAccepted(SendRead(client, slave_id, read.function_code,
+                                 read.address, quantity));
+    });
+    *read.limit = std::min(*read.limit, largest);
+  }
+
+  if (params.probe_writes) {
+    struct WriteProbe {
+      FunctionCode function_code;
+      uint16_t address;
+      // Limit of the writes, and of the reads they need, for multiple
+      // writes.
+      uint16_t *limit;
+      uint16_t read_limit;
+    };
+    const WriteProbe writes[] = {
+        {FunctionCode::kWriteSingleCoil, params.coil_address, nullptr, 1},
+        {FunctionCode::kWriteSingleRegister, params.holding_register_address,
+         nullptr, 1},
+        {FunctionCode::kWriteMultipleCoils, params.coil_address,
+         &profile.max_write_coils, profile.max_read_bits},
+        {FunctionCode::kWriteMultipleRegisters,
+         params.holding_register_address, &profile.max_write_registers,
+         profile.max_read_registers},
+    };
+    for (const WriteProbe &write : writes) {
+      auto first =
+          WriteBack(client, slave_id, write.function_code, write.address, 1);
+      if (!check_first(write.function_code, first) ||
+          write.limit == nullptr) {
+        continue;
+      }
+      uint16_t max = std::min<uint32_t>({*write.limit, write.read_limit,
+                                         0x10000 - uint32_t{write.address}});
+      *write.limit = LargestAccepted(max, [&](uint16_t quantity) {
+        return IsAccepted(WriteBack(client, slave_id, write.function_code,
+                                    write.address, quantity));
+      });
+    }
+  }
+
+  if (!answered) {
+    return last_error;
+  }
+  if (has_echo) {
+    int depth = 1;
+    while (depth < params.max_pipeline_depth) {
+      int next = std::min(depth * 2, params.max_pipeline_depth);
+      if (!AcceptsPipelined(client, slave_id, echo_function, echo_address,
+                            next)) {
+        break;
+      }
+      depth = next;
+    }
+    profile.pipeline_depth = depth;
+  }
+  return profile;
+}
+
+DeviceProfile DeviceProfileCache::Get(absl::string_view endpoint,
+                                      uint8_t slave_id) const {
+  absl::MutexLock lock(&mu_);
+  auto it = profiles_.find(Key(endpoint, slave_id));
+  return it == profiles_.end() ? DeviceProfile() : it->second;
+}
+
+bool DeviceProfileCache::Contains(absl::string_view endpoint,
+                                  uint8_t slave_id) const {
+  absl::MutexLock lock(&mu_);
+  return profiles_.contains(Key(endpoint, slave_id));
+}
+
+void DeviceProfileCache::Put(absl::string_view endpoint, uint8_t slave_id,
+                             const DeviceProfile &profile) {
+  absl::MutexLock lock(&mu_);
+  profiles_[Key(endpoint, slave_id)] = profile;
+}
+
+absl::StatusOr<DeviceProfile>
+DeviceProfileCache::GetOrProbe(absl::string_view endpoint, Client *client,
+                               uint8_t slave_id, const ProbeParams &params) {
+  {
+    absl::MutexLock lock(&mu_);
+    auto it = profiles_.find(Key(endpoint, slave_id));
+    if (it != profiles_.end()) {
+      return it->second;
+    }
+  }
+  // Probes without holding the lock, which would block every other lookup
+  // for many round trips.
+  auto profile = ProbeDevice(client, slave_id, params);
+  if (profile.ok()) {
+    Put(endpoint, slave_id, *profile);
+  }
+  return profile;
+}
+
+std::string DeviceProfileCache::ToCsv() const {
+  absl::MutexLock lock(&mu_);
+  std::vector<std::pair<Key, DeviceProfile>> profiles(profiles_.begin(),
+                                                      profiles_.end());
+  // Sorted, so that saving the same profiles gives the same file.
+  std::sort(profiles.begin(), profiles.end(),
+            [](const auto &a, const auto &b) { return a.first < b.first; });
+  std::string csv;
+  for (const auto &[key, profile] : profiles) {
+    absl::StrAppend(&csv, key.first, ",", key.second, ",",
+                    profile.max_read_bits, ",", profile.max_read_registers,
+                    ",", profile.max_write_coils, ",",
+                    profile.max_write_registers, ",", profile.pipeline_depth,
+                    ",");
+    const char *separator = "";
+    for (FunctionCode function_code : kAllFunctions) {
+      if (profile.Supports(function_code)) {
+        absl::StrAppend(&csv, separator, static_cast<int>(function_code));
+        separator = " ";
+      }
+    }
+    csv += '\n';
+  }
+  return csv;
+}
+
+absl::Status DeviceProfileCache::LoadCsv(absl::string_view csv) {
+  std::vector<std::pair<Key, DeviceProfile>> profiles;
+  int line_number = 0;
+  for (absl::string_view line : absl::StrSplit(csv, '\n')) {
+    ++line_number;
+    line = absl::StripAsciiWhitespace(line);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::vector<absl::string_view> fields = absl::StrSplit(line, ',');
+    auto error = [&](absl::string_view what) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Line ", line_number, ": ", what));
+    };
+    if (fields.size() != 8) {
+      return error("Expected 8 fields.");
+    }
+    for (absl::string_view &field : fields) {
+      field = absl::StripAsciiWhitespace(field);
+    }
+    uint32_t slave_id;
+    if (fields[0].empty()) {
+      return error("Missing endpoint.");
+    }
+    if (!absl::SimpleAtoi(fields[1], &slave_id) || slave_id > 255) {
+      return error("Invalid slave ID.");
+    }
+    DeviceProfile profile;
+    uint16_t *limits[] = {&profile.max_read_bits, &profile.max_read_registers,
+                          &profile.max_write_coils,
+                          &profile.max_write_registers};
+    for (int i = 0; i < 4; ++i) {
+      uint32_t limit;
+      if (!absl::SimpleAtoi(fields[2 + i], &limit) || limit < 1 ||
+          limit > 0xFFFF) {
+        return error("Invalid limit.");
+      }
+      *limits[i] = limit;
+    }
+    if (!absl::SimpleAtoi(fields[6], &profile.pipeline_depth) ||
+        profile.pipeline_depth < 1) {
+      return error("Invalid pipeline depth.");
+    }
+    profile.functions = 0;
+    for (absl::string_view code :
+         absl::StrSplit(fields[7], ' ', absl::SkipEmpty())) {
+      uint32_t function_code;
+      if (!absl::SimpleAtoi(code, &function_code) || function_code > 31) {
+        return error("Invalid function code.");
+      }
+      profile.functions |= uint32_t{1} << function_code;
+    }
+    profiles.emplace_back(Key(fields[0], slave_id), profile);
+  }
+  absl::MutexLock lock(&mu_);
+  for (auto &[key, profile] : profiles) {
+    profiles_[std::move(key)] = profile;
+  }
+  return absl::OkStatus();
+}
+
+ProfiledClient::ProfiledClient(Client *client,
+                               const DeviceProfileCache *profiles,
+                               std::string endpoint)
+    : ClientDecorator(client), profiles_(profiles),
+      endpoint_(std::move(endpoint)) {}
+
+absl::StatusOr<std::vector<uint8_t>>
+ProfiledClient::SendReceive(uint8_t slave_id, FunctionCode function_code,
+                            const std::vector<uint8_t> &request_data) {
+  DeviceProfile profile = profiles_->Get(endpoint_, slave_id);
+  if (!profile.Supports(function_code)) {
+    return std::vector<uint8_t>{
+        static_cast<uint8_t>(static_cast<uint8_t>(function_code) | 0x80),
+        static_cast<uint8_t>(ExceptionCode::kIllegalFunction)};
+  }
+  uint16_t limit = profile.MaxQuantity(function_code);
+  uint16_t quantity =
+      request_data.size() >= 4 ? GetUint16(&request_data[2]) : 0;
+  // Quantities over the limits of the specification are invalid however
+  // they are split, and their combined response would not fit a PDU, so
+  // they are forwarded for the slave to reject.
+  if (limit > 0 && quantity > limit &&
+      quantity <= DeviceProfile().MaxQuantity(function_code)) {
+    return SendSplit(slave_id, function_code, request_data, limit,
+                     profile.pipeline_depth);
+  }
+  return SendWithin(slave_id, profile.pipeline_depth, [&] {
+    return client_->SendReceive(slave_id, function_code, request_data);
+  });
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+ProfiledClient::SendPrepared(const PreparedRequest &request) {
+  DeviceProfile profile = profiles_->Get(endpoint_, request.slave_id());
+  uint16_t limit = profile.MaxQuantity(request.function_code());
+  const std::vector<uint8_t> &data = request.data();
+  if (!profile.Supports(request.function_code()) ||
+      (limit > 0 && data.size() >= 4 && GetUint16(&data[2]) > limit)) {
+    return SendReceive(request.slave_id(), request.function_code(), data);
+  }
+  return SendWithin(request.slave_id(), profile.pipeline_depth,
+                    [&] { return client_->SendPrepared(request); });
+}
+
+template <typename Send>
+absl::StatusOr<std::vector<uint8_t>>
+ProfiledClient::SendWithin(uint8_t slave_id, int pipeline_depth, Send send) {
+  {
+    absl::MutexLock lock(&mu_);
+    while (in_flight_[slave_id] >= std::max(pipeline_depth, 1)) {
+      cv_.Wait(&mu_);
+    }
+    ++in_flight_[slave_id];
+  }
+  absl::StatusOr<std::vector<uint8_t>> response = send();
+  absl::MutexLock lock(&mu_);
+  --in_flight_[slave_id];
+  cv_.SignalAll();
+  return response;
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+ProfiledClient::SendSplit(uint8_t slave_id, FunctionCode function_code,
+                          const std::vector<uint8_t> &request_data,
+                          uint16_t limit, int pipeline_depth) {
+  bool bits = IsBitFunction(function_code);
+  bool write = function_code == FunctionCode::kWriteMultipleCoils ||
+               function_code == FunctionCode::kWriteMultipleRegisters;
+  uint16_t address = GetUint16(&request_data[0]);
+  uint16_t quantity = GetUint16(&request_data[2]);
+  if (write && request_data.size() !=
+                   static_cast<size_t>(
+                       5 + (bits ? (quantity + 7) / 8 : quantity * 2))) {
+    // Malformed; lets the slave reject it.
+    return SendWithin(slave_id, pipeline_depth, [&] {
+      return client_->SendReceive(slave_id, function_code, request_data);
+    });
+  }
+
+  std::vector<bool> read_bits;
+  std::vector<uint8_t> read_bytes;
+  for (uint16_t done = 0; done < quantity;) {
+    uint16_t count = std::min<uint16_t>(limit, quantity - done);
+    std::vector<uint8_t> data;
+    AppendUint16(data, address + done);
+    AppendUint16(data, count);
+    if (write && bits) {
+      std::vector<bool> values(count);
+      for (uint16_t i = 0; i < count; ++i) {
+        values[i] = GetBit(&request_data[5], done + i);
+      }
+      data.push_back((count + 7) / 8);
+      PackBits(values, data);
+    } else if (write) {
+      data.push_back(count * 2);
+      data.insert(data.end(), request_data.begin() + 5 + done * 2,
+                  request_data.begin() + 5 + (done + count) * 2);
+    }
+    auto response = SendWithin(slave_id, pipeline_depth, [&] {
+      return client_->SendReceive(slave_id, function_code, data);
+    });
+    if (!IsAccepted(response)) {
+      return response;
+    }
+    if (!write) {
+      const std::vector<uint8_t> &pdu = *response;
+      size_t size = bits ? (count + 7) / 8 : count * 2;
+      if (pdu.size() != 2 + size || pdu[1] != size) {
+        return absl::InternalError("Invalid response to a split read.");
+      }
+      for (uint16_t i = 0; bits && i < count; ++i) {
+        read_bits.push_back(GetBit(&pdu[2], i));
+      }
+      if (!bits) {
+        read_bytes.insert(read_bytes.end(), pdu.begin() + 2, pdu.end());
+      }
+    }
+    done += count;
+  }
+
+  std::vector<uint8_t> response = {static_cast<uint8_t>(function_code)};
+  if (write) {
+    AppendUint16(response, address);
+    AppendUint16(response, quantity);
+  } else if (bits) {
+    response.push_back((quantity + 7) / 8);
+    PackBits(read_bits, response);
+  } else {
+    response.push_back(static_cast<uint8_t>(read_bytes.size()));
+    response.insert(response.end(), read_bytes.begin(), read_bytes.end());
+  }
+  return response;
+}
+
+} // namespace modbus
@@ -0,0 +1,172 @@
+#ifndef DEVICE_PROFILE_H_
+#define DEVICE_PROFILE_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "modbus_client.h"
+
+namespace modbus {
+
+// Returns the bit of 'function_code' in DeviceProfile::functions.
+constexpr uint32_t FunctionBit(FunctionCode function_code) {
+  return uint32_t{1} << static_cast<uint8_t>(function_code);
+}
+
+// Struct representing what one slave supports. The defaults are the limits
+// of the specification, which every compliant device would accept.
+struct DeviceProfile {
+  // Largest quantities per request.
+  uint16_t max_read_bits = 2000;
+  uint16_t max_read_registers = 125;
+  uint16_t max_write_coils = 1968;
+  uint16_t max_write_registers = 123;
+  // Set of supported function codes, as FunctionBits.
+  uint32_t functions =
+      FunctionBit(FunctionCode::kReadCoils) |
+      FunctionBit(FunctionCode::kReadDiscreteInputs) |
+      FunctionBit(FunctionCode::kReadHoldingRegisters) |
+      FunctionBit(FunctionCode::kReadInputRegisters) |
+      FunctionBit(FunctionCode::kWriteSingleCoil) |
+      FunctionBit(FunctionCode::kWriteSingleRegister) |
+      FunctionBit(FunctionCode::kWriteMultipleCoils) |
+      FunctionBit(FunctionCode::kWriteMultipleRegisters);
+  // Requests the slave answers correctly when sent without waiting for the
+  // previous response.
+  int pipeline_depth = 1;
+
+  bool Supports(FunctionCode function_code) const {
+    return (functions & FunctionBit(function_code)) != 0;
+  }
+
+  // Returns the largest quantity per request with 'function_code', or 0 for
+  // the single-item functions.
+  uint16_t MaxQuantity(FunctionCode function_code) const;
+
+  bool operator==(const DeviceProfile &other) const;
+};
+
+// Struct representing where and how ProbeDevice probes a slave.
+struct ProbeParams {
+  // First address of each table to probe. Read sizes are found by reading
+  // from here, so the addresses after it must exist up to the limit sought.
+  uint16_t coil_address = 0;
+  uint16_t discrete_input_address = 0;
+  uint16_t holding_register_address = 0;
+  uint16_t input_register_address = 0;
+  // Whether to probe the write functions. Writes store the values just
+  // read from the same addresses, which is only harmless on a device that
+  // does not change them concurrently.
+  bool probe_writes = false;
+  // Largest pipeline depth to try. Depths above 1 send requests from
+  // several threads at once, so the client must be thread-safe and should
+  // pipeline requests, like MultiplexedTcpClient.
+  int max_pipeline_depth = 1;
+};
+
+// Discovers the profile of 'slave_id' by sending it requests: functions it
+// answers with an Illegal Function exception are unsupported, the largest
+// request sizes are found by binary search, and the pipeline depth by
+// doubling the requests sent at once until one fails. Fails if the slave
+// does not answer at all. Functions whose first probe fails for another
+// reason, e.g. because the address does not exist, keep the default limits.
+absl::StatusOr<DeviceProfile> ProbeDevice(Client *client, uint8_t slave_id,
+                                          const ProbeParams &params);
+
+// Thread-safe cache of device profiles, keyed by endpoint, e.g.
+// "10.0.0.5:502" or "/dev/ttyUSB0", and slave ID. Profiles can be saved as
+// CSV, one per line:
+//
+//   endpoint,slave_id,max_read_bits,max_read_registers,max_write_coils,
+//   max_write_registers,pipeline_depth,function_codes
+//
+// where 'function_codes' lists the supported function codes in decimal,
+// separated by spaces. Empty lines and lines starting with '#' are skipped.
+class DeviceProfileCache {
+public:
+  // Returns the profile of 'slave_id' at 'endpoint', or the default profile
+  // if none is cached.
+  DeviceProfile Get(absl::string_view endpoint, uint8_t slave_id) const;
+
+  // Returns true if a profile of 'slave_id' at 'endpoint' is cached.
+  bool Contains(absl::string_view endpoint, uint8_t slave_id) const;
+
+  void Put(absl::string_view endpoint, uint8_t slave_id,
+           const DeviceProfile &profile);
+
+  // Returns the cached profile of 'slave_id' at 'endpoint', probing the
+  // slave through 'client' and caching the result if there is none.
+  absl::StatusOr<DeviceProfile> GetOrProbe(absl::string_view endpoint,
+                                           Client *client, uint8_t slave_id,
+                                           const ProbeParams &params);
+
+  // Returns the cached profiles as CSV.
+  std::string ToCsv() const;
+
+  // Adds the profiles in 'csv' to the cache. On error, the cache is left
+  // unchanged.
+  absl::Status LoadCsv(absl::string_view csv);
+
+private:
+  using Key = std::pair<std::string, uint8_t>;
+
+  mutable absl::Mutex mu_;
+  absl::flat_hash_map<Key, DeviceProfile> profiles_ ABSL_GUARDED_BY(mu_);
+};
+
+// Client decorator that fits requests to the profiles of the slaves behind
+// one endpoint. Reads and multiple writes larger than a slave's limit are
+// split into several requests whose responses are merged, requests with
+// unsupported function codes are answered with an Illegal Function
+// exception without a round trip, and no more than the slave's pipeline
+// depth of requests are outstanding at once. Slaves without a cached
+// profile get the defaults. Thread-safe if the wrapped client is.
+class ProfiledClient : public ClientDecorator {
+public:
+  // Constructor taking the wrapped client and the cache, which must outlive
+  // the decorator, and the endpoint of the wrapped client. The wrapped
+  // client's timeout applies to every request sent.
+  ProfiledClient(Client *client, const DeviceProfileCache *profiles,
+                 std::string endpoint);
+
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t slave_id, FunctionCode function_code,
+              const std::vector<uint8_t> &request_data) override;
+  absl::StatusOr<std::vector<uint8_t>>
+  SendPrepared(const PreparedRequest &request) override;
+
+private:
+  // Sends a request that fits the profile of 'slave_id', within its
+  // pipeline depth.
+  template <typename Send>
+  absl::StatusOr<std::vector<uint8_t>> SendWithin(uint8_t slave_id,
+                                                  int pipeline_depth,
+                                                  Send send);
+
+  // Splits a read or multiple write of at most the specification's quantity
+  // into requests of at most 'limit'.
+  absl::StatusOr<std::vector<uint8_t>>
+  SendSplit(uint8_t slave_id, FunctionCode function_code,
+            const std::vector<uint8_t> &request_data, uint16_t limit,
+            int pipeline_depth);
+
+  const DeviceProfileCache *profiles_;
+  std::string endpoint_;
+
+  absl::Mutex mu_;
+  // Signalled when a request completes.
+  absl::CondVar cv_;
+  int in_flight_[256] ABSL_GUARDED_BY(mu_) = {};
+};
+
+} // namespace modbus
+
+#endif // DEVICE_PROFILE_H_
@@ -0,0 +1,124 @@
+#include "engineering_units.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/status/status.h"
+#include "absl/types/span.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define MODBUS_HAVE_AVX2_DISPATCH 1
+#endif
+
+namespace modbus {
+
+namespace {
+
+// Converts 'raw' with the fields of one conversion.
+inline float ConvertOne(int32_t raw, int32_t shift, int32_t mask,
+                        int32_t extend, float scale, float offset, float min,
+                        float max) {
+  int32_t field = (raw >> shift) & mask;
+  // Moves the sign bit of the field to bit 31 and back.
+  field = static_cast<int32_t>(static_cast<uint32_t>(field) << extend) >>
+          extend;
+  float value = static_cast<float>(field) * scale + offset;
+  return std::min(std::max(value, min), max);
+}
+
+#if defined(MODBUS_HAVE_AVX2_DISPATCH)
+
+bool CpuHasAvx2() {
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+}
+
+// Converts values [0, count) eight at a time, where 'count' is a multiple
+// of 8. Registers are loaded from 'registers' if 'contiguous', or from
+// 'registers[source[i]]' otherwise.
+__attribute__((target("avx2"))) void
+ConvertAvx2(const uint16_t *registers, const uint32_t *source,
+            bool contiguous, const int32_t *shift, const int32_t *mask,
+            const int32_t *extend, const float *scale, const float *offset,
+            const float *min, const float *max, float *values, size_t count) {
+  for (size_t i = 0; i < count; i += 8) {
+    __m256i raw;
+    if (contiguous) {
+      raw = _mm256_cvtepu16_epi32(
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(registers + i)));
+    } else {
+      const uint32_t *s = source + i;
+      raw = _mm256_setr_epi32(registers[s[0]], registers[s[1]],
+                              registers[s[2]], registers[s[3]],
+                              registers[s[4]], registers[s[5]],
+                              registers[s[6]], registers[s[7]]);
+    }
+    __m256i field = _mm256_srlv_epi32(
+        raw, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(shift + i)));
+    field = _mm256_and_si256(
+        field, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(mask + i)));
+    __m256i bits =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(extend + i));
+    field = _mm256_srav_epi32(_mm256_sllv_epi32(field, bits), bits);
+    __m256 value = _mm256_add_ps(
+        _mm256_mul_ps(_mm256_cvtepi32_ps(field), _mm256_loadu_ps(scale + i)),
+        _mm256_loadu_ps(offset + i));
+    value = _mm256_min_ps(_mm256_max_ps(value, _mm256_loadu_ps(min + i)),
+                          _mm256_loadu_ps(max + i));
+    _mm256_storeu_ps(values + i, value);
+  }
+}
+
+#endif
+
+} // namespace
+
+absl::Status ConversionTable::Add(const Conversion &conversion) {
+  if (conversion.bit_count == 0 ||
+      conversion.bit_offset + conversion.bit_count > 16) {
+    return absl::InvalidArgumentError("Invalid bit field.");
+  }
+  if (conversion.source != size()) {
+    contiguous_ = false;
+  }
+  registers_needed_ =
+      std::max<size_t>(registers_needed_, size_t{conversion.source} + 1);
+  source_.push_back(conversion.source);
+  shift_.push_back(conversion.bit_offset);
+  mask_.push_back((1 << conversion.bit_count) - 1);
+  extend_.push_back(conversion.is_signed ? 32 - conversion.bit_count : 0);
+  scale_.push_back(conversion.scale);
+  offset_.push_back(conversion.offset);
+  min_.push_back(conversion.min);
+  max_.push_back(conversion.max);
+  return absl::OkStatus();
+}
+
+absl::Status ConversionTable::Convert(absl::Span<const uint16_t> registers,
+                                      absl::Span<float> values) const {
+  if (registers.size() < registers_needed_) {
+    return absl::InvalidArgumentError("Too few registers.");
+  }
+  if (values.size() < size()) {
+    return absl::InvalidArgumentError("Too little room for values.");
+  }
+  size_t i = 0;
+#if defined(MODBUS_HAVE_AVX2_DISPATCH)
+  if (vectorized_ && CpuHasAvx2()) {
+    i = size() & ~size_t{7};
+    ConvertAvx2(registers.data(), source_.data(), contiguous_, shift_.data(),
+                mask_.data(), extend_.data(), scale_.data(), offset_.data(),
+                min_.data(), max_.data(), values.data(), i);
+  }
+#endif
+  for (; i < size(); ++i) {
+    values[i] = ConvertOne(registers[source_[i]], shift_[i], mask_[i],
+                           extend_[i], scale_[i], offset_[i], min_[i],
+                           max_[i]);
+  }
+  return absl::OkStatus();
+}
+
+} // namespace modbus
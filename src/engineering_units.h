@@ -0,0 +1,76 @@
+#ifndef ENGINEERING_UNITS_H_
+#define ENGINEERING_UNITS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/types/span.h"
+
+namespace modbus {
+
+// Struct representing the conversion of a register to a value in
+// engineering units: a bit field of the register is taken as an integer,
+// scaled, offset and clamped.
+struct Conversion {
+  // Index of the register in the registers converted.
+  uint32_t source;
+  // Bit field holding the value: 'bit_count' bits from 'bit_offset', bit 0
+  // being the least significant. The whole register by default.
+  uint8_t bit_offset = 0;
+  uint8_t bit_count = 16;
+  // Set if the bit field is a two's complement integer.
+  bool is_signed = false;
+  float scale = 1;
+  float offset = 0;
+  // Range the value is clamped to.
+  float min = -std::numeric_limits<float>::infinity();
+  float max = std::numeric_limits<float>::infinity();
+};
+
+// Converts registers, as returned by ReadHoldingRegisters or
+// ReadInputRegisters, to values in engineering units, one per conversion
+// added. The conversions are stored by field, so that Convert processes
+// eight values per instruction with AVX2 on CPUs that have it, and one at
+// a time otherwise.
+class ConversionTable {
+public:
+  // Adds the conversion of the next value. Fails if its bit field does not
+  // fit in a register.
+  absl::Status Add(const Conversion &conversion);
+
+  // Returns the number of conversions.
+  size_t size() const { return scale_.size(); }
+
+  // Converts 'registers' into 'values', which must have room for size()
+  // values. Fails if a conversion reads past the end of 'registers'.
+  absl::Status Convert(absl::Span<const uint16_t> registers,
+                       absl::Span<float> values) const;
+
+  // Lets Convert use AVX2 where the CPU has it. On by default; turned off to
+  // compare with the scalar code.
+  void set_vectorized(bool vectorized) { vectorized_ = vectorized; }
+
+private:
+  std::vector<uint32_t> source_;
+  // Right shift and mask that extract the bit field, and the left shift that
+  // moves its top bit to bit 31, for sign extension; 0 for unsigned fields.
+  std::vector<int32_t> shift_;
+  std::vector<int32_t> mask_;
+  std::vector<int32_t> extend_;
+  std::vector<float> scale_;
+  std::vector<float> offset_;
+  std::vector<float> min_;
+  std::vector<float> max_;
+  // Set while conversion i reads register i for every i, so that registers
+  // are loaded instead of gathered.
+  bool contiguous_ = true;
+  size_t registers_needed_ = 0;
+  bool vectorized_ = true;
+};
+
+} // namespace modbus
+
+#endif // ENGINEERING_UNITS_H_
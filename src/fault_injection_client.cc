@@ -0,0 +1,106 @@
+#include "fault_injection_client.h"
+
+#include <algorithm>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace modbus {
+
+FaultInjectionClient::FaultInjectionClient(Client *client, int timeout_ms,
+                                           const FaultInjectionParams &params)
+    : ClientDecorator(client), params_(params), rng_(params.seed) {
+  Client::SetTimeout(timeout_ms);
+}
+
+void FaultInjectionClient::EnableAdaptiveTimeouts(
+    const AdaptiveTimeoutParams &params) {
+  Client::EnableAdaptiveTimeouts(params);
+  ClientDecorator::EnableAdaptiveTimeouts(params);
+}
+
+int FaultInjectionClient::TimeoutFor(uint8_t slave_id) const {
+  return Client::TimeoutFor(slave_id);
+}
+
+FaultInjectionClient::Faults FaultInjectionClient::DrawFaults() {
+  absl::MutexLock lock(&mu_);
+  auto chance = [this](double probability) {
+    return probability > 0 && std::bernoulli_distribution(probability)(rng_);
+  };
+  Faults faults;
+  faults.latency_ms = params_.latency_ms;
+  if (params_.jitter_ms > 0) {
+    faults.latency_ms += std::uniform_int_distribution<int>(
+        -params_.jitter_ms, params_.jitter_ms)(rng_);
+  }
+  faults.latency_ms = std::max(faults.latency_ms, 0);
+  faults.drop = chance(params_.drop_probability);
+  faults.exception = chance(params_.exception_probability);
+  faults.crc_error = chance(params_.crc_error_probability);
+  faults.partial_frame = chance(params_.partial_frame_probability);
+  faults.truncate_fraction = std::uniform_real_distribution<double>()(rng_);
+  return faults;
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+FaultInjectionClient::SendReceive(uint8_t slave_id, FunctionCode function_code,
+                                  const std::vector<uint8_t> &request_data) {
+  Faults faults = DrawFaults();
+  if (Drop(slave_id, faults)) {
+    return absl::DeadlineExceededError("No response from slave.");
+  }
+  return Inject(slave_id, function_code, faults,
+                client_->SendReceive(slave_id, function_code, request_data));
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+FaultInjectionClient::SendPrepared(const PreparedRequest &request) {
+  Faults faults = DrawFaults();
+  if (Drop(request.slave_id(), faults)) {
+    return absl::DeadlineExceededError("No response from slave.");
+  }
+  return Inject(request.slave_id(), request.function_code(), faults,
+                client_->SendPrepared(request));
+}
+
+bool FaultInjectionClient::Drop(uint8_t slave_id, const Faults &faults) {
+  // Lost frames and responses slower than the timeout look the same to the
+  // caller.
+  int timeout_ms = TimeoutFor(slave_id);
+  if (!faults.drop && faults.latency_ms <= timeout_ms) {
+    return false;
+  }
+  clock_->SleepFor(absl::Milliseconds(timeout_ms));
+  RecordTimeout(slave_id);
+  return true;
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+FaultInjectionClient::Inject(uint8_t slave_id, FunctionCode function_code,
+                             const Faults &faults,
+                             absl::StatusOr<std::vector<uint8_t>> response) {
+  clock_->SleepFor(absl::Milliseconds(faults.latency_ms));
+  if (!response.ok()) {
+    return response;
+  }
+  RecordRoundTrip(slave_id, absl::Milliseconds(faults.latency_ms));
+
+  if (faults.exception) {
+    return std::vector<uint8_t>{
+        static_cast<uint8_t>(static_cast<uint8_t>(function_code) | 0x80),
+        static_cast<uint8_t>(params_.exception_code)};
+  }
+  if (faults.crc_error) {
+    return absl::DataLossError("Modbus CRC mismatch.");
+  }
+  if (faults.partial_frame && !response.value().empty()) {
+    response.value().resize(response.value().size() *
+                            faults.truncate_fraction);
+  }
+  return response;
+}
+
+} // namespace modbus
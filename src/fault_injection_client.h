@@ -0,0 +1,85 @@
+#ifndef FAULT_INJECTION_CLIENT_H_
+#define FAULT_INJECTION_CLIENT_H_
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "modbus_client.h"
+
+namespace modbus {
+
+// Struct representing the faults injected by FaultInjectionClient. All
+// probabilities are per request and independent.
+struct FaultInjectionParams {
+  // Added to every round trip: latency_ms plus a uniform [-jitter_ms,
+  // jitter_ms] term.
+  int latency_ms = 0;
+  int jitter_ms = 0;
+  // The request or its response is lost; fails after the timeout.
+  double drop_probability = 0;
+  // The response is cut short at a random length.
+  double partial_frame_probability = 0;
+  // The response arrives corrupted and fails the CRC check.
+  double crc_error_probability = 0;
+  // The slave answers with 'exception_code' instead of the real response.
+  double exception_probability = 0;
+  ExceptionCode exception_code = ExceptionCode::kServerDeviceBusy;
+  // Seed of the random sequence, so runs are reproducible.
+  uint64_t seed = 1;
+};
+
+// Client decorator that forwards requests to another client and injects
+// latency, jitter, drops, partial frames, CRC errors and exceptions. It
+// times requests as a transport would: dropped and late requests fail after
+// its own timeout, which adaptive timeouts adjust from the injected
+// latencies. Timeout settings also apply to the wrapped client.
+class FaultInjectionClient : public ClientDecorator {
+public:
+  // Constructor taking the wrapped client, which must outlive the decorator,
+  // the timeout in milliseconds and the faults to inject.
+  FaultInjectionClient(Client *client, int timeout_ms,
+                       const FaultInjectionParams &params);
+
+  // Sends a Modbus request and receives the response, subject to faults.
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t slave_id, FunctionCode function_code,
+              const std::vector<uint8_t> &request_data) override;
+  absl::StatusOr<std::vector<uint8_t>>
+  SendPrepared(const PreparedRequest &request) override;
+
+  void EnableAdaptiveTimeouts(const AdaptiveTimeoutParams &params) override;
+  int TimeoutFor(uint8_t slave_id) const override;
+
+private:
+  // Draws the random decisions for one request.
+  struct Faults {
+    int latency_ms;
+    bool drop;
+    bool exception;
+    bool crc_error;
+    bool partial_frame;
+    double truncate_fraction;
+  };
+  Faults DrawFaults();
+
+  // Returns true, after waiting out the timeout, if the request to
+  // 'slave_id' is lost or answered too late.
+  bool Drop(uint8_t slave_id, const Faults &faults);
+
+  // Applies 'faults' to the response of the wrapped client.
+  absl::StatusOr<std::vector<uint8_t>>
+  Inject(uint8_t slave_id, FunctionCode function_code, const Faults &faults,
+         absl::StatusOr<std::vector<uint8_t>> response);
+
+  FaultInjectionParams params_;
+  absl::Mutex mu_;
+  std::mt19937_64 rng_ ABSL_GUARDED_BY(mu_);
+};
+
+} // namespace modbus
+
+#endif // FAULT_INJECTION_CLIENT_H_
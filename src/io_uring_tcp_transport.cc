@@ -0,0 +1,493 @@
+// io_uring backend of TcpBatchTransport, driving the rings directly through
+// the system calls so that it builds without liburing.
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "tcp_batch_transport.h"
+
+namespace modbus {
+
+namespace {
+
+// Receive buffers shared by all connections. A buffer is handed to the
+// kernel again as soon as its data has been parsed.
+constexpr uint16_t kBufferCount = 512;
+constexpr size_t kBufferSize = 2048;
+constexpr uint16_t kBufferGroup = 0;
+
+// Size of each connection's own receive buffer when multishot receive is
+// unavailable.
+constexpr size_t kConnectionBufferSize = 16384;
+
+constexpr unsigned kRingEntries = 1024;
+
+// Operation tag in the low bit of a request's user data; the connection
+// index is in the other bits.
+constexpr uint64_t kRecv = 0;
+constexpr uint64_t kSend = 1;
+
+// User data of the receive that probes for multishot support.
+constexpr uint64_t kProbe = ~uint64_t{0};
+
+int IoUringSetup(unsigned entries, struct io_uring_params *params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int IoUringEnter(int ring_fd, unsigned to_submit, unsigned min_complete,
+                 unsigned flags, void *arg, size_t arg_size) {
+  return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags,
+                 arg, arg_size);
+}
+
+int IoUringRegister(int ring_fd, unsigned opcode, void *arg,
+                    unsigned nr_args) {
+  return syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+template <typename T> T LoadAcquire(const T *p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+template <typename T> void StoreRelease(T *p, T value) {
+  __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+class IoUringTcpTransport : public TcpBatchTransport {
+public:
+  IoUringTcpTransport() = default;
+
+  ~IoUringTcpTransport() override {
+    if (ready_) {
+      WindDown();
+    }
+    if (ring_fd_ >= 0) {
+      close(ring_fd_);
+    }
+    if (buffer_ring_ != nullptr) {
+      munmap(buffer_ring_, kBufferCount * sizeof(struct io_uring_buf));
+    }
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != nullptr) {
+      munmap(sq_ring_, sq_ring_size_);
+    }
+    if (sqes_ != nullptr) {
+      munmap(sqes_, sqes_size_);
+    }
+  }
+
+  const char *name() const override {
+    return multishot_ ? "io_uring" : "io_uring (single-shot receive)";
+  }
+
+  // Waits for the kernel to finish every operation.
+  void WindDown() {
+    // The kernel may write into receive buffers until every operation has
+    // completed, so wind them down before the buffers go away.
+    for (auto &connection : connections_) {
+      shutdown(connection->sockfd, SHUT_RDWR);
+    }
+    absl::Time deadline = absl::Now() + absl::Seconds(1);
+    Reap();
+    while (operations_ > 0 && absl::Now() < deadline) {
+      Enter(1, absl::Milliseconds(10));
+      Reap();
+    }
+  }
+
+  // Sets up the rings and the receive buffers.
+  absl::Status Init() {
+    struct io_uring_params params = {};
+    ring_fd_ = IoUringSetup(kRingEntries, &params);
+    if (ring_fd_ < 0) {
+      return absl::UnavailableError(std::string("io_uring_setup failed: ") +
+                                    strerror(errno));
+    }
+    if (!(params.features & IORING_FEAT_NODROP) ||
+        !(params.features & IORING_FEAT_EXT_ARG)) {
+      return absl::UnavailableError("io_uring lacks required features.");
+    }
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = Map(sq_ring_size_, IORING_OFF_SQ_RING);
+    cq_ring_ = single_mmap ? sq_ring_ : Map(cq_ring_size_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ =
+        static_cast<struct io_uring_sqe *>(Map(sqes_size_, IORING_OFF_SQES));
+    if (sq_ring_ == nullptr || cq_ring_ == nullptr || sqes_ == nullptr) {
+      return absl::InternalError("Failed to map io_uring rings.");
+    }
+
+    char *sq = static_cast<char *>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sq_local_tail_ = *sq_tail_;
+    char *cq = static_cast<char *>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    ready_ = true;
+    if (RegisterBufferRing() && ProbeMultishotReceive()) {
+      multishot_ = true;
+    } else {
+      UnregisterBufferRing();
+    }
+    return absl::OkStatus();
+  }
+
+protected:
+  absl::Status Register(size_t index) override {
+    if (!multishot_) {
+      connection_buffers_.resize(index + 1);
+      connection_buffers_[index].resize(kConnectionBufferSize);
+    }
+    ArmReceive(index);
+    return absl::OkStatus();
+  }
+
+  void Unregister(size_t) override {
+    // The shutdown completes the armed receive, which OnRecv then does not
+    // rearm, so no operation is left on the connection.
+  }
+
+  void RunIo(absl::Time deadline) override {
+    for (size_t i = 0; i < connections_.size(); ++i) {
+      Connection &connection = *connections_[i];
+      if (!connection.writing && !connection.out.empty()) {
+        QueueSend(i);
+      }
+    }
+
+    // One system call per round submits every queued operation and waits
+    // for completions, however many connections are involved.
+    while (true) {
+      Reap();
+      if (Done() && sends_ == 0) {
+        break;
+      }
+      absl::Duration remaining = deadline - absl::Now();
+      if (remaining <= absl::ZeroDuration()) {
+        break;
+      }
+      Enter(1, remaining);
+    }
+
+    // A send still in flight owns its connection's output buffer, which the
+    // next batch would otherwise append to.
+    for (size_t i = 0; i < connections_.size(); ++i) {
+      if (connections_[i]->writing) {
+        OnError(i, absl::UnavailableError("Timed out sending request."));
+      }
+    }
+  }
+
+private:
+  // Registers the shared receive buffers as a provided buffer ring, from
+  // which multishot receives pick a buffer for each completion.
+  bool RegisterBufferRing() {
+    void *buffer_ring =
+        mmap(nullptr, kBufferCount * sizeof(struct io_uring_buf),
+             PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (buffer_ring == MAP_FAILED) {
+      return false;
+    }
+    buffer_ring_ = static_cast<struct io_uring_buf_ring *>(buffer_ring);
+    buffers_.resize(kBufferCount * kBufferSize);
+    for (uint16_t id = 0; id < kBufferCount; ++id) {
+      RecycleBuffer(id);
+    }
+    StoreRelease(&buffer_ring_->tail, buffer_tail_);
+    struct io_uring_buf_reg registration = {};
+    registration.ring_addr = reinterpret_cast<uint64_t>(buffer_ring_);
+    registration.ring_entries = kBufferCount;
+    registration.bgid = kBufferGroup;
+    return IoUringRegister(ring_fd_, IORING_REGISTER_PBUF_RING, &registration,
+                           1) == 0;
+  }
+
+  void UnregisterBufferRing() {
+    if (buffer_ring_ == nullptr) {
+      return;
+    }
+    struct io_uring_buf_reg registration = {};
+    registration.bgid = kBufferGroup;
+    IoUringRegister(ring_fd_, IORING_UNREGISTER_PBUF_RING, &registration, 1);
+    munmap(buffer_ring_, kBufferCount * sizeof(struct io_uring_buf));
+    buffer_ring_ = nullptr;
+    buffers_.clear();
+    buffers_.shrink_to_fit();
+  }
+
+  // Returns true if a multishot receive with provided buffers works. Kernels
+  // before 6.0 reject it, and some kernels accept the buffer ring but never
+  // hand out its buffers.
+  bool ProbeMultishotReceive() {
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) < 0) {
+      return false;
+    }
+    struct io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = sockets[0];
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    sqe->user_data = kProbe;
+    probe_armed_ = true;
+    ++operations_;
+    write(sockets[1], "", 1);
+
+    absl::Time deadline = absl::Now() + absl::Seconds(1);
+    while (!probe_completed_ && absl::Now() < deadline) {
+      Enter(1, absl::Milliseconds(100));
+      Reap();
+    }
+    shutdown(sockets[0], SHUT_RDWR);
+    close(sockets[1]);
+    while (probe_armed_ && absl::Now() < deadline) {
+      Enter(1, absl::Milliseconds(100));
+      Reap();
+    }
+    close(sockets[0]);
+    return probe_succeeded_ && !probe_armed_;
+  }
+
+  void *Map(size_t size, off_t offset) {
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+    return p == MAP_FAILED ? nullptr : p;
+  }
+
+  // Returns a cleared submission queue entry, submitting queued entries
+  // first if the queue is full.
+  struct io_uring_sqe *GetSqe() {
+    if (sq_local_tail_ - LoadAcquire(sq_head_) >= sq_entries_) {
+      Enter(0, absl::ZeroDuration());
+    }
+    unsigned index = sq_local_tail_ & sq_mask_;
+    struct io_uring_sqe *sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    ++sq_local_tail_;
+    return sqe;
+  }
+
+  // Submits queued entries and waits for at least 'min_complete'
+  // completions or 'timeout'.
+  void Enter(unsigned min_complete, absl::Duration timeout) {
+    StoreRelease(sq_tail_, sq_local_tail_);
+    unsigned to_submit = sq_local_tail_ - sq_submitted_;
+    struct __kernel_timespec ts = {};
+    ts.tv_sec = absl::ToInt64Seconds(timeout);
+    ts.tv_nsec = absl::ToInt64Nanoseconds(timeout % absl::Seconds(1));
+    struct io_uring_getevents_arg arg = {};
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+    unsigned flags = IORING_ENTER_EXT_ARG;
+    if (min_complete > 0) {
+      flags |= IORING_ENTER_GETEVENTS;
+    }
+    int submitted = IoUringEnter(ring_fd_, to_submit, min_complete, flags,
+                                 &arg, sizeof(arg));
+    if (submitted > 0) {
+      sq_submitted_ += submitted;
+    }
+  }
+
+  void ArmReceive(size_t index) {
+    struct io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = connections_[index]->sockfd;
+    if (multishot_) {
+      sqe->ioprio = IORING_RECV_MULTISHOT;
+      sqe->flags = IOSQE_BUFFER_SELECT;
+      sqe->buf_group = kBufferGroup;
+    } else {
+      sqe->addr = reinterpret_cast<uint64_t>(connection_buffers_[index].data());
+      sqe->len = connection_buffers_[index].size();
+    }
+    sqe->user_data = (index << 1) | kRecv;
+    ++operations_;
+  }
+
+  void QueueSend(size_t index) {
+    Connection &connection = *connections_[index];
+    struct io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = connection.sockfd;
+    sqe->addr = reinterpret_cast<uint64_t>(connection.out.data() +
+                                           connection.out_offset);
+    sqe->len = connection.out.size() - connection.out_offset;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (index << 1) | kSend;
+    connection.writing = true;
+    ++sends_;
+    ++operations_;
+  }
+
+  void RecycleBuffer(uint16_t id) {
+    struct io_uring_buf *buffer =
+        &buffer_ring_->bufs[buffer_tail_ & (kBufferCount - 1)];
+    buffer->addr = reinterpret_cast<uint64_t>(&buffers_[id * kBufferSize]);
+    buffer->len = kBufferSize;
+    buffer->bid = id;
+    ++buffer_tail_;
+  }
+
+  // Processes every available completion.
+  void Reap() {
+    unsigned head = *cq_head_;
+    unsigned tail = LoadAcquire(cq_tail_);
+    if (head == tail) {
+      return;
+    }
+    for (; head != tail; ++head) {
+      const struct io_uring_cqe &cqe = cqes_[head & cq_mask_];
+      size_t index = cqe.user_data >> 1;
+      if (cqe.user_data == kProbe) {
+        OnProbe(cqe.res, cqe.flags);
+      } else if ((cqe.user_data & 1) == kSend) {
+        OnSend(index, cqe.res);
+      } else {
+        OnRecv(index, cqe.res, cqe.flags);
+      }
+    }
+    StoreRelease(cq_head_, head);
+    if (buffer_ring_ != nullptr) {
+      StoreRelease(&buffer_ring_->tail, buffer_tail_);
+    }
+  }
+
+  void OnProbe(int result, uint32_t flags) {
+    probe_completed_ = true;
+    if (!(flags & IORING_CQE_F_MORE)) {
+      probe_armed_ = false;
+      --operations_;
+    }
+    if (flags & IORING_CQE_F_BUFFER) {
+      probe_succeeded_ = probe_succeeded_ || result == 1;
+      RecycleBuffer(flags >> IORING_CQE_BUFFER_SHIFT);
+    }
+  }
+
+  void OnSend(size_t index, int result) {
+    --sends_;
+    --operations_;
+    Connection &connection = *connections_[index];
+    connection.writing = false;
+    if (result < 0) {
+      OnError(index, absl::UnavailableError("Failed to send request."));
+    } else {
+      connection.out_offset += result;
+    }
+    if (connection.status.ok() &&
+        connection.out_offset < connection.out.size()) {
+      QueueSend(index);
+      return;
+    }
+    connection.out.clear();
+    connection.out_offset = 0;
+  }
+
+  void OnRecv(size_t index, int result, uint32_t flags) {
+    bool armed = flags & IORING_CQE_F_MORE;
+    if (!armed) {
+      --operations_;
+    }
+    if (flags & IORING_CQE_F_BUFFER) {
+      uint16_t id = flags >> IORING_CQE_BUFFER_SHIFT;
+      if (result > 0) {
+        OnReceive(index, &buffers_[id * kBufferSize], result);
+      }
+      RecycleBuffer(id);
+    } else if (!multishot_ && result > 0) {
+      OnReceive(index, connection_buffers_[index].data(), result);
+    }
+    if (result == 0) {
+      OnError(index, absl::UnavailableError("Connection closed."));
+    } else if (result < 0 && result != -ENOBUFS) {
+      OnError(index, absl::UnavailableError("Failed to receive."));
+    } else if (!armed && connections_[index]->status.ok()) {
+      // Rearm a single-shot receive, or a multishot one that the kernel
+      // stopped when it ran out of buffers.
+      ArmReceive(index);
+    }
+  }
+
+  // Set once Init has succeeded.
+  bool ready_ = false;
+  int ring_fd_ = -1;
+  void *sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  void *cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  struct io_uring_sqe *sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+
+  unsigned *sq_head_ = nullptr;
+  unsigned *sq_tail_ = nullptr;
+  unsigned *sq_array_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned sq_entries_ = 0;
+  unsigned sq_local_tail_ = 0;
+  unsigned sq_submitted_ = 0;
+  unsigned *cq_head_ = nullptr;
+  unsigned *cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  struct io_uring_cqe *cqes_ = nullptr;
+
+  // Receive path: shared buffers for multishot receives, otherwise one
+  // buffer per connection.
+  bool multishot_ = false;
+  struct io_uring_buf_ring *buffer_ring_ = nullptr;
+  uint16_t buffer_tail_ = 0;
+  std::vector<uint8_t> buffers_;
+  std::vector<std::vector<uint8_t>> connection_buffers_;
+
+  bool probe_armed_ = false;
+  bool probe_completed_ = false;
+  bool probe_succeeded_ = false;
+
+  // Operations submitted and not completed, and how many of them are sends.
+  int operations_ = 0;
+  int sends_ = 0;
+};
+
+} // namespace
+
+absl::StatusOr<std::unique_ptr<TcpBatchTransport>> CreateIoUringTcpTransport() {
+  auto transport = std::make_unique<IoUringTcpTransport>();
+  absl::Status status = transport->Init();
+  if (!status.ok()) {
+    return status;
+  }
+  return transport;
+}
+
+} // namespace modbus
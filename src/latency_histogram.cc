@@ -0,0 +1,87 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace modbus {
+
+namespace {
+
+// Values below kLinearLimit get one bucket each; above it, every power of two
+// is split into kSubBuckets buckets.
+constexpr int kSubBucketBits = 4;
+constexpr int64_t kSubBuckets = 1 << kSubBucketBits;
+constexpr int64_t kLinearLimit = 2 * kSubBuckets;
+constexpr int kMaxShift = 62 - kSubBucketBits;
+constexpr size_t kNumBuckets = kLinearLimit + kMaxShift * kSubBuckets;
+
+size_t BucketIndex(int64_t value) {
+  if (value < kLinearLimit) {
+    return value;
+  }
+  int shift = (63 - __builtin_clzll(value)) - kSubBucketBits;
+  return kLinearLimit + (shift - 1) * kSubBuckets +
+         ((value >> shift) - kSubBuckets);
+}
+
+// Returns the largest value that falls into bucket 'index'.
+int64_t BucketUpperBound(size_t index) {
+  if (index < static_cast<size_t>(kLinearLimit)) {
+    return index;
+  }
+  int shift = (index - kLinearLimit) / kSubBuckets + 1;
+  int64_t sub_bucket = (index - kLinearLimit) % kSubBuckets + kSubBuckets;
+  return ((sub_bucket + 1) << shift) - 1;
+}
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram() : buckets_(kNumBuckets, 0) {}
+
+void LatencyHistogram::Record(int64_t micros) {
+  micros = std::max<int64_t>(micros, 0);
+  ++buckets_[BucketIndex(micros)];
+  min_ = count_ ? std::min(min_, micros) : micros;
+  max_ = std::max(max_, micros);
+  sum_ += micros;
+  ++count_;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram &other) {
+  if (other.count_ == 0) {
+    return;
+  }
+  for (size_t i = 0; i < buckets_.size(); ++i) {
+    buckets_[i] += other.buckets_[i];
+  }
+  min_ = count_ ? std::min(min_, other.min_) : other.min_;
+  max_ = std::max(max_, other.max_);
+  sum_ += other.sum_;
+  count_ += other.count_;
+}
+
+int64_t LatencyHistogram::Percentile(double p) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  int64_t rank = static_cast<int64_t>(p / 100.0 * count_ + 0.5);
+  rank = std::clamp<int64_t>(rank, 1, count_);
+  int64_t seen = 0;
+  for (size_t i = 0; i < buckets_.size(); ++i) {
+    seen += buckets_[i];
+    if (seen >= rank) {
+      return std::min(BucketUpperBound(i), max_);
+    }
+  }
+  return max_;
+}
+
+void LatencyHistogram::Clear() {
+  std::fill(buckets_.begin(), buckets_.end(), 0);
+  count_ = 0;
+  sum_ = 0;
+  min_ = 0;
+  max_ = 0;
+}
+
+} // namespace modbus
@@ -0,0 +1,46 @@
+#ifndef LATENCY_HISTOGRAM_H_
+#define LATENCY_HISTOGRAM_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace modbus {
+
+// Log-linear histogram of latencies in microseconds. Values are bucketed with
+// a relative error below 1/16, which keeps percentiles accurate from single
+// microseconds to hours in a few kilobytes. Not thread-safe; merge per-thread
+// histograms instead.
+class LatencyHistogram {
+public:
+  LatencyHistogram();
+
+  // Records a single latency sample.
+  void Record(int64_t micros);
+
+  // Adds all samples of 'other' to this histogram.
+  void Merge(const LatencyHistogram &other);
+
+  // Returns the latency at percentile 'p' (0-100), or 0 if empty.
+  int64_t Percentile(double p) const;
+
+  // Removes all samples.
+  void Clear();
+
+  int64_t count() const { return count_; }
+  int64_t min() const { return count_ ? min_ : 0; }
+  int64_t max() const { return max_; }
+  double mean() const {
+    return count_ ? static_cast<double>(sum_) / count_ : 0;
+  }
+
+private:
+  std::vector<int64_t> buckets_;
+  int64_t count_ = 0;
+  int64_t sum_ = 0;
+  int64_t min_ = 0;
+  int64_t max_ = 0;
+};
+
+} // namespace modbus
+
+#endif // LATENCY_HISTOGRAM_H_
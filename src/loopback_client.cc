@@ -0,0 +1,46 @@
+#include "loopback_client.h"
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace modbus {
+
+// --- LoopbackServer ---
+
+void LoopbackServer::AddSlave(uint8_t slave_id, SlaveDevice *device) {
+  absl::MutexLock lock(&mu_);
+  slaves_[slave_id] = device;
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+LoopbackServer::HandleRequest(uint8_t slave_id, FunctionCode function_code,
+                              const std::vector<uint8_t> &request_data) {
+  absl::MutexLock lock(&mu_);
+  if (slaves_[slave_id] == nullptr) {
+    return absl::DeadlineExceededError("No response from slave.");
+  }
+  return slaves_[slave_id]->HandleRequest(function_code, request_data);
+}
+
+// --- LoopbackClient ---
+
+LoopbackClient::LoopbackClient(LoopbackServer *server, int timeout_ms)
+    : Client(timeout_ms), server_(server) {}
+
+absl::StatusOr<std::vector<uint8_t>>
+LoopbackClient::SendReceive(uint8_t slave_id, FunctionCode function_code,
+                            const std::vector<uint8_t> &request_data) {
+  absl::Time start = clock_->Now();
+  auto response = server_->HandleRequest(slave_id, function_code, request_data);
+  if (absl::IsDeadlineExceeded(response.status())) {
+    clock_->SleepFor(absl::Milliseconds(TimeoutFor(slave_id)));
+    RecordTimeout(slave_id);
+  } else if (response.ok()) {
+    RecordRoundTrip(slave_id, clock_->Now() - start);
+  }
+  return response;
+}
+
+} // namespace modbus
@@ -0,0 +1,53 @@
+#ifndef LOOPBACK_CLIENT_H_
+#define LOOPBACK_CLIENT_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "modbus_client.h"
+#include "modbus_slave.h"
+
+namespace modbus {
+
+// In-process Modbus server that dispatches requests to SlaveDevices by slave
+// ID. Thread-safe; requests are served one at a time.
+class LoopbackServer {
+public:
+  // Attaches 'device' under 'slave_id'. The device must outlive the server.
+  void AddSlave(uint8_t slave_id, SlaveDevice *device);
+
+  // Serves a request. Requests to unknown slaves are not answered and yield a
+  // DeadlineExceeded error, as a real bus would after the timeout.
+  absl::StatusOr<std::vector<uint8_t>>
+  HandleRequest(uint8_t slave_id, FunctionCode function_code,
+                const std::vector<uint8_t> &request_data);
+
+private:
+  absl::Mutex mu_;
+  SlaveDevice *slaves_[256] ABSL_GUARDED_BY(mu_) = {};
+};
+
+// Concrete Modbus client implementation that talks to a LoopbackServer in
+// the same process, without any I/O. Unanswered requests wait out the
+// timeout on the client's clock.
+class LoopbackClient : public Client {
+public:
+  // Constructor taking the server, which must outlive the client, and the
+  // timeout in milliseconds.
+  LoopbackClient(LoopbackServer *server, int timeout_ms);
+
+  // Sends a Modbus request and receives the response.
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t slave_id, FunctionCode function_code,
+              const std::vector<uint8_t> &request_data) override;
+
+private:
+  LoopbackServer *server_;
+};
+
+} // namespace modbus
+
+#endif // LOOPBACK_CLIENT_H_
@@ -0,0 +1,90 @@
+#include "mbap.h"
+
+#include <sys/socket.h>
+
+#include <cstring>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+namespace modbus {
+
+void EncodeMbapHeader(const MbapHeader &header, uint8_t *out) {
+  out[0] = static_cast<uint8_t>(header.transaction_id >> 8);
+  out[1] = static_cast<uint8_t>(header.transaction_id & 0xFF);
+  out[2] = static_cast<uint8_t>(header.protocol_id >> 8);
+  out[3] = static_cast<uint8_t>(header.protocol_id & 0xFF);
+  out[4] = static_cast<uint8_t>(header.length >> 8);
+  out[5] = static_cast<uint8_t>(header.length & 0xFF);
+  out[6] = header.unit_id;
+}
+
+MbapHeader DecodeMbapHeader(const uint8_t *data) {
+  MbapHeader header;
+  header.transaction_id = (data[0] << 8) | data[1];
+  header.protocol_id = (data[2] << 8) | data[3];
+  header.length = (data[4] << 8) | data[5];
+  header.unit_id = data[6];
+  return header;
+}
+
+MbapReceiveBuffer::MbapReceiveBuffer(size_t capacity) : data_(capacity) {}
+
+ssize_t MbapReceiveBuffer::Receive(int sockfd, int flags) {
+  // A full frame must always fit so that progress is possible.
+  Reserve(kMbapHeaderSize + kMaxMbapLength);
+  ssize_t received =
+      recv(sockfd, data_.data() + end_, data_.size() - end_, flags);
+  if (received > 0) {
+    end_ += received;
+  }
+  return received;
+}
+
+void MbapReceiveBuffer::Append(const uint8_t *data, size_t size) {
+  Reserve(size);
+  memcpy(data_.data() + end_, data, size);
+  end_ += size;
+}
+
+absl::StatusOr<bool> MbapReceiveBuffer::NextFrame(MbapFrame *frame) {
+  if (size() < kMbapHeaderSize) {
+    return false;
+  }
+  MbapHeader header = DecodeMbapHeader(data_.data() + begin_);
+  if (header.protocol_id != 0 || header.length < 2 ||
+      header.length > kMaxMbapLength) {
+    // Frame boundaries are lost, so nothing after this point can be trusted.
+    Clear();
+    return absl::InternalError("Invalid MBAP header.");
+  }
+  // The length field counts the unit ID, which is part of the header.
+  size_t frame_size = kMbapHeaderSize + header.length - 1;
+  if (size() < frame_size) {
+    return false;
+  }
+  frame->header = header;
+  frame->pdu = absl::MakeConstSpan(data_.data() + begin_ + kMbapHeaderSize,
+                                   header.length - 1);
+  begin_ += frame_size;
+  if (begin_ == end_) {
+    begin_ = end_ = 0;
+  }
+  return true;
+}
+
+void MbapReceiveBuffer::Reserve(size_t size) {
+  if (data_.size() - end_ >= size) {
+    return;
+  }
+  // Move the unparsed bytes, usually less than a frame, to the front rather
+  // than growing.
+  memmove(data_.data(), data_.data() + begin_, end_ - begin_);
+  end_ -= begin_;
+  begin_ = 0;
+  if (data_.size() - end_ < size) {
+    data_.resize(end_ + size);
+  }
+}
+
+} // namespace modbus
@@ -0,0 +1,84 @@
+#ifndef MBAP_H_
+#define MBAP_H_
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+
+namespace modbus {
+
+// Size of the Modbus TCP MBAP header, including the unit ID.
+constexpr size_t kMbapHeaderSize = 7;
+
+// Maximum value of the MBAP length field (unit ID + 253 byte PDU).
+constexpr uint16_t kMaxMbapLength = 254;
+
+// Struct representing a Modbus TCP MBAP header.
+struct MbapHeader {
+  uint16_t transaction_id;
+  uint16_t protocol_id;
+  // Number of bytes following the length field (unit ID + PDU).
+  uint16_t length;
+  uint8_t unit_id;
+};
+
+// Writes 'header' to 'out', which must hold at least kMbapHeaderSize bytes.
+void EncodeMbapHeader(const MbapHeader &header, uint8_t *out);
+
+// Reads a header from 'data', which must hold at least kMbapHeaderSize bytes.
+MbapHeader DecodeMbapHeader(const uint8_t *data);
+
+// Struct representing a complete MBAP frame inside an MbapReceiveBuffer.
+struct MbapFrame {
+  MbapHeader header;
+  // The PDU, starting with the function code. Points into the buffer.
+  absl::Span<const uint8_t> pdu;
+};
+
+// Receive buffer for a Modbus TCP byte stream. Receives as much as is
+// available with a single call and splits it into MBAP frames, however the
+// stream was segmented: several frames may arrive at once, and a frame may
+// be split anywhere, including inside its header. Frames are handed out as
+// views into the buffer, valid until the next call that adds data.
+class MbapReceiveBuffer {
+public:
+  // Constructor taking the initial capacity in bytes.
+  explicit MbapReceiveBuffer(size_t capacity = 4096);
+
+  // Receives from 'sockfd' into the free space with one recv call. Returns
+  // the result of recv.
+  ssize_t Receive(int sockfd, int flags = 0);
+
+  // Appends received bytes, for transports that receive elsewhere.
+  void Append(const uint8_t *data, size_t size);
+
+  // Extracts the next complete frame into 'frame'. Returns false if no
+  // complete frame is buffered, or an error if the stream is corrupt. On
+  // an error the buffered bytes are discarded; the stream cannot be
+  // resynchronized, so the caller should drop the connection.
+  absl::StatusOr<bool> NextFrame(MbapFrame *frame);
+
+  // Discards all buffered bytes.
+  void Clear() { begin_ = end_ = 0; }
+
+  // Returns the number of buffered bytes not yet extracted as frames.
+  size_t size() const { return end_ - begin_; }
+
+private:
+  // Makes room for at least 'size' more bytes after 'end_'.
+  void Reserve(size_t size);
+
+  std::vector<uint8_t> data_;
+  // Unparsed bytes are data_[begin_, end_).
+  size_t begin_ = 0;
+  size_t end_ = 0;
+};
+
+} // namespace modbus
+
+#endif // MBAP_H_
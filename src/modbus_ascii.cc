@@ -0,0 +1,256 @@
+#include "modbus_ascii.h"
+
+#include <cstring>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace modbus {
+
+namespace {
+
+constexpr uint8_t kHexDigits[] = "0123456789ABCDEF";
+
+// Returns the value of hex digit 'c', or -1 if it is none.
+int HexValue(uint8_t c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c |= 0x20; // Fold to lower case.
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+#if defined(__SSE2__)
+
+// Converts 16 nibbles to their hex digits.
+__m128i NibblesToHex(__m128i nibbles) {
+  __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)),
+                                  _mm_set1_epi8('A' - '0' - 10));
+  return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+}
+
+// Converts 16 hex digits to their values. Clears 'valid' if any of them is
+// not a hex digit.
+__m128i HexToNibbles(__m128i hex, bool *valid) {
+  // Signed compares also reject bytes of 0x80 and above.
+  __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(hex, _mm_set1_epi8('0' - 1)),
+                                   _mm_cmplt_epi8(hex, _mm_set1_epi8('9' + 1)));
+  __m128i lower = _mm_or_si128(hex, _mm_set1_epi8(0x20));
+  __m128i is_letter =
+      _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                    _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+  if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) != 0xFFFF) {
+    *valid = false;
+  }
+  __m128i digits =
+      _mm_and_si128(is_digit, _mm_sub_epi8(hex, _mm_set1_epi8('0')));
+  __m128i letters = _mm_and_si128(
+      is_letter, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10)));
+  return _mm_or_si128(digits, letters);
+}
+
+// Combines 16 nibbles, high nibble first, into 8 bytes in the low half of
+// each 16-bit lane.
+__m128i CombineNibbles(__m128i nibbles) {
+  __m128i high = _mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0xFF)),
+                                4);
+  __m128i low = _mm_srli_epi16(nibbles, 8);
+  return _mm_or_si128(high, low);
+}
+
+#endif
+
+} // namespace
+
+uint8_t CalculateLrc(const uint8_t *data, size_t size) {
+  uint8_t sum = 0;
+  for (size_t i = 0; i < size; ++i) {
+    sum += data[i];
+  }
+  return static_cast<uint8_t>(-sum);
+}
+
+void EncodeHex(const uint8_t *data, size_t size, uint8_t *out) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  // 16 bytes become 32 digits: split each byte into its nibbles and
+  // interleave them, high nibble first.
+  for (; i + 16 <= size; i += 16) {
+    __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    __m128i mask = _mm_set1_epi8(0x0F);
+    __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+    __m128i low = _mm_and_si128(bytes, mask);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i),
+                     NibblesToHex(_mm_unpacklo_epi8(high, low)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i + 16),
+                     NibblesToHex(_mm_unpackhi_epi8(high, low)));
+  }
+#endif
+  for (; i < size; ++i) {
+    out[2 * i] = kHexDigits[data[i] >> 4];
+    out[2 * i + 1] = kHexDigits[data[i] & 0x0F];
+  }
+}
+
+bool DecodeHex(const uint8_t *hex, size_t size, uint8_t *out) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  // 32 digits become 16 bytes.
+  bool valid = true;
+  for (; i + 16 <= size; i += 16) {
+    __m128i first = HexToNibbles(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(hex + 2 * i)),
+        &valid);
+    __m128i second = HexToNibbles(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(hex + 2 * i + 16)),
+        &valid);
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i *>(out + i),
+        _mm_packus_epi16(CombineNibbles(first), CombineNibbles(second)));
+  }
+  if (!valid) {
+    return false;
+  }
+#endif
+  for (; i < size; ++i) {
+    int high = HexValue(hex[2 * i]);
+    int low = HexValue(hex[2 * i + 1]);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    out[i] = static_cast<uint8_t>((high << 4) | low);
+  }
+  return true;
+}
+
+std::vector<uint8_t> BuildAsciiFrame(uint8_t slave_id,
+                                     FunctionCode function_code,
+                                     const std::vector<uint8_t> &data) {
+  std::vector<uint8_t> binary = {slave_id,
+                                 static_cast<uint8_t>(function_code)};
+  binary.insert(binary.end(), data.begin(), data.end());
+  binary.push_back(CalculateLrc(binary.data(), binary.size()));
+
+  std::vector<uint8_t> frame(1 + 2 * binary.size() + 2);
+  frame.front() = ':';
+  EncodeHex(binary.data(), binary.size(), frame.data() + 1);
+  frame[frame.size() - 2] = '\r';
+  frame[frame.size() - 1] = '\n';
+  return frame;
+}
+
+// --- AsciiFrameParser ---
+
+void AsciiFrameParser::Reset() {
+  state_ = State::kIdle;
+  status_ = absl::OkStatus();
+  size_ = 0;
+  has_pending_digit_ = false;
+}
+
+absl::StatusOr<absl::Span<const uint8_t>> AsciiFrameParser::frame() const {
+  if (state_ != State::kDone) {
+    return absl::FailedPreconditionError("ASCII frame incomplete.");
+  }
+  if (!status_.ok()) {
+    return status_;
+  }
+  return absl::MakeConstSpan(frame_, size_ - 1);
+}
+
+void AsciiFrameParser::Finish(absl::Status status) {
+  state_ = State::kDone;
+  status_ = std::move(status);
+}
+
+void AsciiFrameParser::AppendHex(const uint8_t *hex, size_t size) {
+  if (size == 0) {
+    return;
+  }
+  if (has_pending_digit_) {
+    uint8_t pair[2] = {pending_digit_, hex[0]};
+    if (size_ == kMaxAsciiFrameSize || !DecodeHex(pair, 1, frame_ + size_)) {
+      Finish(absl::DataLossError("Invalid ASCII frame."));
+      return;
+    }
+    ++size_;
+    ++hex;
+    --size;
+    has_pending_digit_ = false;
+  }
+  size_t bytes = size / 2;
+  if (size_ + bytes > kMaxAsciiFrameSize ||
+      !DecodeHex(hex, bytes, frame_ + size_)) {
+    Finish(absl::DataLossError("Invalid ASCII frame."));
+    return;
+  }
+  size_ += bytes;
+  if (size % 2 != 0) {
+    pending_digit_ = hex[size - 1];
+    has_pending_digit_ = true;
+  }
+}
+
+size_t AsciiFrameParser::Feed(const uint8_t *data, size_t size) {
+  size_t i = 0;
+  while (i < size && state_ != State::kDone) {
+    switch (state_) {
+    case State::kIdle: {
+      const void *start = memchr(data + i, ':', size - i);
+      if (start == nullptr) {
+        return size;
+      }
+      i = static_cast<const uint8_t *>(start) - data + 1;
+      state_ = State::kData;
+      break;
+    }
+    case State::kData: {
+      // Decode the run of digits up to CR, or up to a ':' that restarts
+      // the frame.
+      size_t end = i;
+      while (end < size && data[end] != '\r' && data[end] != ':') {
+        ++end;
+      }
+      AppendHex(data + i, end - i);
+      i = end;
+      if (state_ == State::kDone || i == size) {
+        break;
+      }
+      if (data[i] == ':') {
+        size_ = 0;
+        has_pending_digit_ = false;
+      } else {
+        state_ = State::kLineFeed;
+      }
+      ++i;
+      break;
+    }
+    case State::kLineFeed:
+      if (data[i++] != '\n') {
+        Finish(absl::DataLossError("Invalid ASCII frame."));
+      } else if (has_pending_digit_ || size_ < 3) {
+        Finish(absl::DataLossError("Modbus ASCII frame too short."));
+      } else if (CalculateLrc(frame_, size_) != 0) {
+        // The sum over the frame including its LRC is zero.
+        Finish(absl::DataLossError("Modbus LRC mismatch."));
+      } else {
+        Finish(absl::OkStatus());
+      }
+      break;
+    case State::kDone:
+      break;
+    }
+  }
+  return i;
+}
+
+} // namespace modbus
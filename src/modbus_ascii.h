@@ -0,0 +1,77 @@
+#ifndef MODBUS_ASCII_H_
+#define MODBUS_ASCII_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "modbus_client.h"
+
+namespace modbus {
+
+// Maximum size of a decoded ASCII frame (slave ID + 253 byte PDU + LRC).
+constexpr size_t kMaxAsciiFrameSize = 255;
+
+// Calculates the Modbus LRC: the two's complement of the sum of the bytes.
+uint8_t CalculateLrc(const uint8_t *data, size_t size);
+
+// Writes the 2 * 'size' uppercase hex digits of the 'size' bytes at 'data'
+// to 'out'. Uses SSE2 where available.
+void EncodeHex(const uint8_t *data, size_t size, uint8_t *out);
+
+// Decodes the 2 * 'size' hex digits at 'hex', in either case, into 'size'
+// bytes at 'out'. Returns false if any of them is not a hex digit. Uses SSE2
+// where available.
+bool DecodeHex(const uint8_t *hex, size_t size, uint8_t *out);
+
+// Constructs a Modbus ASCII frame: ':', the hex digits of slave ID,
+// function code, data and LRC, then CR LF.
+std::vector<uint8_t> BuildAsciiFrame(uint8_t slave_id,
+                                     FunctionCode function_code,
+                                     const std::vector<uint8_t> &data);
+
+// Streaming parser of Modbus ASCII frames. Bytes are fed as they arrive and
+// decoded right away, so the frame is complete as soon as its CR LF is
+// received. Anything before the ':' is skipped, and a ':' inside a frame
+// starts the frame over, as the specification requires.
+class AsciiFrameParser {
+public:
+  AsciiFrameParser() { Reset(); }
+
+  // Consumes bytes from 'data' up to the end of the current frame. Returns
+  // the number of bytes consumed; the rest belong to what follows.
+  size_t Feed(const uint8_t *data, size_t size);
+
+  // Returns true once a frame has ended, well-formed or not.
+  bool done() const { return state_ == State::kDone; }
+
+  // Returns the decoded frame once done: slave ID and PDU, with the LRC
+  // checked and removed. Fails with kDataLoss if the frame was corrupt.
+  absl::StatusOr<absl::Span<const uint8_t>> frame() const;
+
+  // Discards the current frame to parse the next one.
+  void Reset();
+
+private:
+  enum class State { kIdle, kData, kLineFeed, kDone };
+
+  // Appends the hex digits at 'hex' to the frame.
+  void AppendHex(const uint8_t *hex, size_t size);
+
+  // Ends the frame with 'status'.
+  void Finish(absl::Status status);
+
+  State state_;
+  absl::Status status_;
+  uint8_t frame_[kMaxAsciiFrameSize];
+  size_t size_;
+  // The first digit of a byte whose second digit has not arrived yet.
+  uint8_t pending_digit_;
+  bool has_pending_digit_;
+};
+
+} // namespace modbus
+
+#endif // MODBUS_ASCII_H_
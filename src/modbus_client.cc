@@ -1,6 +1,12 @@
 #include "modbus_client.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
 
 namespace modbus {
 
@@ -52,11 +58,15 @@ std::vector<uint8_t> BuildAdu(uint8_t slave_id, FunctionCode function_code,
 }
 
 uint16_t CalculateCrc16(const std::vector<uint8_t> &data) {
+  return CalculateCrc16(data.data(), data.size());
+}
+
+uint16_t CalculateCrc16(const uint8_t *data, size_t size) {
   uint8_t crc_xor = 0;
   uint16_t crc = 0xFFFF;
 
-  for (const auto &piece : data) {
-    crc_xor = piece ^ crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc_xor = data[i] ^ crc;
     crc >>= 8;
     crc ^= crc_table[crc_xor];
   }
@@ -64,4 +74,120 @@ uint16_t CalculateCrc16(const std::vector<uint8_t> &data) {
   return crc;
 }
 
+size_t ExpectedResponseSize(FunctionCode function_code,
+                            const uint8_t *request_data, size_t size) {
+  if (size < 4) {
+    return 0;
+  }
+  size_t quantity = (request_data[2] << 8) | request_data[3];
+  switch (function_code) {
+  case FunctionCode::kReadCoils:
+  case FunctionCode::kReadDiscreteInputs:
+    return 2 + (quantity + 7) / 8; // Function code, byte count, bits.
+  case FunctionCode::kReadHoldingRegisters:
+  case FunctionCode::kReadInputRegisters:
+    return 2 + 2 * quantity;
+  case FunctionCode::kWriteSingleCoil:
+  case FunctionCode::kWriteSingleRegister:
+  case FunctionCode::kWriteMultipleCoils:
+  case FunctionCode::kWriteMultipleRegisters:
+    return 5; // Function code and echo of address and value or quantity.
+  default:
+    return 0;
+  }
+}
+
+// --- PreparedRequest ---
+
+PreparedRequest::PreparedRequest(uint8_t slave_id, FunctionCode function_code,
+                                 std::vector<uint8_t> data)
+    : data_(std::move(data)),
+      rtu_frame_(BuildAdu(slave_id, function_code, data_)),
+      response_size_(
+          ExpectedResponseSize(function_code, data_.data(), data_.size())) {
+  // MBAP header: transaction ID, protocol ID 0, length of unit ID and PDU,
+  // unit ID.
+  uint16_t length = data_.size() + 2;
+  mbap_frame_ = {0, 0, 0, 0, static_cast<uint8_t>(length >> 8),
+                 static_cast<uint8_t>(length & 0xFF), slave_id,
+                 static_cast<uint8_t>(function_code)};
+  mbap_frame_.insert(mbap_frame_.end(), data_.begin(), data_.end());
+}
+
+absl::Status
+PreparedRequest::CheckResponse(const std::vector<uint8_t> &response) const {
+  if (response.empty()) {
+    return absl::InternalError("Empty Modbus response.");
+  }
+  if (response[0] & 0x80) {
+    if (response.size() < 2) {
+      return absl::InternalError("Invalid Modbus exception response.");
+    }
+    return absl::InternalError("Modbus exception: " +
+                               std::to_string(static_cast<int>(response[1])));
+  }
+  if (response[0] != rtu_frame_[1]) {
+    return absl::InternalError("Response does not match request.");
+  }
+  if (response_size_ != 0) {
+    // Reads carry a byte count after the function code, which must agree.
+    bool is_read = rtu_frame_[1] <= static_cast<uint8_t>(
+                                        FunctionCode::kReadInputRegisters);
+    if (response.size() != response_size_ ||
+        (is_read && response[1] != response_size_ - 2)) {
+      return absl::InternalError("Invalid response size.");
+    }
+  }
+  return absl::OkStatus();
+}
+
+// --- Client ---
+
+void Client::EnableAdaptiveTimeouts(const AdaptiveTimeoutParams &params) {
+  rtt_estimators_.assign(
+      256, RttEstimator(params, absl::Milliseconds(timeout_ms_)));
+}
+
+int Client::TimeoutFor(uint8_t slave_id) const {
+  if (rtt_estimators_.empty()) {
+    return timeout_ms_;
+  }
+  // Rounds up so that a timeout below 1 ms does not become 0, which
+  // transports take as no timeout at all.
+  absl::Duration timeout = absl::Ceil(rtt_estimators_[slave_id].Timeout(),
+                                      absl::Milliseconds(1));
+  return std::max<int64_t>(absl::ToInt64Milliseconds(timeout), 1);
+}
+
+void Client::RecordRoundTrip(uint8_t slave_id, absl::Duration rtt) {
+  if (!rtt_estimators_.empty()) {
+    rtt_estimators_[slave_id].AddSample(rtt);
+  }
+}
+
+void Client::RecordTimeout(uint8_t slave_id) {
+  if (!rtt_estimators_.empty()) {
+    rtt_estimators_[slave_id].OnTimeout();
+  }
+}
+
+void ClientDecorator::SetTimeout(int timeout_ms) {
+  Client::SetTimeout(timeout_ms);
+  client_->SetTimeout(timeout_ms);
+}
+
+void ClientDecorator::SetClock(Clock *clock) {
+  Client::SetClock(clock);
+  client_->SetClock(clock);
+}
+
+void ClientDecorator::EnableAdaptiveTimeouts(
+    const AdaptiveTimeoutParams &params) {
+  client_->EnableAdaptiveTimeouts(params);
+}
+
+int ClientDecorator::TimeoutFor(uint8_t slave_id) const {
+  return client_->TimeoutFor(slave_id);
+}
+
 } // namespace modbus
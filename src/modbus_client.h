@@ -1,10 +1,15 @@
 #ifndef MODBUS_CLIENT_H_
 #define MODBUS_CLIENT_H_
 
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "clock.h"
+#include "rtt_estimator.h"
 
 namespace modbus {
 
@@ -40,6 +45,50 @@ std::vector<uint8_t> BuildAdu(uint8_t slave_id, FunctionCode function_code,
 
 // Calculates the Modbus CRC16 checksum of the provided data.
 uint16_t CalculateCrc16(const std::vector<uint8_t> &data);
+uint16_t CalculateCrc16(const uint8_t *data, size_t size);
+
+// Returns the size of the normal response PDU, function code included, to a
+// request with 'function_code' and the 'size' bytes of PDU data at
+// 'request_data', or 0 if the function code has no known layout.
+size_t ExpectedResponseSize(FunctionCode function_code,
+                            const uint8_t *request_data, size_t size);
+
+// A request encoded once in the wire format of every transport, for polls
+// that send the same request every cycle. Sending it costs a copy of the
+// frame at most: the CRC is computed and the MBAP header built up front,
+// and only the transaction ID is filled in per send.
+class PreparedRequest {
+public:
+  PreparedRequest(uint8_t slave_id, FunctionCode function_code,
+                  std::vector<uint8_t> data);
+
+  uint8_t slave_id() const { return rtu_frame_[0]; }
+  FunctionCode function_code() const {
+    return static_cast<FunctionCode>(rtu_frame_[1]);
+  }
+  const std::vector<uint8_t> &data() const { return data_; }
+
+  // RTU frame: slave ID, PDU and CRC.
+  const std::vector<uint8_t> &rtu_frame() const { return rtu_frame_; }
+
+  // MBAP frame: header and PDU. Its first two bytes, the transaction ID,
+  // are zero and must be replaced per send.
+  const std::vector<uint8_t> &mbap_frame() const { return mbap_frame_; }
+
+  // Size of the normal response PDU, or 0 if unknown.
+  size_t response_size() const { return response_size_; }
+
+  // Checks that 'response', a response PDU, is the normal response to this
+  // request. Fails for exception responses and for responses of the wrong
+  // function code, size or byte count.
+  absl::Status CheckResponse(const std::vector<uint8_t> &response) const;
+
+private:
+  std::vector<uint8_t> data_;
+  std::vector<uint8_t> rtu_frame_;
+  std::vector<uint8_t> mbap_frame_;
+  size_t response_size_;
+};
 
 // Abstract base class for a Modbus client.
 class Client {
@@ -49,22 +98,78 @@ public:
 
   virtual ~Client() = default;
 
-  // Method to update the timeout.
-  void SetTimeout(int timeout_ms) { timeout_ms_ = timeout_ms; }
+  // Method to update the timeout. Decorators forward this and the methods
+  // below to the client they wrap; see ClientDecorator.
+  virtual void SetTimeout(int timeout_ms) { timeout_ms_ = timeout_ms; }
+
+  // Method to replace the clock used for timing, e.g. with a SimulatedClock
+  // in tests. The clock must outlive the client. Transports that wait on
+  // real I/O still rely on the OS to time out those waits.
+  virtual void SetClock(Clock *clock) { clock_ = clock; }
+
+  // Enables per-slave adaptive timeouts: each slave's timeout follows its
+  // observed round trip times instead of the static timeout, so a slow or
+  // dead slave no longer dictates the timeout of every other slave. A slave
+  // starts at the static timeout until it has answered, and timeouts back
+  // off no further than the static timeout.
+  virtual void EnableAdaptiveTimeouts(const AdaptiveTimeoutParams &params);
+
+  // Returns the timeout in milliseconds for the next request to 'slave_id'.
+  virtual int TimeoutFor(uint8_t slave_id) const;
 
   // Sends a Modbus request and receives the response.
   // 'slave_id' is the Modbus slave ID (1-247).
   // 'function_code' is the Modbus function code.
   // 'request_data' is the request PDU data, without the slave ID and
   // function code.
-  // Returns the response PDU data, without the slave ID and function code.
+  // Returns the response PDU, starting with the function code (with the high
+  // bit set for exception responses) and without the slave ID or CRC.
   virtual absl::StatusOr<std::vector<uint8_t>>
   SendReceive(uint8_t slave_id, FunctionCode function_code,
               const std::vector<uint8_t> &request_data) = 0;
 
+  // Sends a prepared request and receives the response, like SendReceive.
+  // Transports override it to send the prepared frame as it is.
+  virtual absl::StatusOr<std::vector<uint8_t>>
+  SendPrepared(const PreparedRequest &request) {
+    return SendReceive(request.slave_id(), request.function_code(),
+                       request.data());
+  }
+
 protected:
+  // Records a successful round trip to 'slave_id' for adaptive timeouts.
+  void RecordRoundTrip(uint8_t slave_id, absl::Duration rtt);
+
+  // Records a request to 'slave_id' that timed out.
+  void RecordTimeout(uint8_t slave_id);
+
   // Timeout for Modbus communication in milliseconds.
   int timeout_ms_;
+
+  // Clock for measuring and waiting out durations.
+  Clock *clock_ = Clock::RealClock();
+
+private:
+  // Per-slave estimators, indexed by slave ID. Empty unless adaptive timeouts
+  // are enabled.
+  std::vector<RttEstimator> rtt_estimators_;
+};
+
+// Base class for a client that wraps another client, which must outlive it.
+// The wrapped client sends the requests and times them, so the timeout and
+// adaptive timeout settings are forwarded to it. The clock is set on both, for
+// decorators that wait or measure latencies themselves.
+class ClientDecorator : public Client {
+public:
+  explicit ClientDecorator(Client *client) : Client(0), client_(client) {}
+
+  void SetTimeout(int timeout_ms) override;
+  void SetClock(Clock *clock) override;
+  void EnableAdaptiveTimeouts(const AdaptiveTimeoutParams &params) override;
+  int TimeoutFor(uint8_t slave_id) const override;
+
+protected:
+  Client *client_;
 };
 
 } // namespace modbus
@@ -1,5 +1,6 @@
 #include "modbus_functions.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <vector>
 
@@ -63,7 +64,7 @@ absl::StatusOr<std::vector<bool>> ReadCoils(Client *client, uint8_t slave_id,
 
   std::vector<bool> coils(quantity);
   for (size_t i = 0; i < quantity; ++i) {
-    uint8_t byte = response.value()[1 + (i / 8)];
+    uint8_t byte = response.value()[2 + (i / 8)];
     coils[i] = (byte >> (i % 8)) & 0x01;
   }
   return coils;
@@ -101,7 +102,7 @@ absl::StatusOr<std::vector<bool>> ReadDiscreteInputs(Client *client,
 
   std::vector<bool> inputs(quantity);
   for (size_t i = 0; i < quantity; ++i) {
-    uint8_t byte = response.value()[1 + (i / 8)];
+    uint8_t byte = response.value()[2 + (i / 8)];
     inputs[i] = (byte >> (i % 8)) & 0x01;
   }
   return inputs;
@@ -139,7 +140,7 @@ ReadHoldingRegisters(Client *client, uint8_t slave_id,
   std::vector<uint16_t> registers(quantity);
   for (size_t i = 0; i < quantity; ++i) {
     registers[i] =
-        (response.value()[1 + i * 2] << 8) | response.value()[2 + i * 2];
+        (response.value()[2 + i * 2] << 8) | response.value()[3 + i * 2];
   }
   return registers;
 }
@@ -176,7 +177,7 @@ ReadInputRegisters(Client *client, uint8_t slave_id, uint16_t starting_address,
   std::vector<uint16_t> registers(quantity);
   for (size_t i = 0; i < quantity; ++i) {
     registers[i] =
-        (response.value()[1 + i * 2] << 8) | response.value()[2 + i * 2];
+        (response.value()[2 + i * 2] << 8) | response.value()[3 + i * 2];
   }
   return registers;
 }
@@ -201,8 +202,10 @@ absl::Status WriteSingleCoil(Client *client, uint8_t slave_id,
     return status;
   }
 
-  if (response.value().size() != request.size() ||
-      response.value() != request) {
+  // Response echoes the request after the function code.
+  if (response.value().size() != request.size() + 1 ||
+      !std::equal(request.begin(), request.end(),
+                  response.value().begin() + 1)) {
     return absl::InternalError("Invalid response data.");
   }
 
@@ -229,8 +232,10 @@ absl::Status WriteSingleRegister(Client *client, uint8_t slave_id,
     return status;
   }
 
-  if (response.value().size() != request.size() ||
-      response.value() != request) {
+  // Response echoes the request after the function code.
+  if (response.value().size() != request.size() + 1 ||
+      !std::equal(request.begin(), request.end(),
+                  response.value().begin() + 1)) {
     return absl::InternalError("Invalid response data.");
   }
 
@@ -274,9 +279,9 @@ absl::Status WriteMultipleCoils(Client *client, uint8_t slave_id,
   }
 
   // Response only contains starting address and quantity of coils.
-  if (response.value().size() != 4 || response.value()[0] != request[0] ||
-      response.value()[1] != request[1] || response.value()[2] != request[2] ||
-      response.value()[3] != request[3]) {
+  if (response.value().size() != 5 || response.value()[1] != request[0] ||
+      response.value()[2] != request[1] || response.value()[3] != request[2] ||
+      response.value()[4] != request[3]) {
     return absl::InternalError("Invalid response data.");
   }
 
@@ -315,13 +320,101 @@ absl::Status WriteMultipleRegisters(Client *client, uint8_t slave_id,
   }
 
   // Response only contains starting address and quantity of registers.
-  if (response.value().size() != 4 || response.value()[0] != request[0] ||
-      response.value()[1] != request[1] || response.value()[2] != request[2] ||
-      response.value()[3] != request[3]) {
+  if (response.value().size() != 5 || response.value()[1] != request[0] ||
+      response.value()[2] != request[1] || response.value()[3] != request[2] ||
+      response.value()[4] != request[3]) {
     return absl::InternalError("Invalid response data.");
   }
 
   return absl::OkStatus();
 }
 
+// --- Prepared Reads ---
+
+absl::StatusOr<PreparedRequest> PrepareRead(uint8_t slave_id,
+                                            FunctionCode function_code,
+                                            uint16_t starting_address,
+                                            uint16_t quantity) {
+  switch (function_code) {
+  case FunctionCode::kReadCoils:
+  case FunctionCode::kReadDiscreteInputs:
+    if (quantity < 1 || quantity > 2000) {
+      return absl::InvalidArgumentError("Invalid quantity of bits.");
+    }
+    break;
+  case FunctionCode::kReadHoldingRegisters:
+  case FunctionCode::kReadInputRegisters:
+    if (quantity < 1 || quantity > 125) {
+      return absl::InvalidArgumentError("Invalid quantity of registers.");
+    }
+    break;
+  default:
+    return absl::InvalidArgumentError("Not a read function code.");
+  }
+  return PreparedRequest(slave_id, function_code,
+                         {static_cast<uint8_t>(starting_address >> 8),
+                          static_cast<uint8_t>(starting_address & 0xFF),
+                          static_cast<uint8_t>(quantity >> 8),
+                          static_cast<uint8_t>(quantity & 0xFF)});
+}
+
+absl::StatusOr<std::vector<bool>> ReadBits(Client *client,
+                                           const PreparedRequest &request) {
+  if (request.function_code() != FunctionCode::kReadCoils &&
+      request.function_code() != FunctionCode::kReadDiscreteInputs) {
+    return absl::InvalidArgumentError("Not a read of bits.");
+  }
+  if (request.data().size() != 4) {
+    return absl::InvalidArgumentError("Invalid read request data.");
+  }
+  auto response = client->SendPrepared(request);
+  if (!response.ok()) {
+    return response.status();
+  }
+  auto status = request.CheckResponse(response.value());
+  if (!status.ok()) {
+    return status;
+  }
+
+  size_t quantity = (request.data()[2] << 8) | request.data()[3];
+  if (response.value().size() != 2 + (quantity + 7) / 8) {
+    return absl::InternalError("Invalid response size.");
+  }
+  std::vector<bool> bits(quantity);
+  for (size_t i = 0; i < quantity; ++i) {
+    bits[i] = (response.value()[2 + (i / 8)] >> (i % 8)) & 0x01;
+  }
+  return bits;
+}
+
+absl::StatusOr<std::vector<uint16_t>>
+ReadRegisters(Client *client, const PreparedRequest &request) {
+  if (request.function_code() != FunctionCode::kReadHoldingRegisters &&
+      request.function_code() != FunctionCode::kReadInputRegisters) {
+    return absl::InvalidArgumentError("Not a read of registers.");
+  }
+  if (request.data().size() != 4) {
+    return absl::InvalidArgumentError("Invalid read request data.");
+  }
+  auto response = client->SendPrepared(request);
+  if (!response.ok()) {
+    return response.status();
+  }
+  auto status = request.CheckResponse(response.value());
+  if (!status.ok()) {
+    return status;
+  }
+
+  size_t quantity = (request.data()[2] << 8) | request.data()[3];
+  if (response.value().size() != 2 + 2 * quantity) {
+    return absl::InternalError("Invalid response size.");
+  }
+  std::vector<uint16_t> registers(quantity);
+  for (size_t i = 0; i < quantity; ++i) {
+    registers[i] =
+        (response.value()[2 + i * 2] << 8) | response.value()[3 + i * 2];
+  }
+  return registers;
+}
+
 } // namespace modbus
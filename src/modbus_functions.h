@@ -57,6 +57,25 @@ absl::Status WriteMultipleRegisters(Client *client, uint8_t slave_id,
                                     uint16_t starting_address,
                                     const std::vector<uint16_t> &values);
 
+// --- Prepared Reads ---
+
+// Prepares a read of 'quantity' coils, discrete inputs, holding registers or
+// input registers, depending on 'function_code', for polling with
+// ReadBits or ReadRegisters.
+absl::StatusOr<PreparedRequest> PrepareRead(uint8_t slave_id,
+                                            FunctionCode function_code,
+                                            uint16_t starting_address,
+                                            uint16_t quantity);
+
+// Sends a prepared read of coils or discrete inputs and decodes the bits.
+absl::StatusOr<std::vector<bool>> ReadBits(Client *client,
+                                           const PreparedRequest &request);
+
+// Sends a prepared read of holding or input registers and decodes the
+// registers.
+absl::StatusOr<std::vector<uint16_t>>
+ReadRegisters(Client *client, const PreparedRequest &request);
+
 } // namespace modbus
 
 #endif // MODBUS_FUNCTIONS_H_
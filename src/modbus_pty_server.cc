@@ -0,0 +1,126 @@
+#include "modbus_pty_server.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "modbus_client.h"
+#include "rtu_framing.h"
+
+namespace modbus {
+
+PtyServer::PtyServer(LoopbackServer *slaves) : slaves_(slaves) {}
+
+PtyServer::~PtyServer() { Stop(); }
+
+absl::StatusOr<std::string> PtyServer::Start() {
+  if (master_fd_ >= 0) {
+    return absl::FailedPreconditionError("Server already started.");
+  }
+  master_fd_ = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (master_fd_ < 0 || grantpt(master_fd_) < 0 || unlockpt(master_fd_) < 0) {
+    Stop();
+    return absl::InternalError("Failed to create pseudo-terminal.");
+  }
+  std::string path = ptsname(master_fd_);
+  terminal_fd_ = open(path.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+  wake_fd_ = eventfd(0, EFD_CLOEXEC);
+  if (terminal_fd_ < 0 || wake_fd_ < 0) {
+    Stop();
+    return absl::InternalError("Failed to create pseudo-terminal.");
+  }
+  // Until a client configures the terminal, keep it from echoing or
+  // translating bytes.
+  struct termios tty;
+  tcgetattr(terminal_fd_, &tty);
+  cfmakeraw(&tty);
+  tcsetattr(terminal_fd_, TCSANOW, &tty);
+
+  thread_ = std::thread([this] { Serve(); });
+  return path;
+}
+
+void PtyServer::Stop() {
+  if (thread_.joinable()) {
+    uint64_t one = 1;
+    write(wake_fd_, &one, sizeof(one));
+    thread_.join();
+  }
+  for (int *fd : {&master_fd_, &terminal_fd_, &wake_fd_}) {
+    if (*fd >= 0) {
+      close(*fd);
+      *fd = -1;
+    }
+  }
+}
+
+void PtyServer::Serve() {
+  std::vector<uint8_t> buffer;
+  uint8_t chunk[4096];
+  while (true) {
+    struct pollfd fds[2] = {{master_fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0 || fds[1].revents != 0) {
+      return;
+    }
+    ssize_t received = read(master_fd_, chunk, sizeof(chunk));
+    if (received <= 0) {
+      return;
+    }
+    buffer.insert(buffer.end(), chunk, chunk + received);
+
+    // Answer every complete frame in the buffer with a single write.
+    std::vector<uint8_t> out;
+    size_t offset = 0;
+    while (true) {
+      auto frame_size =
+          RtuRequestSize(buffer.data() + offset, buffer.size() - offset);
+      if (!frame_size.ok()) {
+        offset = buffer.size(); // Cannot find the next frame boundary.
+        break;
+      }
+      if (*frame_size == 0 || buffer.size() - offset < *frame_size) {
+        break;
+      }
+      const uint8_t *frame = buffer.data() + offset;
+      offset += *frame_size;
+      uint16_t crc = (frame[*frame_size - 1] << 8) | frame[*frame_size - 2];
+      if (crc != CalculateCrc16(frame, *frame_size - 2)) {
+        continue; // Like a device on a serial line, ignore corrupt frames.
+      }
+      ++requests_received_;
+      auto response = slaves_->HandleRequest(
+          frame[0], static_cast<FunctionCode>(frame[1]),
+          std::vector<uint8_t>(frame + 2, frame + *frame_size - 2));
+      if (!response.ok()) {
+        continue;
+      }
+      size_t start = out.size();
+      out.push_back(frame[0]);
+      out.insert(out.end(), response.value().begin(), response.value().end());
+      uint16_t response_crc =
+          CalculateCrc16(out.data() + start, out.size() - start);
+      out.push_back(response_crc & 0xFF);
+      out.push_back(response_crc >> 8);
+    }
+    buffer.erase(buffer.begin(), buffer.begin() + offset);
+
+    size_t sent = 0;
+    while (sent < out.size()) {
+      ssize_t n = write(master_fd_, out.data() + sent, out.size() - sent);
+      if (n <= 0) {
+        return;
+      }
+      sent += n;
+    }
+  }
+}
+
+} // namespace modbus
@@ -0,0 +1,48 @@
+#ifndef MODBUS_PTY_SERVER_H_
+#define MODBUS_PTY_SERVER_H_
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "absl/status/statusor.h"
+#include "loopback_client.h"
+
+namespace modbus {
+
+// Modbus RTU server on a pseudo-terminal that answers requests from a
+// LoopbackServer's slaves. Clients open the terminal like a serial port.
+// Meant for tests, benchmarks and local simulation.
+class PtyServer {
+public:
+  // Constructor taking the slaves to serve, which must outlive the server.
+  explicit PtyServer(LoopbackServer *slaves);
+
+  ~PtyServer();
+
+  // Creates the pseudo-terminal and starts serving on it. Returns the path
+  // of the terminal to open.
+  absl::StatusOr<std::string> Start();
+
+  // Stops serving and closes the pseudo-terminal.
+  void Stop();
+
+  // Returns the number of requests received so far.
+  int requests_received() const { return requests_received_; }
+
+private:
+  void Serve();
+
+  LoopbackServer *slaves_;
+  int master_fd_ = -1;
+  // The terminal side, held open so that the master does not hang up while
+  // no client has it open.
+  int terminal_fd_ = -1;
+  int wake_fd_ = -1;
+  std::thread thread_;
+  std::atomic<int> requests_received_ = 0;
+};
+
+} // namespace modbus
+
+#endif // MODBUS_PTY_SERVER_H_
@@ -0,0 +1,217 @@
+#include "modbus_slave.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace modbus {
+
+namespace {
+
+// Reads a big-endian 16-bit value from 'data' at 'offset'.
+uint16_t ReadUint16(const std::vector<uint8_t> &data, size_t offset) {
+  return (data[offset] << 8) | data[offset + 1];
+}
+
+// Returns true if [address, address + quantity) lies within a table of
+// 'table_size' entries.
+bool InRange(uint16_t address, uint16_t quantity, size_t table_size) {
+  return static_cast<size_t>(address) + quantity <= table_size;
+}
+
+} // namespace
+
+std::vector<uint8_t> BuildExceptionResponse(FunctionCode function_code,
+                                            ExceptionCode exception_code) {
+  return {static_cast<uint8_t>(static_cast<uint8_t>(function_code) | 0x80),
+          static_cast<uint8_t>(exception_code)};
+}
+
+SlaveDevice::SlaveDevice(const RegisterMapParams &params)
+    : coils_(params.num_coils), discrete_inputs_(params.num_discrete_inputs),
+      holding_registers_(params.num_holding_registers),
+      input_registers_(params.num_input_registers) {}
+
+std::vector<uint8_t>
+SlaveDevice::HandleRequest(FunctionCode function_code,
+                           const std::vector<uint8_t> &request_data) {
+  switch (function_code) {
+  case FunctionCode::kReadCoils:
+    return ReadBits(function_code, coils_, request_data);
+  case FunctionCode::kReadDiscreteInputs:
+    return ReadBits(function_code, discrete_inputs_, request_data);
+  case FunctionCode::kReadHoldingRegisters:
+    return ReadRegisters(function_code, holding_registers_, request_data);
+  case FunctionCode::kReadInputRegisters:
+    return ReadRegisters(function_code, input_registers_, request_data);
+  case FunctionCode::kWriteSingleCoil:
+    return WriteSingleCoil(request_data);
+  case FunctionCode::kWriteSingleRegister:
+    return WriteSingleRegister(request_data);
+  case FunctionCode::kWriteMultipleCoils:
+    return WriteMultipleCoils(request_data);
+  case FunctionCode::kWriteMultipleRegisters:
+    return WriteMultipleRegisters(request_data);
+  default:
+    return BuildExceptionResponse(function_code,
+                                  ExceptionCode::kIllegalFunction);
+  }
+}
+
+std::vector<uint8_t>
+SlaveDevice::ReadBits(FunctionCode function_code,
+                      const std::vector<bool> &table,
+                      const std::vector<uint8_t> &request_data) {
+  if (request_data.size() != 4) {
+    return BuildExceptionResponse(function_code,
+                                  ExceptionCode::kIllegalDataValue);
+  }
+  uint16_t address = ReadUint16(request_data, 0);
+  uint16_t quantity = ReadUint16(request_data, 2);
+  if (quantity < 1 || quantity > 2000) {
+    return BuildExceptionResponse(function_code,
+                                  ExceptionCode::kIllegalDataValue);
+  }
+  if (!InRange(address, quantity, table.size())) {
+    return BuildExceptionResponse(function_code,
+                                  ExceptionCode::kIllegalDataAddress);
+  }
+
+  uint8_t byte_count = (quantity + 7) / 8;
+  std::vector<uint8_t> response(2 + byte_count, 0x00);
+  response[0] = static_cast<uint8_t>(function_code);
+  response[1] = byte_count;
+  for (size_t i = 0; i < quantity; ++i) {
+    if (table[address + i]) {
+      response[2 + i / 8] |= 1 << (i % 8);
+    }
+  }
+  return response;
+}
+
+std::vector<uint8_t>
+SlaveDevice::ReadRegisters(FunctionCode function_code,
+                           const std::vector<uint16_t> &table,
+                           const std::vector<uint8_t> &request_data) {
+  if (request_data.size() != 4) {
+    return BuildExceptionResponse(function_code,
+                                  ExceptionCode::kIllegalDataValue);
+  }
+  uint16_t address = ReadUint16(request_data, 0);
+  uint16_t quantity = ReadUint16(request_data, 2);
+  if (quantity < 1 || quantity > 125) {
+    return BuildExceptionResponse(function_code,
+                                  ExceptionCode::kIllegalDataValue);
+  }
+  if (!InRange(address, quantity, table.size())) {
+    return BuildExceptionResponse(function_code,
+                                  ExceptionCode::kIllegalDataAddress);
+  }
+
+  std::vector<uint8_t> response(2 + quantity * 2);
+  response[0] = static_cast<uint8_t>(function_code);
+  response[1] = static_cast<uint8_t>(quantity * 2);
+  for (size_t i = 0; i < quantity; ++i) {
+    response[2 + i * 2] = static_cast<uint8_t>(table[address + i] >> 8);
+    response[3 + i * 2] = static_cast<uint8_t>(table[address + i] & 0xFF);
+  }
+  return response;
+}
+
+std::vector<uint8_t>
+SlaveDevice::WriteSingleCoil(const std::vector<uint8_t> &request_data) {
+  FunctionCode function_code = FunctionCode::kWriteSingleCoil;
+  if (request_data.size() != 4) {
+    return BuildExceptionResponse(function_code,
+                                  ExceptionCode::kIllegalDataValue);
+  }
+  uint16_t address = ReadUint16(request_data, 0);
+  uint16_t value = ReadUint16(request_data, 2);
+  if (value != 0xFF00 && value != 0x0000) {
+    return BuildExceptionResponse(function_code,
+                                  ExceptionCode::kIllegalDataValue);
+  }
+  if (!InRange(address, 1, coils_.size())) {
+    return BuildExceptionResponse(function_code,
+                                  ExceptionCode::kIllegalDataAddress);
+  }
+
+  coils_[address] = value == 0xFF00;
+  std::vector<uint8_t> response = {static_cast<uint8_t>(function_code)};
+  response.insert(response.end(), request_data.begin(), request_data.end());
+  return response;
+}
+
+std::vector<uint8_t>
+SlaveDevice::WriteSingleRegister(const std::vector<uint8_t> &request_data) {
+  FunctionCode function_code = FunctionCode::kWriteSingleRegister;
+  if (request_data.size() != 4) {
+    return BuildExceptionResponse(function_code,
+                                  ExceptionCode::kIllegalDataValue);
+  }
+  uint16_t address = ReadUint16(request_data, 0);
+  if (!InRange(address, 1, holding_registers_.size())) {
+    return BuildExceptionResponse(function_code,
+                                  ExceptionCode::kIllegalDataAddress);
+  }
+
+  holding_registers_[address] = ReadUint16(request_data, 2);
+  std::vector<uint8_t> response = {static_cast<uint8_t>(function_code)};
+  response.insert(response.end(), request_data.begin(), request_data.end());
+  return response;
+}
+
+std::vector<uint8_t>
+SlaveDevice::WriteMultipleCoils(const std::vector<uint8_t> &request_data) {
+  FunctionCode function_code = FunctionCode::kWriteMultipleCoils;
+  if (request_data.size() < 5) {
+    return BuildExceptionResponse(function_code,
+                                  ExceptionCode::kIllegalDataValue);
+  }
+  uint16_t address = ReadUint16(request_data, 0);
+  uint16_t quantity = ReadUint16(request_data, 2);
+  uint8_t byte_count = request_data[4];
+  if (quantity < 1 || quantity > 1968 || byte_count != (quantity + 7) / 8 ||
+      request_data.size() != 5u + byte_count) {
+    return BuildExceptionResponse(function_code,
+                                  ExceptionCode::kIllegalDataValue);
+  }
+  if (!InRange(address, quantity, coils_.size())) {
+    return BuildExceptionResponse(function_code,
+                                  ExceptionCode::kIllegalDataAddress);
+  }
+
+  for (size_t i = 0; i < quantity; ++i) {
+    coils_[address + i] = (request_data[5 + i / 8] >> (i % 8)) & 0x01;
+  }
+  return {static_cast<uint8_t>(function_code), request_data[0],
+          request_data[1], request_data[2], request_data[3]};
+}
+
+std::vector<uint8_t>
+SlaveDevice::WriteMultipleRegisters(const std::vector<uint8_t> &request_data) {
+  FunctionCode function_code = FunctionCode::kWriteMultipleRegisters;
+  if (request_data.size() < 5) {
+    return BuildExceptionResponse(function_code,
+                                  ExceptionCode::kIllegalDataValue);
+  }
+  uint16_t address = ReadUint16(request_data, 0);
+  uint16_t quantity = ReadUint16(request_data, 2);
+  uint8_t byte_count = request_data[4];
+  if (quantity < 1 || quantity > 123 || byte_count != quantity * 2 ||
+      request_data.size() != 5u + byte_count) {
+    return BuildExceptionResponse(function_code,
+                                  ExceptionCode::kIllegalDataValue);
+  }
+  if (!InRange(address, quantity, holding_registers_.size())) {
+    return BuildExceptionResponse(function_code,
+                                  ExceptionCode::kIllegalDataAddress);
+  }
+
+  for (size_t i = 0; i < quantity; ++i) {
+    holding_registers_[address + i] = ReadUint16(request_data, 5 + i * 2);
+  }
+  return {static_cast<uint8_t>(function_code), request_data[0],
+          request_data[1], request_data[2], request_data[3]};
+}
+
+} // namespace modbus
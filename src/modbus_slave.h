@@ -0,0 +1,65 @@
+#ifndef MODBUS_SLAVE_H_
+#define MODBUS_SLAVE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "modbus_client.h"
+
+namespace modbus {
+
+// Struct representing the sizes of a Modbus slave's data tables.
+struct RegisterMapParams {
+  size_t num_coils;
+  size_t num_discrete_inputs;
+  size_t num_holding_registers;
+  size_t num_input_registers;
+};
+
+// Builds an exception response PDU for 'function_code'.
+std::vector<uint8_t> BuildExceptionResponse(FunctionCode function_code,
+                                            ExceptionCode exception_code);
+
+// In-memory Modbus slave that serves requests from its data tables.
+// Addresses are zero-based offsets into each table. Not thread-safe.
+class SlaveDevice {
+public:
+  explicit SlaveDevice(const RegisterMapParams &params);
+
+  // Handles a request and returns the response PDU, starting with the
+  // function code. Invalid requests are answered with exception responses.
+  std::vector<uint8_t> HandleRequest(FunctionCode function_code,
+                                     const std::vector<uint8_t> &request_data);
+
+  // Accessors for the data tables.
+  std::vector<bool> &coils() { return coils_; }
+  std::vector<bool> &discrete_inputs() { return discrete_inputs_; }
+  std::vector<uint16_t> &holding_registers() { return holding_registers_; }
+  std::vector<uint16_t> &input_registers() { return input_registers_; }
+
+private:
+  std::vector<uint8_t> ReadBits(FunctionCode function_code,
+                                const std::vector<bool> &table,
+                                const std::vector<uint8_t> &request_data);
+  std::vector<uint8_t> ReadRegisters(FunctionCode function_code,
+                                     const std::vector<uint16_t> &table,
+                                     const std::vector<uint8_t> &request_data);
+  std::vector<uint8_t>
+  WriteSingleCoil(const std::vector<uint8_t> &request_data);
+  std::vector<uint8_t>
+  WriteSingleRegister(const std::vector<uint8_t> &request_data);
+  std::vector<uint8_t>
+  WriteMultipleCoils(const std::vector<uint8_t> &request_data);
+  std::vector<uint8_t>
+  WriteMultipleRegisters(const std::vector<uint8_t> &request_data);
+
+  std::vector<bool> coils_;
+  std::vector<bool> discrete_inputs_;
+  std::vector<uint16_t> holding_registers_;
+  std::vector<uint16_t> input_registers_;
+};
+
+} // namespace modbus
+
+#endif // MODBUS_SLAVE_H_
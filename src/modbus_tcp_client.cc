@@ -1,16 +1,19 @@
 #include "modbus_tcp_client.h"
 
-#include <arpa/inet.h>
-#include <netdb.h>
-#include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <cassert>
+#include <cerrno>
 #include <cstring>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "mbap.h"
+#include "tcp_socket.h"
 
 namespace modbus {
 
@@ -24,34 +27,20 @@ absl::Status TcpClient::Connect() {
     return absl::FailedPreconditionError("Already connected to server.");
   }
 
-  // Create socket
-  sockfd_ = socket(AF_INET, SOCK_STREAM, 0);
-  if (sockfd_ < 0) {
-    return absl::InternalError("Failed to create socket.");
-  }
-
-  // Resolve hostname to IP address
-  struct hostent *server = gethostbyname(hostname_.c_str());
-  if (server == nullptr) {
-    close(sockfd_);
-    sockfd_ = -1;
-    return absl::InternalError("Failed to resolve hostname.");
+  auto sockfd = ConnectTcpSocket(hostname_, port_);
+  if (!sockfd.ok()) {
+    return sockfd.status();
   }
+  return Attach(sockfd.value());
+}
 
-  // Prepare server address structure
-  struct sockaddr_in serv_addr;
-  memset(&serv_addr, 0, sizeof(serv_addr));
-  serv_addr.sin_family = AF_INET;
-  memcpy(&serv_addr.sin_addr.s_addr, server->h_addr, server->h_length);
-  serv_addr.sin_port = htons(port_);
-
-  // Connect to server
-  if (connect(sockfd_, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-    close(sockfd_);
-    sockfd_ = -1;
-    return absl::InternalError("Failed to connect to server.");
+absl::Status TcpClient::Attach(int sockfd) {
+  if (sockfd_ >= 0) {
+    return absl::FailedPreconditionError("Already connected to server.");
   }
-
+  sockfd_ = sockfd;
+  receive_timeout_ms_ = -1;
+  receive_buffer_.Clear();
   return absl::OkStatus();
 }
 
@@ -66,73 +55,94 @@ absl::Status TcpClient::Disconnect() {
 absl::StatusOr<std::vector<uint8_t>>
 TcpClient::SendReceive(uint8_t slave_id, FunctionCode function_code,
                        const std::vector<uint8_t> &request_data) {
-  if (sockfd_ < 0) {
-    return absl::FailedPreconditionError("Not connected to server.");
+  // Build the MBAP header and function code on the stack and send them
+  // together with the request data in one sendmsg call, without copying the
+  // data into a frame first. Unlike RTU, no CRC is appended.
+  if (request_data.size() + 2 > kMaxMbapLength) {
+    return absl::InvalidArgumentError("Request too long.");
   }
+  uint16_t transaction_id = next_transaction_id_++;
+  uint8_t header[kMbapHeaderSize + 1];
+  EncodeMbapHeader({transaction_id, /*protocol_id=*/0x0000,
+                    static_cast<uint16_t>(request_data.size() + 2), slave_id},
+                   header);
+  header[kMbapHeaderSize] = static_cast<uint8_t>(function_code);
+  struct iovec iov[2] = {
+      {header, sizeof(header)},
+      {const_cast<uint8_t *>(request_data.data()), request_data.size()}};
+  return Exchange(slave_id, transaction_id, absl::MakeSpan(iov));
+}
 
-  // Set receive timeout
-  struct timeval tv;
-  tv.tv_sec = timeout_ms_ / 1000;
-  tv.tv_usec = (timeout_ms_ % 1000) * 1000;
-  if (setsockopt(sockfd_, SOL_SOCKET, SO_RCVTIMEO,
-                 reinterpret_cast<const char *>(&tv), sizeof(tv)) < 0) {
-    return absl::InternalError("Failed to set socket receive timeout.");
+absl::StatusOr<std::vector<uint8_t>>
+TcpClient::SendPrepared(const PreparedRequest &request) {
+  if (request.data().size() + 2 > kMaxMbapLength) {
+    return absl::InvalidArgumentError("Request too long.");
   }
+  // Send the prepared frame as it is, behind its own transaction ID.
+  const std::vector<uint8_t> &frame = request.mbap_frame();
+  uint16_t transaction_id = next_transaction_id_++;
+  uint8_t id[2] = {static_cast<uint8_t>(transaction_id >> 8),
+                   static_cast<uint8_t>(transaction_id & 0xFF)};
+  struct iovec iov[2] = {
+      {id, sizeof(id)},
+      {const_cast<uint8_t *>(frame.data()) + 2, frame.size() - 2}};
+  return Exchange(request.slave_id(), transaction_id, absl::MakeSpan(iov));
+}
 
-  // Build the Modbus TCP ADU.
-  std::vector<uint8_t> adu = BuildAdu(slave_id, function_code, request_data);
-
-  // Prepend the MBAP header (transaction ID, protocol ID, length).
-  // For simplicity, we'll use fixed values for transaction ID and protocol ID.
-  std::vector<uint8_t> tcp_adu = {
-      0x00,
-      0x01, // Transaction ID
-      0x00,
-      0x00, // Protocol ID
-      static_cast<uint8_t>(adu.size() + 2),
-      0x00,    // Length (PDU + unit ID)
-      slave_id // Unit ID
-  };
-  tcp_adu.insert(tcp_adu.end(), adu.begin(), adu.end());
+absl::StatusOr<std::vector<uint8_t>>
+TcpClient::Exchange(uint8_t slave_id, uint16_t transaction_id,
+                    absl::Span<struct iovec> iov) {
+  if (sockfd_ < 0) {
+    return absl::FailedPreconditionError("Not connected to server.");
+  }
 
-  // Send the request.
-  size_t total_sent = 0;
-  while (total_sent < tcp_adu.size()) {
-    ssize_t sent = send(sockfd_, tcp_adu.data() + total_sent,
-                        tcp_adu.size() - total_sent, 0);
-    if (sent < 0) {
-      return absl::InternalError("Failed to send data to server.");
+  // Set the receive timeout, sparing the system call when it is unchanged.
+  int timeout_ms = TimeoutFor(slave_id);
+  if (timeout_ms != receive_timeout_ms_) {
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    if (setsockopt(sockfd_, SOL_SOCKET, SO_RCVTIMEO,
+                   reinterpret_cast<const char *>(&tv), sizeof(tv)) < 0) {
+      return absl::InternalError("Failed to set socket receive timeout.");
     }
-    total_sent += sent;
+    receive_timeout_ms_ = timeout_ms;
   }
 
-  // Receive the response.
-  // First, receive the MBAP header (7 bytes).
-  uint8_t mbap_header[7];
-  ssize_t received = recv(sockfd_, mbap_header, 7, 0);
-  if (received != 7) {
-    return absl::InternalError("Failed to receive MBAP header.");
+  // Send the request.
+  absl::Time start = clock_->Now();
+  absl::Status status = SendVector(sockfd_, iov);
+  if (!status.ok()) {
+    return status;
   }
 
-  // Extract the PDU length from the header.
-  uint16_t pdu_length = (mbap_header[4] << 8) | mbap_header[5];
-
-  // Receive the remaining PDU data.
-  std::vector<uint8_t> response_pdu(pdu_length);
-  total_sent = 0;
-  while (total_sent < pdu_length) {
-    received = recv(sockfd_, response_pdu.data() + total_sent,
-                    pdu_length - total_sent, 0);
-    if (received < 0) {
-      return absl::InternalError("Failed to receive PDU data.");
+  // Receive until the response arrives, usually with a single recv call.
+  // Late responses to earlier requests that timed out are skipped.
+  while (true) {
+    MbapFrame frame;
+    auto has_frame = receive_buffer_.NextFrame(&frame);
+    if (!has_frame.ok()) {
+      // A corrupt stream cannot be resynchronized; make the caller reconnect.
+      Disconnect().IgnoreError();
+      return has_frame.status();
+    }
+    if (*has_frame) {
+      if (frame.header.transaction_id != transaction_id) {
+        continue;
+      }
+      RecordRoundTrip(slave_id, clock_->Now() - start);
+      return std::vector<uint8_t>(frame.pdu.begin(), frame.pdu.end());
     }
-    total_sent += received;
-  }
-
-  // Remove the unit ID from the response PDU.
-  response_pdu.erase(response_pdu.begin());
 
-  return response_pdu;
+    ssize_t received = receive_buffer_.Receive(sockfd_);
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      RecordTimeout(slave_id);
+      return absl::DeadlineExceededError("Timed out waiting for response.");
+    }
+    if (received <= 0) {
+      return absl::InternalError("Failed to receive response.");
+    }
+  }
 }
 
 } // namespace modbus
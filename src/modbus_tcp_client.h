@@ -1,12 +1,16 @@
 #ifndef MODBUS_TCP_CLIENT_H_
 #define MODBUS_TCP_CLIENT_H_
 
+#include <sys/uio.h>
+
 #include <cstdint>
 #include <string>
 #include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "mbap.h"
 #include "modbus_client.h"
 
 namespace modbus {
@@ -22,18 +26,44 @@ public:
   // Connects to the Modbus TCP server.
   absl::Status Connect();
 
+  // Takes ownership of 'sockfd', a blocking socket already connected to
+  // the server, e.g. one set up by a ConnectionPool.
+  absl::Status Attach(int sockfd);
+
   // Disconnects from the Modbus TCP server.
   absl::Status Disconnect();
 
+  // Returns true while connected to the server.
+  bool connected() const { return sockfd_ >= 0; }
+
   // Sends a Modbus request and receives the response.
   absl::StatusOr<std::vector<uint8_t>>
   SendReceive(uint8_t slave_id, FunctionCode function_code,
               const std::vector<uint8_t> &request_data) override;
 
+  // Sends a prepared request, patching in only the transaction ID.
+  absl::StatusOr<std::vector<uint8_t>>
+  SendPrepared(const PreparedRequest &request) override;
+
 private:
+  // Sends the frame in 'iov' and receives the response to
+  // 'transaction_id'.
+  absl::StatusOr<std::vector<uint8_t>>
+  Exchange(uint8_t slave_id, uint16_t transaction_id,
+           absl::Span<struct iovec> iov);
+
   // Socket handle.
   int sockfd_ = -1;
 
+  // Receive timeout currently set on the socket, or -1 if none.
+  int receive_timeout_ms_ = -1;
+
+  // Transaction ID of the next request.
+  uint16_t next_transaction_id_ = 0;
+
+  // Bytes received but not yet consumed as responses.
+  MbapReceiveBuffer receive_buffer_;
+
   // Server address information.
   std::string hostname_;
   int port_;
@@ -98,53 +98,75 @@ TcpClientWin::SendReceive(uint8_t slave_id, FunctionCode function_code,
     return absl::InternalError("Failed to set socket receive timeout.");
   }
 
-  // Build the Modbus TCP ADU (same as in TcpClient).
-  std::vector<uint8_t> adu = BuildAdu(slave_id, function_code, request_data);
-  std::vector<uint8_t> tcp_adu = {
-      0x00,
-      0x01, // Transaction ID
+  // Build the MBAP header and function code and send them together with the
+  // request data from separate buffers.
+  uint16_t transaction_id = next_transaction_id_++;
+  uint16_t length = static_cast<uint16_t>(request_data.size() + 2);
+  uint8_t header[8] = {
+      static_cast<uint8_t>(transaction_id >> 8),
+      static_cast<uint8_t>(transaction_id & 0xFF), // Transaction ID
       0x00,
       0x00, // Protocol ID
-      static_cast<uint8_t>(adu.size() + 2),
-      0x00,    // Length (PDU + unit ID)
-      slave_id // Unit ID
-  };
-  tcp_adu.insert(tcp_adu.end(), adu.begin(), adu.end());
-
-  // Send the request.
-  int total_sent = 0;
-  while (total_sent < tcp_adu.size()) {
-    int sent = send(sockfd_,
-                    reinterpret_cast<const char *>(tcp_adu.data() + total_sent),
-                    static_cast<int>(tcp_adu.size() - total_sent), 0);
-    if (sent == SOCKET_ERROR) {
-      return absl::InternalError("Failed to send data to server.");
-    }
-    total_sent += sent;
+      static_cast<uint8_t>(length >> 8),
+      static_cast<uint8_t>(length & 0xFF), // Length (PDU + unit ID)
+      slave_id,                            // Unit ID
+      static_cast<uint8_t>(function_code)};
+  WSABUF buffers[2];
+  buffers[0].buf = reinterpret_cast<char *>(header);
+  buffers[0].len = sizeof(header);
+  buffers[1].buf =
+      reinterpret_cast<char *>(const_cast<uint8_t *>(request_data.data()));
+  buffers[1].len = static_cast<ULONG>(request_data.size());
+
+  // Send the request. On a blocking socket WSASend returns once all buffers
+  // have been sent.
+  DWORD sent = 0;
+  if (WSASend(sockfd_, buffers, 2, &sent, 0, nullptr, nullptr) ==
+      SOCKET_ERROR) {
+    return absl::InternalError("Failed to send data to server.");
   }
 
-  // Receive the response (same as in TcpClient).
-  uint8_t mbap_header[7];
-  int received = recv(sockfd_, reinterpret_cast<char *>(mbap_header), 7, 0);
-  if (received != 7) {
-    return absl::InternalError("Failed to receive MBAP header.");
-  }
+  // Receive frames until the response arrives. Late responses to earlier
+  // requests that timed out are skipped.
+  while (true) {
+    uint8_t mbap_header[7];
+    absl::Status status = ReceiveAll(mbap_header, sizeof(mbap_header));
+    if (!status.ok()) {
+      return status;
+    }
+    uint16_t pdu_length = (mbap_header[4] << 8) | mbap_header[5];
+    if (mbap_header[2] != 0 || mbap_header[3] != 0 || pdu_length < 2) {
+      return absl::InternalError("Invalid MBAP header.");
+    }
 
-  uint16_t pdu_length = (mbap_header[4] << 8) | mbap_header[5];
-  std::vector<uint8_t> response_pdu(pdu_length);
-  total_sent = 0;
-  while (total_sent < pdu_length) {
-    received = recv(sockfd_,
-                    reinterpret_cast<char *>(response_pdu.data() + total_sent),
-                    static_cast<int>(pdu_length - total_sent), 0);
-    if (received == SOCKET_ERROR) {
-      return absl::InternalError("Failed to receive PDU data.");
+    // The length field counts the unit ID, already received with the
+    // header.
+    std::vector<uint8_t> response_pdu(pdu_length - 1);
+    status = ReceiveAll(response_pdu.data(), response_pdu.size());
+    if (!status.ok()) {
+      return status;
+    }
+    if (((mbap_header[0] << 8) | mbap_header[1]) == transaction_id) {
+      return response_pdu;
     }
-    total_sent += received;
   }
+}
 
-  response_pdu.erase(response_pdu.begin()); // Remove unit ID
-  return response_pdu;
+absl::Status TcpClientWin::ReceiveAll(uint8_t *buffer, size_t size) {
+  size_t total_received = 0;
+  while (total_received < size) {
+    int received = recv(sockfd_,
+                        reinterpret_cast<char *>(buffer + total_received),
+                        static_cast<int>(size - total_received), 0);
+    if (received == SOCKET_ERROR && WSAGetLastError() == WSAETIMEDOUT) {
+      return absl::DeadlineExceededError("Timed out waiting for response.");
+    }
+    if (received == SOCKET_ERROR || received == 0) {
+      return absl::InternalError("Failed to receive response.");
+    }
+    total_received += received;
+  }
+  return absl::OkStatus();
 }
 
 } // namespace modbus
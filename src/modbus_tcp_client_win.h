@@ -30,6 +30,10 @@ public:
               const std::vector<uint8_t> &request_data) override;
 
 private:
+  // Receives exactly 'size' bytes into 'buffer'. Fails if the connection
+  // closes or errs, or with DeadlineExceeded if the receive timeout expires.
+  absl::Status ReceiveAll(uint8_t *buffer, size_t size);
+
   // Socket handle.
   SOCKET sockfd_ = INVALID_SOCKET;
 
@@ -39,6 +43,9 @@ private:
 
   // Address info structure for the server.
   addrinfo *server_info_ = nullptr;
+
+  // Transaction ID of the next request.
+  uint16_t next_transaction_id_ = 1;
 };
 
 } // namespace modbus
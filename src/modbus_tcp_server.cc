@@ -0,0 +1,209 @@
+#include "modbus_tcp_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "mbap.h"
+#include "modbus_client.h"
+#include "rtu_framing.h"
+
+namespace modbus {
+
+namespace {
+
+// Writes all of 'out' to 'fd', giving up if the connection fails.
+void SendAll(int fd, const std::vector<uint8_t> &out) {
+  size_t sent = 0;
+  while (sent < out.size()) {
+    ssize_t n = send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      break;
+    }
+    sent += n;
+  }
+}
+
+} // namespace
+
+TcpServer::TcpServer(LoopbackServer *slaves, TcpFraming framing)
+    : slaves_(slaves), framing_(framing) {}
+
+TcpServer::~TcpServer() { Stop(); }
+
+absl::StatusOr<int> TcpServer::Start(int port) {
+  if (listen_fd_ >= 0) {
+    return absl::FailedPreconditionError("Server already started.");
+  }
+  listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd_ < 0) {
+    return absl::InternalError("Failed to create socket.");
+  }
+  int one = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  socklen_t addr_len = sizeof(addr);
+  if (bind(listen_fd_, reinterpret_cast<struct sockaddr *>(&addr),
+           sizeof(addr)) < 0 ||
+      listen(listen_fd_, SOMAXCONN) < 0 ||
+      getsockname(listen_fd_, reinterpret_cast<struct sockaddr *>(&addr),
+                  &addr_len) < 0) {
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return absl::InternalError("Failed to listen.");
+  }
+
+  accept_thread_ = std::thread([this] { AcceptLoop(); });
+  return ntohs(addr.sin_port);
+}
+
+void TcpServer::Stop() {
+  if (listen_fd_ < 0) {
+    return;
+  }
+  shutdown(listen_fd_, SHUT_RDWR);
+  accept_thread_.join();
+  close(listen_fd_);
+  listen_fd_ = -1;
+
+  std::vector<std::thread> threads;
+  {
+    absl::MutexLock lock(&mu_);
+    for (int fd : connection_fds_) {
+      shutdown(fd, SHUT_RDWR);
+    }
+    threads.swap(connection_threads_);
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+void TcpServer::AcceptLoop() {
+  while (true) {
+    int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0) {
+      return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    ++connections_accepted_;
+    absl::MutexLock lock(&mu_);
+    connection_fds_.push_back(fd);
+    connection_threads_.emplace_back([this, fd] { Serve(fd); });
+  }
+}
+
+void TcpServer::Serve(int fd) {
+  if (framing_ == TcpFraming::kRtu) {
+    ServeRtu(fd);
+  } else {
+    ServeMbap(fd);
+  }
+
+  absl::MutexLock lock(&mu_);
+  close(fd);
+  for (int &connection_fd : connection_fds_) {
+    if (connection_fd == fd) {
+      connection_fd = -1;
+    }
+  }
+}
+
+void TcpServer::ServeMbap(int fd) {
+  MbapReceiveBuffer buffer;
+  bool corrupt = false;
+  while (!corrupt) {
+    if (buffer.Receive(fd) <= 0) {
+      break;
+    }
+
+    // Answer every complete frame in the buffer with a single write.
+    std::vector<uint8_t> out;
+    MbapFrame frame;
+    while (true) {
+      auto has_frame = buffer.NextFrame(&frame);
+      if (!has_frame.ok()) {
+        corrupt = true; // Drop the connection after answering what came before.
+        break;
+      }
+      if (!*has_frame) {
+        break;
+      }
+      auto response = slaves_->HandleRequest(
+          frame.header.unit_id, static_cast<FunctionCode>(frame.pdu[0]),
+          std::vector<uint8_t>(frame.pdu.begin() + 1, frame.pdu.end()));
+      if (!response.ok()) {
+        continue; // Unknown slave: stay silent, like a gateway would not.
+      }
+      MbapHeader header = frame.header;
+      header.length = response.value().size() + 1;
+      size_t start = out.size();
+      out.resize(start + kMbapHeaderSize);
+      EncodeMbapHeader(header, out.data() + start);
+      out.insert(out.end(), response.value().begin(), response.value().end());
+    }
+    SendAll(fd, out);
+  }
+}
+
+void TcpServer::ServeRtu(int fd) {
+  std::vector<uint8_t> buffer;
+  uint8_t chunk[4096];
+  while (true) {
+    ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+    if (received <= 0) {
+      return;
+    }
+    buffer.insert(buffer.end(), chunk, chunk + received);
+
+    // Answer every complete frame in the buffer with a single write.
+    std::vector<uint8_t> out;
+    size_t offset = 0;
+    while (true) {
+      auto frame_size =
+          RtuRequestSize(buffer.data() + offset, buffer.size() - offset);
+      if (!frame_size.ok()) {
+        return; // Cannot find the next frame boundary.
+      }
+      if (*frame_size == 0 || buffer.size() - offset < *frame_size) {
+        break;
+      }
+      const uint8_t *frame = buffer.data() + offset;
+      offset += *frame_size;
+      uint16_t crc = (frame[*frame_size - 1] << 8) | frame[*frame_size - 2];
+      if (crc != CalculateCrc16(frame, *frame_size - 2)) {
+        continue; // Like a device on a serial line, ignore corrupt frames.
+      }
+      auto response = slaves_->HandleRequest(
+          frame[0], static_cast<FunctionCode>(frame[1]),
+          std::vector<uint8_t>(frame + 2, frame + *frame_size - 2));
+      if (!response.ok()) {
+        continue;
+      }
+      size_t start = out.size();
+      out.push_back(frame[0]);
+      out.insert(out.end(), response.value().begin(), response.value().end());
+      uint16_t response_crc = CalculateCrc16(out.data() + start,
+                                             out.size() - start);
+      out.push_back(static_cast<uint8_t>(response_crc & 0xFF));
+      out.push_back(static_cast<uint8_t>(response_crc >> 8));
+    }
+    buffer.erase(buffer.begin(), buffer.begin() + offset);
+    SendAll(fd, out);
+  }
+}
+
+} // namespace modbus
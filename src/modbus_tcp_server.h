@@ -0,0 +1,65 @@
+#ifndef MODBUS_TCP_SERVER_H_
+#define MODBUS_TCP_SERVER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "loopback_client.h"
+
+namespace modbus {
+
+// Enum class representing how Modbus frames are carried over TCP.
+enum class TcpFraming {
+  // Modbus TCP: MBAP header, no CRC.
+  kMbap,
+  // RTU frames with CRC, as sent by serial-to-Ethernet converters.
+  kRtu,
+};
+
+// Modbus TCP server that answers requests from a LoopbackServer's slaves.
+// Serves each connection on its own thread and answers pipelined requests
+// in order. Meant for tests, benchmarks and local simulation.
+class TcpServer {
+public:
+  // Constructor taking the slaves to serve, which must outlive the server,
+  // and the framing to speak.
+  explicit TcpServer(LoopbackServer *slaves,
+                     TcpFraming framing = TcpFraming::kMbap);
+
+  ~TcpServer();
+
+  // Starts listening on 127.0.0.1:'port', or on an ephemeral port if 'port'
+  // is 0. Returns the port.
+  absl::StatusOr<int> Start(int port = 0);
+
+  // Closes the listening socket and all connections.
+  void Stop();
+
+  // Returns the number of connections accepted so far.
+  int connections_accepted() const { return connections_accepted_; }
+
+private:
+  void AcceptLoop();
+  void Serve(int fd);
+  void ServeMbap(int fd);
+  void ServeRtu(int fd);
+
+  LoopbackServer *slaves_;
+  TcpFraming framing_;
+  int listen_fd_ = -1;
+  std::thread accept_thread_;
+  std::atomic<int> connections_accepted_ = 0;
+  absl::Mutex mu_;
+  std::vector<int> connection_fds_ ABSL_GUARDED_BY(mu_);
+  std::vector<std::thread> connection_threads_ ABSL_GUARDED_BY(mu_);
+};
+
+} // namespace modbus
+
+#endif // MODBUS_TCP_SERVER_H_
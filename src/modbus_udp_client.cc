@@ -0,0 +1,364 @@
+#include "modbus_udp_client.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "mbap.h"
+
+namespace modbus {
+
+namespace {
+
+// Largest Modbus UDP datagram: MBAP header and a 253 byte PDU.
+constexpr size_t kMaxDatagramSize = kMbapHeaderSize + kMaxMbapLength - 1;
+
+// Datagrams moved per sendmmsg or recvmmsg call.
+constexpr size_t kMessagesPerCall = 64;
+
+// Requests in flight at once; keeps transaction IDs of a batch unique.
+constexpr size_t kMaxInFlight = 32768;
+
+// Decodes the MBAP header of 'datagram' into 'header'. Returns false if the
+// datagram is not a well-formed Modbus UDP frame.
+bool ParseResponse(const uint8_t *datagram, size_t size, MbapHeader *header) {
+  if (size < kMbapHeaderSize + 1) {
+    return false;
+  }
+  *header = DecodeMbapHeader(datagram);
+  return header->protocol_id == 0 && header->length == size - 6;
+}
+
+} // namespace
+
+// --- UdpClient ---
+
+UdpClient::UdpClient(const std::string &hostname, int port, int timeout_ms)
+    : Client(timeout_ms), hostname_(hostname), port_(port) {}
+
+UdpClient::~UdpClient() { Disconnect().IgnoreError(); }
+
+absl::Status UdpClient::Connect() {
+  if (sockfd_ >= 0) {
+    return absl::FailedPreconditionError("Already connected to server.");
+  }
+  AddressCache resolver(absl::ZeroDuration());
+  auto addresses = resolver.Resolve(hostname_, port_);
+  if (!addresses.ok()) {
+    return addresses.status();
+  }
+  const SocketAddress &address = addresses.value().front();
+  sockfd_ = socket(address.storage.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (sockfd_ < 0) {
+    return absl::InternalError("Failed to create socket.");
+  }
+  // Connecting filters out datagrams from other senders.
+  if (connect(sockfd_,
+              reinterpret_cast<const struct sockaddr *>(&address.storage),
+              address.length) < 0) {
+    close(sockfd_);
+    sockfd_ = -1;
+    return absl::UnavailableError("Failed to connect to server.");
+  }
+  receive_timeout_ms_ = -1;
+  return absl::OkStatus();
+}
+
+absl::Status UdpClient::Disconnect() {
+  if (sockfd_ >= 0) {
+    close(sockfd_);
+    sockfd_ = -1;
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+UdpClient::SendReceive(uint8_t slave_id, FunctionCode function_code,
+                       const std::vector<uint8_t> &request_data) {
+  if (sockfd_ < 0) {
+    return absl::FailedPreconditionError("Not connected to server.");
+  }
+  if (request_data.size() + 2 > kMaxMbapLength) {
+    return absl::InvalidArgumentError("Request too long.");
+  }
+
+  // Set the receive timeout, sparing the system call when it is unchanged.
+  int timeout_ms = TimeoutFor(slave_id);
+  if (timeout_ms != receive_timeout_ms_) {
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    if (setsockopt(sockfd_, SOL_SOCKET, SO_RCVTIMEO,
+                   reinterpret_cast<const char *>(&tv), sizeof(tv)) < 0) {
+      return absl::InternalError("Failed to set socket receive timeout.");
+    }
+    receive_timeout_ms_ = timeout_ms;
+  }
+
+  // Send the header and the request data as one datagram.
+  uint16_t transaction_id = next_transaction_id_++;
+  uint8_t header[kMbapHeaderSize + 1];
+  EncodeMbapHeader({transaction_id, /*protocol_id=*/0x0000,
+                    static_cast<uint16_t>(request_data.size() + 2), slave_id},
+                   header);
+  header[kMbapHeaderSize] = static_cast<uint8_t>(function_code);
+  struct iovec iov[2] = {
+      {header, sizeof(header)},
+      {const_cast<uint8_t *>(request_data.data()), request_data.size()}};
+  absl::Time start = clock_->Now();
+  absl::Status status = SendVector(sockfd_, absl::MakeSpan(iov));
+  if (!status.ok()) {
+    return status;
+  }
+
+  uint8_t datagram[kMaxDatagramSize];
+  while (true) {
+    ssize_t received = recv(sockfd_, datagram, sizeof(datagram), 0);
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      RecordTimeout(slave_id);
+      return absl::DeadlineExceededError("Timed out waiting for response.");
+    }
+    if (received < 0 && errno == ECONNREFUSED) {
+      return absl::UnavailableError("Device unreachable.");
+    }
+    if (received < 0) {
+      return absl::InternalError("Failed to receive response.");
+    }
+    MbapHeader response;
+    if (!ParseResponse(datagram, received, &response) ||
+        response.transaction_id != transaction_id ||
+        response.unit_id != slave_id) {
+      continue;
+    }
+    RecordRoundTrip(slave_id, clock_->Now() - start);
+    return std::vector<uint8_t>(datagram + kMbapHeaderSize,
+                                datagram + received);
+  }
+}
+
+// --- UdpBatchTransport ---
+
+UdpBatchTransport::UdpBatchTransport()
+    : resolver_(absl::Minutes(5)), pending_(65536, 0),
+      receive_buffers_(kMessagesPerCall * kMaxDatagramSize) {}
+
+UdpBatchTransport::~UdpBatchTransport() {
+  if (sockfd_ >= 0) {
+    close(sockfd_);
+  }
+}
+
+absl::StatusOr<size_t> UdpBatchTransport::AddDevice(const std::string &hostname,
+                                                    int port) {
+  auto addresses = resolver_.Resolve(hostname, port);
+  if (!addresses.ok()) {
+    return addresses.status();
+  }
+  if (sockfd_ < 0) {
+    const SocketAddress &address = addresses.value().front();
+    sockfd_ = socket(address.storage.ss_family,
+                     SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd_ < 0) {
+      return absl::InternalError("Failed to create socket.");
+    }
+    // Responses to a whole batch arrive at once; make room for them.
+    int size = 4 << 20;
+    setsockopt(sockfd_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    devices_.push_back(address);
+    return devices_.size() - 1;
+  }
+  int family = devices_.front().storage.ss_family;
+  for (const SocketAddress &address : addresses.value()) {
+    if (address.storage.ss_family == family) {
+      devices_.push_back(address);
+      return devices_.size() - 1;
+    }
+  }
+  return absl::InvalidArgumentError("No address of the socket's family.");
+}
+
+std::vector<absl::StatusOr<std::vector<uint8_t>>>
+UdpBatchTransport::Transact(const std::vector<UdpBatchRequest> &requests,
+                            int timeout_ms) {
+  std::vector<absl::StatusOr<std::vector<uint8_t>>> results(
+      requests.size(), absl::UnknownError("No response."));
+  results_ = &results;
+  absl::Time deadline = absl::Now() + absl::Milliseconds(timeout_ms);
+
+  // Serialize all frames into one buffer, then point a message at each.
+  std::vector<uint8_t> frames;
+  std::vector<size_t> offsets;
+  std::vector<uint16_t> transaction_ids(requests.size());
+  for (size_t i = 0; i < requests.size(); ++i) {
+    const UdpBatchRequest &request = requests[i];
+    offsets.push_back(frames.size());
+    if (request.device >= devices_.size()) {
+      results[i] = absl::InvalidArgumentError("Unknown device.");
+      continue;
+    }
+    if (request.data.size() + 2 > kMaxMbapLength) {
+      results[i] = absl::InvalidArgumentError("Request too long.");
+      continue;
+    }
+    transaction_ids[i] = next_transaction_id_++;
+    size_t start = frames.size();
+    frames.resize(start + kMbapHeaderSize);
+    EncodeMbapHeader({transaction_ids[i], 0,
+                      static_cast<uint16_t>(request.data.size() + 2),
+                      request.slave_id},
+                     frames.data() + start);
+    frames.push_back(static_cast<uint8_t>(request.function_code));
+    frames.insert(frames.end(), request.data.begin(), request.data.end());
+  }
+  offsets.push_back(frames.size());
+
+  std::vector<struct iovec> iov;
+  std::vector<struct mmsghdr> messages;
+  std::vector<size_t> indices;
+  size_t next = 0;
+  while (next < requests.size() || outstanding_ > 0) {
+    // Queue the next requests, keeping their transaction IDs unique.
+    iov.clear();
+    messages.clear();
+    indices.clear();
+    for (; next < requests.size() && outstanding_ < kMaxInFlight; ++next) {
+      if (offsets[next] == offsets[next + 1]) {
+        continue; // Rejected above.
+      }
+      iov.push_back({frames.data() + offsets[next],
+                     offsets[next + 1] - offsets[next]});
+      indices.push_back(next);
+      pending_[transaction_ids[next]] = next + 1;
+      ++outstanding_;
+    }
+    for (size_t i = 0; i < iov.size(); ++i) {
+      SocketAddress &device = devices_[requests[indices[i]].device];
+      struct mmsghdr message = {};
+      message.msg_hdr.msg_name = &device.storage;
+      message.msg_hdr.msg_namelen = device.length;
+      message.msg_hdr.msg_iov = &iov[i];
+      message.msg_hdr.msg_iovlen = 1;
+      messages.push_back(message);
+    }
+
+    // Send, draining responses while the socket buffer is full.
+    for (size_t sent = 0; sent < messages.size();) {
+      int count = sendmmsg(sockfd_, messages.data() + sent,
+                           std::min(messages.size() - sent, kMessagesPerCall),
+                           0);
+      if (count > 0) {
+        sent += count;
+        continue;
+      }
+      if (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        // The first message of the call failed; give up on it alone.
+        size_t index = indices[sent++];
+        results[index] = absl::UnavailableError("Failed to send request.");
+        pending_[transaction_ids[index]] = 0;
+        --outstanding_;
+        continue;
+      }
+      struct pollfd fd = {sockfd_, POLLIN | POLLOUT, 0};
+      poll(&fd, 1, 1);
+      ReceiveResponses(requests);
+    }
+
+    // Collect responses until this wave is answered or time runs out.
+    while (outstanding_ > 0 &&
+           (next == requests.size() || outstanding_ >= kMaxInFlight)) {
+      ReceiveResponses(requests);
+      if (outstanding_ == 0) {
+        break;
+      }
+      int wait_ms = static_cast<int>(absl::ToInt64Milliseconds(
+          absl::Ceil(deadline - absl::Now(), absl::Milliseconds(1))));
+      if (wait_ms <= 0) {
+        break;
+      }
+      struct pollfd fd = {sockfd_, POLLIN, 0};
+      poll(&fd, 1, wait_ms);
+    }
+    if (absl::Now() >= deadline) {
+      break;
+    }
+  }
+
+  // Whatever is still pending timed out. Forgetting the transaction IDs
+  // makes late responses to them be discarded.
+  for (size_t i = 0; i < requests.size(); ++i) {
+    uint32_t &slot = pending_[transaction_ids[i]];
+    if (slot == i + 1) {
+      results[i] =
+          absl::DeadlineExceededError("Timed out waiting for response.");
+      slot = 0;
+    }
+  }
+  for (size_t i = next; i < requests.size(); ++i) {
+    if (offsets[i] != offsets[i + 1]) {
+      results[i] =
+          absl::DeadlineExceededError("Timed out waiting to send request.");
+    }
+  }
+  outstanding_ = 0;
+  results_ = nullptr;
+  return results;
+}
+
+void UdpBatchTransport::ReceiveResponses(
+    const std::vector<UdpBatchRequest> &requests) {
+  struct iovec iov[kMessagesPerCall];
+  struct mmsghdr messages[kMessagesPerCall];
+  struct sockaddr_storage sources[kMessagesPerCall];
+  while (outstanding_ > 0) {
+    for (size_t i = 0; i < kMessagesPerCall; ++i) {
+      iov[i] = {receive_buffers_.data() + i * kMaxDatagramSize,
+                kMaxDatagramSize};
+      messages[i] = {};
+      messages[i].msg_hdr.msg_name = &sources[i];
+      messages[i].msg_hdr.msg_namelen = sizeof(sources[i]);
+      messages[i].msg_hdr.msg_iov = &iov[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    int count = recvmmsg(sockfd_, messages, kMessagesPerCall, 0, nullptr);
+    if (count <= 0) {
+      return;
+    }
+    for (int i = 0; i < count; ++i) {
+      const uint8_t *datagram = static_cast<uint8_t *>(iov[i].iov_base);
+      MbapHeader header;
+      if (!ParseResponse(datagram, messages[i].msg_len, &header)) {
+        continue;
+      }
+      uint32_t &slot = pending_[header.transaction_id];
+      if (slot == 0) {
+        continue;
+      }
+      const UdpBatchRequest &request = requests[slot - 1];
+      const SocketAddress &device = devices_[request.device];
+      if (header.unit_id != request.slave_id ||
+          messages[i].msg_hdr.msg_namelen != device.length ||
+          memcmp(&sources[i], &device.storage, device.length) != 0) {
+        continue;
+      }
+      (*results_)[slot - 1] = std::vector<uint8_t>(
+          datagram + kMbapHeaderSize, datagram + messages[i].msg_len);
+      slot = 0;
+      --outstanding_;
+    }
+    if (static_cast<size_t>(count) < kMessagesPerCall) {
+      return;
+    }
+  }
+}
+
+} // namespace modbus
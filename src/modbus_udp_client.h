@@ -0,0 +1,110 @@
+#ifndef MODBUS_UDP_CLIENT_H_
+#define MODBUS_UDP_CLIENT_H_
+
+#include <sys/socket.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "modbus_client.h"
+#include "tcp_socket.h"
+
+namespace modbus {
+
+// Modbus client sending MBAP frames as UDP datagrams, one request and one
+// response per datagram. There is no connection to set up or lose, and a
+// lost datagram only costs its own request a timeout.
+class UdpClient : public Client {
+public:
+  // Constructor taking the hostname, port, and timeout in milliseconds.
+  UdpClient(const std::string &hostname, int port, int timeout_ms);
+
+  ~UdpClient() override;
+
+  // Resolves the device address and opens the socket.
+  absl::Status Connect();
+
+  // Closes the socket.
+  absl::Status Disconnect();
+
+  // Sends a Modbus request and receives the response. Datagrams that do not
+  // answer this request, e.g. late responses, are discarded.
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t slave_id, FunctionCode function_code,
+              const std::vector<uint8_t> &request_data) override;
+
+private:
+  // Socket handle, connected to the device.
+  int sockfd_ = -1;
+
+  // Receive timeout currently set on the socket, or -1 if none.
+  int receive_timeout_ms_ = -1;
+
+  // Transaction ID of the next request.
+  uint16_t next_transaction_id_ = 0;
+
+  // Device address information.
+  std::string hostname_;
+  int port_;
+};
+
+// Struct representing one request of a UDP batch.
+struct UdpBatchRequest {
+  // Index of the device, as returned by AddDevice.
+  size_t device;
+  uint8_t slave_id;
+  FunctionCode function_code;
+  std::vector<uint8_t> data;
+};
+
+// Modbus UDP transport that polls many devices from one socket. Each
+// Transact call sends a whole batch of requests with sendmmsg and collects
+// the responses with recvmmsg, so hundreds of devices cost a handful of
+// system calls and no per-device connection state. Responses are matched
+// to requests by transaction ID and source address. Not thread-safe.
+class UdpBatchTransport {
+public:
+  UdpBatchTransport();
+  ~UdpBatchTransport();
+
+  UdpBatchTransport(const UdpBatchTransport &) = delete;
+  UdpBatchTransport &operator=(const UdpBatchTransport &) = delete;
+
+  // Resolves a device and returns its index. All devices must share an
+  // address family.
+  absl::StatusOr<size_t> AddDevice(const std::string &hostname, int port);
+
+  // Sends 'requests' and waits up to 'timeout_ms' for their responses.
+  // Returns the response PDU of each request, in the order of 'requests'.
+  // Requests that are not answered in time fail with kDeadlineExceeded.
+  std::vector<absl::StatusOr<std::vector<uint8_t>>>
+  Transact(const std::vector<UdpBatchRequest> &requests, int timeout_ms);
+
+  // Returns the number of devices.
+  size_t size() const { return devices_.size(); }
+
+private:
+  // Receives and dispatches the responses waiting on the socket.
+  void ReceiveResponses(const std::vector<UdpBatchRequest> &requests);
+
+  int sockfd_ = -1;
+  AddressCache resolver_;
+  std::vector<SocketAddress> devices_;
+  uint16_t next_transaction_id_ = 0;
+
+  // Index + 1 of the request awaiting each transaction ID, or 0.
+  std::vector<uint32_t> pending_;
+  size_t outstanding_ = 0;
+  std::vector<absl::StatusOr<std::vector<uint8_t>>> *results_ = nullptr;
+
+  // Receive buffers for one recvmmsg call.
+  std::vector<uint8_t> receive_buffers_;
+};
+
+} // namespace modbus
+
+#endif // MODBUS_UDP_CLIENT_H_
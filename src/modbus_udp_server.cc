@@ -0,0 +1,142 @@
+#include "modbus_udp_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "mbap.h"
+#include "modbus_client.h"
+
+namespace modbus {
+
+namespace {
+
+// Largest Modbus UDP datagram: MBAP header and a 253 byte PDU.
+constexpr size_t kMaxDatagramSize = kMbapHeaderSize + kMaxMbapLength - 1;
+
+// Datagrams moved per recvmmsg or sendmmsg call.
+constexpr int kMessagesPerCall = 64;
+
+} // namespace
+
+UdpServer::UdpServer(LoopbackServer *slaves) : slaves_(slaves) {}
+
+UdpServer::~UdpServer() { Stop(); }
+
+absl::StatusOr<int> UdpServer::Start(int port) {
+  if (sockfd_ >= 0) {
+    return absl::FailedPreconditionError("Server already started.");
+  }
+  sockfd_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (sockfd_ < 0) {
+    return absl::InternalError("Failed to create socket.");
+  }
+  int size = 4 << 20;
+  setsockopt(sockfd_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  socklen_t addr_len = sizeof(addr);
+  if (bind(sockfd_, reinterpret_cast<struct sockaddr *>(&addr),
+           sizeof(addr)) < 0 ||
+      getsockname(sockfd_, reinterpret_cast<struct sockaddr *>(&addr),
+                  &addr_len) < 0) {
+    close(sockfd_);
+    sockfd_ = -1;
+    return absl::InternalError("Failed to bind.");
+  }
+
+  stop_ = false;
+  thread_ = std::thread([this] { Serve(); });
+  return ntohs(addr.sin_port);
+}
+
+void UdpServer::Stop() {
+  if (sockfd_ < 0) {
+    return;
+  }
+  // Wakes up the blocked recvmmsg, which then reports empty datagrams.
+  stop_ = true;
+  shutdown(sockfd_, SHUT_RDWR);
+  thread_.join();
+  close(sockfd_);
+  sockfd_ = -1;
+}
+
+void UdpServer::Serve() {
+  std::vector<uint8_t> in(kMessagesPerCall * kMaxDatagramSize);
+  std::vector<uint8_t> out(kMessagesPerCall * kMaxDatagramSize);
+  struct sockaddr_in sources[kMessagesPerCall];
+  struct iovec in_iov[kMessagesPerCall];
+  struct iovec out_iov[kMessagesPerCall];
+  struct mmsghdr requests[kMessagesPerCall];
+  struct mmsghdr responses[kMessagesPerCall];
+  while (true) {
+    for (int i = 0; i < kMessagesPerCall; ++i) {
+      in_iov[i] = {in.data() + i * kMaxDatagramSize, kMaxDatagramSize};
+      requests[i] = {};
+      requests[i].msg_hdr.msg_name = &sources[i];
+      requests[i].msg_hdr.msg_namelen = sizeof(sources[i]);
+      requests[i].msg_hdr.msg_iov = &in_iov[i];
+      requests[i].msg_hdr.msg_iovlen = 1;
+    }
+    int count = recvmmsg(sockfd_, requests, kMessagesPerCall, MSG_WAITFORONE,
+                         nullptr);
+    if (count <= 0 || stop_) {
+      return;
+    }
+    requests_received_ += count;
+
+    // Answer the whole batch with one sendmmsg call.
+    int answered = 0;
+    for (int i = 0; i < count; ++i) {
+      const uint8_t *datagram = static_cast<uint8_t *>(in_iov[i].iov_base);
+      size_t size = requests[i].msg_len;
+      if (size < kMbapHeaderSize + 1) {
+        continue;
+      }
+      MbapHeader header = DecodeMbapHeader(datagram);
+      if (header.protocol_id != 0 || header.length != size - 6) {
+        continue;
+      }
+      auto response = slaves_->HandleRequest(
+          header.unit_id, static_cast<FunctionCode>(datagram[kMbapHeaderSize]),
+          std::vector<uint8_t>(datagram + kMbapHeaderSize + 1,
+                               datagram + size));
+      if (!response.ok()) {
+        continue; // Unknown slave: stay silent.
+      }
+      uint8_t *frame = out.data() + answered * kMaxDatagramSize;
+      header.length = response.value().size() + 1;
+      EncodeMbapHeader(header, frame);
+      std::copy(response.value().begin(), response.value().end(),
+                frame + kMbapHeaderSize);
+      out_iov[answered] = {frame, kMbapHeaderSize + response.value().size()};
+      responses[answered] = {};
+      responses[answered].msg_hdr.msg_name = &sources[i];
+      responses[answered].msg_hdr.msg_namelen = requests[i].msg_hdr.msg_namelen;
+      responses[answered].msg_hdr.msg_iov = &out_iov[answered];
+      responses[answered].msg_hdr.msg_iovlen = 1;
+      ++answered;
+    }
+    for (int sent = 0; sent < answered;) {
+      int n = sendmmsg(sockfd_, responses + sent, answered - sent, 0);
+      if (n <= 0) {
+        break;
+      }
+      sent += n;
+    }
+  }
+}
+
+} // namespace modbus
@@ -0,0 +1,44 @@
+#ifndef MODBUS_UDP_SERVER_H_
+#define MODBUS_UDP_SERVER_H_
+
+#include <atomic>
+#include <thread>
+
+#include "absl/status/statusor.h"
+#include "loopback_client.h"
+
+namespace modbus {
+
+// Modbus UDP server that answers requests from a LoopbackServer's slaves.
+// Receives and answers datagrams in batches on a single thread. Meant for
+// tests, benchmarks and local simulation.
+class UdpServer {
+public:
+  // Constructor taking the slaves to serve, which must outlive the server.
+  explicit UdpServer(LoopbackServer *slaves);
+
+  ~UdpServer();
+
+  // Starts listening on 127.0.0.1:'port', or on an ephemeral port if 'port'
+  // is 0. Returns the port.
+  absl::StatusOr<int> Start(int port = 0);
+
+  // Closes the socket.
+  void Stop();
+
+  // Returns the number of requests received so far.
+  int requests_received() const { return requests_received_; }
+
+private:
+  void Serve();
+
+  LoopbackServer *slaves_;
+  int sockfd_ = -1;
+  std::thread thread_;
+  std::atomic<bool> stop_ = false;
+  std::atomic<int> requests_received_ = 0;
+};
+
+} // namespace modbus
+
+#endif // MODBUS_UDP_SERVER_H_
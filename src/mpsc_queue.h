@@ -0,0 +1,70 @@
+#ifndef MPSC_QUEUE_H_
+#define MPSC_QUEUE_H_
+
+#include <atomic>
+
+namespace modbus {
+
+// Intrusive lock-free multi-producer single-consumer queue (Vyukov). 'T'
+// must have a member 'std::atomic<T *> next'. Push is wait-free and may be
+// called from any thread; Pop must only be called from the consumer thread.
+// Nodes are owned by the caller and must stay alive until popped.
+template <typename T> class MpscQueue {
+public:
+  MpscQueue() : head_(&stub_), tail_(&stub_) { stub_.next = nullptr; }
+
+  MpscQueue(const MpscQueue &) = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  // Appends 'node' to the queue.
+  void Push(T *node) {
+    node->next.store(nullptr, std::memory_order_relaxed);
+    T *prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  // Removes and returns the oldest node, or nullptr if the queue is empty or
+  // a concurrent Push has not completed yet.
+  T *Pop() {
+    T *tail = tail_;
+    T *next = tail->next.load(std::memory_order_acquire);
+    if (tail == &stub_) {
+      if (next == nullptr) {
+        return nullptr;
+      }
+      tail_ = next;
+      tail = next;
+      next = next->next.load(std::memory_order_acquire);
+    }
+    if (next != nullptr) {
+      tail_ = next;
+      return tail;
+    }
+    if (tail != head_.load(std::memory_order_acquire)) {
+      return nullptr; // A producer is between exchange and link.
+    }
+    Push(&stub_);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next != nullptr) {
+      tail_ = next;
+      return tail;
+    }
+    return nullptr;
+  }
+
+  // Returns true if no node is queued. Only exact on the consumer thread.
+  bool Empty() const {
+    T *tail = tail_;
+    return tail == &stub_ &&
+           tail->next.load(std::memory_order_acquire) == nullptr;
+  }
+
+private:
+  std::atomic<T *> head_;
+  T *tail_;
+  T stub_;
+};
+
+} // namespace modbus
+
+#endif // MPSC_QUEUE_H_
@@ -0,0 +1,325 @@
+#include "multiplexed_tcp_client.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "mbap.h"
+#include "tcp_socket.h"
+
+namespace modbus {
+
+MultiplexedTcpClient::MultiplexedTcpClient(const std::string &hostname,
+                                           int port, int timeout_ms,
+                                           int max_in_flight)
+    : Client(timeout_ms), hostname_(hostname), port_(port),
+      max_in_flight_(std::max(1, max_in_flight)) {}
+
+MultiplexedTcpClient::~MultiplexedTcpClient() { Disconnect().IgnoreError(); }
+
+absl::Status MultiplexedTcpClient::Connect() {
+  absl::MutexLock lock(&mu_);
+  if (connected_) {
+    if (!failed_) {
+      return absl::FailedPreconditionError("Already connected to server.");
+    }
+    // The I/O thread only fails requests until it is replaced.
+    StopIoThread();
+  }
+
+  auto sockfd = ConnectTcpSocket(hostname_, port_);
+  if (!sockfd.ok()) {
+    return sockfd.status();
+  }
+  sockfd_ = sockfd.value();
+  fcntl(sockfd_, F_SETFL, fcntl(sockfd_, F_GETFL) | O_NONBLOCK);
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd_ < 0) {
+    close(sockfd_);
+    sockfd_ = -1;
+    return absl::InternalError("Failed to create eventfd.");
+  }
+
+  stop_ = false;
+  sleeping_ = false;
+  failed_ = false;
+  io_thread_ = std::thread([this] { IoLoop(); });
+  connected_ = true;
+  return absl::OkStatus();
+}
+
+absl::Status MultiplexedTcpClient::Disconnect() {
+  // Taking the lock exclusively waits out callers that are enqueueing.
+  absl::MutexLock lock(&mu_);
+  if (connected_) {
+    StopIoThread();
+  }
+  return absl::OkStatus();
+}
+
+void MultiplexedTcpClient::StopIoThread() {
+  connected_ = false;
+  stop_ = true;
+  sleeping_ = true;
+  Wake();
+  io_thread_.join();
+  close(wake_fd_);
+  wake_fd_ = -1;
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+MultiplexedTcpClient::SendReceive(uint8_t slave_id, FunctionCode function_code,
+                                  const std::vector<uint8_t> &request_data) {
+  if (request_data.size() + 2 > kMaxMbapLength) {
+    return absl::InvalidArgumentError("Request too long.");
+  }
+
+  Request request;
+  request.slave_id = slave_id;
+  request.frame.resize(kMbapHeaderSize);
+  EncodeMbapHeader({0, 0, static_cast<uint16_t>(request_data.size() + 2),
+                    slave_id},
+                   request.frame.data());
+  request.frame.push_back(static_cast<uint8_t>(function_code));
+  request.frame.insert(request.frame.end(), request_data.begin(),
+                       request_data.end());
+  request.deadline =
+      absl::Now() + absl::Milliseconds(SynchronizedTimeoutFor(slave_id));
+
+  {
+    absl::ReaderMutexLock lock(&mu_);
+    if (!connected_) {
+      return absl::FailedPreconditionError("Not connected to server.");
+    }
+    queue_.Push(&request);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_.load(std::memory_order_relaxed)) {
+      Wake();
+    }
+  }
+
+  request.done.WaitForNotification();
+  return std::move(request.response);
+}
+
+void MultiplexedTcpClient::Wake() {
+  if (sleeping_.exchange(false)) {
+    uint64_t one = 1;
+    write(wake_fd_, &one, sizeof(one));
+  }
+}
+
+int MultiplexedTcpClient::SynchronizedTimeoutFor(uint8_t slave_id) {
+  absl::MutexLock lock(&rtt_mu_);
+  return TimeoutFor(slave_id);
+}
+
+void MultiplexedTcpClient::SynchronizedRecordRoundTrip(uint8_t slave_id,
+                                                       absl::Duration rtt) {
+  absl::MutexLock lock(&rtt_mu_);
+  RecordRoundTrip(slave_id, rtt);
+}
+
+void MultiplexedTcpClient::SynchronizedRecordTimeout(uint8_t slave_id) {
+  absl::MutexLock lock(&rtt_mu_);
+  RecordTimeout(slave_id);
+}
+
+void MultiplexedTcpClient::IoLoop() {
+  // Requests dequeued but not yet written because 'max_in_flight_' requests
+  // are already outstanding.
+  std::deque<Request *> pending;
+  std::unordered_map<uint16_t, Request *> in_flight;
+  std::vector<uint8_t> out;
+  size_t out_offset = 0;
+  MbapReceiveBuffer in;
+  uint16_t next_transaction_id = 0;
+  absl::Status connection_status = absl::OkStatus();
+
+  auto complete = [](Request *request,
+                     absl::StatusOr<std::vector<uint8_t>> response) {
+    request->response = std::move(response);
+    request->done.Notify();
+  };
+
+  auto fail_connection = [&](absl::Status status) {
+    connection_status = status;
+    failed_ = true;
+    shutdown(sockfd_, SHUT_RDWR);
+    for (auto &[transaction_id, request] : in_flight) {
+      complete(request, status);
+    }
+    in_flight.clear();
+    out.clear();
+    out_offset = 0;
+  };
+
+  while (true) {
+    while (Request *request = queue_.Pop()) {
+      pending.push_back(request);
+    }
+    if (stop_) {
+      break;
+    }
+
+    if (!connection_status.ok()) {
+      for (Request *request : pending) {
+        complete(request, connection_status);
+      }
+      pending.clear();
+    }
+
+    // Admit pending requests up to the in-flight limit.
+    absl::Time now = absl::Now();
+    while (!pending.empty() && in_flight.size() < max_in_flight_) {
+      Request *request = pending.front();
+      pending.pop_front();
+      while (in_flight.count(next_transaction_id) != 0) {
+        ++next_transaction_id;
+      }
+      uint16_t transaction_id = next_transaction_id++;
+      request->frame[0] = transaction_id >> 8;
+      request->frame[1] = transaction_id & 0xFF;
+      request->sent = clock_->Now();
+      in_flight[transaction_id] = request;
+      out.insert(out.end(), request->frame.begin(), request->frame.end());
+    }
+
+    // Write out as much as the socket takes.
+    while (out_offset < out.size()) {
+      ssize_t sent = send(sockfd_, out.data() + out_offset,
+                          out.size() - out_offset, MSG_NOSIGNAL);
+      if (sent < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          fail_connection(absl::UnavailableError("Failed to send request."));
+        }
+        break;
+      }
+      out_offset += sent;
+    }
+    if (out_offset == out.size()) {
+      out.clear();
+      out_offset = 0;
+    }
+
+    // Expire requests whose deadline has passed. A late response to one of
+    // them finds no matching transaction ID and is discarded.
+    absl::Time next_deadline = absl::InfiniteFuture();
+    for (auto it = in_flight.begin(); it != in_flight.end();) {
+      Request *request = it->second;
+      if (request->deadline <= now) {
+        SynchronizedRecordTimeout(request->slave_id);
+        complete(request, absl::DeadlineExceededError(
+                              "Timed out waiting for response."));
+        it = in_flight.erase(it);
+      } else {
+        next_deadline = std::min(next_deadline, request->deadline);
+        ++it;
+      }
+    }
+    for (auto it = pending.begin(); it != pending.end();) {
+      if ((*it)->deadline <= now) {
+        complete(*it, absl::DeadlineExceededError(
+                          "Timed out waiting to send request."));
+        it = pending.erase(it);
+      } else {
+        next_deadline = std::min(next_deadline, (*it)->deadline);
+        ++it;
+      }
+    }
+
+    // Sleep until the socket or a caller needs attention.
+    sleeping_ = true;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int timeout_ms = -1;
+    if (!queue_.Empty() || stop_) {
+      timeout_ms = 0;
+    } else if (next_deadline != absl::InfiniteFuture()) {
+      timeout_ms = static_cast<int>(absl::ToInt64Milliseconds(
+          absl::Ceil(next_deadline - absl::Now(), absl::Milliseconds(1))));
+      timeout_ms = std::max(timeout_ms, 0);
+    }
+    struct pollfd fds[2] = {};
+    fds[0].fd = wake_fd_;
+    fds[0].events = POLLIN;
+    fds[1].fd = connection_status.ok() ? sockfd_ : -1;
+    fds[1].events = POLLIN | (out.empty() ? 0 : POLLOUT);
+    poll(fds, 2, timeout_ms);
+    sleeping_ = false;
+    if (fds[0].revents & POLLIN) {
+      uint64_t count;
+      read(wake_fd_, &count, sizeof(count));
+    }
+    if (!(fds[1].revents & (POLLIN | POLLERR | POLLHUP))) {
+      continue;
+    }
+
+    // Read everything available and dispatch complete frames.
+    while (connection_status.ok()) {
+      ssize_t received = in.Receive(sockfd_);
+      if (received <= 0) {
+        if (received == 0) {
+          fail_connection(absl::UnavailableError("Connection closed."));
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          fail_connection(absl::UnavailableError("Failed to receive."));
+        }
+        break;
+      }
+
+      MbapFrame frame;
+      while (true) {
+        auto has_frame = in.NextFrame(&frame);
+        if (!has_frame.ok()) {
+          fail_connection(has_frame.status());
+          break;
+        }
+        if (!*has_frame) {
+          break;
+        }
+        auto it = in_flight.find(frame.header.transaction_id);
+        if (it == in_flight.end()) {
+          continue;
+        }
+        Request *request = it->second;
+        uint8_t function_code = request->frame[kMbapHeaderSize];
+        if (frame.header.unit_id != request->slave_id ||
+            (frame.pdu[0] & 0x7F) != function_code) {
+          continue;
+        }
+        in_flight.erase(it);
+        SynchronizedRecordRoundTrip(request->slave_id,
+                                    clock_->Now() - request->sent);
+        complete(request,
+                 std::vector<uint8_t>(frame.pdu.begin(), frame.pdu.end()));
+      }
+    }
+    if (!connection_status.ok()) {
+      in.Clear();
+    }
+  }
+
+  // Shutting down: fail whatever is left.
+  for (auto &[transaction_id, request] : in_flight) {
+    complete(request, absl::CancelledError("Client disconnected."));
+  }
+  for (Request *request : pending) {
+    complete(request, absl::CancelledError("Client disconnected."));
+  }
+  close(sockfd_);
+  sockfd_ = -1;
+}
+
+} // namespace modbus
@@ -0,0 +1,101 @@
+#ifndef MULTIPLEXED_TCP_CLIENT_H_
+#define MULTIPLEXED_TCP_CLIENT_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+#include "modbus_client.h"
+#include "mpsc_queue.h"
+
+namespace modbus {
+
+// Thread-safe Modbus TCP client that shares one connection among many
+// caller threads. Callers enqueue requests on a lock-free queue; a single
+// I/O thread writes them out with unique transaction IDs, keeps up to
+// 'max_in_flight' of them outstanding and hands each response back to the
+// caller waiting for its transaction ID. Late responses to requests that
+// already timed out are discarded.
+class MultiplexedTcpClient : public Client {
+public:
+  // Constructor taking the hostname, port, timeout in milliseconds and the
+  // maximum number of requests outstanding on the connection at once, which
+  // should match the concurrency the server supports.
+  MultiplexedTcpClient(const std::string &hostname, int port, int timeout_ms,
+                       int max_in_flight = 16);
+
+  ~MultiplexedTcpClient() override;
+
+  // Connects to the Modbus TCP server and starts the I/O thread. If the
+  // connection was lost, replaces it. Fails if already connected.
+  absl::Status Connect();
+
+  // Stops the I/O thread and disconnects from the server. Requests still
+  // outstanding fail with kCancelled.
+  absl::Status Disconnect();
+
+  // Sends a Modbus request and waits for its response. Thread-safe. If the
+  // connection is lost, outstanding and later requests fail with
+  // kUnavailable until the client is reconnected.
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t slave_id, FunctionCode function_code,
+              const std::vector<uint8_t> &request_data) override;
+
+private:
+  // A request travelling from a caller to the I/O thread and back.
+  struct Request {
+    std::atomic<Request *> next;
+    // MBAP header and PDU. The I/O thread fills in the transaction ID.
+    std::vector<uint8_t> frame;
+    uint8_t slave_id = 0;
+    absl::Time deadline;
+    absl::Time sent;
+    absl::StatusOr<std::vector<uint8_t>> response;
+    absl::Notification done;
+  };
+
+  // Body of the I/O thread.
+  void IoLoop();
+
+  // Wakes the I/O thread if it is waiting for work.
+  void Wake();
+
+  // Stops the I/O thread, which closes the socket.
+  void StopIoThread() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Timeout bookkeeping is shared between callers and the I/O thread.
+  int SynchronizedTimeoutFor(uint8_t slave_id);
+  void SynchronizedRecordRoundTrip(uint8_t slave_id, absl::Duration rtt);
+  void SynchronizedRecordTimeout(uint8_t slave_id);
+
+  std::string hostname_;
+  int port_;
+  size_t max_in_flight_;
+
+  // Guards the connection state. Callers hold it shared while enqueueing so
+  // that Disconnect can wait for them before shutting the I/O thread down.
+  absl::Mutex mu_;
+  bool connected_ ABSL_GUARDED_BY(mu_) = false;
+  // Set by the I/O thread once the connection failed.
+  std::atomic<bool> failed_ = false;
+  int sockfd_ = -1;
+  int wake_fd_ = -1;
+  std::thread io_thread_;
+  std::atomic<bool> stop_ = false;
+  std::atomic<bool> sleeping_ = false;
+  MpscQueue<Request> queue_;
+
+  absl::Mutex rtt_mu_;
+};
+
+} // namespace modbus
+
+#endif // MULTIPLEXED_TCP_CLIENT_H_
@@ -0,0 +1,216 @@
+#include "network_scanner.h"
+
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "tcp_batch_transport.h"
+#include "tcp_socket.h"
+
+namespace modbus {
+
+namespace {
+
+// Largest subnet ExpandSubnet expands, as a prefix length.
+constexpr int kMinPrefixLength = 16;
+
+// Returns true if 'response' shows a device behind the unit ID.
+bool IsAnswer(const absl::StatusOr<std::vector<uint8_t>> &response) {
+  if (!response.ok() || response->empty()) {
+    return false;
+  }
+  const std::vector<uint8_t> &pdu = *response;
+  if (pdu.size() >= 2 && (pdu[0] & 0x80)) {
+    auto exception_code = static_cast<ExceptionCode>(pdu[1]);
+    return exception_code != ExceptionCode::kGatewayPathUnavailable &&
+           exception_code !=
+               ExceptionCode::kGatewayTargetDeviceFailedToRespond;
+  }
+  return true;
+}
+
+// A target being probed.
+struct Probe {
+  size_t target;
+  size_t connection;
+  // Results, indexed by unit ID index times the number of reads plus the
+  // read index.
+  std::vector<absl::StatusOr<std::vector<uint8_t>>> responses;
+  // Index of the next probe to send.
+  size_t next = 0;
+  bool failed = false;
+};
+
+} // namespace
+
+absl::StatusOr<std::vector<ScanTarget>> ExpandSubnet(absl::string_view cidr,
+                                                     int port) {
+  size_t slash = cidr.find('/');
+  std::string address(cidr.substr(0, slash));
+  int prefix_length = 32;
+  if (slash != absl::string_view::npos &&
+      (!absl::SimpleAtoi(cidr.substr(slash + 1), &prefix_length) ||
+       prefix_length < 0 || prefix_length > 32)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid prefix length: ", cidr));
+  }
+  if (prefix_length < kMinPrefixLength) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Subnet larger than /", kMinPrefixLength, ": ", cidr));
+  }
+  struct in_addr parsed;
+  if (inet_pton(AF_INET, address.c_str(), &parsed) != 1) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid IPv4 address: ", cidr));
+  }
+  uint32_t mask = ~uint32_t{0} << (32 - prefix_length);
+  uint32_t first = ntohl(parsed.s_addr) & mask;
+  uint32_t last = first | ~mask;
+  if (last - first > 1) {
+    ++first;
+    --last;
+  }
+  std::vector<ScanTarget> targets;
+  targets.reserve(last - first + 1);
+  for (uint64_t host = first; host <= last; ++host) {
+    targets.push_back({absl::StrCat(host >> 24, ".", (host >> 16) & 0xFF, ".",
+                                    (host >> 8) & 0xFF, ".", host & 0xFF),
+                       port});
+  }
+  return targets;
+}
+
+absl::StatusOr<std::vector<TargetScanResult>>
+ScanNetwork(const std::vector<ScanTarget> &targets, const ScanParams &params) {
+  if (params.reads.empty()) {
+    return absl::InvalidArgumentError("No reads to probe with.");
+  }
+  auto transport = CreateTcpBatchTransport(params.backend);
+  if (!transport.ok()) {
+    return transport.status();
+  }
+  std::vector<uint8_t> unit_ids = params.unit_ids;
+  if (unit_ids.empty()) {
+    for (int unit_id = 1; unit_id <= 247; ++unit_id) {
+      unit_ids.push_back(unit_id);
+    }
+  }
+  std::vector<TargetScanResult> results(targets.size());
+
+  // Resolves and connects to all targets at once.
+  AddressCache address_cache;
+  std::vector<std::vector<SocketAddress>> addresses;
+  std::vector<size_t> resolved;
+  for (size_t i = 0; i < targets.size(); ++i) {
+    results[i].target = targets[i];
+    auto target_addresses =
+        address_cache.Resolve(targets[i].host, targets[i].port);
+    if (!target_addresses.ok()) {
+      results[i].status = target_addresses.status();
+      continue;
+    }
+    addresses.push_back(*std::move(target_addresses));
+    resolved.push_back(i);
+  }
+  TcpSocketParams socket_params;
+  socket_params.connect_timeout_ms = params.connect_timeout_ms;
+  std::vector<absl::StatusOr<int>> sockets = ConnectTcpSockets(
+      addresses, socket_params, std::max(params.max_connects, 1));
+
+  size_t probes_per_target = unit_ids.size() * params.reads.size();
+  std::vector<Probe> probes;
+  for (size_t i = 0; i < resolved.size(); ++i) {
+    TargetScanResult &result = results[resolved[i]];
+    if (!sockets[i].ok()) {
+      result.status = sockets[i].status();
+      continue;
+    }
+    auto connection = (*transport)->AddConnection(*sockets[i]);
+    if (!connection.ok()) {
+      close(*sockets[i]);
+      result.status = connection.status();
+      continue;
+    }
+    Probe probe;
+    probe.target = resolved[i];
+    probe.connection = *connection;
+    probe.responses.resize(probes_per_target,
+                           absl::UnknownError("Not probed."));
+    probes.push_back(std::move(probe));
+  }
+
+  // Sends rounds of probes to all connections until every unit ID of every
+  // target has been probed.
+  int max_in_flight = std::max(params.max_in_flight, 1);
+  while (true) {
+    absl::Time round_start = absl::Now();
+    std::vector<TcpBatchRequest> batch;
+    // Probe and index of the result of each request of the batch.
+    std::vector<std::pair<Probe *, size_t>> owners;
+    for (Probe &probe : probes) {
+      for (int i = 0; i < max_in_flight && !probe.failed &&
+                      probe.next < probes_per_target;
+           ++i, ++probe.next) {
+        uint8_t unit_id = unit_ids[probe.next / params.reads.size()];
+        const ScanRead &read = params.reads[probe.next % params.reads.size()];
+        batch.push_back({probe.connection,
+                         unit_id,
+                         read.function_code,
+                         {static_cast<uint8_t>(read.address >> 8),
+                          static_cast<uint8_t>(read.address & 0xFF),
+                          static_cast<uint8_t>(read.quantity >> 8),
+                          static_cast<uint8_t>(read.quantity & 0xFF)}});
+        owners.emplace_back(&probe, probe.next);
+      }
+    }
+    if (batch.empty()) {
+      break;
+    }
+    std::vector<absl::StatusOr<std::vector<uint8_t>>> responses =
+        (*transport)->Transact(batch, params.response_timeout_ms);
+    for (size_t i = 0; i < responses.size(); ++i) {
+      auto [probe, index] = owners[i];
+      if (responses[i].status().code() == absl::StatusCode::kUnavailable) {
+        // The connection failed; later probes would fail the same way.
+        probe->failed = true;
+        results[probe->target].status = responses[i].status();
+      }
+      probe->responses[index] = std::move(responses[i]);
+    }
+    absl::Duration elapsed = absl::Now() - round_start;
+    if (elapsed < params.round_interval) {
+      absl::SleepFor(params.round_interval - elapsed);
+    }
+  }
+
+  for (Probe &probe : probes) {
+    TargetScanResult &result = results[probe.target];
+    for (size_t unit = 0; unit < unit_ids.size(); ++unit) {
+      auto first = probe.responses.begin() + unit * params.reads.size();
+      auto last = first + params.reads.size();
+      if (std::any_of(first, last, IsAnswer)) {
+        result.units.push_back(
+            {unit_ids[unit],
+             {std::make_move_iterator(first), std::make_move_iterator(last)}});
+      }
+    }
+  }
+  return results;
+}
+
+} // namespace modbus
@@ -0,0 +1,90 @@
+#ifndef NETWORK_SCANNER_H_
+#define NETWORK_SCANNER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "modbus_client.h"
+#include "tcp_batch_transport.h"
+
+namespace modbus {
+
+// Struct representing a Modbus TCP endpoint to scan.
+struct ScanTarget {
+  std::string host;
+  int port = 502;
+};
+
+// Returns a target for every host address of the IPv4 subnet 'cidr', e.g.
+// "192.168.1.0/24". The network and broadcast addresses are left out of
+// subnets with more than two addresses.
+absl::StatusOr<std::vector<ScanTarget>> ExpandSubnet(absl::string_view cidr,
+                                                     int port = 502);
+
+// Struct representing a read sent to every unit ID to find out whether it
+// responds.
+struct ScanRead {
+  FunctionCode function_code;
+  uint16_t address;
+  uint16_t quantity;
+};
+
+// Struct representing the parameters of a scan.
+struct ScanParams {
+  // Unit IDs to probe behind every target. Empty probes 1 to 247.
+  std::vector<uint8_t> unit_ids;
+  // Reads sent to every unit ID.
+  std::vector<ScanRead> reads = {{FunctionCode::kReadHoldingRegisters, 0, 1}};
+  // Connection attempts in progress at once, and the time each may take.
+  int max_connects = 256;
+  int connect_timeout_ms = 1000;
+  // Probes outstanding at once on each connection. 1 waits for every
+  // response before the next probe, for gateways that do not pipeline.
+  int max_in_flight = 4;
+  // Time a probe waits for its response.
+  int response_timeout_ms = 500;
+  // Least time between the start of two rounds of probes, to spread the
+  // load on slow networks and devices.
+  absl::Duration round_interval = absl::ZeroDuration();
+  TcpBackend backend = TcpBackend::kAuto;
+};
+
+// Struct representing a unit ID that responded.
+struct UnitScanResult {
+  uint8_t unit_id;
+  // Response PDU, exception responses included, or error of each of
+  // ScanParams::reads. A normal response shows the registers exist.
+  std::vector<absl::StatusOr<std::vector<uint8_t>>> responses;
+};
+
+// Struct representing what was found at one target.
+struct TargetScanResult {
+  ScanTarget target;
+  // Error if the target could not be connected to or dropped the
+  // connection during the scan.
+  absl::Status status;
+  // Unit IDs that answered at least one read, in the order probed. Gateway
+  // exceptions (0x0A, 0x0B) do not count as answers: they mean nothing is
+  // behind the unit ID.
+  std::vector<UnitScanResult> units;
+};
+
+// Discovers the Modbus devices at 'targets'. Connects to all targets in
+// parallel with non-blocking sockets, then probes the unit IDs of every
+// connected target from a single thread: each round pipelines up to
+// 'max_in_flight' probes per connection and sends the rounds of all
+// targets as one batch, so a scan takes about as many response timeouts as
+// a single target needs rounds. Returns the results in the order of
+// 'targets'. Fails only if 'params' has no reads or no transport can be
+// created.
+absl::StatusOr<std::vector<TargetScanResult>>
+ScanNetwork(const std::vector<ScanTarget> &targets, const ScanParams &params);
+
+} // namespace modbus
+
+#endif // NETWORK_SCANNER_H_
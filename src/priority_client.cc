@@ -0,0 +1,152 @@
+#include "priority_client.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace modbus {
+
+PriorityClient::PriorityClient(Client *client, const PriorityParams &params)
+    : ClientDecorator(client), params_(params) {}
+
+absl::StatusOr<std::vector<uint8_t>>
+PriorityClient::SendReceive(uint8_t slave_id, FunctionCode function_code,
+                            const std::vector<uint8_t> &request_data) {
+  return SendReceive(Classify(function_code), slave_id, function_code,
+                     request_data);
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+PriorityClient::SendPrepared(const PreparedRequest &request) {
+  return SendPrepared(Classify(request.function_code()), request);
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+PriorityClient::SendReceive(RequestClass request_class, uint8_t slave_id,
+                            FunctionCode function_code,
+                            const std::vector<uint8_t> &request_data) {
+  absl::Time start = clock_->Now();
+  Acquire(request_class);
+  absl::Time sent = clock_->Now();
+  auto response = client_->SendReceive(slave_id, function_code, request_data);
+  Release();
+  Record(request_class, start, sent);
+  return response;
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+PriorityClient::SendPrepared(RequestClass request_class,
+                             const PreparedRequest &request) {
+  absl::Time start = clock_->Now();
+  Acquire(request_class);
+  absl::Time sent = clock_->Now();
+  auto response = client_->SendPrepared(request);
+  Release();
+  Record(request_class, start, sent);
+  return response;
+}
+
+RequestClass PriorityClient::Classify(FunctionCode function_code) {
+  switch (function_code) {
+  case FunctionCode::kWriteSingleCoil:
+  case FunctionCode::kWriteSingleRegister:
+  case FunctionCode::kWriteMultipleCoils:
+  case FunctionCode::kWriteMultipleRegisters:
+    return RequestClass::kControl;
+  default:
+    return RequestClass::kInteractive;
+  }
+}
+
+RequestClassStats PriorityClient::stats(RequestClass request_class) const {
+  absl::MutexLock lock(&mu_);
+  return stats_[static_cast<size_t>(request_class)];
+}
+
+size_t PriorityClient::queued() const {
+  absl::MutexLock lock(&mu_);
+  size_t count = 0;
+  for (const std::deque<Waiter *> &queue : queues_) {
+    count += queue.size();
+  }
+  return count;
+}
+
+void PriorityClient::Acquire(RequestClass request_class) {
+  absl::MutexLock lock(&mu_);
+  Waiter waiter;
+  queues_[static_cast<size_t>(request_class)].push_back(&waiter);
+  // Lets the request through at once if the transport is free and nothing
+  // else is waiting.
+  Dispatch();
+  mu_.Await(absl::Condition(&waiter.granted));
+}
+
+void PriorityClient::Release() {
+  absl::MutexLock lock(&mu_);
+  --in_flight_;
+  Dispatch();
+}
+
+void PriorityClient::Dispatch() {
+  while (in_flight_ < std::max(params_.max_in_flight, 1)) {
+    bool waiting = false;
+    for (const std::deque<Waiter *> &queue : queues_) {
+      waiting |= !queue.empty();
+    }
+    if (!waiting) {
+      return;
+    }
+    std::deque<Waiter *> &queue = queues_[NextClass()];
+    queue.front()->granted = true;
+    queue.pop_front();
+    ++in_flight_;
+  }
+}
+
+size_t PriorityClient::NextClass() {
+  for (size_t i = 0; i < kNumRequestClasses; ++i) {
+    if (params_.classes[i].strict && !queues_[i].empty()) {
+      return i;
+    }
+  }
+  // Smooth weighted round robin: every waiting class earns its weight, and
+  // the class with the most credit goes and pays back the total weight.
+  // This interleaves the classes instead of serving them in bursts.
+  size_t next = kNumRequestClasses;
+  int64_t total_weight = 0;
+  for (size_t i = 0; i < kNumRequestClasses; ++i) {
+    if (params_.classes[i].strict || queues_[i].empty()) {
+      // Idle classes do not bank credit.
+      credits_[i] = 0;
+      continue;
+    }
+    int64_t weight = std::max(params_.classes[i].weight, 1);
+    credits_[i] += weight;
+    total_weight += weight;
+    if (next == kNumRequestClasses || credits_[i] > credits_[next]) {
+      next = i;
+    }
+  }
+  credits_[next] -= total_weight;
+  return next;
+}
+
+void PriorityClient::Record(RequestClass request_class, absl::Time start,
+                            absl::Time sent) {
+  absl::Duration latency = clock_->Now() - start;
+  size_t i = static_cast<size_t>(request_class);
+  absl::MutexLock lock(&mu_);
+  stats_[i].queue_wait.Record(absl::ToInt64Microseconds(sent - start));
+  stats_[i].latency.Record(absl::ToInt64Microseconds(latency));
+  if (latency > params_.classes[i].slo) {
+    ++stats_[i].slo_misses;
+  }
+}
+
+} // namespace modbus
@@ -0,0 +1,141 @@
+#ifndef PRIORITY_CLIENT_H_
+#define PRIORITY_CLIENT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "latency_histogram.h"
+#include "modbus_client.h"
+
+namespace modbus {
+
+// Enum class representing the submission classes of a PriorityClient, from
+// the most to the least urgent.
+enum class RequestClass : uint8_t {
+  // Writes issued by operators or control loops, e.g. a stop command.
+  kControl,
+  // Polls of alarm and safety tags.
+  kAlarm,
+  // Reads someone is waiting for, e.g. to refresh a display.
+  kInteractive,
+  // Bulk transfers such as history uploads.
+  kBackground,
+};
+
+constexpr size_t kNumRequestClasses = 4;
+
+// Struct representing how a PriorityClient schedules one request class.
+struct RequestClassParams {
+  // Strict classes are served, in class order, before any other request
+  // waiting. The remaining classes share the transport in proportion to
+  // 'weight'.
+  bool strict;
+  int weight;
+  // Latency objective, from submission to response, that requests of the
+  // class are tracked against.
+  absl::Duration slo;
+};
+
+// Struct representing the parameters of a PriorityClient.
+struct PriorityParams {
+  RequestClassParams classes[kNumRequestClasses] = {
+      {true, 1, absl::Milliseconds(50)},
+      {true, 1, absl::Milliseconds(100)},
+      {false, 4, absl::Milliseconds(500)},
+      {false, 1, absl::Seconds(5)},
+  };
+  // Requests sent to the wrapped client at once. Above 1 only for
+  // transports that pipeline requests.
+  int max_in_flight = 1;
+};
+
+// Struct representing the latencies of the requests of one class.
+struct RequestClassStats {
+  // Time spent waiting for the transport, in microseconds.
+  LatencyHistogram queue_wait;
+  // Time from submission to response, in microseconds.
+  LatencyHistogram latency;
+  // Requests whose latency exceeded the objective of their class.
+  int64_t slo_misses = 0;
+};
+
+// Client decorator that orders requests from many threads by class instead
+// of by arrival, so that a stop command does not wait behind hundreds of
+// queued history reads. Requests beyond 'max_in_flight' wait in one queue
+// per class; when the transport frees up, the oldest request of the first
+// non-empty strict class goes next, and otherwise the weighted classes are
+// served by smooth weighted round robin. A request already sent is never
+// interrupted, so a control write waits for at most the requests in flight.
+// Thread-safe.
+class PriorityClient : public ClientDecorator {
+public:
+  // Constructor taking the wrapped client, which must outlive the decorator
+  // and whose timeout applies.
+  PriorityClient(Client *client, const PriorityParams &params);
+
+  // Sends a request of the class given by Classify.
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t slave_id, FunctionCode function_code,
+              const std::vector<uint8_t> &request_data) override;
+  absl::StatusOr<std::vector<uint8_t>>
+  SendPrepared(const PreparedRequest &request) override;
+
+  // Sends a request of class 'request_class'.
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(RequestClass request_class, uint8_t slave_id,
+              FunctionCode function_code,
+              const std::vector<uint8_t> &request_data);
+  absl::StatusOr<std::vector<uint8_t>>
+  SendPrepared(RequestClass request_class, const PreparedRequest &request);
+
+  // Returns the default class of requests with 'function_code': writes are
+  // control requests and reads are interactive.
+  static RequestClass Classify(FunctionCode function_code);
+
+  // Returns the latencies of the requests of 'request_class' so far.
+  RequestClassStats stats(RequestClass request_class) const;
+
+  // Returns the number of requests waiting for the transport.
+  size_t queued() const;
+
+private:
+  struct Waiter {
+    bool granted = false;
+  };
+
+  // Blocks until a request of 'request_class' may be sent.
+  void Acquire(RequestClass request_class);
+
+  // Frees the transport slot of a completed request.
+  void Release();
+
+  // Grants transport slots to waiting requests while some are free.
+  void Dispatch() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Returns the class whose oldest request goes next. At least one request
+  // must be waiting.
+  size_t NextClass() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Updates the stats of 'request_class' with a request submitted at
+  // 'start' and sent at 'sent'.
+  void Record(RequestClass request_class, absl::Time start, absl::Time sent);
+
+  PriorityParams params_;
+
+  mutable absl::Mutex mu_;
+  std::deque<Waiter *> queues_[kNumRequestClasses] ABSL_GUARDED_BY(mu_);
+  // Credits of the weighted classes for smooth weighted round robin.
+  int64_t credits_[kNumRequestClasses] ABSL_GUARDED_BY(mu_) = {};
+  int in_flight_ ABSL_GUARDED_BY(mu_) = 0;
+  RequestClassStats stats_[kNumRequestClasses] ABSL_GUARDED_BY(mu_);
+};
+
+} // namespace modbus
+
+#endif // PRIORITY_CLIENT_H_
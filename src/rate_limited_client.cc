@@ -0,0 +1,136 @@
+#include "rate_limited_client.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace modbus {
+
+namespace {
+
+// Returns true if the outcome of a request shows the slave or the gateway
+// in front of it is overloaded.
+bool IsOverload(const absl::StatusOr<std::vector<uint8_t>> &response) {
+  if (!response.ok()) {
+    return true;
+  }
+  const std::vector<uint8_t> &pdu = response.value();
+  if (pdu.size() >= 2 && (pdu[0] & 0x80)) {
+    auto exception_code = static_cast<ExceptionCode>(pdu[1]);
+    return exception_code == ExceptionCode::kServerDeviceBusy ||
+           exception_code == ExceptionCode::kGatewayPathUnavailable ||
+           exception_code ==
+               ExceptionCode::kGatewayTargetDeviceFailedToRespond;
+  }
+  return false;
+}
+
+} // namespace
+
+RateLimitedClient::RateLimitedClient(Client *client, const RateLimit &limit,
+                                     const AutoTuneParams &auto_tune)
+    : ClientDecorator(client), auto_tune_(auto_tune) {
+  for (int i = 0; i < 256; ++i) {
+    SetLimit(i, limit);
+  }
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+RateLimitedClient::SendReceive(uint8_t slave_id, FunctionCode function_code,
+                               const std::vector<uint8_t> &request_data) {
+  Acquire(slave_id);
+  absl::Time start = clock_->Now();
+  auto response = client_->SendReceive(slave_id, function_code, request_data);
+  Release(slave_id, response, clock_->Now() - start);
+  return response;
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+RateLimitedClient::SendPrepared(const PreparedRequest &request) {
+  Acquire(request.slave_id());
+  absl::Time start = clock_->Now();
+  auto response = client_->SendPrepared(request);
+  Release(request.slave_id(), response, clock_->Now() - start);
+  return response;
+}
+
+void RateLimitedClient::SetLimit(uint8_t slave_id, const RateLimit &limit) {
+  absl::MutexLock lock(&mu_);
+  Bucket &bucket = buckets_[slave_id];
+  bucket.limit = limit;
+  bucket.limit.burst = std::max(limit.burst, 1.0);
+  bucket.limit.max_concurrent = std::max(limit.max_concurrent, 1);
+  if (auto_tune_.enabled) {
+    bucket.limit.rate =
+        std::clamp(limit.rate, auto_tune_.min_rate, auto_tune_.max_rate);
+  }
+  bucket.tokens = bucket.limit.burst;
+  bucket.last_refill = absl::InfinitePast();
+  cv_.SignalAll();
+}
+
+double RateLimitedClient::GetRate(uint8_t slave_id) {
+  absl::MutexLock lock(&mu_);
+  return buckets_[slave_id].limit.rate;
+}
+
+void RateLimitedClient::Acquire(uint8_t slave_id) {
+  absl::Duration wait;
+  {
+    absl::MutexLock lock(&mu_);
+    Bucket &bucket = buckets_[slave_id];
+    while (bucket.in_flight >= bucket.limit.max_concurrent) {
+      cv_.Wait(&mu_);
+    }
+    ++bucket.in_flight;
+    double rate = bucket.limit.rate;
+    if (rate <= 0) {
+      return;
+    }
+    absl::Time now = clock_->Now();
+    if (now > bucket.last_refill) {
+      double elapsed = absl::ToDoubleSeconds(now - bucket.last_refill);
+      bucket.tokens =
+          std::min(bucket.limit.burst, bucket.tokens + rate * elapsed);
+      bucket.last_refill = now;
+    }
+    // Takes a token even if there is none left, so that callers waiting for
+    // the same slave line up behind each other instead of racing for the
+    // next token.
+    bucket.tokens -= 1;
+    if (bucket.tokens < 0) {
+      wait = absl::Seconds(-bucket.tokens / rate);
+    }
+  }
+  if (wait > absl::ZeroDuration()) {
+    clock_->SleepFor(wait);
+  }
+}
+
+void RateLimitedClient::Release(
+    uint8_t slave_id, const absl::StatusOr<std::vector<uint8_t>> &response,
+    absl::Duration latency) {
+  absl::MutexLock lock(&mu_);
+  Bucket &bucket = buckets_[slave_id];
+  --bucket.in_flight;
+  cv_.SignalAll();
+  double rate = bucket.limit.rate;
+  if (!auto_tune_.enabled || rate <= 0) {
+    return;
+  }
+  if (IsOverload(response) || latency > auto_tune_.max_latency) {
+    rate *= auto_tune_.decrease;
+  } else {
+    // At full pace 'rate' requests succeed per second, which together add
+    // 'increase'.
+    rate += auto_tune_.increase / rate;
+  }
+  bucket.limit.rate =
+      std::clamp(rate, auto_tune_.min_rate, auto_tune_.max_rate);
+}
+
+} // namespace modbus
@@ -0,0 +1,100 @@
+#ifndef RATE_LIMITED_CLIENT_H_
+#define RATE_LIMITED_CLIENT_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "modbus_client.h"
+
+namespace modbus {
+
+// Struct representing how fast requests may be sent to one slave.
+struct RateLimit {
+  // Sustained rate, in transactions per second, or 0 for no pacing.
+  double rate = 10;
+  // Transactions that may be sent back to back after an idle period.
+  double burst = 1;
+  // Requests that may be outstanding at once. Above 1 only for transports
+  // that pipeline requests.
+  int max_concurrent = 1;
+};
+
+// Struct representing how a RateLimitedClient searches for the fastest rate
+// each slave sustains. Rates grow additively while requests succeed and
+// shrink multiplicatively on the first sign of overload, like TCP
+// congestion control.
+struct AutoTuneParams {
+  bool enabled = false;
+  // Range the rate is kept in, in transactions per second.
+  double min_rate = 1;
+  double max_rate = 1000;
+  // Rate gained per second of requests without overload.
+  double increase = 1;
+  // Factor applied to the rate on overload.
+  double decrease = 0.5;
+  // Round trips slower than this count as overload.
+  absl::Duration max_latency = absl::InfiniteDuration();
+};
+
+// Client decorator that paces the requests to every slave of the wrapped
+// transport with a token bucket and caps the requests outstanding per
+// slave, so that slow devices are not polled to death and fast ones are not
+// held to a conservative global rate. Callers over the rate block until
+// their turn. Wrapping each transport separately gives limits per endpoint
+// and slave.
+//
+// With auto-tuning, transport errors, busy and gateway exceptions, and
+// round trips over 'max_latency' are taken as overload. Other exception
+// responses leave the rate as it is. Thread-safe.
+class RateLimitedClient : public ClientDecorator {
+public:
+  // Constructor taking the wrapped client, which must outlive the decorator
+  // and whose timeout applies, and the limit of every slave.
+  RateLimitedClient(Client *client, const RateLimit &limit,
+                    const AutoTuneParams &auto_tune = AutoTuneParams());
+
+  // Sends a Modbus request and receives the response once the limits of
+  // 'slave_id' allow.
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t slave_id, FunctionCode function_code,
+              const std::vector<uint8_t> &request_data) override;
+  absl::StatusOr<std::vector<uint8_t>>
+  SendPrepared(const PreparedRequest &request) override;
+
+  // Replaces the limit of 'slave_id'.
+  void SetLimit(uint8_t slave_id, const RateLimit &limit);
+
+  // Returns the current rate of 'slave_id', in transactions per second.
+  double GetRate(uint8_t slave_id);
+
+private:
+  struct Bucket {
+    RateLimit limit;
+    double tokens;
+    absl::Time last_refill;
+    int in_flight = 0;
+  };
+
+  // Blocks until a request to 'slave_id' may be sent.
+  void Acquire(uint8_t slave_id);
+
+  // Frees the slot of a request to 'slave_id' and tunes the rate with its
+  // outcome.
+  void Release(uint8_t slave_id,
+               const absl::StatusOr<std::vector<uint8_t>> &response,
+               absl::Duration latency);
+
+  AutoTuneParams auto_tune_;
+  absl::Mutex mu_;
+  // Signalled when a request completes.
+  absl::CondVar cv_;
+  Bucket buckets_[256] ABSL_GUARDED_BY(mu_);
+};
+
+} // namespace modbus
+
+#endif // RATE_LIMITED_CLIENT_H_
@@ -0,0 +1,38 @@
+#include "rtt_estimator.h"
+
+#include <algorithm>
+
+#include "absl/time/time.h"
+
+namespace modbus {
+
+RttEstimator::RttEstimator(const AdaptiveTimeoutParams &params,
+                           absl::Duration initial_timeout)
+    : min_timeout_(absl::Milliseconds(params.min_timeout_ms)),
+      max_timeout_(absl::Milliseconds(params.max_timeout_ms)),
+      backoff_limit_(Clamp(initial_timeout)), timeout_(backoff_limit_) {}
+
+void RttEstimator::AddSample(absl::Duration rtt) {
+  if (!has_samples_) {
+    smoothed_rtt_ = rtt;
+    rtt_variance_ = rtt / 2;
+    has_samples_ = true;
+  } else {
+    // RTTVAR is updated first, using the previous SRTT (RFC 6298, 2.3).
+    rtt_variance_ =
+        rtt_variance_ * 3 / 4 + absl::AbsDuration(smoothed_rtt_ - rtt) / 4;
+    smoothed_rtt_ = smoothed_rtt_ * 7 / 8 + rtt / 8;
+  }
+  timeout_ = Clamp(smoothed_rtt_ + 4 * rtt_variance_);
+}
+
+void RttEstimator::OnTimeout() {
+  // A learned timeout above the limit is kept rather than lowered.
+  timeout_ = std::max(timeout_, std::min(timeout_ * 2, backoff_limit_));
+}
+
+absl::Duration RttEstimator::Clamp(absl::Duration timeout) const {
+  return std::clamp(timeout, min_timeout_, max_timeout_);
+}
+
+} // namespace modbus
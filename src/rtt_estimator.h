@@ -0,0 +1,57 @@
+#ifndef RTT_ESTIMATOR_H_
+#define RTT_ESTIMATOR_H_
+
+#include "absl/time/time.h"
+
+namespace modbus {
+
+// Struct representing the bounds of adaptive timeouts.
+struct AdaptiveTimeoutParams {
+  // Floor of the computed timeout, in milliseconds. Should cover the slowest
+  // legitimate response of a healthy device.
+  int min_timeout_ms = 20;
+  // Ceiling of the computed timeout, in milliseconds.
+  int max_timeout_ms = 5000;
+};
+
+// Estimates a response timeout from observed round trip times, using the
+// smoothed RTT and RTT variance of TCP's retransmission timer (RFC 6298):
+// timeout = SRTT + 4 * RTTVAR, clamped to [min_timeout_ms, max_timeout_ms].
+// Each timeout doubles the current value until the next successful sample,
+// but backs off no further than the initial timeout: a dead slave costs at
+// most the static timeout per request instead of climbing to the ceiling.
+class RttEstimator {
+public:
+  // Constructor taking the bounds and the timeout used before the first
+  // sample.
+  RttEstimator(const AdaptiveTimeoutParams &params,
+               absl::Duration initial_timeout);
+
+  // Records the round trip time of a successful request.
+  void AddSample(absl::Duration rtt);
+
+  // Records a request that timed out.
+  void OnTimeout();
+
+  // Returns the timeout for the next request.
+  absl::Duration Timeout() const { return timeout_; }
+
+  absl::Duration smoothed_rtt() const { return smoothed_rtt_; }
+  absl::Duration rtt_variance() const { return rtt_variance_; }
+
+private:
+  absl::Duration Clamp(absl::Duration timeout) const;
+
+  absl::Duration min_timeout_;
+  absl::Duration max_timeout_;
+  // Highest value timeouts back off to.
+  absl::Duration backoff_limit_;
+  bool has_samples_ = false;
+  absl::Duration smoothed_rtt_;
+  absl::Duration rtt_variance_;
+  absl::Duration timeout_;
+};
+
+} // namespace modbus
+
+#endif // RTT_ESTIMATOR_H_
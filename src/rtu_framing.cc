@@ -0,0 +1,81 @@
+#include "rtu_framing.h"
+
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "modbus_client.h"
+
+namespace modbus {
+
+namespace {
+
+// Size of slave ID plus CRC.
+constexpr size_t kRtuOverhead = 3;
+
+absl::Status UnknownLayout(uint8_t function_code) {
+  return absl::UnimplementedError("Cannot frame function code " +
+                                  std::to_string(function_code) + ".");
+}
+
+} // namespace
+
+absl::StatusOr<size_t> RtuResponseSize(const uint8_t *data, size_t size) {
+  if (size < 2) {
+    return 0;
+  }
+  uint8_t function_code = data[1];
+  if (function_code & 0x80) {
+    return kRtuOverhead + 2; // Function code and exception code.
+  }
+  switch (static_cast<FunctionCode>(function_code)) {
+  case FunctionCode::kReadCoils:
+  case FunctionCode::kReadDiscreteInputs:
+  case FunctionCode::kReadHoldingRegisters:
+  case FunctionCode::kReadInputRegisters:
+    if (size < 3) {
+      return 0;
+    }
+    return kRtuOverhead + 2 + data[2];
+  case FunctionCode::kWriteSingleCoil:
+  case FunctionCode::kWriteSingleRegister:
+  case FunctionCode::kWriteMultipleCoils:
+  case FunctionCode::kWriteMultipleRegisters:
+    return kRtuOverhead + 5; // Echo of address and value or quantity.
+  default:
+    return UnknownLayout(function_code);
+  }
+}
+
+absl::StatusOr<size_t> RtuRequestSize(const uint8_t *data, size_t size) {
+  if (size < 2) {
+    return 0;
+  }
+  uint8_t function_code = data[1];
+  switch (static_cast<FunctionCode>(function_code)) {
+  case FunctionCode::kReadCoils:
+  case FunctionCode::kReadDiscreteInputs:
+  case FunctionCode::kReadHoldingRegisters:
+  case FunctionCode::kReadInputRegisters:
+  case FunctionCode::kWriteSingleCoil:
+  case FunctionCode::kWriteSingleRegister:
+    return kRtuOverhead + 5;
+  case FunctionCode::kWriteMultipleCoils:
+  case FunctionCode::kWriteMultipleRegisters:
+    // Address, quantity and byte count precede the values.
+    if (size < 7) {
+      return 0;
+    }
+    return kRtuOverhead + 6 + data[6];
+  default:
+    return UnknownLayout(function_code);
+  }
+}
+
+size_t ExpectedRtuResponseSize(FunctionCode function_code,
+                               const uint8_t *request_data, size_t size) {
+  size_t pdu_size = ExpectedResponseSize(function_code, request_data, size);
+  return pdu_size != 0 ? kRtuOverhead + pdu_size : 0;
+}
+
+} // namespace modbus
@@ -0,0 +1,36 @@
+#ifndef RTU_FRAMING_H_
+#define RTU_FRAMING_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/status/statusor.h"
+#include "modbus_client.h"
+
+namespace modbus {
+
+// Maximum size of an RTU frame (slave ID + 253 byte PDU + CRC).
+constexpr size_t kMaxRtuFrameSize = 256;
+
+// Over a byte stream such as TCP, RTU frames are not delimited by silent
+// intervals, so their size must be inferred from the function code and, for
+// variable-length frames, the byte count that follows it. The functions
+// below return the size of the frame starting at 'data', including slave ID
+// and CRC, given its first 'size' bytes. They return 0 if more bytes are
+// needed to tell, and an error for function codes of unknown layout.
+
+// Frame size of a response.
+absl::StatusOr<size_t> RtuResponseSize(const uint8_t *data, size_t size);
+
+// Frame size of a request.
+absl::StatusOr<size_t> RtuRequestSize(const uint8_t *data, size_t size);
+
+// Returns the frame size of the normal response to a request, given its
+// function code and the 'size' bytes of its PDU data, or 0 if the function
+// code has no known layout.
+size_t ExpectedRtuResponseSize(FunctionCode function_code,
+                               const uint8_t *request_data, size_t size);
+
+} // namespace modbus
+
+#endif // RTU_FRAMING_H_
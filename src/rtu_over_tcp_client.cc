@@ -0,0 +1,157 @@
+#include "rtu_over_tcp_client.h"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "rtu_framing.h"
+#include "tcp_socket.h"
+
+namespace modbus {
+
+RtuOverTcpClient::RtuOverTcpClient(const std::string &hostname, int port,
+                                   int timeout_ms)
+    : Client(timeout_ms), hostname_(hostname), port_(port) {}
+
+RtuOverTcpClient::~RtuOverTcpClient() { Disconnect().IgnoreError(); }
+
+absl::Status RtuOverTcpClient::Connect() {
+  if (sockfd_ >= 0) {
+    return absl::FailedPreconditionError("Already connected to server.");
+  }
+
+  auto sockfd = ConnectTcpSocket(hostname_, port_);
+  if (!sockfd.ok()) {
+    return sockfd.status();
+  }
+  return Attach(sockfd.value());
+}
+
+absl::Status RtuOverTcpClient::Attach(int sockfd) {
+  if (sockfd_ >= 0) {
+    return absl::FailedPreconditionError("Already connected to server.");
+  }
+  sockfd_ = sockfd;
+  receive_timeout_ms_ = -1;
+  return absl::OkStatus();
+}
+
+absl::Status RtuOverTcpClient::Disconnect() {
+  if (sockfd_ >= 0) {
+    close(sockfd_);
+    sockfd_ = -1;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status RtuOverTcpClient::DiscardStaleInput() {
+  uint8_t buffer[kMaxRtuFrameSize];
+  while (true) {
+    ssize_t received = recv(sockfd_, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (received > 0) {
+      continue;
+    }
+    if (received == 0) {
+      return absl::UnavailableError("Connection closed.");
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return absl::OkStatus();
+    }
+    return absl::InternalError("Failed to receive response.");
+  }
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+RtuOverTcpClient::SendReceive(uint8_t slave_id, FunctionCode function_code,
+                              const std::vector<uint8_t> &request_data) {
+  return Exchange(slave_id, function_code,
+                  BuildAdu(slave_id, function_code, request_data));
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+RtuOverTcpClient::SendPrepared(const PreparedRequest &request) {
+  return Exchange(request.slave_id(), request.function_code(),
+                  request.rtu_frame());
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+RtuOverTcpClient::Exchange(uint8_t slave_id, FunctionCode function_code,
+                           const std::vector<uint8_t> &adu) {
+  if (sockfd_ < 0) {
+    return absl::FailedPreconditionError("Not connected to server.");
+  }
+
+  // Set the receive timeout, sparing the system call when it is unchanged.
+  int timeout_ms = TimeoutFor(slave_id);
+  if (timeout_ms != receive_timeout_ms_) {
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    if (setsockopt(sockfd_, SOL_SOCKET, SO_RCVTIMEO,
+                   reinterpret_cast<const char *>(&tv), sizeof(tv)) < 0) {
+      return absl::InternalError("Failed to set socket receive timeout.");
+    }
+    receive_timeout_ms_ = timeout_ms;
+  }
+
+  // A late response to an earlier request would be taken for this one.
+  absl::Status status = DiscardStaleInput();
+  if (!status.ok()) {
+    return status;
+  }
+
+  // Send the request.
+  if (adu.size() > kMaxRtuFrameSize) {
+    return absl::InvalidArgumentError("Request too long.");
+  }
+  absl::Time start = clock_->Now();
+  struct iovec iov = {const_cast<uint8_t *>(adu.data()), adu.size()};
+  status = SendVector(sockfd_, absl::MakeSpan(&iov, 1));
+  if (!status.ok()) {
+    return status;
+  }
+
+  // Receive until the frame is complete, as told by its function code and
+  // byte count.
+  uint8_t frame[kMaxRtuFrameSize];
+  size_t received = 0;
+  size_t frame_size = 0;
+  while (frame_size == 0 || received < frame_size) {
+    ssize_t n = recv(sockfd_, frame + received, sizeof(frame) - received, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      RecordTimeout(slave_id);
+      return absl::DeadlineExceededError("Timed out waiting for response.");
+    }
+    if (n <= 0) {
+      return absl::InternalError("Failed to receive response.");
+    }
+    received += n;
+    auto size = RtuResponseSize(frame, received);
+    if (!size.ok()) {
+      return size.status();
+    }
+    frame_size = size.value();
+    if (frame_size > sizeof(frame)) {
+      return absl::InternalError("Modbus response too long.");
+    }
+  }
+
+  uint16_t received_crc = (frame[frame_size - 1] << 8) | frame[frame_size - 2];
+  if (received_crc != CalculateCrc16(frame, frame_size - 2)) {
+    return absl::DataLossError("Modbus CRC mismatch.");
+  }
+  if (frame[0] != slave_id ||
+      (frame[1] & 0x7F) != static_cast<uint8_t>(function_code)) {
+    return absl::InternalError("Response does not match request.");
+  }
+  RecordRoundTrip(slave_id, clock_->Now() - start);
+  return std::vector<uint8_t>(frame + 1, frame + frame_size - 2);
+}
+
+} // namespace modbus
@@ -0,0 +1,69 @@
+#ifndef RTU_OVER_TCP_CLIENT_H_
+#define RTU_OVER_TCP_CLIENT_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "modbus_client.h"
+
+namespace modbus {
+
+// Modbus client sending RTU frames, with CRC and without MBAP header, over a
+// TCP connection, as spoken by many serial-to-Ethernet converters. RTU
+// frames carry no transaction ID, so bytes left over from a request that
+// timed out are discarded before the next request is sent.
+class RtuOverTcpClient : public Client {
+public:
+  // Constructor taking the hostname, port, and timeout in milliseconds.
+  RtuOverTcpClient(const std::string &hostname, int port, int timeout_ms);
+
+  ~RtuOverTcpClient() override;
+
+  // Connects to the converter.
+  absl::Status Connect();
+
+  // Takes ownership of 'sockfd', a blocking socket already connected to
+  // the converter.
+  absl::Status Attach(int sockfd);
+
+  // Disconnects from the converter.
+  absl::Status Disconnect();
+
+  // Returns true while connected to the converter.
+  bool connected() const { return sockfd_ >= 0; }
+
+  // Sends a Modbus request and receives the response.
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t slave_id, FunctionCode function_code,
+              const std::vector<uint8_t> &request_data) override;
+
+  // Sends a prepared request's RTU frame as it is.
+  absl::StatusOr<std::vector<uint8_t>>
+  SendPrepared(const PreparedRequest &request) override;
+
+private:
+  // Sends 'adu' and receives the response.
+  absl::StatusOr<std::vector<uint8_t>>
+  Exchange(uint8_t slave_id, FunctionCode function_code,
+           const std::vector<uint8_t> &adu);
+
+  // Discards received bytes that belong to no request.
+  absl::Status DiscardStaleInput();
+
+  // Socket handle.
+  int sockfd_ = -1;
+
+  // Receive timeout currently set on the socket, or -1 if none.
+  int receive_timeout_ms_ = -1;
+
+  // Converter address information.
+  std::string hostname_;
+  int port_;
+};
+
+} // namespace modbus
+
+#endif // RTU_OVER_TCP_CLIENT_H_
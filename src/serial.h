@@ -18,6 +18,10 @@ struct SerialParams {
   Parity parity;
   int data_bits;
   int stop_bits;
+  // Sets ASYNC_LOW_LATENCY on the port, so that the driver hands received
+  // bytes over at once instead of batching them, e.g. for up to 16 ms on
+  // USB adapters. Costs some CPU; only supported on Linux.
+  bool low_latency = false;
 };
 
 // Abstract base class for Modbus serial connection.
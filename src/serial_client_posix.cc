@@ -1,55 +1,127 @@
 #include "serial_client_posix.h"
 
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "rtu_framing.h"
+#include <algorithm>
 #include <cassert>
 
 namespace modbus {
 
+namespace {
+
+// Converts 'duration' to whole milliseconds for Serial::Read, rounding up so
+// that a wait is never cut short.
+int WaitMilliseconds(absl::Duration duration) {
+  return static_cast<int>(absl::ToInt64Milliseconds(
+      absl::Ceil(std::max(duration, absl::ZeroDuration()),
+                 absl::Milliseconds(1))));
+}
+
+} // namespace
+
 // --- SerialClient ---
 
 SerialClient::SerialClient(std::unique_ptr<Serial> serial, int timeout_ms)
     : Client(timeout_ms), serial_(std::move(serial)) {}
 
+SerialClient::SerialClient(std::unique_ptr<Serial> serial, int timeout_ms,
+                           const SerialParams &params)
+    : Client(timeout_ms), serial_(std::move(serial)), timing_(params) {}
+
 absl::StatusOr<std::vector<uint8_t>>
 SerialClient::SendReceive(uint8_t slave_id, FunctionCode function_code,
                           const std::vector<uint8_t> &request_data) {
-  // Build the Modbus ADU.
-  std::vector<uint8_t> adu = BuildAdu(slave_id, function_code, request_data);
+  return Exchange(slave_id, function_code, request_data,
+                  BuildAdu(slave_id, function_code, request_data));
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+SerialClient::SendPrepared(const PreparedRequest &request) {
+  return Exchange(request.slave_id(), request.function_code(), request.data(),
+                  request.rtu_frame());
+}
+
+absl::StatusOr<std::vector<uint8_t>>
+SerialClient::Exchange(uint8_t slave_id, FunctionCode function_code,
+                       const std::vector<uint8_t> &request_data,
+                       const std::vector<uint8_t> &adu) {
+  // Keep the line silent for 3.5 characters since the last frame.
+  absl::Duration wire_time = absl::ZeroDuration();
+  if (timing_.has_value()) {
+    absl::Duration silence = line_busy_until_ + timing_->t35() - absl::Now();
+    if (silence > absl::ZeroDuration()) {
+      absl::SleepFor(silence);
+    }
+    wire_time = timing_->WireTime(function_code, request_data);
+  }
 
   // Send the request.
+  absl::Time start = clock_->Now();
   auto status = serial_->Write(adu.data(), adu.size());
   if (!status.ok()) {
     return status;
   }
+  absl::Time deadline =
+      absl::Now() + absl::Milliseconds(TimeoutFor(slave_id)) + wire_time;
 
-  // Read the response.
-  std::vector<uint8_t> response_buffer(256); // Maximum ADU size
-  absl::StatusOr<size_t> bytes_read = serial_->Read(
-      response_buffer.data(), response_buffer.size(), timeout_ms_);
-  if (!bytes_read.ok()) {
-    return bytes_read.status();
+  // Read until the frame is complete, as told by its function code and byte
+  // count. A frame of unknown layout ends with 3.5 characters of silence or,
+  // without a timing model, with the first read.
+  uint8_t frame[kMaxRtuFrameSize]; // Maximum ADU size
+  size_t received = 0;
+  bool unknown_layout = false;
+  while (received < sizeof(frame)) {
+    int wait_ms = unknown_layout ? WaitMilliseconds(timing_->t35())
+                                 : WaitMilliseconds(deadline - absl::Now());
+    absl::StatusOr<size_t> bytes_read =
+        serial_->Read(frame + received, sizeof(frame) - received, wait_ms);
+    if (!bytes_read.ok()) {
+      return bytes_read.status();
+    }
+    if (bytes_read.value() == 0) {
+      break;
+    }
+    received += bytes_read.value();
+    auto frame_size = RtuResponseSize(frame, received);
+    if (frame_size.ok() && *frame_size != 0 && received >= *frame_size) {
+      received = *frame_size;
+      break;
+    }
+    if (!frame_size.ok()) {
+      if (!timing_.has_value()) {
+        break;
+      }
+      unknown_layout = true;
+    }
   }
+  line_busy_until_ = absl::Now();
 
-  if (bytes_read.value() < 3) {
+  if (received == 0) {
+    RecordTimeout(slave_id);
+    return absl::DeadlineExceededError("Timed out waiting for response.");
+  }
+
+  if (received < 3) {
     // Minimum response size: slave address + function code + error code
     return absl::InternalError("Modbus response too short.");
   }
 
   // Verify CRC.
-  uint16_t received_crc =
-      (static_cast<uint16_t>(response_buffer[bytes_read.value() - 1]) << 8) |
-      static_cast<uint16_t>(response_buffer[bytes_read.value() - 2]);
-  std::vector<uint8_t> response_data_for_crc(response_buffer.begin(),
-                                             response_buffer.begin() +
-                                                 bytes_read.value() - 2);
-  if (received_crc != CalculateCrc16(response_data_for_crc)) {
+  uint16_t received_crc = (static_cast<uint16_t>(frame[received - 1]) << 8) |
+                          static_cast<uint16_t>(frame[received - 2]);
+  if (received_crc != CalculateCrc16(frame, received - 2)) {
     return absl::DataLossError("Modbus CRC mismatch.");
   }
+  // Adaptive timeouts learn how long the slave takes to answer; the time
+  // on the wire is added back per request.
+  RecordRoundTrip(slave_id, std::max(clock_->Now() - start - wire_time,
+                                     absl::ZeroDuration()));
+
   // Extract the PDU data from the response.
-  std::vector<uint8_t> response_pdu(response_buffer.begin() + 2,
-                                    response_buffer.begin() +
-                                        bytes_read.value() - 2);
-  return response_pdu;
+  return std::vector<uint8_t>(frame + 1, frame + received - 2);
 }
 
 } // namespace modbus
@@ -2,12 +2,15 @@
 #define SERIAL_CLIENT_POSIX_H_
 
 #include "absl/status/statusor.h"
+#include "absl/time/time.h"
 #include <cstdint>
 #include <memory>
+#include <optional>
 #include <vector>
 
 #include "modbus_client.h"
 #include "serial_posix.h"
+#include "serial_timing.h"
 
 namespace modbus {
 
@@ -17,13 +20,35 @@ public:
   // Constructor taking ownership of a Serial object.
   explicit SerialClient(std::unique_ptr<Serial> serial, int timeout_ms);
 
+  // Constructor also taking the parameters the port was opened with. Their
+  // timing model sets the pace of transactions: the line is kept silent
+  // for 3.5 characters between frames, and the time the request and
+  // response take on the wire is added to the timeout, which then only
+  // needs to cover the time the slave takes to answer. Adaptive timeouts
+  // learn that time alone.
+  SerialClient(std::unique_ptr<Serial> serial, int timeout_ms,
+               const SerialParams &params);
+
   // Sends a Modbus request and receives the response.
   absl::StatusOr<std::vector<uint8_t>>
   SendReceive(uint8_t slave_id, FunctionCode function_code,
               const std::vector<uint8_t> &request_data) override;
 
+  // Sends a prepared request's RTU frame as it is.
+  absl::StatusOr<std::vector<uint8_t>>
+  SendPrepared(const PreparedRequest &request) override;
+
 private:
+  // Sends 'adu', the frame of the request, and receives the response.
+  absl::StatusOr<std::vector<uint8_t>>
+  Exchange(uint8_t slave_id, FunctionCode function_code,
+           const std::vector<uint8_t> &request_data,
+           const std::vector<uint8_t> &adu);
+
   std::unique_ptr<Serial> serial_;
+  std::optional<SerialTiming> timing_;
+  // When the line last carried a frame.
+  absl::Time line_busy_until_ = absl::InfinitePast();
 };
 
 } // namespace modbus
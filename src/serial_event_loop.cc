@@ -0,0 +1,328 @@
+#include "serial_event_loop.h"
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "rtu_framing.h"
+#include "serial_posix.h"
+#include "serial_timing.h"
+
+namespace modbus {
+
+namespace {
+
+// Epoll data of a port's file descriptor and of its timer.
+uint64_t PortEvent(size_t index) { return index << 1; }
+uint64_t TimerEvent(size_t index) { return (index << 1) | 1; }
+
+} // namespace
+
+SerialEventLoop::SerialEventLoop()
+    : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)) {}
+
+SerialEventLoop::~SerialEventLoop() {
+  for (auto &port : ports_) {
+    close(port->fd);
+    close(port->timer_fd);
+  }
+  close(epoll_fd_);
+}
+
+absl::StatusOr<size_t> SerialEventLoop::AddPort(const SerialParams &params) {
+  auto fd = OpenSerialPort(params);
+  if (!fd.ok()) {
+    return fd.status();
+  }
+  SerialTiming timing(params);
+  auto index = AddPort(fd.value(), timing.t35());
+  if (index.ok()) {
+    ports_[*index]->timing = timing;
+  }
+  return index;
+}
+
+absl::StatusOr<size_t> SerialEventLoop::AddPort(int fd,
+                                                absl::Duration frame_gap) {
+  auto port = std::make_unique<Port>();
+  port->fd = fd;
+  port->frame_gap = frame_gap;
+  port->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (port->timer_fd < 0) {
+    close(fd);
+    return absl::InternalError("Failed to create timer.");
+  }
+
+  size_t index = ports_.size();
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u64 = PortEvent(index);
+  bool registered = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) == 0;
+  event.data.u64 = TimerEvent(index);
+  registered = registered && epoll_ctl(epoll_fd_, EPOLL_CTL_ADD,
+                                       port->timer_fd, &event) == 0;
+  if (!registered) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    close(port->timer_fd);
+    return absl::InternalError("Failed to add serial port to epoll.");
+  }
+  ports_.push_back(std::move(port));
+  return index;
+}
+
+std::vector<absl::StatusOr<std::vector<uint8_t>>>
+SerialEventLoop::Transact(const std::vector<SerialBatchRequest> &requests,
+                          int timeout_ms) {
+  std::vector<absl::StatusOr<std::vector<uint8_t>>> results(
+      requests.size(), absl::UnknownError("No response."));
+  requests_ = &requests;
+  results_ = &results;
+  response_timeout_ = absl::Milliseconds(timeout_ms);
+  outstanding_ = 0;
+
+  for (size_t i = 0; i < requests.size(); ++i) {
+    const SerialBatchRequest &request = requests[i];
+    if (request.port >= ports_.size()) {
+      results[i] = absl::InvalidArgumentError("Unknown port.");
+      continue;
+    }
+    if (request.data.size() + 4 > kMaxRtuFrameSize) {
+      results[i] = absl::InvalidArgumentError("Request too long.");
+      continue;
+    }
+    Port &port = *ports_[request.port];
+    if (!port.status.ok()) {
+      results[i] = port.status;
+      continue;
+    }
+    port.queue.push_back(i);
+    ++outstanding_;
+  }
+  for (size_t index = 0; index < ports_.size(); ++index) {
+    // Whatever arrived since the last batch is stale.
+    ports_[index]->flush = true;
+    SendNext(index);
+  }
+
+  // Every port is either idle or has its timer armed, so the wait always
+  // ends.
+  struct epoll_event events[64];
+  while (outstanding_ > 0) {
+    int count = epoll_wait(epoll_fd_, events, 64, -1);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      for (size_t index = 0; index < ports_.size(); ++index) {
+        OnError(index, absl::InternalError("Failed to wait for serial I/O."));
+      }
+      break;
+    }
+    for (int i = 0; i < count; ++i) {
+      size_t index = events[i].data.u64 >> 1;
+      Port &port = *ports_[index];
+      if ((events[i].data.u64 & 1) != 0) {
+        OnTimer(index);
+      } else if ((events[i].events & (EPOLLERR | EPOLLHUP)) != 0) {
+        OnError(index, absl::UnavailableError("Serial port failed."));
+      } else if (port.state == Port::State::kReceiving) {
+        OnReadable(index);
+      } else {
+        // Noise on a line that awaits no response: discard it.
+        uint8_t discard[kMaxRtuFrameSize];
+        while (read(port.fd, discard, sizeof(discard)) > 0) {
+        }
+      }
+    }
+  }
+
+  // Ports finish their last transaction in turnaround; nothing follows it.
+  for (auto &port : ports_) {
+    if (port->state == Port::State::kTurnaround) {
+      DisarmTimer(*port);
+      port->state = Port::State::kIdle;
+    }
+    port->queue.clear();
+    port->next = 0;
+  }
+  requests_ = nullptr;
+  results_ = nullptr;
+  return results;
+}
+
+void SerialEventLoop::ArmTimer(Port &port, absl::Duration delay) {
+  // A zero expiry would disarm the timer instead.
+  struct itimerspec spec = {};
+  spec.it_value = absl::ToTimespec(std::max(delay, absl::Nanoseconds(1)));
+  timerfd_settime(port.timer_fd, 0, &spec, nullptr);
+}
+
+void SerialEventLoop::DisarmTimer(Port &port) {
+  struct itimerspec spec = {};
+  timerfd_settime(port.timer_fd, 0, &spec, nullptr);
+}
+
+void SerialEventLoop::SendNext(size_t index) {
+  Port &port = *ports_[index];
+  port.state = Port::State::kIdle;
+  if (port.next == port.queue.size()) {
+    DisarmTimer(port);
+    return;
+  }
+  const SerialBatchRequest &request = (*requests_)[port.queue[port.next]];
+
+  // A late response to an earlier request would be taken for this one.
+  if (port.flush) {
+    tcflush(port.fd, TCIFLUSH);
+    port.flush = false;
+  }
+  std::vector<uint8_t> adu =
+      BuildAdu(request.slave_id, request.function_code, request.data);
+  ssize_t written = write(port.fd, adu.data(), adu.size());
+  if (written != static_cast<ssize_t>(adu.size())) {
+    OnError(index, absl::InternalError("Failed to write to serial port."));
+    return;
+  }
+  port.received = 0;
+  port.state = Port::State::kReceiving;
+  absl::Duration timeout = response_timeout_;
+  if (port.timing.has_value()) {
+    timeout += port.timing->WireTime(request.function_code, request.data);
+  }
+  ArmTimer(port, timeout);
+}
+
+bool SerialEventLoop::OnReadable(size_t index) {
+  Port &port = *ports_[index];
+  size_t before = port.received;
+  absl::StatusOr<size_t> frame_size = size_t{0};
+  bool complete = false;
+  while (!complete) {
+    ssize_t n = read(port.fd, port.frame + port.received,
+                     sizeof(port.frame) - port.received);
+    if (n <= 0) {
+      if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        OnError(index,
+                absl::InternalError("Failed to read from serial port."));
+        return false;
+      }
+      break;
+    }
+    port.received += n;
+    frame_size = RtuResponseSize(port.frame, port.received);
+    complete = (frame_size.ok() && *frame_size != 0 &&
+                port.received >= *frame_size) ||
+               port.received == sizeof(port.frame);
+  }
+  if (port.received == before) {
+    return false;
+  }
+
+  if (complete) {
+    FinishFrame(index);
+  } else if (!frame_size.ok()) {
+    // Only silence can tell where a frame of unknown layout ends.
+    ArmTimer(port, port.frame_gap);
+  }
+  // Otherwise the rest is on its way, however far apart the chunks arrive,
+  // and the response deadline still bounds the wait for it.
+  return true;
+}
+
+void SerialEventLoop::OnTimer(size_t index) {
+  Port &port = *ports_[index];
+  uint64_t expirations;
+  if (read(port.timer_fd, &expirations, sizeof(expirations)) < 0) {
+    return; // Rearmed since it fired.
+  }
+  switch (port.state) {
+  case Port::State::kIdle:
+    break;
+  case Port::State::kReceiving:
+    // Bytes may have arrived in the same wakeup as the expiry.
+    if (OnReadable(index) || port.state != Port::State::kReceiving) {
+      break;
+    }
+    if (port.received == 0) {
+      port.flush = true;
+      Complete(index,
+               absl::DeadlineExceededError("Timed out waiting for response."));
+      SendNext(index);
+    } else {
+      FinishFrame(index);
+    }
+    break;
+  case Port::State::kTurnaround:
+    SendNext(index);
+    break;
+  }
+}
+
+void SerialEventLoop::FinishFrame(size_t index) {
+  Port &port = *ports_[index];
+  const SerialBatchRequest &request = (*requests_)[port.queue[port.next]];
+  const uint8_t *frame = port.frame;
+  size_t size = port.received;
+  auto frame_size = RtuResponseSize(frame, size);
+  if (frame_size.ok() && *frame_size != 0 && *frame_size < size) {
+    size = *frame_size; // Trailing noise.
+  }
+
+  port.flush = true;
+  if (size < 4) {
+    Complete(index, absl::InternalError("Modbus response too short."));
+  } else if (((frame[size - 1] << 8) | frame[size - 2]) !=
+             CalculateCrc16(frame, size - 2)) {
+    Complete(index, absl::DataLossError("Modbus CRC mismatch."));
+  } else if (frame[0] != request.slave_id ||
+             (frame[1] & 0x7F) !=
+                 static_cast<uint8_t>(request.function_code)) {
+    Complete(index, absl::InternalError("Response does not match request."));
+  } else {
+    port.flush = size < port.received;
+    Complete(index, std::vector<uint8_t>(frame + 1, frame + size - 2));
+  }
+
+  // Keep the line silent for a frame gap before the next request.
+  if (port.frame_gap == absl::ZeroDuration()) {
+    SendNext(index);
+    return;
+  }
+  port.state = Port::State::kTurnaround;
+  ArmTimer(port, port.frame_gap);
+}
+
+void SerialEventLoop::Complete(size_t index,
+                               absl::StatusOr<std::vector<uint8_t>> result) {
+  Port &port = *ports_[index];
+  (*results_)[port.queue[port.next++]] = std::move(result);
+  --outstanding_;
+}
+
+void SerialEventLoop::OnError(size_t index, const absl::Status &status) {
+  Port &port = *ports_[index];
+  if (!port.status.ok()) {
+    return;
+  }
+  port.status = status;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, port.fd, nullptr);
+  DisarmTimer(port);
+  port.state = Port::State::kIdle;
+  while (port.next < port.queue.size()) {
+    Complete(index, status);
+  }
+}
+
+} // namespace modbus
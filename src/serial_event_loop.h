@@ -0,0 +1,125 @@
+#ifndef SERIAL_EVENT_LOOP_H_
+#define SERIAL_EVENT_LOOP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "modbus_client.h"
+#include "rtu_framing.h"
+#include "serial.h"
+#include "serial_timing.h"
+
+namespace modbus {
+
+// Struct representing one request of a serial batch.
+struct SerialBatchRequest {
+  // Index of the port, as returned by AddPort.
+  size_t port;
+  uint8_t slave_id;
+  FunctionCode function_code;
+  std::vector<uint8_t> data;
+};
+
+// Modbus RTU master that drives many serial ports from a single thread.
+// Each port has one transaction on the line at a time; the ports run
+// theirs concurrently, all waited on by one epoll loop. Every port has a
+// timerfd that bounds the wait for a response, and finally spaces the next
+// request from the response. Frames of known layout end as soon as their
+// last byte arrives, however far apart their chunks are, like SerialClient;
+// only frames of unknown layout end once the line goes silent between
+// characters. Not thread-safe.
+class SerialEventLoop {
+public:
+  SerialEventLoop();
+  ~SerialEventLoop();
+
+  SerialEventLoop(const SerialEventLoop &) = delete;
+  SerialEventLoop &operator=(const SerialEventLoop &) = delete;
+
+  // Opens the serial port described by 'params' and returns its index. The
+  // frame gap and the time frames take on the wire follow from 'params'.
+  absl::StatusOr<size_t> AddPort(const SerialParams &params);
+
+  // Takes ownership of 'fd', an open, non-blocking serial port, and returns
+  // its index. 'frame_gap' is the silent interval that ends a frame.
+  absl::StatusOr<size_t> AddPort(int fd, absl::Duration frame_gap);
+
+  // Sends 'requests', those for the same port one after the other, and
+  // returns the response PDU of each, in the order of 'requests'. Each
+  // request waits up to 'timeout_ms' for its response to start, plus the
+  // time the request and response take on the wire if the port's timing is
+  // known, and fails with kDeadlineExceeded if it does not.
+  std::vector<absl::StatusOr<std::vector<uint8_t>>>
+  Transact(const std::vector<SerialBatchRequest> &requests, int timeout_ms);
+
+  // Returns the number of ports.
+  size_t size() const { return ports_.size(); }
+
+private:
+  struct Port {
+    enum class State {
+      kIdle,
+      // Waiting for the response to the current request.
+      kReceiving,
+      // Keeping the line silent before the next request.
+      kTurnaround,
+    };
+
+    int fd = -1;
+    int timer_fd = -1;
+    absl::Duration frame_gap;
+    std::optional<SerialTiming> timing;
+    State state = State::kIdle;
+    // Requests of the running batch for this port, and the next to send.
+    std::vector<size_t> queue;
+    size_t next = 0;
+    uint8_t frame[kMaxRtuFrameSize];
+    size_t received = 0;
+    // Set when stale input may be waiting, to flush it before the next
+    // request.
+    bool flush = false;
+    // Set once the port failed; its requests fail with it.
+    absl::Status status;
+  };
+
+  // Arms the timer of 'port' to expire after 'delay', or disarms it.
+  void ArmTimer(Port &port, absl::Duration delay);
+  void DisarmTimer(Port &port);
+
+  // Sends the next queued request of 'port', if any.
+  void SendNext(size_t index);
+
+  // Reads what the port received. Returns true if it got any bytes.
+  bool OnReadable(size_t index);
+
+  // Handles the expiry of the timer of 'port'.
+  void OnTimer(size_t index);
+
+  // Validates the received frame and completes the current request.
+  void FinishFrame(size_t index);
+
+  // Completes the current request of 'port' with 'result'.
+  void Complete(size_t index, absl::StatusOr<std::vector<uint8_t>> result);
+
+  // Fails 'port' and everything queued on it.
+  void OnError(size_t index, const absl::Status &status);
+
+  int epoll_fd_;
+  std::vector<std::unique_ptr<Port>> ports_;
+
+  // State of the running batch.
+  const std::vector<SerialBatchRequest> *requests_ = nullptr;
+  std::vector<absl::StatusOr<std::vector<uint8_t>>> *results_ = nullptr;
+  size_t outstanding_ = 0;
+  absl::Duration response_timeout_;
+};
+
+} // namespace modbus
+
+#endif // SERIAL_EVENT_LOOP_H_
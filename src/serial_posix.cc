@@ -1,10 +1,15 @@
 #include "serial_posix.h"
 
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <termios.h>
 #include <unistd.h>
 
+#if defined(__linux__)
+#include <linux/serial.h>
+#endif
+
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 
@@ -26,23 +31,10 @@ tcflag_t ParityToTermios(Parity parity) {
   }
 }
 
-} // namespace
-
-SerialPosix::~SerialPosix() { Close().IgnoreError(); }
-
-absl::Status SerialPosix::Open(const SerialParams &params) {
-  if (fd_ >= 0) {
-    return absl::FailedPreconditionError("Serial port already open.");
-  }
-
-  fd_ = open(params.port.c_str(), O_RDWR | O_NOCTTY | O_NDELAY);
-  if (fd_ < 0) {
-    return absl::InternalError("Failed to open serial port.");
-  }
-
-  // Configure serial port parameters.
+// Configures the open port 'fd' as described by 'params'.
+absl::Status ConfigureSerialPort(int fd, const SerialParams &params) {
   struct termios tty;
-  tcgetattr(fd_, &tty);
+  tcgetattr(fd, &tty);
 
   cfsetospeed(&tty, params.baud_rate);
   cfsetispeed(&tty, params.baud_rate);
@@ -54,7 +46,7 @@ absl::Status SerialPosix::Open(const SerialParams &params) {
   tty.c_cc[VMIN] = 0;
   tty.c_cc[VTIME] = 0;
 
-  tcsetattr(fd_, TCSANOW, &tty);
+  tcsetattr(fd, TCSANOW, &tty);
 
   // Set parity.
   if (auto parity = ParityToTermios(params.parity); parity < 0) {
@@ -89,8 +81,55 @@ absl::Status SerialPosix::Open(const SerialParams &params) {
     return absl::InvalidArgumentError("Invalid stop bits value.");
   }
 
-  tcsetattr(fd_, TCSANOW, &tty);
+  tcsetattr(fd, TCSANOW, &tty);
+
+  if (params.low_latency) {
+#if defined(__linux__)
+    struct serial_struct serial;
+    if (ioctl(fd, TIOCGSERIAL, &serial) < 0) {
+      return absl::UnimplementedError(
+          "Serial port does not support low latency mode.");
+    }
+    serial.flags |= ASYNC_LOW_LATENCY;
+    if (ioctl(fd, TIOCSSERIAL, &serial) < 0) {
+      return absl::InternalError("Failed to set low latency mode.");
+    }
+#else
+    return absl::UnimplementedError(
+        "Low latency mode is only supported on Linux.");
+#endif
+  }
+
+  return absl::OkStatus();
+}
+
+} // namespace
+
+absl::StatusOr<int> OpenSerialPort(const SerialParams &params) {
+  int fd = open(params.port.c_str(), O_RDWR | O_NOCTTY | O_NDELAY);
+  if (fd < 0) {
+    return absl::InternalError("Failed to open serial port.");
+  }
+  absl::Status status = ConfigureSerialPort(fd, params);
+  if (!status.ok()) {
+    close(fd);
+    return status;
+  }
+  return fd;
+}
 
+SerialPosix::~SerialPosix() { Close().IgnoreError(); }
+
+absl::Status SerialPosix::Open(const SerialParams &params) {
+  if (fd_ >= 0) {
+    return absl::FailedPreconditionError("Serial port already open.");
+  }
+
+  auto fd = OpenSerialPort(params);
+  if (!fd.ok()) {
+    return fd.status();
+  }
+  fd_ = fd.value();
   return absl::OkStatus();
 }
 
@@ -119,15 +158,8 @@ absl::StatusOr<size_t> SerialPosix::Read(uint8_t *buffer, size_t length,
     return absl::FailedPreconditionError("Serial port not open.");
   }
 
-  fd_set read_fds;
-  FD_ZERO(&read_fds);
-  FD_SET(fd_, &read_fds);
-
-  struct timeval timeout;
-  timeout.tv_sec = timeout_ms / 1000;
-  timeout.tv_usec = (timeout_ms % 1000) * 1000;
-
-  int result = select(fd_ + 1, &read_fds, nullptr, nullptr, &timeout);
+  struct pollfd pfd = {fd_, POLLIN, 0};
+  int result = poll(&pfd, 1, timeout_ms);
   if (result < 0) {
     return absl::InternalError("Error during serial read.");
   } else if (result == 0) {
@@ -1,10 +1,15 @@
 #ifndef SERIAL_POSIX_H_
 #define SERIAL_POSIX_H_
 
+#include "absl/status/statusor.h"
 #include "serial.h"
 
 namespace modbus {
 
+// Opens the serial port described by 'params' and configures it for raw,
+// non-blocking I/O. Returns the file descriptor.
+absl::StatusOr<int> OpenSerialPort(const SerialParams &params);
+
 // Concrete implementation of Serial for POSIX.
 class SerialPosix : public Serial {
 public:
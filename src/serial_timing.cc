@@ -0,0 +1,47 @@
+#include "serial_timing.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "rtu_framing.h"
+
+namespace modbus {
+
+namespace {
+
+// Size of slave ID, function code and CRC.
+constexpr size_t kRtuFrameOverhead = 4;
+
+} // namespace
+
+SerialTiming::SerialTiming(const SerialParams &params) {
+  int bits = 1 + params.data_bits + (params.parity != Parity::kNone ? 1 : 0) +
+             params.stop_bits;
+  character_time_ = absl::Seconds(bits) / params.baud_rate;
+  if (params.baud_rate > 19200) {
+    // Above 19200 baud, the intervals would be too short for UARTs to
+    // time, so the specification fixes them.
+    t15_ = absl::Microseconds(750);
+    t35_ = absl::Microseconds(1750);
+  } else {
+    t15_ = absl::Seconds(1.5 * bits) / params.baud_rate;
+    t35_ = absl::Seconds(3.5 * bits) / params.baud_rate;
+  }
+}
+
+absl::Duration
+SerialTiming::RequestTime(const std::vector<uint8_t> &request_data) const {
+  return TransmitTime(kRtuFrameOverhead + request_data.size());
+}
+
+absl::Duration
+SerialTiming::ResponseTime(FunctionCode function_code,
+                           const std::vector<uint8_t> &request_data) const {
+  size_t size = ExpectedRtuResponseSize(function_code, request_data.data(),
+                                        request_data.size());
+  return TransmitTime(size != 0 ? size : kMaxRtuFrameSize);
+}
+
+} // namespace modbus
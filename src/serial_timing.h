@@ -0,0 +1,63 @@
+#ifndef SERIAL_TIMING_H_
+#define SERIAL_TIMING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "modbus_client.h"
+#include "serial.h"
+
+namespace modbus {
+
+// Timing of Modbus RTU transmissions on a serial line, derived from its
+// parameters: how long characters and frames take on the wire, and the
+// silent intervals the specification requires between them.
+class SerialTiming {
+public:
+  explicit SerialTiming(const SerialParams &params);
+
+  // Time to transmit one character: start bit, data bits, parity bit and
+  // stop bits.
+  absl::Duration character_time() const { return character_time_; }
+
+  // Longest silence allowed between the characters of a frame: 1.5
+  // characters, fixed at 750 us above 19200 baud.
+  absl::Duration t15() const { return t15_; }
+
+  // Shortest silence between frames: 3.5 characters, fixed at 1.75 ms above
+  // 19200 baud. A silence this long also ends the frame being received.
+  absl::Duration t35() const { return t35_; }
+
+  // Time to transmit 'size' bytes.
+  absl::Duration TransmitTime(size_t size) const {
+    return character_time_ * static_cast<int64_t>(size);
+  }
+
+  // Time to transmit the request frame carrying 'request_data'.
+  absl::Duration RequestTime(const std::vector<uint8_t> &request_data) const;
+
+  // Time to transmit the normal response to a request with 'function_code'
+  // and 'request_data'. Function codes of unknown layout are assumed to get
+  // a frame of the maximum size.
+  absl::Duration ResponseTime(FunctionCode function_code,
+                              const std::vector<uint8_t> &request_data) const;
+
+  // Time the request and its response spend on the wire, which a response
+  // timeout must allow for on top of the time the slave takes to answer.
+  absl::Duration WireTime(FunctionCode function_code,
+                          const std::vector<uint8_t> &request_data) const {
+    return RequestTime(request_data) +
+           ResponseTime(function_code, request_data);
+  }
+
+private:
+  absl::Duration character_time_;
+  absl::Duration t15_;
+  absl::Duration t35_;
+};
+
+} // namespace modbus
+
+#endif // SERIAL_TIMING_H_
@@ -0,0 +1,186 @@
+#include "tag_batch.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace modbus {
+
+namespace {
+
+constexpr int kFieldCount = 4;
+// The only nullable field.
+constexpr int kValueField = 2;
+
+constexpr const char *kFieldNames[kFieldCount] = {"timestamp", "tag_id",
+                                                  "value", "quality"};
+constexpr const char *kFieldFormats[kFieldCount] = {"tsu:", "I", "g", "C"};
+
+// Storage of an exported schema or array and its children. The parent and
+// every child each hold a reference to it in their private data, so a child
+// that a consumer moves out stays valid after the parent is released; the
+// storage is freed with the last reference.
+struct ExportedSchema {
+  ArrowSchema fields[kFieldCount];
+  ArrowSchema *children[kFieldCount];
+};
+
+struct ExportedArray {
+  ArrowArray fields[kFieldCount];
+  ArrowArray *children[kFieldCount];
+  const void *buffers[kFieldCount][2];
+  const void *parent_buffers[1] = {nullptr};
+};
+
+// Drops the reference of a child to the storage.
+template <typename Exported, typename Arrow> void ReleaseChild(Arrow *child) {
+  delete static_cast<std::shared_ptr<Exported> *>(child->private_data);
+  child->release = nullptr;
+}
+
+// Releases the children that were not moved out, then drops the reference
+// of the parent to the storage.
+template <typename Exported, typename Arrow> void ReleaseParent(Arrow *parent) {
+  auto *exported =
+      static_cast<std::shared_ptr<Exported> *>(parent->private_data);
+  for (Arrow &field : (*exported)->fields) {
+    if (field.release != nullptr) {
+      field.release(&field);
+    }
+  }
+  delete exported;
+  parent->release = nullptr;
+}
+
+} // namespace
+
+void TagBatch::Clear() {
+  timestamps_.clear();
+  tag_ids_.clear();
+  values_.clear();
+  validity_.clear();
+  qualities_.clear();
+  null_count_ = 0;
+}
+
+void TagBatch::Reserve(size_t rows) {
+  timestamps_.reserve(rows);
+  tag_ids_.reserve(rows);
+  values_.reserve(rows);
+  validity_.reserve((rows + 7) / 8);
+  qualities_.reserve(rows);
+}
+
+void TagBatch::Append(int64_t timestamp_us, uint32_t tag_id, double value,
+                      absl::StatusCode quality) {
+  size_t row = size();
+  if (row % 8 == 0) {
+    validity_.push_back(0);
+  }
+  if (quality == absl::StatusCode::kOk) {
+    validity_.back() |= 1 << (row % 8);
+  } else {
+    value = 0;
+    ++null_count_;
+  }
+  timestamps_.push_back(timestamp_us);
+  tag_ids_.push_back(tag_id);
+  values_.push_back(value);
+  qualities_.push_back(static_cast<uint8_t>(quality));
+}
+
+absl::Status PollTags(Client *client, const TagDatabase &database,
+                      const std::vector<TagRead> &plan, TagBatch *batch) {
+  absl::Status first_error;
+  for (const TagRead &read : plan) {
+    auto response = client->SendPrepared(read.request);
+    int64_t timestamp = absl::ToUnixMicros(absl::Now());
+    absl::Status status =
+        response.ok() ? read.request.CheckResponse(response.value())
+                      : response.status();
+    if (!status.ok()) {
+      for (const TagSlot &slot : read.slots) {
+        batch->Append(timestamp, slot.tag, 0, status.code());
+      }
+      first_error.Update(status);
+      continue;
+    }
+    const uint8_t *data = response->data() + 2;
+    for (const TagSlot &slot : read.slots) {
+      batch->Append(timestamp, slot.tag,
+                    DecodeTagValue(database.tag(slot.tag), data, slot.offset),
+                    absl::StatusCode::kOk);
+    }
+  }
+  return first_error;
+}
+
+void ExportArrow(const TagBatch &batch, ArrowSchema *schema,
+                 ArrowArray *array) {
+  auto exported_schema = std::make_shared<ExportedSchema>();
+  for (int i = 0; i < kFieldCount; ++i) {
+    exported_schema->fields[i] = {
+        kFieldFormats[i],
+        kFieldNames[i],
+        nullptr,
+        i == kValueField ? ARROW_FLAG_NULLABLE : 0,
+        0,
+        nullptr,
+        nullptr,
+        ReleaseChild<ExportedSchema, ArrowSchema>,
+        new std::shared_ptr<ExportedSchema>(exported_schema)};
+    exported_schema->children[i] = &exported_schema->fields[i];
+  }
+  *schema = {"+s",
+             nullptr,
+             nullptr,
+             0,
+             kFieldCount,
+             exported_schema->children,
+             nullptr,
+             ReleaseParent<ExportedSchema, ArrowSchema>,
+             new std::shared_ptr<ExportedSchema>(std::move(exported_schema))};
+
+  auto exported_array = std::make_shared<ExportedArray>();
+  const void *data[kFieldCount] = {batch.timestamps().data(),
+                                   batch.tag_ids().data(),
+                                   batch.values().data(),
+                                   batch.qualities().data()};
+  int64_t length = batch.size();
+  for (int i = 0; i < kFieldCount; ++i) {
+    int64_t null_count = i == kValueField ? batch.null_count() : 0;
+    exported_array->buffers[i][0] =
+        null_count > 0 ? batch.validity().data() : nullptr;
+    exported_array->buffers[i][1] = data[i];
+    exported_array->fields[i] = {length,
+                                 null_count,
+                                 0,
+                                 2,
+                                 0,
+                                 exported_array->buffers[i],
+                                 nullptr,
+                                 nullptr,
+                                 ReleaseChild<ExportedArray, ArrowArray>,
+                                 new std::shared_ptr<ExportedArray>(
+                                     exported_array)};
+    exported_array->children[i] = &exported_array->fields[i];
+  }
+  *array = {length,
+            0,
+            0,
+            1,
+            kFieldCount,
+            exported_array->parent_buffers,
+            exported_array->children,
+            nullptr,
+            ReleaseParent<ExportedArray, ArrowArray>,
+            new std::shared_ptr<ExportedArray>(std::move(exported_array))};
+}
+
+} // namespace modbus
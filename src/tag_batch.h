@@ -0,0 +1,147 @@
+#ifndef TAG_BATCH_H_
+#define TAG_BATCH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "modbus_client.h"
+#include "tag_database.h"
+
+namespace modbus {
+
+// Allocator of column buffers, aligned to 64 bytes as Arrow recommends.
+template <typename T> struct ColumnAllocator {
+  using value_type = T;
+  static constexpr std::align_val_t kAlignment{64};
+
+  ColumnAllocator() = default;
+  template <typename U> ColumnAllocator(const ColumnAllocator<U> &) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(::operator new(n * sizeof(T), kAlignment));
+  }
+  void deallocate(T *p, size_t) { ::operator delete(p, kAlignment); }
+
+  template <typename U> bool operator==(const ColumnAllocator<U> &) const {
+    return true;
+  }
+  template <typename U> bool operator!=(const ColumnAllocator<U> &) const {
+    return false;
+  }
+};
+
+template <typename T> using Column = std::vector<T, ColumnAllocator<T>>;
+
+// Tag values of one or more poll cycles, stored by column: one row per tag
+// read, with the time its response arrived, the index of the tag in its
+// database, its scaled value and the status code of its read. The columns
+// have the memory layout of Arrow arrays, so they can be handed to Arrow
+// without copying; see ExportArrow. Clear keeps the buffers, so a batch
+// reused for every cycle stops allocating once it has grown to the size of
+// a cycle. Not thread-safe.
+class TagBatch {
+public:
+  // Removes every row, keeping the buffers.
+  void Clear();
+
+  // Makes room for 'rows' rows.
+  void Reserve(size_t rows);
+
+  // Appends a row. The value is null unless 'quality' is kOk.
+  void Append(int64_t timestamp_us, uint32_t tag_id, double value,
+              absl::StatusCode quality);
+
+  // Returns the number of rows.
+  size_t size() const { return timestamps_.size(); }
+
+  // Returns the number of rows without a value.
+  size_t null_count() const { return null_count_; }
+
+  // Time the response of each row arrived, in microseconds since the Unix
+  // epoch.
+  absl::Span<const int64_t> timestamps() const { return timestamps_; }
+
+  // Index of the tag of each row in its database.
+  absl::Span<const uint32_t> tag_ids() const { return tag_ids_; }
+
+  // Value of each row, or 0 for rows without one.
+  absl::Span<const double> values() const { return values_; }
+
+  // Validity bitmap of values(): bit i, counting from the least significant
+  // bit of byte i / 8, is set if row i has a value.
+  absl::Span<const uint8_t> validity() const { return validity_; }
+
+  // absl::StatusCode of the read of each row.
+  absl::Span<const uint8_t> qualities() const { return qualities_; }
+
+private:
+  Column<int64_t> timestamps_;
+  Column<uint32_t> tag_ids_;
+  Column<double> values_;
+  Column<uint8_t> validity_;
+  Column<uint8_t> qualities_;
+  size_t null_count_ = 0;
+};
+
+// Sends the reads of 'plan', made for tags of 'database', and appends a row
+// for every tag to 'batch'. A poll cycle over many devices appends the plan
+// of each device to the same batch. Returns the first failure once every
+// read was sent; the tags of failed reads have null values.
+absl::Status PollTags(Client *client, const TagDatabase &database,
+                      const std::vector<TagRead> &plan, TagBatch *batch);
+
+} // namespace modbus
+
+// Structs of the Arrow C data interface, as defined by its specification.
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  const char *format;
+  const char *name;
+  const char *metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema **children;
+  struct ArrowSchema *dictionary;
+  void (*release)(struct ArrowSchema *);
+  void *private_data;
+};
+
+struct ArrowArray {
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void **buffers;
+  struct ArrowArray **children;
+  struct ArrowArray *dictionary;
+  void (*release)(struct ArrowArray *);
+  void *private_data;
+};
+
+#endif // ARROW_C_DATA_INTERFACE
+
+namespace modbus {
+
+// Exports 'batch' through the Arrow C data interface as a struct array with
+// the fields timestamp (timestamp[us]), tag_id (uint32), value (float64,
+// nullable) and quality (uint8). The array points into the buffers of
+// 'batch', which must not change until the array, and every child a
+// consumer moved out of it, is released.
+void ExportArrow(const TagBatch &batch, ArrowSchema *schema,
+                 ArrowArray *array);
+
+} // namespace modbus
+
+#endif // TAG_BATCH_H_
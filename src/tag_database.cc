@@ -0,0 +1,621 @@
+#include "tag_database.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <tuple>
+#include <utility>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "modbus_functions.h"
+
+namespace modbus {
+
+namespace {
+
+// "MTDB" read as a host-order integer, so that an image of the other byte
+// order is rejected.
+constexpr uint32_t kMagic = 0x4244544D;
+constexpr uint32_t kVersion = 1;
+
+// Header of a database image. It is followed by the bucket table, the
+// records, padded to 8 bytes, and the names.
+struct ImageHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t salt;
+  uint32_t tag_count;
+  uint32_t bucket_count;
+  uint64_t names_size;
+};
+
+static_assert(sizeof(ImageHeader) == 32);
+static_assert(sizeof(TagRecord) == 24);
+
+// Average number of tags per bucket of the perfect hash.
+constexpr uint32_t kTagsPerBucket = 4;
+
+// Marks a bucket entry that holds the slot of its single tag instead of a
+// seed.
+constexpr uint32_t kDirectSlot = 0x80000000;
+
+// Seeds tried for a bucket before starting over with another salt.
+constexpr uint32_t kMaxSeeds = 1 << 20;
+
+constexpr uint64_t kGolden = 0x9E3779B97F4A7C15;
+
+uint64_t Mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xFF51AFD7ED558CCD;
+  x ^= x >> 33;
+  x *= 0xC4CEB9FE1A85EC53;
+  x ^= x >> 33;
+  return x;
+}
+
+uint64_t HashName(absl::string_view name, uint64_t salt) {
+  uint64_t hash = salt ^ (name.size() * kGolden);
+  size_t i = 0;
+  for (; i + 8 <= name.size(); i += 8) {
+    uint64_t chunk;
+    memcpy(&chunk, name.data() + i, 8);
+    hash = Mix(hash ^ chunk);
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, name.data() + i, name.size() - i);
+  return Mix(hash ^ tail ^ kGolden);
+}
+
+uint32_t BucketOf(uint64_t hash, uint32_t bucket_count) {
+  return static_cast<uint32_t>((hash >> 32) % bucket_count);
+}
+
+uint32_t SlotOf(uint64_t hash, uint32_t seed, uint32_t tag_count) {
+  return static_cast<uint32_t>(Mix(hash ^ ((seed + 1ull) * kGolden)) %
+                               tag_count);
+}
+
+size_t RecordsOffset(uint32_t bucket_count) {
+  size_t offset = sizeof(ImageHeader) + 4ull * bucket_count;
+  return (offset + 7) & ~size_t{7};
+}
+
+// Computes a minimal perfect hash of 'hashes' by hash and displace: the
+// tags are split into buckets, and each bucket, largest first, gets the
+// first seed that sends its tags to free slots. Buckets of a single tag
+// come last and take the remaining slots directly. Returns the bucket
+// table and stores the slot of each tag in 'slots', or returns an empty
+// table if some bucket found no seed.
+std::vector<uint32_t> BuildBuckets(const std::vector<uint64_t> &hashes,
+                                   uint32_t bucket_count,
+                                   std::vector<uint32_t> *slots) {
+  uint32_t tag_count = hashes.size();
+  std::vector<std::vector<uint32_t>> members(bucket_count);
+  for (uint32_t i = 0; i < tag_count; ++i) {
+    members[BucketOf(hashes[i], bucket_count)].push_back(i);
+  }
+  std::vector<uint32_t> order(bucket_count);
+  for (uint32_t i = 0; i < bucket_count; ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return members[a].size() > members[b].size();
+  });
+
+  std::vector<uint32_t> buckets(bucket_count, 0);
+  std::vector<bool> taken(tag_count, false);
+  slots->assign(tag_count, 0);
+  std::vector<uint32_t> candidate;
+  uint32_t next_free = 0;
+  for (uint32_t bucket : order) {
+    const std::vector<uint32_t> &tags = members[bucket];
+    if (tags.empty()) {
+      break;
+    }
+    if (tags.size() == 1) {
+      while (taken[next_free]) {
+        ++next_free;
+      }
+      taken[next_free] = true;
+      (*slots)[tags[0]] = next_free;
+      buckets[bucket] = kDirectSlot | next_free;
+      continue;
+    }
+    uint32_t seed = 0;
+    for (; seed < kMaxSeeds; ++seed) {
+      candidate.clear();
+      bool fits = true;
+      for (uint32_t tag : tags) {
+        uint32_t slot = SlotOf(hashes[tag], seed, tag_count);
+        if (taken[slot] || std::find(candidate.begin(), candidate.end(),
+                                     slot) != candidate.end()) {
+          fits = false;
+          break;
+        }
+        candidate.push_back(slot);
+      }
+      if (fits) {
+        break;
+      }
+    }
+    if (seed == kMaxSeeds) {
+      return {};
+    }
+    for (size_t i = 0; i < tags.size(); ++i) {
+      taken[candidate[i]] = true;
+      (*slots)[tags[i]] = candidate[i];
+    }
+    buckets[bucket] = seed;
+  }
+  return buckets;
+}
+
+absl::Status CheckDefinition(const TagDefinition &tag) {
+  if (tag.name.empty() ||
+      tag.name.size() > std::numeric_limits<uint16_t>::max()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid tag name size: ", tag.name.size()));
+  }
+  bool bits = tag.function_code == FunctionCode::kReadCoils ||
+              tag.function_code == FunctionCode::kReadDiscreteInputs;
+  bool registers = tag.function_code == FunctionCode::kReadHoldingRegisters ||
+                   tag.function_code == FunctionCode::kReadInputRegisters;
+  if (!bits && !registers) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Tag ", tag.name, " is not in a readable table."));
+  }
+  if (bits != (tag.type == TagType::kBool)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Type of tag ", tag.name, " does not fit its table."));
+  }
+  if (tag.address + TagQuantity(tag.type) > 0x10000) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Tag ", tag.name, " extends past the last address."));
+  }
+  return absl::OkStatus();
+}
+
+// Checks a record of an image the way CheckDefinition checks a definition.
+absl::Status CheckRecord(const TagRecord &tag) {
+  bool bits =
+      tag.read_function_code() == FunctionCode::kReadCoils ||
+      tag.read_function_code() == FunctionCode::kReadDiscreteInputs;
+  bool registers =
+      tag.read_function_code() == FunctionCode::kReadHoldingRegisters ||
+      tag.read_function_code() == FunctionCode::kReadInputRegisters;
+  if ((!bits && !registers) ||
+      tag.type > static_cast<uint8_t>(TagType::kFloat64) ||
+      bits != (tag.tag_type() == TagType::kBool) ||
+      tag.word_order > static_cast<uint8_t>(WordOrder::kLowWordFirst) ||
+      tag.address + TagQuantity(tag.tag_type()) > 0x10000) {
+    return absl::InvalidArgumentError("Corrupt tag record.");
+  }
+  return absl::OkStatus();
+}
+
+std::optional<FunctionCode> ParseTable(absl::string_view table) {
+  if (table == "coil") {
+    return FunctionCode::kReadCoils;
+  } else if (table == "discrete_input") {
+    return FunctionCode::kReadDiscreteInputs;
+  } else if (table == "holding_register") {
+    return FunctionCode::kReadHoldingRegisters;
+  } else if (table == "input_register") {
+    return FunctionCode::kReadInputRegisters;
+  }
+  return std::nullopt;
+}
+
+std::optional<TagType> ParseType(absl::string_view type) {
+  static constexpr std::pair<absl::string_view, TagType> kTypes[] = {
+      {"bool", TagType::kBool},       {"uint16", TagType::kUint16},
+      {"int16", TagType::kInt16},     {"uint32", TagType::kUint32},
+      {"int32", TagType::kInt32},     {"uint64", TagType::kUint64},
+      {"int64", TagType::kInt64},     {"float32", TagType::kFloat32},
+      {"float64", TagType::kFloat64},
+  };
+  for (const auto &[name, value] : kTypes) {
+    if (type == name) {
+      return value;
+    }
+  }
+  return std::nullopt;
+}
+
+template <WordOrder Order>
+double DecodeRegisters(TagType type, const uint8_t *data) {
+  using device_map_internal::DecodeRaw;
+  switch (type) {
+  case TagType::kUint16:
+    return DecodeRaw<uint16_t, Order>(data);
+  case TagType::kInt16:
+    return DecodeRaw<int16_t, Order>(data);
+  case TagType::kUint32:
+    return DecodeRaw<uint32_t, Order>(data);
+  case TagType::kInt32:
+    return DecodeRaw<int32_t, Order>(data);
+  case TagType::kUint64:
+    return DecodeRaw<uint64_t, Order>(data);
+  case TagType::kInt64:
+    return DecodeRaw<int64_t, Order>(data);
+  case TagType::kFloat32:
+    return DecodeRaw<float, Order>(data);
+  case TagType::kFloat64:
+    return DecodeRaw<double, Order>(data);
+  case TagType::kBool:
+    break;
+  }
+  return std::nan("");
+}
+
+} // namespace
+
+uint16_t TagQuantity(TagType type) {
+  switch (type) {
+  case TagType::kBool:
+  case TagType::kUint16:
+  case TagType::kInt16:
+    return 1;
+  case TagType::kUint32:
+  case TagType::kInt32:
+  case TagType::kFloat32:
+    return 2;
+  case TagType::kUint64:
+  case TagType::kInt64:
+  case TagType::kFloat64:
+    return 4;
+  }
+  return 1;
+}
+
+absl::StatusOr<std::vector<TagDefinition>> ParseTagCsv(absl::string_view csv) {
+  std::vector<TagDefinition> tags;
+  int line_number = 0;
+  for (absl::string_view line : absl::StrSplit(csv, '\n')) {
+    ++line_number;
+    line = absl::StripAsciiWhitespace(line);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::vector<absl::string_view> fields = absl::StrSplit(line, ',');
+    auto error = [&](absl::string_view what) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Line ", line_number, ": ", what));
+    };
+    if (fields.size() < 5 || fields.size() > 7) {
+      return error("Expected 5 to 7 fields.");
+    }
+    for (absl::string_view &field : fields) {
+      field = absl::StripAsciiWhitespace(field);
+    }
+    TagDefinition tag;
+    tag.name = std::string(fields[0]);
+    uint32_t slave_id, address;
+    if (!absl::SimpleAtoi(fields[1], &slave_id) || slave_id > 255) {
+      return error("Invalid slave ID.");
+    }
+    tag.slave_id = slave_id;
+    std::optional<FunctionCode> table = ParseTable(fields[2]);
+    if (!table.has_value()) {
+      return error("Invalid table.");
+    }
+    tag.function_code = *table;
+    if (!absl::SimpleAtoi(fields[3], &address) || address > 0xFFFF) {
+      return error("Invalid address.");
+    }
+    tag.address = address;
+    std::optional<TagType> type = ParseType(fields[4]);
+    if (!type.has_value()) {
+      return error("Invalid type.");
+    }
+    tag.type = *type;
+    if (fields.size() > 5 && !fields[5].empty()) {
+      if (fields[5] == "low_first") {
+        tag.word_order = WordOrder::kLowWordFirst;
+      } else if (fields[5] != "high_first") {
+        return error("Invalid word order.");
+      }
+    }
+    if (fields.size() > 6 && !absl::SimpleAtod(fields[6], &tag.scale)) {
+      return error("Invalid scale.");
+    }
+    absl::Status status = CheckDefinition(tag);
+    if (!status.ok()) {
+      return error(status.message());
+    }
+    tags.push_back(std::move(tag));
+  }
+  return tags;
+}
+
+absl::StatusOr<std::string>
+BuildTagImage(const std::vector<TagDefinition> &tags) {
+  if (tags.size() >= kDirectSlot) {
+    return absl::InvalidArgumentError("Too many tags.");
+  }
+  absl::flat_hash_set<absl::string_view> names;
+  uint64_t names_size = 0;
+  for (const TagDefinition &tag : tags) {
+    absl::Status status = CheckDefinition(tag);
+    if (!status.ok()) {
+      return status;
+    }
+    if (!names.insert(tag.name).second) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Duplicate tag name: ", tag.name));
+    }
+    names_size += tag.name.size();
+  }
+  if (names_size > std::numeric_limits<uint32_t>::max()) {
+    return absl::InvalidArgumentError("Tag names too large.");
+  }
+
+  uint32_t tag_count = tags.size();
+  uint32_t bucket_count = std::max<uint32_t>(
+      1, (tag_count + kTagsPerBucket - 1) / kTagsPerBucket);
+  std::vector<uint64_t> hashes(tag_count);
+  std::vector<uint32_t> buckets;
+  std::vector<uint32_t> slots;
+  uint64_t salt = 0;
+  for (int attempt = 0; tag_count > 0; ++attempt) {
+    if (attempt == 16) {
+      return absl::InternalError("Failed to compute a perfect hash.");
+    }
+    salt = Mix(attempt + kGolden);
+    for (uint32_t i = 0; i < tag_count; ++i) {
+      hashes[i] = HashName(tags[i].name, salt);
+    }
+    buckets = BuildBuckets(hashes, bucket_count, &slots);
+    if (!buckets.empty()) {
+      break;
+    }
+  }
+  buckets.resize(bucket_count, 0);
+
+  size_t records_offset = RecordsOffset(bucket_count);
+  size_t names_offset = records_offset + sizeof(TagRecord) * tag_count;
+  std::string image(names_offset + names_size, '\0');
+  ImageHeader header = {kMagic,    kVersion,     salt,
+                        tag_count, bucket_count, names_size};
+  memcpy(image.data(), &header, sizeof(header));
+  memcpy(image.data() + sizeof(header), buckets.data(), 4 * bucket_count);
+  uint32_t name_offset = 0;
+  for (uint32_t i = 0; i < tag_count; ++i) {
+    const TagDefinition &tag = tags[i];
+    TagRecord record = {};
+    record.name_offset = name_offset;
+    record.name_size = tag.name.size();
+    record.slave_id = tag.slave_id;
+    record.function_code = static_cast<uint8_t>(tag.function_code);
+    record.address = tag.address;
+    record.type = static_cast<uint8_t>(tag.type);
+    record.word_order = static_cast<uint8_t>(tag.word_order);
+    record.scale = tag.scale;
+    memcpy(image.data() + records_offset + sizeof(TagRecord) * slots[i],
+           &record, sizeof(record));
+    memcpy(image.data() + names_offset + name_offset, tag.name.data(),
+           tag.name.size());
+    name_offset += tag.name.size();
+  }
+  return image;
+}
+
+TagDatabase::~TagDatabase() {
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+  }
+}
+
+absl::StatusOr<std::unique_ptr<TagDatabase>>
+TagDatabase::Open(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("Failed to open ", path));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    int error = errno;
+    close(fd);
+    return absl::ErrnoToStatus(error, "Failed to stat tag database.");
+  }
+  if (st.st_size < static_cast<off_t>(sizeof(ImageHeader))) {
+    close(fd);
+    return absl::InvalidArgumentError("Tag database image too small.");
+  }
+  void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  int error = errno;
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return absl::ErrnoToStatus(error, "Failed to map tag database.");
+  }
+  auto database = FromImage(absl::string_view(
+      static_cast<const char *>(mapping), static_cast<size_t>(st.st_size)));
+  if (!database.ok()) {
+    munmap(mapping, st.st_size);
+    return database.status();
+  }
+  (*database)->mapping_ = mapping;
+  (*database)->mapping_size_ = st.st_size;
+  return database;
+}
+
+absl::StatusOr<std::unique_ptr<TagDatabase>>
+TagDatabase::FromImage(absl::string_view image) {
+  if (reinterpret_cast<uintptr_t>(image.data()) % alignof(TagRecord) != 0) {
+    return absl::InvalidArgumentError("Tag database image misaligned.");
+  }
+  ImageHeader header;
+  if (image.size() < sizeof(header)) {
+    return absl::InvalidArgumentError("Tag database image too small.");
+  }
+  memcpy(&header, image.data(), sizeof(header));
+  if (header.magic != kMagic || header.version != kVersion) {
+    return absl::InvalidArgumentError("Not a tag database image.");
+  }
+  if (header.bucket_count == 0 || header.tag_count >= kDirectSlot) {
+    return absl::InvalidArgumentError("Corrupt tag database image.");
+  }
+  size_t records_offset = RecordsOffset(header.bucket_count);
+  size_t names_offset =
+      records_offset + sizeof(TagRecord) * size_t{header.tag_count};
+  // Compared without adding to names_offset, which a crafted names_size
+  // could make wrap around.
+  if (names_offset > image.size() ||
+      header.names_size != image.size() - names_offset) {
+    return absl::InvalidArgumentError("Tag database image has wrong size.");
+  }
+  std::unique_ptr<TagDatabase> database(new TagDatabase());
+  database->salt_ = header.salt;
+  database->size_ = header.tag_count;
+  database->bucket_count_ = header.bucket_count;
+  database->buckets_ =
+      reinterpret_cast<const uint32_t *>(image.data() + sizeof(header));
+  database->records_ =
+      reinterpret_cast<const TagRecord *>(image.data() + records_offset);
+  database->names_ = image.data() + names_offset;
+  database->names_size_ = header.names_size;
+  return database;
+}
+
+std::optional<uint32_t> TagDatabase::Find(absl::string_view name) const {
+  if (size_ == 0) {
+    return std::nullopt;
+  }
+  uint64_t hash = HashName(name, salt_);
+  uint32_t entry = buckets_[BucketOf(hash, bucket_count_)];
+  uint32_t slot = (entry & kDirectSlot) != 0 ? entry & ~kDirectSlot
+                                             : SlotOf(hash, entry, size_);
+  if (slot >= size_ || this->name(slot) != name) {
+    return std::nullopt;
+  }
+  return slot;
+}
+
+absl::string_view TagDatabase::name(uint32_t index) const {
+  const TagRecord &record = records_[index];
+  if (record.name_offset + size_t{record.name_size} > names_size_) {
+    return absl::string_view();
+  }
+  return absl::string_view(names_ + record.name_offset, record.name_size);
+}
+
+absl::StatusOr<std::vector<TagRead>>
+PlanTagReads(const TagDatabase &database, const std::vector<uint32_t> &tags,
+             uint16_t max_gap) {
+  for (uint32_t tag : tags) {
+    if (tag >= database.size()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Tag index out of range: ", tag));
+    }
+    absl::Status status = CheckRecord(database.tag(tag));
+    if (!status.ok()) {
+      return status;
+    }
+  }
+
+  // Tag positions by slave, table and address.
+  std::vector<uint32_t> order(tags.size());
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  auto key = [&](uint32_t position) {
+    const TagRecord &tag = database.tag(tags[position]);
+    return std::make_tuple(tag.slave_id, tag.function_code, tag.address);
+  };
+  std::sort(order.begin(), order.end(),
+            [&](uint32_t a, uint32_t b) { return key(a) < key(b); });
+
+  std::vector<TagRead> plan;
+  size_t first = 0;
+  while (first < order.size()) {
+    const TagRecord &head = database.tag(tags[order[first]]);
+    uint32_t limit = head.tag_type() == TagType::kBool ? 2000 : 125;
+    uint32_t start = head.address;
+    uint32_t end = start + TagQuantity(head.tag_type());
+    size_t last = first + 1;
+    for (; last < order.size(); ++last) {
+      const TagRecord &tag = database.tag(tags[order[last]]);
+      uint32_t tag_end = tag.address + TagQuantity(tag.tag_type());
+      uint32_t merged_end = std::max(end, tag_end);
+      if (tag.slave_id != head.slave_id ||
+          tag.function_code != head.function_code ||
+          tag.address > end + max_gap || merged_end - start > limit) {
+        break;
+      }
+      end = merged_end;
+    }
+    auto request = PrepareRead(head.slave_id, head.read_function_code(),
+                               start, end - start);
+    if (!request.ok()) {
+      return request.status();
+    }
+    TagRead read = {*std::move(request), {}};
+    read.slots.reserve(last - first);
+    for (size_t i = first; i < last; ++i) {
+      uint32_t tag = tags[order[i]];
+      read.slots.push_back({tag, order[i],
+                            static_cast<uint16_t>(
+                                database.tag(tag).address - start)});
+    }
+    plan.push_back(std::move(read));
+    first = last;
+  }
+  return plan;
+}
+
+double DecodeTagValue(const TagRecord &tag, const uint8_t *data,
+                      uint16_t offset) {
+  double value;
+  if (tag.tag_type() == TagType::kBool) {
+    value = (data[offset / 8] >> (offset % 8)) & 1;
+  } else if (tag.tag_word_order() == WordOrder::kHighWordFirst) {
+    value = DecodeRegisters<WordOrder::kHighWordFirst>(tag.tag_type(),
+                                                       data + 2 * offset);
+  } else {
+    value = DecodeRegisters<WordOrder::kLowWordFirst>(tag.tag_type(),
+                                                      data + 2 * offset);
+  }
+  return value * tag.scale;
+}
+
+absl::Status ReadTags(Client *client, const TagDatabase &database,
+                      const std::vector<TagRead> &plan,
+                      std::vector<double> *values) {
+  absl::Status first_error;
+  for (const TagRead &read : plan) {
+    auto response = client->SendPrepared(read.request);
+    absl::Status status =
+        response.ok() ? read.request.CheckResponse(response.value())
+                      : response.status();
+    if (!status.ok()) {
+      for (const TagSlot &slot : read.slots) {
+        (*values)[slot.position] = std::nan("");
+      }
+      first_error.Update(status);
+      continue;
+    }
+    const uint8_t *data = response->data() + 2;
+    for (const TagSlot &slot : read.slots) {
+      (*values)[slot.position] =
+          DecodeTagValue(database.tag(slot.tag), data, slot.offset);
+    }
+  }
+  return first_error;
+}
+
+} // namespace modbus
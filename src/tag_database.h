@@ -0,0 +1,179 @@
+#ifndef TAG_DATABASE_H_
+#define TAG_DATABASE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/base/macros.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "device_map.h"
+#include "modbus_client.h"
+
+namespace modbus {
+
+// Enum class representing the type of the value of a tag.
+enum class TagType : uint8_t {
+  // One coil or discrete input.
+  kBool,
+  kUint16,
+  kInt16,
+  kUint32,
+  kInt32,
+  kUint64,
+  kInt64,
+  kFloat32,
+  kFloat64,
+};
+
+// Returns the number of registers a value of 'type' takes, or 1 for kBool.
+uint16_t TagQuantity(TagType type);
+
+// Struct representing the definition of a tag: a named value of a slave.
+struct TagDefinition {
+  std::string name;
+  uint8_t slave_id;
+  // Read function code of the table the tag is in.
+  FunctionCode function_code;
+  uint16_t address;
+  TagType type;
+  WordOrder word_order = WordOrder::kHighWordFirst;
+  // Factor the raw value is multiplied by.
+  double scale = 1;
+};
+
+// Parses tag definitions from CSV, one per line:
+//
+//   name,slave_id,table,address,type[,word_order[,scale]]
+//
+// where 'table' is coil, discrete_input, holding_register or input_register,
+// 'type' is bool, uint16, int16, uint32, int32, uint64, int64, float32 or
+// float64, and 'word_order' is high_first, the default, or low_first. Empty
+// lines and lines starting with '#' are skipped.
+absl::StatusOr<std::vector<TagDefinition>> ParseTagCsv(absl::string_view csv);
+
+// Builds the image of a database of 'tags', which must have unique names,
+// for TagDatabase. Lookups by name go through a minimal perfect hash
+// computed here. Images are in host byte order.
+absl::StatusOr<std::string>
+BuildTagImage(const std::vector<TagDefinition> &tags);
+
+// Struct representing a tag as stored in a database image.
+struct TagRecord {
+  uint32_t name_offset;
+  uint16_t name_size;
+  uint8_t slave_id;
+  uint8_t function_code;
+  uint16_t address;
+  uint8_t type;
+  uint8_t word_order;
+  uint32_t reserved;
+  double scale;
+
+  FunctionCode read_function_code() const {
+    return static_cast<FunctionCode>(function_code);
+  }
+  TagType tag_type() const { return static_cast<TagType>(type); }
+  WordOrder tag_word_order() const {
+    return static_cast<WordOrder>(word_order);
+  }
+};
+
+// Read-only database of tags, backed by an image from BuildTagImage. Opening
+// one only maps the image into memory, so it takes the same time for any
+// number of tags, and finding a tag by name takes one hash and one
+// comparison. Thread-safe.
+class TagDatabase {
+public:
+  ~TagDatabase();
+
+  TagDatabase(const TagDatabase &) = delete;
+  TagDatabase &operator=(const TagDatabase &) = delete;
+
+  // Maps the image file at 'path' into memory.
+  static absl::StatusOr<std::unique_ptr<TagDatabase>>
+  Open(const std::string &path);
+
+  // Uses 'image', which must outlive the database.
+  static absl::StatusOr<std::unique_ptr<TagDatabase>>
+  FromImage(absl::string_view image);
+
+  // Returns the number of tags.
+  size_t size() const { return size_; }
+
+  // Returns the index of the tag named 'name', if any.
+  std::optional<uint32_t> Find(absl::string_view name) const;
+
+  // Returns the tag at 'index', which must be less than size(). Records are
+  // not validated when the image is opened; PlanTagReads checks those it
+  // plans.
+  const TagRecord &tag(uint32_t index) const {
+    ABSL_HARDENING_ASSERT(index < size_);
+    return records_[index];
+  }
+
+  // Returns the name of the tag at 'index'.
+  absl::string_view name(uint32_t index) const;
+
+private:
+  TagDatabase() = default;
+
+  // Mapped file, if the database owns one.
+  void *mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+
+  uint64_t salt_ = 0;
+  uint32_t size_ = 0;
+  uint32_t bucket_count_ = 0;
+  const uint32_t *buckets_ = nullptr;
+  const TagRecord *records_ = nullptr;
+  const char *names_ = nullptr;
+  size_t names_size_ = 0;
+};
+
+// Struct representing a tag decoded from the response to a TagRead.
+struct TagSlot {
+  // Index of the tag in its database.
+  uint32_t tag;
+  // Position of the tag in the list of tags the plan was made for.
+  uint32_t position;
+  // Offset of the tag, in registers or bits, from the start of the read.
+  uint16_t offset;
+};
+
+// Struct representing one read of a tag read plan.
+struct TagRead {
+  PreparedRequest request;
+  std::vector<TagSlot> slots;
+};
+
+// Plans the reads of 'tags', indices into 'database'. Tags of the same slave
+// and table are merged into one read when they are at most 'max_gap'
+// registers or bits apart and the read stays within the size limit of its
+// function code. Fails if an index is out of range or its record, read from
+// a possibly corrupt image, has an invalid table, type or address range.
+absl::StatusOr<std::vector<TagRead>>
+PlanTagReads(const TagDatabase &database, const std::vector<uint32_t> &tags,
+             uint16_t max_gap);
+
+// Decodes the value of 'tag' from the data of a read response, at 'offset'
+// registers or bits from its start, and scales it.
+double DecodeTagValue(const TagRecord &tag, const uint8_t *data,
+                      uint16_t offset);
+
+// Sends the reads of 'plan' and stores the value of each tag in 'values', at
+// its position in the list of tags the plan was made for; 'values' must have
+// room for every position. Tags whose read fails are set to NaN, and the
+// first failure is returned once every read was sent.
+absl::Status ReadTags(Client *client, const TagDatabase &database,
+                      const std::vector<TagRead> &plan,
+                      std::vector<double> *values);
+
+} // namespace modbus
+
+#endif // TAG_DATABASE_H_
@@ -0,0 +1,382 @@
+#include "tcp_batch_transport.h"
+
+#include <fcntl.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "mbap.h"
+
+namespace modbus {
+
+TcpBatchTransport::~TcpBatchTransport() {
+  for (auto &connection : connections_) {
+    close(connection->sockfd);
+  }
+}
+
+absl::StatusOr<size_t> TcpBatchTransport::AddConnection(int sockfd) {
+  auto connection = std::make_unique<Connection>();
+  connection->sockfd = sockfd;
+  connections_.push_back(std::move(connection));
+  size_t index = connections_.size() - 1;
+  absl::Status status = Register(index);
+  if (!status.ok()) {
+    connections_.pop_back();
+    return status;
+  }
+  return index;
+}
+
+std::vector<absl::StatusOr<std::vector<uint8_t>>>
+TcpBatchTransport::Transact(const std::vector<TcpBatchRequest> &requests,
+                            int timeout_ms) {
+  std::vector<absl::StatusOr<std::vector<uint8_t>>> results(
+      requests.size(), absl::UnknownError("No response."));
+  results_ = &results;
+  outstanding_ = 0;
+
+  for (size_t i = 0; i < requests.size(); ++i) {
+    const TcpBatchRequest &request = requests[i];
+    if (request.connection >= connections_.size()) {
+      results[i] = absl::InvalidArgumentError("Unknown connection.");
+      continue;
+    }
+    if (request.data.size() + 2 > kMaxMbapLength) {
+      results[i] = absl::InvalidArgumentError("Request too long.");
+      continue;
+    }
+    Connection &connection = *connections_[request.connection];
+    if (!connection.status.ok()) {
+      results[i] = connection.status;
+      continue;
+    }
+
+    uint16_t transaction_id = connection.next_transaction_id++;
+    size_t start = connection.out.size();
+    connection.out.resize(start + kMbapHeaderSize);
+    EncodeMbapHeader({transaction_id, 0,
+                      static_cast<uint16_t>(request.data.size() + 2),
+                      request.slave_id},
+                     connection.out.data() + start);
+    connection.out.push_back(static_cast<uint8_t>(request.function_code));
+    connection.out.insert(connection.out.end(), request.data.begin(),
+                          request.data.end());
+    connection.pending[transaction_id] = i;
+    ++outstanding_;
+  }
+
+  if (outstanding_ > 0) {
+    RunIo(absl::Now() + absl::Milliseconds(timeout_ms));
+  }
+
+  // Whatever is still pending timed out. Forgetting the transaction IDs
+  // makes late responses to them be discarded.
+  for (auto &connection : connections_) {
+    for (const auto &[transaction_id, index] : connection->pending) {
+      results[index] =
+          absl::DeadlineExceededError("Timed out waiting for response.");
+    }
+    connection->pending.clear();
+  }
+  results_ = nullptr;
+  return results;
+}
+
+void TcpBatchTransport::OnReceive(size_t index, const uint8_t *data,
+                                  size_t size) {
+  Connection &connection = *connections_[index];
+  if (!connection.status.ok()) {
+    return;
+  }
+  connection.in.Append(data, size);
+
+  MbapFrame frame;
+  while (true) {
+    auto has_frame = connection.in.NextFrame(&frame);
+    if (!has_frame.ok()) {
+      OnError(index, has_frame.status());
+      return;
+    }
+    if (!*has_frame) {
+      break;
+    }
+    auto it = connection.pending.find(frame.header.transaction_id);
+    if (it == connection.pending.end() || results_ == nullptr) {
+      continue;
+    }
+    (*results_)[it->second] =
+        std::vector<uint8_t>(frame.pdu.begin(), frame.pdu.end());
+    connection.pending.erase(it);
+    --outstanding_;
+  }
+}
+
+void TcpBatchTransport::OnError(size_t index, const absl::Status &status) {
+  Connection &connection = *connections_[index];
+  if (!connection.status.ok()) {
+    return;
+  }
+  connection.status = status;
+  shutdown(connection.sockfd, SHUT_RDWR);
+  Unregister(index);
+  for (const auto &[transaction_id, request] : connection.pending) {
+    if (results_ != nullptr) {
+      (*results_)[request] = status;
+    }
+    --outstanding_;
+  }
+  connection.pending.clear();
+  connection.in.Clear();
+}
+
+namespace {
+
+// Backend that waits for readiness with epoll and moves data with
+// non-blocking send and recv. A zero-copy send keeps using its output
+// buffer until the kernel reports completion on the socket's error queue,
+// so such buffers are set aside until then rather than reused.
+class EpollTcpTransport : public TcpBatchTransport {
+public:
+  EpollTcpTransport() : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)) {}
+
+  ~EpollTcpTransport() override { close(epoll_fd_); }
+
+  const char *name() const override { return "epoll"; }
+
+protected:
+  absl::Status Register(size_t index) override {
+    int sockfd = connections_[index]->sockfd;
+    fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL) | O_NONBLOCK);
+    int one = 1;
+    zerocopy_.resize(index + 1);
+    zerocopy_[index].supported =
+        setsockopt(sockfd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = index;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, sockfd, &event) < 0) {
+      return absl::InternalError("Failed to add socket to epoll.");
+    }
+    return absl::OkStatus();
+  }
+
+  void Unregister(size_t index) override {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connections_[index]->sockfd, nullptr);
+  }
+
+  void RunIo(absl::Time deadline) override {
+    // Most writes complete at once; only wait for writability on the rest.
+    for (size_t i = 0; i < connections_.size(); ++i) {
+      Flush(i);
+    }
+
+    std::vector<struct epoll_event> events(
+        std::clamp<size_t>(connections_.size(), 1, 1024));
+    uint8_t buffer[16384];
+    while (!Done()) {
+      int timeout_ms = static_cast<int>(absl::ToInt64Milliseconds(
+          absl::Ceil(deadline - absl::Now(), absl::Milliseconds(1))));
+      if (timeout_ms <= 0) {
+        break;
+      }
+      int ready =
+          epoll_wait(epoll_fd_, events.data(), events.size(), timeout_ms);
+      for (int i = 0; i < ready; ++i) {
+        size_t index = events[i].data.u64;
+        Connection &connection = *connections_[index];
+        if (events[i].events & EPOLLOUT) {
+          Flush(index);
+        }
+        if ((events[i].events & EPOLLERR) &&
+            zerocopy_[index].completed != zerocopy_[index].sends) {
+          ReapZeroCopy(index);
+        }
+        if (!(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+          continue;
+        }
+        while (connection.status.ok()) {
+          ssize_t received =
+              recv(connection.sockfd, buffer, sizeof(buffer), 0);
+          if (received > 0) {
+            OnReceive(index, buffer, received);
+            if (static_cast<size_t>(received) < sizeof(buffer)) {
+              break;
+            }
+          } else if (received == 0) {
+            OnError(index, absl::UnavailableError("Connection closed."));
+          } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            OnError(index, absl::UnavailableError("Failed to receive."));
+          } else {
+            break;
+          }
+        }
+      }
+    }
+
+    // The next batch appends to unsent output, which may move it while a
+    // zero-copy send still reads it; hand that buffer over to the kernel.
+    for (size_t i = 0; i < connections_.size(); ++i) {
+      Connection &connection = *connections_[i];
+      ZeroCopy &zerocopy = zerocopy_[i];
+      if (zerocopy.completed == zerocopy.sends || connection.out.empty()) {
+        continue;
+      }
+      std::vector<uint8_t> unsent(
+          connection.out.begin() + connection.out_offset,
+          connection.out.end());
+      zerocopy.retired.push_back(std::move(connection.out));
+      connection.out = std::move(unsent);
+      connection.out_offset = 0;
+    }
+  }
+
+private:
+  // Zero-copy state of a connection.
+  struct ZeroCopy {
+    bool supported = false;
+    // Zero-copy send calls made and completed, as counted by the kernel.
+    uint32_t sends = 0;
+    uint32_t completed = 0;
+    // Output buffers that the kernel may still be sending from.
+    std::vector<std::vector<uint8_t>> retired;
+  };
+
+  // Writes as much queued output of connection 'index' as the socket takes
+  // and waits for writability if some is left.
+  void Flush(size_t index) {
+    Connection &connection = *connections_[index];
+    ZeroCopy &zerocopy = zerocopy_[index];
+    if (!connection.status.ok()) {
+      ReleaseOutput(index);
+      return;
+    }
+    bool allow_zerocopy = zerocopy_threshold_ > 0 && zerocopy.supported;
+    while (connection.out_offset < connection.out.size()) {
+      size_t size = connection.out.size() - connection.out_offset;
+      bool use_zerocopy = allow_zerocopy && size >= zerocopy_threshold_;
+      ssize_t sent = send(connection.sockfd,
+                          connection.out.data() + connection.out_offset, size,
+                          MSG_NOSIGNAL | (use_zerocopy ? MSG_ZEROCOPY : 0));
+      if (sent < 0) {
+        if (use_zerocopy && errno == ENOBUFS) {
+          // Out of memory for pinning pages; copy this time.
+          allow_zerocopy = false;
+          continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          OnError(index, absl::UnavailableError("Failed to send request."));
+          ReleaseOutput(index);
+        }
+        break;
+      }
+      if (use_zerocopy) {
+        ++zerocopy.sends;
+      }
+      connection.out_offset += sent;
+    }
+    bool drained = connection.out_offset == connection.out.size();
+    if (drained) {
+      ReleaseOutput(index);
+    }
+    if (drained != connection.writing) {
+      return;
+    }
+    connection.writing = !drained;
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    if (!drained) {
+      event.events |= EPOLLOUT;
+    }
+    event.data.u64 = index;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.sockfd, &event);
+  }
+
+  // Empties the output buffer of connection 'index', setting it aside if a
+  // zero-copy send may still read it.
+  void ReleaseOutput(size_t index) {
+    Connection &connection = *connections_[index];
+    ZeroCopy &zerocopy = zerocopy_[index];
+    if (zerocopy.completed != zerocopy.sends && !connection.out.empty()) {
+      zerocopy.retired.push_back(std::move(connection.out));
+      connection.out = std::vector<uint8_t>();
+    }
+    connection.out.clear();
+    connection.out_offset = 0;
+  }
+
+  // Reads zero-copy completions of connection 'index' from its error queue
+  // and frees the buffers no longer in use.
+  void ReapZeroCopy(size_t index) {
+    ZeroCopy &zerocopy = zerocopy_[index];
+    while (true) {
+      uint8_t control[CMSG_SPACE(sizeof(struct sock_extended_err) +
+                                 sizeof(struct sockaddr_in6))];
+      struct msghdr message = {};
+      message.msg_control = control;
+      message.msg_controllen = sizeof(control);
+      if (recvmsg(connections_[index]->sockfd, &message, MSG_ERRQUEUE) < 0) {
+        break;
+      }
+      for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr;
+           cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+            !(cmsg->cmsg_level == SOL_IPV6 &&
+              cmsg->cmsg_type == IPV6_RECVERR)) {
+          continue;
+        }
+        struct sock_extended_err error;
+        memcpy(&error, CMSG_DATA(cmsg), sizeof(error));
+        if (error.ee_errno != 0 || error.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+          continue;
+        }
+        // The notification covers send calls ee_info through ee_data.
+        zerocopy.completed = std::max(zerocopy.completed, error.ee_data + 1);
+      }
+    }
+    if (zerocopy.completed == zerocopy.sends) {
+      zerocopy.retired.clear();
+    }
+  }
+
+  int epoll_fd_;
+  std::vector<ZeroCopy> zerocopy_;
+};
+
+} // namespace
+
+std::unique_ptr<TcpBatchTransport> CreateEpollTcpTransport() {
+  return std::make_unique<EpollTcpTransport>();
+}
+
+absl::StatusOr<std::unique_ptr<TcpBatchTransport>>
+CreateTcpBatchTransport(TcpBackend backend) {
+  switch (backend) {
+  case TcpBackend::kEpoll:
+    return CreateEpollTcpTransport();
+  case TcpBackend::kIoUring:
+    return CreateIoUringTcpTransport();
+  case TcpBackend::kAuto:
+  default: {
+    auto transport = CreateIoUringTcpTransport();
+    if (transport.ok()) {
+      return transport;
+    }
+    return CreateEpollTcpTransport();
+  }
+  }
+}
+
+} // namespace modbus
@@ -0,0 +1,137 @@
+#ifndef TCP_BATCH_TRANSPORT_H_
+#define TCP_BATCH_TRANSPORT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "mbap.h"
+#include "modbus_client.h"
+
+namespace modbus {
+
+// Enum class representing the I/O mechanism of a TcpBatchTransport.
+enum class TcpBackend {
+  // io_uring where the kernel supports it, epoll otherwise.
+  kAuto,
+  kEpoll,
+  kIoUring,
+};
+
+// Struct representing one request of a batch.
+struct TcpBatchRequest {
+  // Index of the connection, as returned by AddConnection.
+  size_t connection;
+  uint8_t slave_id;
+  FunctionCode function_code;
+  std::vector<uint8_t> data;
+};
+
+// Modbus TCP transport that drives many device connections from a single
+// thread. Each Transact call writes a whole batch of requests, pipelining
+// those for the same connection, and collects the responses as they
+// arrive, so the cost of system calls is shared by the batch instead of
+// paid per transaction. Not thread-safe.
+class TcpBatchTransport {
+public:
+  virtual ~TcpBatchTransport();
+
+  // Takes ownership of 'sockfd', a connected TCP socket, and returns the
+  // index of the connection.
+  absl::StatusOr<size_t> AddConnection(int sockfd);
+
+  // Sends 'requests' and waits up to 'timeout_ms' for their responses.
+  // Returns the response PDU of each request, in the order of 'requests'.
+  // Requests that are not answered in time fail with kDeadlineExceeded. A
+  // connection that fails is not used again, and requests to it fail with
+  // kUnavailable.
+  std::vector<absl::StatusOr<std::vector<uint8_t>>>
+  Transact(const std::vector<TcpBatchRequest> &requests, int timeout_ms);
+
+  // Sends writes of at least 'min_bytes' with MSG_ZEROCOPY, so that the
+  // kernel transmits straight from the output buffer instead of copying it.
+  // This only pays off for writes of tens of kilobytes, i.e. large batches
+  // pipelined to one connection. 0, the default, disables it. Backends
+  // without zero-copy support ignore it.
+  void SetZeroCopyThreshold(size_t min_bytes) {
+    zerocopy_threshold_ = min_bytes;
+  }
+
+  // Returns the number of connections.
+  size_t size() const { return connections_.size(); }
+
+  // Returns the name of the backend.
+  virtual const char *name() const = 0;
+
+protected:
+  struct Connection {
+    int sockfd = -1;
+    // Serialized requests waiting to be written, from 'out_offset' on.
+    std::vector<uint8_t> out;
+    size_t out_offset = 0;
+    // Set while the backend is still writing 'out'.
+    bool writing = false;
+    // Received bytes that do not form a complete frame yet.
+    MbapReceiveBuffer in;
+    // Transaction IDs keep counting across batches so that a late response
+    // to an earlier batch cannot be taken for a current one.
+    uint16_t next_transaction_id = 0;
+    // Requests awaiting a response, by transaction ID.
+    std::unordered_map<uint16_t, size_t> pending;
+    absl::Status status;
+  };
+
+  // Prepares the backend for connection 'index'.
+  virtual absl::Status Register(size_t index) = 0;
+
+  // Stops waiting for events on connection 'index', which has failed and
+  // been shut down, so that its hangup does not wake every later batch. The
+  // socket stays open until the transport is destroyed.
+  virtual void Unregister(size_t index) = 0;
+
+  // Writes the queued output of every connection and receives until no
+  // response is pending or 'deadline' passes.
+  virtual void RunIo(absl::Time deadline) = 0;
+
+  // Passes bytes received on connection 'index' to the frame parser.
+  void OnReceive(size_t index, const uint8_t *data, size_t size);
+
+  // Fails connection 'index' and everything pending on it.
+  void OnError(size_t index, const absl::Status &status);
+
+  // Returns true once every request of the batch has its result.
+  bool Done() const { return outstanding_ == 0; }
+
+  std::vector<std::unique_ptr<Connection>> connections_;
+  size_t zerocopy_threshold_ = 0;
+
+private:
+  // Results of the running batch.
+  std::vector<absl::StatusOr<std::vector<uint8_t>>> *results_ = nullptr;
+  size_t outstanding_ = 0;
+};
+
+// Returns a transport using epoll and non-blocking send/recv. Supports
+// MSG_ZEROCOPY.
+std::unique_ptr<TcpBatchTransport> CreateEpollTcpTransport();
+
+// Returns a transport using io_uring. Where the kernel supports it, a
+// multishot receive stays armed on every connection and received data lands
+// in a ring of buffers registered with the kernel; otherwise each connection
+// rearms a single-shot receive into its own buffer. Fails if io_uring is
+// unavailable or disabled.
+absl::StatusOr<std::unique_ptr<TcpBatchTransport>> CreateIoUringTcpTransport();
+
+// Returns a transport using 'backend'. kAuto falls back to epoll if
+// io_uring is unavailable.
+absl::StatusOr<std::unique_ptr<TcpBatchTransport>>
+CreateTcpBatchTransport(TcpBackend backend = TcpBackend::kAuto);
+
+} // namespace modbus
+
+#endif // TCP_BATCH_TRANSPORT_H_
@@ -0,0 +1,264 @@
+#include "tcp_socket.h"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace modbus {
+
+AddressCache::AddressCache(absl::Duration ttl) : ttl_(ttl) {}
+
+absl::StatusOr<std::vector<SocketAddress>>
+AddressCache::Resolve(const std::string &hostname, int port) {
+  auto key = std::make_pair(hostname, port);
+  {
+    absl::MutexLock lock(&mu_);
+    auto it = entries_.find(key);
+    if (it != entries_.end() && absl::Now() < it->second.expiry) {
+      return it->second.addresses;
+    }
+  }
+
+  // Resolve without holding the lock; getaddrinfo may block for a while.
+  struct addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo *results = nullptr;
+  int error = getaddrinfo(hostname.c_str(), std::to_string(port).c_str(),
+                          &hints, &results);
+  if (error != 0) {
+    return absl::UnavailableError("Failed to resolve " + hostname + ": " +
+                                  gai_strerror(error));
+  }
+  std::vector<SocketAddress> addresses;
+  for (struct addrinfo *result = results; result != nullptr;
+       result = result->ai_next) {
+    SocketAddress address = {};
+    memcpy(&address.storage, result->ai_addr, result->ai_addrlen);
+    address.length = result->ai_addrlen;
+    addresses.push_back(address);
+  }
+  freeaddrinfo(results);
+
+  absl::MutexLock lock(&mu_);
+  entries_[key] = {addresses, absl::Now() + ttl_};
+  return addresses;
+}
+
+absl::Status ApplyTcpSocketParams(int sockfd, const TcpSocketParams &params) {
+  int one = 1;
+  if (params.no_delay &&
+      setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0) {
+    return absl::InternalError("Failed to set TCP_NODELAY.");
+  }
+  if (params.keepalive_idle_s > 0 &&
+      (setsockopt(sockfd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one)) < 0 ||
+       setsockopt(sockfd, IPPROTO_TCP, TCP_KEEPIDLE, &params.keepalive_idle_s,
+                  sizeof(int)) < 0 ||
+       setsockopt(sockfd, IPPROTO_TCP, TCP_KEEPINTVL,
+                  &params.keepalive_interval_s, sizeof(int)) < 0 ||
+       setsockopt(sockfd, IPPROTO_TCP, TCP_KEEPCNT, &params.keepalive_count,
+                  sizeof(int)) < 0)) {
+    return absl::InternalError("Failed to enable TCP keepalive.");
+  }
+  return absl::OkStatus();
+}
+
+std::vector<absl::StatusOr<int>>
+ConnectTcpSockets(const std::vector<std::vector<SocketAddress>> &targets,
+                  const TcpSocketParams &params, int max_concurrent) {
+  std::vector<absl::StatusOr<int>> results(
+      targets.size(), absl::UnavailableError("No address to connect to."));
+
+  struct Attempt {
+    int sockfd = -1;
+    size_t next_address = 0;
+    absl::Time deadline;
+    int last_errno = 0;
+  };
+  std::vector<Attempt> attempts(targets.size());
+  std::deque<size_t> waiting;
+  for (size_t i = 0; i < targets.size(); ++i) {
+    waiting.push_back(i);
+  }
+
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0) {
+    results.assign(targets.size(),
+                   absl::InternalError("Failed to create epoll instance."));
+    return results;
+  }
+
+  auto succeed = [&](size_t target) {
+    int sockfd = attempts[target].sockfd;
+    attempts[target].sockfd = -1;
+    fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL) & ~O_NONBLOCK);
+    absl::Status status = ApplyTcpSocketParams(sockfd, params);
+    if (!status.ok()) {
+      close(sockfd);
+      results[target] = status;
+      return;
+    }
+    results[target] = sockfd;
+  };
+
+  // Starts connecting 'target' to its next address. Returns true while an
+  // attempt is in progress.
+  auto start = [&](size_t target) {
+    Attempt &attempt = attempts[target];
+    while (attempt.next_address < targets[target].size()) {
+      const SocketAddress &address = targets[target][attempt.next_address++];
+      int sockfd = socket(address.storage.ss_family,
+                          SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      if (sockfd < 0) {
+        attempt.last_errno = errno;
+        continue;
+      }
+      attempt.sockfd = sockfd;
+      if (connect(sockfd, reinterpret_cast<const struct sockaddr *>(
+                              &address.storage),
+                  address.length) == 0) {
+        succeed(target);
+        return false;
+      }
+      if (errno == EINPROGRESS) {
+        struct epoll_event event = {};
+        event.events = EPOLLOUT;
+        event.data.u64 = target;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sockfd, &event);
+        return true;
+      }
+      attempt.last_errno = errno;
+      close(sockfd);
+      attempt.sockfd = -1;
+    }
+    if (attempt.last_errno != 0) {
+      results[target] = absl::UnavailableError(
+          std::string("Failed to connect: ") + strerror(attempt.last_errno));
+    }
+    return false;
+  };
+
+  auto abandon = [&](size_t target) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, attempts[target].sockfd, nullptr);
+    close(attempts[target].sockfd);
+    attempts[target].sockfd = -1;
+  };
+
+  std::vector<size_t> active;
+  std::vector<struct epoll_event> events(std::max(1, max_concurrent));
+  while (!waiting.empty() || !active.empty()) {
+    while (!waiting.empty() &&
+           active.size() < static_cast<size_t>(std::max(1, max_concurrent))) {
+      size_t target = waiting.front();
+      waiting.pop_front();
+      attempts[target].deadline =
+          absl::Now() + absl::Milliseconds(params.connect_timeout_ms);
+      if (start(target)) {
+        active.push_back(target);
+      }
+    }
+    if (active.empty()) {
+      continue;
+    }
+
+    absl::Time next_deadline = absl::InfiniteFuture();
+    for (size_t target : active) {
+      next_deadline = std::min(next_deadline, attempts[target].deadline);
+    }
+    int timeout_ms = static_cast<int>(std::max<int64_t>(
+        0, absl::ToInt64Milliseconds(absl::Ceil(next_deadline - absl::Now(),
+                                                absl::Milliseconds(1)))));
+    int ready = epoll_wait(epoll_fd, events.data(), events.size(), timeout_ms);
+    for (int i = 0; i < ready; ++i) {
+      size_t target = events[i].data.u64;
+      Attempt &attempt = attempts[target];
+      int error = 0;
+      socklen_t length = sizeof(error);
+      getsockopt(attempt.sockfd, SOL_SOCKET, SO_ERROR, &error, &length);
+      epoll_ctl(epoll_fd, EPOLL_CTL_DEL, attempt.sockfd, nullptr);
+      if (error == 0) {
+        succeed(target);
+      } else {
+        attempt.last_errno = error;
+        close(attempt.sockfd);
+        attempt.sockfd = -1;
+        start(target);
+      }
+    }
+
+    // Drop targets that finished and time out the rest.
+    absl::Time now = absl::Now();
+    auto done = [&](size_t target) {
+      if (attempts[target].sockfd < 0) {
+        return true;
+      }
+      if (now >= attempts[target].deadline) {
+        abandon(target);
+        results[target] = absl::DeadlineExceededError("Connect timed out.");
+        return true;
+      }
+      return false;
+    };
+    active.erase(std::remove_if(active.begin(), active.end(), done),
+                 active.end());
+  }
+
+  close(epoll_fd);
+  return results;
+}
+
+absl::StatusOr<int> ConnectTcpSocket(const std::string &hostname, int port,
+                                     const TcpSocketParams &params) {
+  AddressCache resolver(absl::ZeroDuration());
+  auto addresses = resolver.Resolve(hostname, port);
+  if (!addresses.ok()) {
+    return addresses.status();
+  }
+  return std::move(ConnectTcpSockets({addresses.value()}, params)[0]);
+}
+
+absl::Status SendVector(int sockfd, absl::Span<struct iovec> iov) {
+  while (!iov.empty()) {
+    struct msghdr message = {};
+    message.msg_iov = iov.data();
+    message.msg_iovlen = std::min<size_t>(iov.size(), IOV_MAX);
+    ssize_t sent = sendmsg(sockfd, &message, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return absl::InternalError("Failed to send data to server.");
+    }
+    // Skip the buffers written completely and trim the one written partly.
+    while (!iov.empty() && static_cast<size_t>(sent) >= iov[0].iov_len) {
+      sent -= iov[0].iov_len;
+      iov.remove_prefix(1);
+    }
+    if (!iov.empty()) {
+      iov[0].iov_base = static_cast<uint8_t *>(iov[0].iov_base) + sent;
+      iov[0].iov_len -= sent;
+    }
+  }
+  return absl::OkStatus();
+}
+
+} // namespace modbus
@@ -0,0 +1,87 @@
+#ifndef TCP_SOCKET_H_
+#define TCP_SOCKET_H_
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+
+namespace modbus {
+
+// Struct representing how TCP connections are set up.
+struct TcpSocketParams {
+  // Time allowed for a connection attempt, in milliseconds.
+  int connect_timeout_ms = 3000;
+  // Disables Nagle's algorithm; requests are small and latency-sensitive.
+  bool no_delay = true;
+  // TCP keepalive probing of idle connections, so that dead peers are
+  // detected without a request. 0 disables keepalive.
+  int keepalive_idle_s = 30;
+  int keepalive_interval_s = 10;
+  int keepalive_count = 3;
+};
+
+// A resolved socket address.
+struct SocketAddress {
+  struct sockaddr_storage storage;
+  socklen_t length;
+};
+
+// Thread-safe cache of getaddrinfo results, so that bringing up many
+// devices on the same host resolves it only once.
+class AddressCache {
+public:
+  // Constructor taking how long resolved addresses are reused.
+  explicit AddressCache(absl::Duration ttl = absl::Minutes(5));
+
+  // Resolves 'hostname' and 'port' to stream socket addresses.
+  absl::StatusOr<std::vector<SocketAddress>>
+  Resolve(const std::string &hostname, int port);
+
+private:
+  struct Entry {
+    std::vector<SocketAddress> addresses;
+    absl::Time expiry;
+  };
+
+  absl::Duration ttl_;
+  absl::Mutex mu_;
+  std::map<std::pair<std::string, int>, Entry> entries_ ABSL_GUARDED_BY(mu_);
+};
+
+// Applies 'params' to the connected socket 'sockfd'.
+absl::Status ApplyTcpSocketParams(int sockfd, const TcpSocketParams &params);
+
+// Connects to every target in parallel with non-blocking sockets, trying
+// each target's addresses in order until one connects or the target's
+// connect timeout expires. At most 'max_concurrent' attempts are in progress
+// at once. Returns a blocking socket with 'params' applied, or the error,
+// for each target. The caller must close the sockets.
+std::vector<absl::StatusOr<int>>
+ConnectTcpSockets(const std::vector<std::vector<SocketAddress>> &targets,
+                  const TcpSocketParams &params, int max_concurrent = 256);
+
+// Resolves 'hostname' and opens a blocking TCP connection to 'port'.
+// Thread-safe. Returns the connected socket, which the caller must close.
+absl::StatusOr<int> ConnectTcpSocket(const std::string &hostname, int port,
+                                     const TcpSocketParams &params = {});
+
+// Writes the buffers of 'iov', in order, to the blocking socket 'sockfd',
+// gathering them into as few sendmsg calls as the socket allows so that
+// a header and a payload need not be copied together first. 'iov' is
+// advanced past the data written.
+absl::Status SendVector(int sockfd, absl::Span<struct iovec> iov);
+
+} // namespace modbus
+
+#endif // TCP_SOCKET_H_
@@ -0,0 +1,178 @@
+#include "write_behind_queue.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "clock.h"
+#include "modbus_functions.h"
+
+namespace modbus {
+
+namespace {
+
+// Most registers and coils one write request carries.
+constexpr size_t kMaxWriteRegisters = 123;
+constexpr size_t kMaxWriteCoils = 1968;
+
+} // namespace
+
+WriteBehindQueue::WriteBehindQueue(Client *client,
+                                   const WriteBehindParams &params)
+    : client_(client), params_(params) {
+  thread_ = std::thread(&WriteBehindQueue::SendLoop, this);
+}
+
+WriteBehindQueue::~WriteBehindQueue() {
+  {
+    absl::MutexLock lock(&mu_);
+    stop_ = true;
+    cv_.Signal();
+  }
+  thread_.join();
+  SendPending();
+}
+
+void WriteBehindQueue::WriteRegister(uint8_t slave_id, uint16_t address,
+                                     uint16_t value, WriteCallback done) {
+  Enqueue(slave_id, FunctionCode::kWriteMultipleRegisters, address, value,
+          std::move(done));
+}
+
+void WriteBehindQueue::WriteCoil(uint8_t slave_id, uint16_t address,
+                                 bool value, WriteCallback done) {
+  Enqueue(slave_id, FunctionCode::kWriteMultipleCoils, address, value,
+          std::move(done));
+}
+
+void WriteBehindQueue::Flush() { SendPending(); }
+
+void WriteBehindQueue::SetClock(Clock *clock) {
+  absl::MutexLock lock(&mu_);
+  clock_ = clock;
+}
+
+WriteBehindStats WriteBehindQueue::stats() const {
+  absl::MutexLock lock(&mu_);
+  return stats_;
+}
+
+void WriteBehindQueue::Enqueue(uint8_t slave_id, FunctionCode function_code,
+                               uint16_t address, uint16_t value,
+                               WriteCallback done) {
+  absl::MutexLock lock(&mu_);
+  ++stats_.writes;
+  if (pending_.empty()) {
+    oldest_ = clock_->Now();
+    cv_.Signal();
+  }
+  std::vector<PendingWrite> &writes = pending_[slave_id];
+  // Replacing an earlier write would move it past the writes queued after
+  // it.
+  if (!writes.empty() && writes.back().function_code == function_code &&
+      writes.back().address == address) {
+    ++stats_.superseded;
+  } else {
+    writes.push_back({function_code, address, 0, {}});
+    ++pending_count_;
+  }
+  writes.back().value = value;
+  if (done != nullptr) {
+    writes.back().callbacks.push_back(std::move(done));
+  }
+  if (pending_count_ == params_.max_pending) {
+    cv_.Signal();
+  }
+}
+
+void WriteBehindQueue::SendLoop() {
+  while (true) {
+    {
+      absl::MutexLock lock(&mu_);
+      while (!stop_) {
+        if (pending_.empty()) {
+          cv_.Wait(&mu_);
+          continue;
+        }
+        absl::Duration remaining =
+            oldest_ + params_.max_delay - clock_->Now();
+        if (pending_count_ >= params_.max_pending ||
+            remaining <= absl::ZeroDuration()) {
+          // Full, or the oldest write is due.
+          break;
+        }
+        // Checks the clock again at least every 'max_delay', so that a
+        // simulated clock moved forward is noticed.
+        cv_.WaitWithTimeout(&mu_, remaining);
+      }
+      if (stop_) {
+        return;
+      }
+    }
+    SendPending();
+  }
+}
+
+void WriteBehindQueue::SendPending() {
+  absl::MutexLock send_lock(&send_mu_);
+  PendingWrites batch;
+  {
+    absl::MutexLock lock(&mu_);
+    batch.swap(pending_);
+    pending_count_ = 0;
+  }
+  uint64_t transactions = 0;
+  for (auto &[slave_id, writes] : batch) {
+    size_t first = 0;
+    while (first < writes.size()) {
+      FunctionCode function_code = writes[first].function_code;
+      uint16_t address = writes[first].address;
+      bool coils = function_code == FunctionCode::kWriteMultipleCoils;
+      size_t limit = coils ? kMaxWriteCoils : kMaxWriteRegisters;
+      // Extends the run while the next write is to the next address of the
+      // same table.
+      size_t last = first + 1;
+      while (last < writes.size() && last - first < limit &&
+             writes[last].function_code == function_code &&
+             writes[last].address == address + (last - first)) {
+        ++last;
+      }
+
+      absl::Status status;
+      if (last - first == 1 && coils) {
+        status = WriteSingleCoil(client_, slave_id, address,
+                                 writes[first].value != 0);
+      } else if (last - first == 1) {
+        status = WriteSingleRegister(client_, slave_id, address,
+                                     writes[first].value);
+      } else if (coils) {
+        std::vector<bool> values;
+        for (size_t i = first; i < last; ++i) {
+          values.push_back(writes[i].value != 0);
+        }
+        status = WriteMultipleCoils(client_, slave_id, address, values);
+      } else {
+        std::vector<uint16_t> values;
+        for (size_t i = first; i < last; ++i) {
+          values.push_back(writes[i].value);
+        }
+        status = WriteMultipleRegisters(client_, slave_id, address, values);
+      }
+      ++transactions;
+      for (; first < last; ++first) {
+        for (WriteCallback &callback : writes[first].callbacks) {
+          callback(status);
+        }
+      }
+    }
+  }
+  absl::MutexLock lock(&mu_);
+  stats_.transactions += transactions;
+}
+
+} // namespace modbus
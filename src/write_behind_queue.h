@@ -0,0 +1,129 @@
+#ifndef WRITE_BEHIND_QUEUE_H_
+#define WRITE_BEHIND_QUEUE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/any_invocable.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "clock.h"
+#include "modbus_client.h"
+
+namespace modbus {
+
+// Called with the result of a write once it completed.
+using WriteCallback = absl::AnyInvocable<void(const absl::Status &)>;
+
+// Struct representing the parameters of a WriteBehindQueue.
+struct WriteBehindParams {
+  // Pending writes are sent at most this long after the first of them was
+  // queued...
+  absl::Duration max_delay = absl::Milliseconds(10);
+  // ...or as soon as this many writes are pending.
+  size_t max_pending = 64;
+};
+
+// Struct representing the counters of a WriteBehindQueue.
+struct WriteBehindStats {
+  // Writes queued.
+  uint64_t writes = 0;
+  // Writes replaced by a later write to the same address before being sent.
+  uint64_t superseded = 0;
+  // Requests sent.
+  uint64_t transactions = 0;
+};
+
+// Buffers writes of single registers and coils and sends them in the
+// background, so that callers do not wait for a round trip per write.
+//
+// Writes reach each slave in the order they were queued, so that e.g. a
+// setpoint still arrives before the start command queued after it. A write
+// replaces the pending write to the same address, so that only the last
+// value is sent, only if no other write to the slave was queued in between.
+// Writes queued one after the other to consecutive addresses of the same
+// slave and table go out as one Write Multiple Registers or Write Multiple
+// Coils request, within the protocol's limits. Slaves are written one after
+// the other, so writes to different slaves may be reordered.
+//
+// Writes are sent once the oldest pending write has waited 'max_delay',
+// once 'max_pending' writes are pending, or on Flush. Thread-safe; the queue
+// must be the only user of its client.
+class WriteBehindQueue {
+public:
+  WriteBehindQueue(Client *client, const WriteBehindParams &params);
+
+  // Sends the writes still pending.
+  ~WriteBehindQueue();
+
+  WriteBehindQueue(const WriteBehindQueue &) = delete;
+  WriteBehindQueue &operator=(const WriteBehindQueue &) = delete;
+
+  // Queues a write of 'value' to the holding register at 'address'. 'done',
+  // if set, is called from the thread sending the write with its result. A
+  // write that is superseded completes with the write that replaced it.
+  void WriteRegister(uint8_t slave_id, uint16_t address, uint16_t value,
+                     WriteCallback done = nullptr);
+
+  // Queues a write of 'value' to the coil at 'address', as WriteRegister.
+  void WriteCoil(uint8_t slave_id, uint16_t address, bool value,
+                 WriteCallback done = nullptr);
+
+  // Sends every pending write and waits until they completed.
+  void Flush();
+
+  // Replaces the clock that times 'max_delay', e.g. with a SimulatedClock in
+  // tests. The clock must outlive the queue. The sending thread notices a
+  // simulated clock's time moving within 'max_delay' of real time.
+  void SetClock(Clock *clock);
+
+  WriteBehindStats stats() const;
+
+private:
+  struct PendingWrite {
+    // Write function code of the table.
+    FunctionCode function_code;
+    uint16_t address;
+    uint16_t value;
+    std::vector<WriteCallback> callbacks;
+  };
+  // Pending writes, of each slave in the order they were queued.
+  using PendingWrites = std::map<uint8_t, std::vector<PendingWrite>>;
+
+  void Enqueue(uint8_t slave_id, FunctionCode function_code, uint16_t address,
+               uint16_t value, WriteCallback done);
+
+  // Body of the thread sending writes in the background.
+  void SendLoop();
+
+  // Takes the pending writes and sends them.
+  void SendPending() ABSL_LOCKS_EXCLUDED(mu_);
+
+  Client *client_;
+  WriteBehindParams params_;
+
+  mutable absl::Mutex mu_;
+  // Signalled when the sending thread has something to do.
+  absl::CondVar cv_;
+  PendingWrites pending_ ABSL_GUARDED_BY(mu_);
+  size_t pending_count_ ABSL_GUARDED_BY(mu_) = 0;
+  absl::Time oldest_ ABSL_GUARDED_BY(mu_);
+  Clock *clock_ ABSL_GUARDED_BY(mu_) = Clock::RealClock();
+  bool stop_ ABSL_GUARDED_BY(mu_) = false;
+  WriteBehindStats stats_ ABSL_GUARDED_BY(mu_);
+
+  // Held while sending, so that batches go out in the order they were
+  // taken.
+  absl::Mutex send_mu_ ABSL_ACQUIRED_BEFORE(mu_);
+
+  std::thread thread_;
+};
+
+} // namespace modbus
+
+#endif // WRITE_BEHIND_QUEUE_H_
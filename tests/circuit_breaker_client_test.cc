@@ -0,0 +1,160 @@
+#include "src/circuit_breaker_client.h"
+#include "gtest/gtest.h"
+#include "src/clock.h"
+#include "src/loopback_client.h"
+#include "src/modbus_functions.h"
+
+namespace modbus {
+namespace test {
+
+class CircuitBreakerClientTest : public testing::Test {
+protected:
+  CircuitBreakerClientTest()
+      : device_({0, 0, 16, 0}), loopback_(&server_, 1000),
+        client_(&loopback_, {3, 1000, 8000}) {
+    server_.AddSlave(1, &device_);
+    loopback_.SetClock(&clock_);
+    client_.SetClock(&clock_);
+  }
+
+  // Time spent on a request to 'slave_id', and whether it succeeded.
+  std::pair<absl::Duration, absl::StatusCode> Poll(uint8_t slave_id) {
+    absl::Time start = clock_.Now();
+    auto result = ReadHoldingRegisters(&client_, slave_id, 0, 1);
+    return {clock_.Now() - start, result.status().code()};
+  }
+
+  SimulatedClock clock_;
+  SlaveDevice device_;
+  LoopbackServer server_;
+  LoopbackClient loopback_;
+  CircuitBreakerClient client_;
+};
+
+TEST_F(CircuitBreakerClientTest, TripsAfterConsecutiveFailures) {
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_EQ(Poll(2).second, absl::StatusCode::kDeadlineExceeded);
+  }
+  ASSERT_EQ(client_.GetState(2), CircuitBreakerClient::State::kOpen);
+
+  // Fails fast without waiting out a timeout.
+  auto [elapsed, code] = Poll(2);
+  ASSERT_EQ(code, absl::StatusCode::kUnavailable);
+  ASSERT_EQ(elapsed, absl::ZeroDuration());
+
+  // Healthy slaves are unaffected.
+  ASSERT_EQ(Poll(1).second, absl::StatusCode::kOk);
+  ASSERT_EQ(client_.GetState(1), CircuitBreakerClient::State::kClosed);
+}
+
+TEST_F(CircuitBreakerClientTest, ProbesWithExponentialBackoff) {
+  for (int i = 0; i < 3; ++i) {
+    Poll(2);
+  }
+  // First probe after 1 s fails (and takes the 1 s timeout).
+  clock_.AdvanceTime(absl::Milliseconds(999));
+  ASSERT_EQ(Poll(2).second, absl::StatusCode::kUnavailable);
+  clock_.AdvanceTime(absl::Milliseconds(1));
+  ASSERT_EQ(Poll(2).second, absl::StatusCode::kDeadlineExceeded);
+
+  // Next probe only after 2 s.
+  clock_.AdvanceTime(absl::Milliseconds(1999));
+  ASSERT_EQ(Poll(2).second, absl::StatusCode::kUnavailable);
+  clock_.AdvanceTime(absl::Milliseconds(1));
+
+  // The slave has come back; the probe closes the circuit.
+  SlaveDevice recovered({0, 0, 16, 0});
+  server_.AddSlave(2, &recovered);
+  ASSERT_EQ(Poll(2).second, absl::StatusCode::kOk);
+  ASSERT_EQ(client_.GetState(2), CircuitBreakerClient::State::kClosed);
+}
+
+TEST_F(CircuitBreakerClientTest, ExceptionResponsesKeepCircuitClosed) {
+  for (int i = 0; i < 5; ++i) {
+    // Address out of range: the slave answers with an exception.
+    auto result = ReadHoldingRegisters(&client_, 1, 100, 1);
+    ASSERT_EQ(result.status().code(), absl::StatusCode::kInternal);
+  }
+  ASSERT_EQ(client_.GetState(1), CircuitBreakerClient::State::kClosed);
+}
+
+// Client that rejects requests too long for a frame before sending them, as
+// transports do, and forwards the others.
+class FrameLimitClient : public Client {
+public:
+  explicit FrameLimitClient(Client *client) : Client(0), client_(client) {}
+
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t slave_id, FunctionCode function_code,
+              const std::vector<uint8_t> &request_data) override {
+    if (request_data.size() > 252) {
+      return absl::InvalidArgumentError("Request too long.");
+    }
+    return client_->SendReceive(slave_id, function_code, request_data);
+  }
+
+private:
+  Client *client_;
+};
+
+TEST_F(CircuitBreakerClientTest, CallerErrorsLeaveCircuitAlone) {
+  FrameLimitClient transport(&loopback_);
+  CircuitBreakerClient client(&transport, {3, 1000, 8000});
+  client.SetClock(&clock_);
+  std::vector<uint8_t> too_long(300);
+  auto send_too_long = [&](uint8_t slave_id) {
+    return client
+        .SendReceive(slave_id, FunctionCode::kWriteMultipleRegisters, too_long)
+        .status()
+        .code();
+  };
+  for (int i = 0; i < 5; ++i) {
+    ASSERT_EQ(send_too_long(1), absl::StatusCode::kInvalidArgument);
+  }
+  ASSERT_EQ(client.GetState(1), CircuitBreakerClient::State::kClosed);
+
+  // A probe that fails the same way lets the next request probe.
+  for (int i = 0; i < 3; ++i) {
+    ReadHoldingRegisters(&client, 2, 0, 1).IgnoreError();
+  }
+  clock_.AdvanceTime(absl::Seconds(1));
+  ASSERT_EQ(send_too_long(2), absl::StatusCode::kInvalidArgument);
+  ASSERT_EQ(client.GetState(2), CircuitBreakerClient::State::kOpen);
+  ASSERT_EQ(ReadHoldingRegisters(&client, 2, 0, 1).status().code(),
+            absl::StatusCode::kDeadlineExceeded);
+}
+
+TEST_F(CircuitBreakerClientTest, GuardsPreparedRequests) {
+  auto request = PrepareRead(2, FunctionCode::kReadHoldingRegisters, 0, 1);
+  ASSERT_TRUE(request.ok());
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_EQ(ReadRegisters(&client_, *request).status().code(),
+              absl::StatusCode::kDeadlineExceeded);
+  }
+  ASSERT_EQ(client_.GetState(2), CircuitBreakerClient::State::kOpen);
+  ASSERT_EQ(ReadRegisters(&client_, *request).status().code(),
+            absl::StatusCode::kUnavailable);
+}
+
+TEST_F(CircuitBreakerClientTest, ForwardsTimeoutsToWrappedClient) {
+  LoopbackClient loopback(&server_, 1000);
+  CircuitBreakerClient client(&loopback, {3, 1000, 8000});
+  client.SetClock(&clock_);
+  client.SetTimeout(200);
+  AdaptiveTimeoutParams params;
+  params.min_timeout_ms = 50;
+  client.EnableAdaptiveTimeouts(params);
+  EXPECT_EQ(client.TimeoutFor(2), 200);
+
+  // The wrapped client waits out its timeout on the decorator's clock.
+  absl::Time start = clock_.Now();
+  EXPECT_EQ(ReadHoldingRegisters(&client, 2, 0, 1).status().code(),
+            absl::StatusCode::kDeadlineExceeded);
+  EXPECT_EQ(clock_.Now() - start, absl::Milliseconds(200));
+  ASSERT_TRUE(ReadHoldingRegisters(&client, 1, 0, 1).ok());
+  EXPECT_EQ(loopback.TimeoutFor(1), 50);
+  EXPECT_EQ(client.TimeoutFor(1), 50);
+}
+
+} // namespace test
+} // namespace modbus
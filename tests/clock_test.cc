@@ -0,0 +1,59 @@
+#include "src/clock.h"
+#include "gtest/gtest.h"
+#include "src/fault_injection_client.h"
+#include "src/loopback_client.h"
+#include "src/modbus_functions.h"
+
+namespace modbus {
+namespace test {
+
+TEST(SimulatedClockTest, SleepAdvancesTime) {
+  SimulatedClock clock;
+  absl::Time start = clock.Now();
+  clock.SleepFor(absl::Seconds(3));
+  clock.AdvanceTime(absl::Milliseconds(250));
+  ASSERT_EQ(clock.Now() - start, absl::Milliseconds(3250));
+}
+
+TEST(SimulatedClockTest, IgnoresNegativeDurations) {
+  SimulatedClock clock;
+  absl::Time start = clock.Now();
+  clock.AdvanceTime(-absl::Seconds(1));
+  ASSERT_EQ(clock.Now(), start);
+}
+
+// Runs 10,000 one-second timeout scenarios in virtual time.
+TEST(SimulatedClockTest, TimeoutsRunInVirtualTime) {
+  SlaveDevice device({0, 0, 16, 0});
+  LoopbackServer server;
+  server.AddSlave(1, &device);
+  LoopbackClient loopback(&server, 1000);
+
+  FaultInjectionParams params;
+  params.latency_ms = 5;
+  params.drop_probability = 0.5;
+  FaultInjectionClient client(&loopback, 1000, params);
+  SimulatedClock clock;
+  client.SetClock(&clock);
+
+  absl::Time real_start = absl::Now();
+  absl::Time virtual_start = clock.Now();
+  int timeouts = 0;
+  for (int i = 0; i < 10000; ++i) {
+    auto result = ReadHoldingRegisters(&client, 1, 0, 4);
+    if (result.status().code() == absl::StatusCode::kDeadlineExceeded) {
+      ++timeouts;
+    } else {
+      ASSERT_TRUE(result.ok());
+    }
+  }
+
+  ASSERT_GT(timeouts, 0);
+  ASSERT_EQ(clock.Now() - virtual_start,
+            timeouts * absl::Seconds(1) +
+                (10000 - timeouts) * absl::Milliseconds(5));
+  ASSERT_LT(absl::Now() - real_start, absl::Seconds(10));
+}
+
+} // namespace test
+} // namespace modbus
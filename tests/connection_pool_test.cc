@@ -0,0 +1,179 @@
+#include "src/connection_pool.h"
+#include "gtest/gtest.h"
+#include "src/clock.h"
+#include "src/loopback_client.h"
+#include "src/modbus_functions.h"
+#include "src/modbus_slave.h"
+#include "src/modbus_tcp_server.h"
+#include "src/tcp_socket.h"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace modbus {
+namespace test {
+
+class ConnectionPoolTest : public testing::Test {
+protected:
+  ConnectionPoolTest() : device_({0, 0, 16, 0}) {
+    device_.holding_registers()[0] = 42;
+    slaves_.AddSlave(1, &device_);
+  }
+
+  // Starts a server, on 'port' if nonzero, and returns its port.
+  int StartServer(int port = 0) {
+    servers_.push_back(std::make_unique<TcpServer>(&slaves_));
+    auto started = servers_.back()->Start(port);
+    EXPECT_TRUE(started.ok());
+    return started.value_or(0);
+  }
+
+  SlaveDevice device_;
+  LoopbackServer slaves_;
+  std::vector<std::unique_ptr<TcpServer>> servers_;
+};
+
+TEST(AddressCacheTest, ResolvesNumericHost) {
+  AddressCache cache;
+  auto addresses = cache.Resolve("127.0.0.1", 502);
+  ASSERT_TRUE(addresses.ok());
+  ASSERT_EQ(addresses.value().size(), 1u);
+  ASSERT_EQ(addresses.value()[0].storage.ss_family, AF_INET);
+}
+
+TEST(AddressCacheTest, FailsOnInvalidHost) {
+  AddressCache cache;
+  ASSERT_FALSE(cache.Resolve("invalid host name", 502).ok());
+}
+
+TEST(SendVectorTest, ResumesAfterPartialWrites) {
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  int size = 4096;
+  setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  uint8_t header[3] = {1, 2, 3};
+  std::vector<uint8_t> payload(100000);
+  for (size_t i = 0; i < payload.size(); ++i) {
+    payload[i] = i % 251;
+  }
+
+  std::vector<uint8_t> received;
+  std::thread reader([&] {
+    uint8_t chunk[1000];
+    ssize_t n;
+    while ((n = read(fds[1], chunk, sizeof(chunk))) > 0) {
+      received.insert(received.end(), chunk, chunk + n);
+    }
+  });
+  struct iovec iov[2] = {{header, sizeof(header)},
+                         {payload.data(), payload.size()}};
+  ASSERT_TRUE(SendVector(fds[0], absl::MakeSpan(iov)).ok());
+  close(fds[0]);
+  reader.join();
+  close(fds[1]);
+
+  std::vector<uint8_t> expected(header, header + sizeof(header));
+  expected.insert(expected.end(), payload.begin(), payload.end());
+  ASSERT_EQ(received, expected);
+}
+
+TEST_F(ConnectionPoolTest, ConnectsAllDevicesInParallel) {
+  ConnectionPool pool({}, 1000);
+  for (int i = 0; i < 20; ++i) {
+    pool.AddDevice("127.0.0.1", StartServer());
+  }
+  ASSERT_EQ(pool.ConnectAll(), 20);
+  for (size_t i = 0; i < pool.size(); ++i) {
+    auto registers = ReadHoldingRegisters(pool.client(i), 1, 0, 1);
+    ASSERT_TRUE(registers.ok());
+    ASSERT_EQ(registers.value()[0], 42);
+  }
+  for (auto &server : servers_) {
+    ASSERT_EQ(server->connections_accepted(), 1);
+  }
+}
+
+TEST_F(ConnectionPoolTest, ReconnectsAfterConnectionLoss) {
+  ConnectionPool pool({}, 1000);
+  int port = StartServer();
+  PooledTcpClient *client = pool.AddDevice("127.0.0.1", port);
+  ASSERT_TRUE(ReadHoldingRegisters(client, 1, 0, 1).ok());
+
+  servers_.back()->Stop();
+  ASSERT_FALSE(ReadHoldingRegisters(client, 1, 0, 1).ok());
+  ASSERT_FALSE(client->connected());
+
+  StartServer(port);
+  ASSERT_TRUE(ReadHoldingRegisters(client, 1, 0, 1).ok());
+  ASSERT_TRUE(client->connected());
+}
+
+TEST_F(ConnectionPoolTest, SendsPreparedRequests) {
+  ConnectionPool pool({}, 1000);
+  int port = StartServer();
+  PooledTcpClient *client = pool.AddDevice("127.0.0.1", port);
+  auto request = PrepareRead(1, FunctionCode::kReadHoldingRegisters, 0, 1);
+  ASSERT_TRUE(request.ok());
+  auto registers = ReadRegisters(client, *request);
+  ASSERT_TRUE(registers.ok()) << registers.status();
+  ASSERT_EQ(registers.value()[0], 42);
+
+  servers_.back()->Stop();
+  ASSERT_FALSE(ReadRegisters(client, *request).ok());
+  ASSERT_FALSE(client->connected());
+}
+
+TEST_F(ConnectionPoolTest, KeepsConnectionAfterTimeout) {
+  ConnectionPool pool({}, 100);
+  PooledTcpClient *client = pool.AddDevice("127.0.0.1", StartServer());
+  ASSERT_TRUE(ReadHoldingRegisters(client, 1, 0, 1).ok());
+  // The server does not answer for unknown slaves.
+  ASSERT_EQ(ReadHoldingRegisters(client, 2, 0, 1).status().code(),
+            absl::StatusCode::kDeadlineExceeded);
+  ASSERT_TRUE(client->connected());
+  ASSERT_TRUE(ReadHoldingRegisters(client, 1, 0, 1).ok());
+  ASSERT_EQ(servers_.back()->connections_accepted(), 1);
+}
+
+TEST_F(ConnectionPoolTest, ForwardsAdaptiveTimeouts) {
+  ConnectionPool pool({}, 1000);
+  PooledTcpClient *client = pool.AddDevice("127.0.0.1", StartServer());
+  client->SetTimeout(200);
+  AdaptiveTimeoutParams params;
+  params.min_timeout_ms = 50;
+  client->EnableAdaptiveTimeouts(params);
+  ASSERT_EQ(client->TimeoutFor(1), 200);
+  ASSERT_TRUE(ReadHoldingRegisters(client, 1, 0, 1).ok());
+  ASSERT_EQ(client->TimeoutFor(1), 50);
+}
+
+TEST_F(ConnectionPoolTest, BacksOffAfterFailedConnect) {
+  // Reserve a port, then free it so that connecting is refused.
+  int port = StartServer();
+  servers_.back()->Stop();
+
+  ConnectionPoolParams params;
+  params.initial_backoff_ms = 100;
+  params.max_backoff_ms = 1000;
+  ConnectionPool pool(params, 1000);
+  PooledTcpClient *client = pool.AddDevice("127.0.0.1", port);
+  SimulatedClock clock;
+  client->SetClock(&clock);
+  ASSERT_EQ(pool.ConnectAll(), 0);
+
+  // The device comes back, but is not retried until the backoff elapses.
+  StartServer(port);
+  ASSERT_EQ(ReadHoldingRegisters(client, 1, 0, 1).status().code(),
+            absl::StatusCode::kUnavailable);
+  ASSERT_EQ(pool.ConnectAll(), 0);
+  clock.AdvanceTime(absl::Milliseconds(100));
+  ASSERT_TRUE(ReadHoldingRegisters(client, 1, 0, 1).ok());
+}
+
+} // namespace test
+} // namespace modbus
@@ -0,0 +1,160 @@
+#include "src/device_map.h"
+#include "gtest/gtest.h"
+#include "src/loopback_client.h"
+#include "src/modbus_slave.h"
+
+#include <cstdint>
+#include <ratio>
+#include <vector>
+
+namespace modbus {
+namespace test {
+
+struct Meter {
+  float voltage;
+  uint32_t energy;
+  double temperature;
+  int64_t counter;
+  uint16_t status;
+};
+
+using MeterMap = DeviceMap<
+    Meter, FunctionCode::kReadHoldingRegisters, 4,
+    Tag<&Meter::status, 200>, Tag<&Meter::voltage, 0>,
+    Tag<&Meter::energy, 2, uint32_t, WordOrder::kLowWordFirst>,
+    Tag<&Meter::temperature, 8, int16_t, WordOrder::kHighWordFirst,
+        std::ratio<1, 10>>,
+    Tag<&Meter::counter, 100>>;
+
+// The tags at 0, 2 and 8 are within 4 registers of each other; those at
+// 100 and 200 are not.
+static_assert(MeterMap::kReadCount == 3);
+static_assert(MeterMap::kReads[0].address == 0 &&
+              MeterMap::kReads[0].quantity == 9);
+static_assert(MeterMap::kReads[1].address == 100 &&
+              MeterMap::kReads[1].quantity == 4);
+static_assert(MeterMap::kReads[2].address == 200 &&
+              MeterMap::kReads[2].quantity == 1);
+
+struct Block {
+  uint16_t first;
+  uint16_t middle;
+  uint16_t last;
+};
+
+// Spans 201 registers, more than one read returns.
+using BlockMap =
+    DeviceMap<Block, FunctionCode::kReadInputRegisters, 200,
+              Tag<&Block::middle, 100>, Tag<&Block::first, 0>,
+              Tag<&Block::last, 200>>;
+
+static_assert(BlockMap::kReadCount == 2);
+static_assert(BlockMap::kReads[0].address == 0 &&
+              BlockMap::kReads[0].quantity == 101);
+static_assert(BlockMap::kReads[1].address == 200 &&
+              BlockMap::kReads[1].quantity == 1);
+
+struct Overlap {
+  uint16_t head;
+  uint64_t low;
+  uint64_t high;
+};
+
+// 'high' does not fit into the read of 'head' and 'low' and starts a read
+// that overlaps it.
+using OverlapMap =
+    DeviceMap<Overlap, FunctionCode::kReadHoldingRegisters, 125,
+              Tag<&Overlap::head, 0>, Tag<&Overlap::low, 120>,
+              Tag<&Overlap::high, 122>>;
+
+static_assert(OverlapMap::kReadCount == 2);
+static_assert(OverlapMap::kReads[0].address == 0 &&
+              OverlapMap::kReads[0].quantity == 124);
+static_assert(OverlapMap::kReads[1].address == 122 &&
+              OverlapMap::kReads[1].quantity == 4);
+
+class DeviceMapTest : public testing::Test {
+protected:
+  DeviceMapTest() : device_({0, 0, 256, 256}), client_(&server_, 100) {
+    std::vector<uint16_t> &registers = device_.holding_registers();
+    // 230.5 as a float, high word first.
+    registers[0] = 0x4366;
+    registers[1] = 0x8000;
+    // 0x00012345, low word first.
+    registers[2] = 0x2345;
+    registers[3] = 0x0001;
+    // -21.5, scaled by 10.
+    registers[8] = static_cast<uint16_t>(-215);
+    // -2 as a 64-bit integer.
+    for (size_t i = 100; i < 104; ++i) {
+      registers[i] = 0xFFFF;
+    }
+    registers[103] = 0xFFFE;
+    registers[200] = 7;
+    server_.AddSlave(1, &device_);
+  }
+
+  SlaveDevice device_;
+  LoopbackServer server_;
+  LoopbackClient client_;
+};
+
+TEST_F(DeviceMapTest, ReadsTags) {
+  MeterMap::Requests requests = MeterMap::Prepare(1);
+  ASSERT_EQ(requests[0].data(), std::vector<uint8_t>({0, 0, 0, 9}));
+  ASSERT_EQ(requests[1].data(), std::vector<uint8_t>({0, 100, 0, 4}));
+
+  auto meter = MeterMap::Read(&client_, requests);
+  ASSERT_TRUE(meter.ok()) << meter.status();
+  EXPECT_EQ(meter->voltage, 230.5f);
+  EXPECT_EQ(meter->energy, 0x00012345u);
+  EXPECT_DOUBLE_EQ(meter->temperature, -21.5);
+  EXPECT_EQ(meter->counter, -2);
+  EXPECT_EQ(meter->status, 7);
+
+  auto missing = MeterMap::Read(&client_, MeterMap::Prepare(2));
+  ASSERT_EQ(missing.status().code(), absl::StatusCode::kDeadlineExceeded);
+}
+
+TEST_F(DeviceMapTest, ReadsAcrossSplitReads) {
+  device_.input_registers()[0] = 1;
+  device_.input_registers()[100] = 2;
+  device_.input_registers()[200] = 3;
+  auto block = BlockMap::Read(&client_, BlockMap::Prepare(1));
+  ASSERT_TRUE(block.ok()) << block.status();
+  EXPECT_EQ(block->first, 1);
+  EXPECT_EQ(block->middle, 2);
+  EXPECT_EQ(block->last, 3);
+}
+
+TEST_F(DeviceMapTest, ReadsTagsInOverlappingReads) {
+  std::vector<uint16_t> &registers = device_.holding_registers();
+  for (size_t i = 120; i < 126; ++i) {
+    registers[i] = i;
+  }
+  auto overlap = OverlapMap::Read(&client_, OverlapMap::Prepare(1));
+  ASSERT_TRUE(overlap.ok()) << overlap.status();
+  EXPECT_EQ(overlap->low, 0x00780079007A007Bu);
+  EXPECT_EQ(overlap->high, 0x007A007B007C007Du);
+}
+
+TEST(DeviceMapDecodeTest, RejectsWrongResponses) {
+  MeterMap::Responses responses = {
+      std::vector<uint8_t>(20), std::vector<uint8_t>(10),
+      std::vector<uint8_t>(4)};
+  for (auto &response : responses) {
+    response[0] = 0x03;
+    response[1] = response.size() - 2;
+  }
+  Meter meter;
+  ASSERT_TRUE(MeterMap::Decode(responses, &meter).ok());
+
+  responses[1].pop_back();
+  ASSERT_FALSE(MeterMap::Decode(responses, &meter).ok());
+  responses[1].push_back(0);
+  responses[2][0] = 0x04;
+  ASSERT_FALSE(MeterMap::Decode(responses, &meter).ok());
+}
+
+} // namespace test
+} // namespace modbus
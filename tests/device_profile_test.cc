@@ -0,0 +1,260 @@
+#include "src/device_profile.h"
+#include "gtest/gtest.h"
+#include "src/clock.h"
+#include "src/loopback_client.h"
+#include "src/modbus_functions.h"
+#include "src/modbus_slave.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace modbus {
+namespace test {
+
+// Client for a device with lower limits than the specification's. Requests
+// over a limit are answered with Illegal Data Value, unsupported function
+// codes with Illegal Function, and requests beyond 'max_concurrent' at once
+// with Server Device Busy.
+class LimitedDeviceClient : public Client {
+public:
+  LimitedDeviceClient(Client *client, const DeviceProfile &limits,
+                      int max_concurrent)
+      : Client(0), client_(client), limits_(limits),
+        max_concurrent_(max_concurrent) {}
+
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t slave_id, FunctionCode function_code,
+              const std::vector<uint8_t> &request_data) override {
+    {
+      absl::MutexLock lock(&mu_);
+      ++requests_;
+      ++concurrent_;
+    }
+    if (max_concurrent_ > 1) {
+      // Lets requests sent at once overlap.
+      absl::SleepFor(absl::Milliseconds(10));
+    }
+    absl::StatusOr<std::vector<uint8_t>> response;
+    uint16_t limit = limits_.MaxQuantity(function_code);
+    bool busy;
+    {
+      absl::MutexLock lock(&mu_);
+      busy = concurrent_ > max_concurrent_;
+    }
+    if (!limits_.Supports(function_code)) {
+      response = BuildExceptionResponse(function_code,
+                                        ExceptionCode::kIllegalFunction);
+    } else if (limit > 0 &&
+               (request_data[2] << 8 | request_data[3]) > limit) {
+      response = BuildExceptionResponse(function_code,
+                                        ExceptionCode::kIllegalDataValue);
+    } else if (busy) {
+      response = BuildExceptionResponse(function_code,
+                                        ExceptionCode::kServerDeviceBusy);
+    } else {
+      response = client_->SendReceive(slave_id, function_code, request_data);
+    }
+    absl::MutexLock lock(&mu_);
+    --concurrent_;
+    return response;
+  }
+
+  int requests() {
+    absl::MutexLock lock(&mu_);
+    return requests_;
+  }
+
+private:
+  Client *client_;
+  DeviceProfile limits_;
+  int max_concurrent_;
+  absl::Mutex mu_;
+  int requests_ ABSL_GUARDED_BY(mu_) = 0;
+  int concurrent_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+class DeviceProfileTest : public testing::Test {
+protected:
+  DeviceProfileTest()
+      : device_({4000, 4000, 1000, 1000}), loopback_(&server_, 50) {
+    server_.AddSlave(1, &device_);
+    limits_.max_read_bits = 500;
+    limits_.max_read_registers = 60;
+    limits_.max_write_coils = 1968;
+    limits_.max_write_registers = 20;
+    limits_.functions &= ~FunctionBit(FunctionCode::kReadInputRegisters) &
+                         ~FunctionBit(FunctionCode::kWriteMultipleCoils);
+  }
+
+  SlaveDevice device_;
+  LoopbackServer server_;
+  LoopbackClient loopback_;
+  DeviceProfile limits_;
+};
+
+TEST_F(DeviceProfileTest, ProbesLimitsAndFunctions) {
+  LimitedDeviceClient client(&loopback_, limits_, 1);
+  ProbeParams params;
+  params.holding_register_address = 100;
+  params.probe_writes = true;
+  device_.holding_registers()[105] = 1234;
+  auto profile = ProbeDevice(&client, 1, params);
+  ASSERT_TRUE(profile.ok()) << profile.status();
+  EXPECT_EQ(*profile, limits_);
+  // Writes store the values they read.
+  EXPECT_EQ(device_.holding_registers()[105], 1234);
+
+  // Without write probing, write limits stay at the specification's.
+  params.probe_writes = false;
+  profile = ProbeDevice(&client, 1, params);
+  ASSERT_TRUE(profile.ok());
+  EXPECT_EQ(profile->max_write_registers, 123);
+  EXPECT_TRUE(profile->Supports(FunctionCode::kWriteMultipleCoils));
+  EXPECT_FALSE(profile->Supports(FunctionCode::kReadInputRegisters));
+
+  EXPECT_EQ(ProbeDevice(&loopback_, 2, params).status().code(),
+            absl::StatusCode::kDeadlineExceeded);
+}
+
+TEST_F(DeviceProfileTest, ProbesWritesAtAddressZero) {
+  limits_.max_write_coils = 100;
+  limits_.functions |= FunctionBit(FunctionCode::kWriteMultipleCoils);
+  LimitedDeviceClient client(&loopback_, limits_, 1);
+  ProbeParams params;
+  params.probe_writes = true;
+  auto profile = ProbeDevice(&client, 1, params);
+  ASSERT_TRUE(profile.ok()) << profile.status();
+  EXPECT_EQ(*profile, limits_);
+
+  DeviceProfileCache cache;
+  cache.Put("loopback", 1, *profile);
+  DeviceProfileCache loaded;
+  ASSERT_TRUE(loaded.LoadCsv(cache.ToCsv()).ok());
+  EXPECT_EQ(loaded.Get("loopback", 1), limits_);
+}
+
+TEST_F(DeviceProfileTest, ProbesPipelineDepth) {
+  LimitedDeviceClient client(&loopback_, DeviceProfile(), 4);
+  ProbeParams params;
+  params.max_pipeline_depth = 16;
+  auto profile = ProbeDevice(&client, 1, params);
+  ASSERT_TRUE(profile.ok()) << profile.status();
+  EXPECT_EQ(profile->pipeline_depth, 4);
+}
+
+TEST_F(DeviceProfileTest, CachesProfilesAsCsv) {
+  DeviceProfileCache cache;
+  LimitedDeviceClient client(&loopback_, limits_, 1);
+  auto profile = cache.GetOrProbe("10.0.0.5:502", &client, 1, ProbeParams());
+  ASSERT_TRUE(profile.ok());
+  int requests = client.requests();
+  EXPECT_TRUE(cache.GetOrProbe("10.0.0.5:502", &client, 1, {}).ok());
+  EXPECT_EQ(client.requests(), requests);
+  EXPECT_FALSE(cache.Contains("10.0.0.6:502", 1));
+  EXPECT_EQ(cache.Get("10.0.0.6:502", 1), DeviceProfile());
+
+  DeviceProfile other;
+  other.pipeline_depth = 8;
+  cache.Put("/dev/ttyUSB0", 7, other);
+  std::string csv = cache.ToCsv();
+  EXPECT_EQ(csv, "/dev/ttyUSB0,7,2000,125,1968,123,8,1 2 3 4 5 6 15 16\n"
+                 "10.0.0.5:502,1,500,60,1968,123,1,1 2 3 5 6 15 16\n");
+
+  DeviceProfileCache loaded;
+  ASSERT_TRUE(loaded.LoadCsv("# endpoint,slave,...\n\n" + csv).ok());
+  EXPECT_EQ(loaded.Get("10.0.0.5:502", 1), *profile);
+  EXPECT_EQ(loaded.Get("/dev/ttyUSB0", 7), other);
+  EXPECT_FALSE(loaded.LoadCsv("a,1,2,3,4,5,6").ok());
+  EXPECT_FALSE(loaded.LoadCsv("a,256,2000,125,1968,123,1,3").ok());
+  EXPECT_FALSE(loaded.LoadCsv("a,1,0,125,1968,123,1,3").ok());
+}
+
+TEST_F(DeviceProfileTest, FitsRequestsToProfile) {
+  DeviceProfile limits = limits_;
+  limits.max_read_bits = 12;
+  limits.max_read_registers = 10;
+  limits.max_write_coils = 5;
+  limits.max_write_registers = 7;
+  limits.functions |= FunctionBit(FunctionCode::kWriteMultipleCoils);
+  LimitedDeviceClient device(&loopback_, limits, 1);
+  DeviceProfileCache cache;
+  cache.Put("loopback", 1, limits);
+  ProfiledClient client(&device, &cache, "loopback");
+
+  std::vector<uint16_t> registers(30);
+  std::vector<bool> coils(29);
+  for (int i = 0; i < 30; ++i) {
+    registers[i] = i * 3 + 1;
+  }
+  for (int i = 0; i < 29; ++i) {
+    coils[i] = i % 3 == 0;
+  }
+  ASSERT_TRUE(WriteMultipleRegisters(&client, 1, 3, registers).ok());
+  ASSERT_TRUE(WriteMultipleCoils(&client, 1, 3, coils).ok());
+  EXPECT_EQ(device.requests(), 5 + 6);
+  auto read_registers = ReadHoldingRegisters(&client, 1, 3, 30);
+  ASSERT_TRUE(read_registers.ok()) << read_registers.status();
+  EXPECT_EQ(*read_registers, registers);
+  auto read_coils = ReadCoils(&client, 1, 3, 29);
+  ASSERT_TRUE(read_coils.ok()) << read_coils.status();
+  EXPECT_EQ(*read_coils, coils);
+  auto prepared = PrepareRead(1, FunctionCode::kReadHoldingRegisters, 3, 30);
+  ASSERT_TRUE(prepared.ok());
+  EXPECT_EQ(ReadRegisters(&client, *prepared).value(), registers);
+  EXPECT_EQ(device.requests(), 11 + 3 + 3 + 3);
+
+  // Unsupported functions fail without a round trip.
+  EXPECT_FALSE(ReadInputRegisters(&client, 1, 0, 1).ok());
+  EXPECT_EQ(device.requests(), 20);
+}
+
+TEST_F(DeviceProfileTest, ForwardsQuantitiesOverSpecificationUnsplit) {
+  LimitedDeviceClient device(&loopback_, limits_, 1);
+  DeviceProfileCache cache;
+  cache.Put("loopback", 1, limits_);
+  ProfiledClient client(&device, &cache, "loopback");
+
+  // 200 registers would need 400 response bytes, more than a PDU holds.
+  auto response = client.SendReceive(1, FunctionCode::kReadHoldingRegisters,
+                                     {0x00, 0x00, 0x00, 200});
+  ASSERT_TRUE(response.ok()) << response.status();
+  EXPECT_EQ(*response, std::vector<uint8_t>({0x83, 0x03}));
+  EXPECT_EQ(device.requests(), 1);
+
+  // The largest read the specification allows is still split.
+  auto registers = ReadHoldingRegisters(&client, 1, 0, 125);
+  ASSERT_TRUE(registers.ok()) << registers.status();
+  EXPECT_EQ(registers->size(), 125);
+  EXPECT_EQ(device.requests(), 1 + 3);
+}
+
+TEST_F(DeviceProfileTest, ForwardsTimeoutsToWrappedClient) {
+  SimulatedClock clock;
+  DeviceProfileCache cache;
+  LoopbackClient loopback(&server_, 1000);
+  ProfiledClient client(&loopback, &cache, "loopback");
+  client.SetClock(&clock);
+  client.SetTimeout(200);
+  AdaptiveTimeoutParams params;
+  params.min_timeout_ms = 50;
+  client.EnableAdaptiveTimeouts(params);
+  EXPECT_EQ(client.TimeoutFor(2), 200);
+
+  // The wrapped client waits out its timeout on the decorator's clock.
+  absl::Time start = clock.Now();
+  EXPECT_EQ(ReadHoldingRegisters(&client, 2, 0, 1).status().code(),
+            absl::StatusCode::kDeadlineExceeded);
+  EXPECT_EQ(clock.Now() - start, absl::Milliseconds(200));
+  ASSERT_TRUE(ReadHoldingRegisters(&client, 1, 0, 1).ok());
+  EXPECT_EQ(loopback.TimeoutFor(1), 50);
+  EXPECT_EQ(client.TimeoutFor(1), 50);
+}
+
+} // namespace test
+} // namespace modbus
@@ -0,0 +1,84 @@
+#include "src/engineering_units.h"
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace modbus {
+namespace test {
+
+TEST(ConversionTableTest, ScalesOffsetsAndClamps) {
+  ConversionTable table;
+  ASSERT_TRUE(table.Add({0, 0, 16, false, 0.1f, -40}).ok());
+  ASSERT_TRUE(table.Add({1, 0, 16, true, 0.5f}).ok());
+  ASSERT_TRUE(table.Add({2, 0, 16, false, 1, 0, 0, 100}).ok());
+  // Bits 4 to 7 of the status word in register 3, and its top bit.
+  ASSERT_TRUE(table.Add({3, 4, 4}).ok());
+  ASSERT_TRUE(table.Add({3, 15, 1}).ok());
+  // A signed 4-bit field.
+  ASSERT_TRUE(table.Add({3, 0, 4, true}).ok());
+  ASSERT_EQ(table.size(), 6);
+
+  std::vector<uint16_t> registers = {650, static_cast<uint16_t>(-20), 250,
+                                     0x80AE};
+  std::vector<float> values(table.size());
+  ASSERT_TRUE(table.Convert(registers, absl::MakeSpan(values)).ok());
+  EXPECT_FLOAT_EQ(values[0], 25);
+  EXPECT_FLOAT_EQ(values[1], -10);
+  EXPECT_FLOAT_EQ(values[2], 100);
+  EXPECT_FLOAT_EQ(values[3], 0xA);
+  EXPECT_FLOAT_EQ(values[4], 1);
+  EXPECT_FLOAT_EQ(values[5], -2);
+}
+
+TEST(ConversionTableTest, RejectsBadInput) {
+  ConversionTable table;
+  EXPECT_FALSE(table.Add({0, 8, 9}).ok());
+  EXPECT_FALSE(table.Add({0, 0, 0}).ok());
+  ASSERT_TRUE(table.Add({4}).ok());
+  std::vector<float> values(1);
+  EXPECT_FALSE(
+      table.Convert(std::vector<uint16_t>(4), absl::MakeSpan(values)).ok());
+  EXPECT_TRUE(
+      table.Convert(std::vector<uint16_t>(5), absl::MakeSpan(values)).ok());
+  EXPECT_FALSE(table.Convert(std::vector<uint16_t>(5), {}).ok());
+}
+
+// Compares the vectorized and scalar code on random conversions, with
+// registers read in order and gathered.
+TEST(ConversionTableTest, VectorizedMatchesScalar) {
+  std::mt19937 random(1);
+  std::vector<uint16_t> registers(1005);
+  for (uint16_t &value : registers) {
+    value = random();
+  }
+  for (bool contiguous : {true, false}) {
+    ConversionTable table;
+    for (uint32_t i = 0; i < registers.size(); ++i) {
+      Conversion conversion;
+      conversion.source = contiguous ? i : random() % registers.size();
+      conversion.bit_count = 1 + random() % 16;
+      conversion.bit_offset = random() % (17 - conversion.bit_count);
+      conversion.is_signed = random() % 2;
+      conversion.scale = (random() % 2000) / 100.0f - 10;
+      conversion.offset = (random() % 2000) - 1000.0f;
+      if (random() % 4 == 0) {
+        conversion.min = -500;
+        conversion.max = 500;
+      }
+      ASSERT_TRUE(table.Add(conversion).ok());
+    }
+    std::vector<float> vectorized(table.size());
+    std::vector<float> scalar(table.size());
+    ASSERT_TRUE(table.Convert(registers, absl::MakeSpan(vectorized)).ok());
+    table.set_vectorized(false);
+    ASSERT_TRUE(table.Convert(registers, absl::MakeSpan(scalar)).ok());
+    for (size_t i = 0; i < table.size(); ++i) {
+      ASSERT_EQ(vectorized[i], scalar[i]) << i;
+    }
+  }
+}
+
+} // namespace test
+} // namespace modbus
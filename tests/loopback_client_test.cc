@@ -0,0 +1,114 @@
+#include "src/loopback_client.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/clock.h"
+#include "src/fault_injection_client.h"
+#include "src/modbus_functions.h"
+
+namespace modbus {
+namespace test {
+
+class LoopbackClientTest : public testing::Test {
+protected:
+  LoopbackClientTest() : device_({16, 16, 16, 16}), client_(&server_, 100) {
+    for (size_t i = 0; i < device_.holding_registers().size(); ++i) {
+      device_.holding_registers()[i] = 100 + i;
+    }
+    server_.AddSlave(1, &device_);
+  }
+
+  SlaveDevice device_;
+  LoopbackServer server_;
+  LoopbackClient client_;
+};
+
+TEST_F(LoopbackClientTest, RoundTrip) {
+  ASSERT_TRUE(WriteSingleRegister(&client_, 1, 0, 7).ok());
+  auto registers = ReadHoldingRegisters(&client_, 1, 0, 3);
+  ASSERT_TRUE(registers.ok());
+  ASSERT_THAT(registers.value(), testing::ElementsAre(7, 101, 102));
+}
+
+TEST_F(LoopbackClientTest, UnknownSlaveTimesOut) {
+  auto registers = ReadHoldingRegisters(&client_, 2, 0, 3);
+  ASSERT_EQ(registers.status().code(), absl::StatusCode::kDeadlineExceeded);
+}
+
+TEST_F(LoopbackClientTest, InjectsException) {
+  FaultInjectionParams params;
+  params.exception_probability = 1;
+  FaultInjectionClient faulty(&client_, 100, params);
+  auto response =
+      faulty.SendReceive(1, FunctionCode::kReadHoldingRegisters,
+                         {0x00, 0x00, 0x00, 0x01});
+  ASSERT_TRUE(response.ok());
+  ASSERT_THAT(response.value(), testing::ElementsAre(0x83, 0x06));
+}
+
+TEST_F(LoopbackClientTest, InjectsCrcErrorsAndPartialFrames) {
+  FaultInjectionParams params;
+  params.crc_error_probability = 1;
+  FaultInjectionClient corrupting(&client_, 100, params);
+  ASSERT_EQ(ReadHoldingRegisters(&corrupting, 1, 0, 3).status().code(),
+            absl::StatusCode::kDataLoss);
+
+  params.crc_error_probability = 0;
+  params.partial_frame_probability = 1;
+  FaultInjectionClient truncating(&client_, 100, params);
+  auto response = truncating.SendReceive(
+      1, FunctionCode::kReadHoldingRegisters, {0x00, 0x00, 0x00, 0x03});
+  ASSERT_TRUE(response.ok());
+  ASSERT_LT(response.value().size(), 8u);
+}
+
+TEST_F(LoopbackClientTest, InjectsFaultsIntoPreparedRequests) {
+  FaultInjectionParams params;
+  params.crc_error_probability = 1;
+  FaultInjectionClient corrupting(&client_, 100, params);
+  auto request = PrepareRead(1, FunctionCode::kReadHoldingRegisters, 0, 3);
+  ASSERT_TRUE(request.ok());
+  ASSERT_EQ(ReadRegisters(&corrupting, *request).status().code(),
+            absl::StatusCode::kDataLoss);
+}
+
+TEST_F(LoopbackClientTest, DropsAreReproducible) {
+  FaultInjectionParams params;
+  params.drop_probability = 0.3;
+  params.seed = 42;
+  auto run = [&] {
+    FaultInjectionClient faulty(&client_, 0, params);
+    std::vector<bool> outcomes;
+    for (int i = 0; i < 50; ++i) {
+      outcomes.push_back(ReadHoldingRegisters(&faulty, 1, 0, 1).ok());
+    }
+    return outcomes;
+  };
+  std::vector<bool> first = run();
+  ASSERT_EQ(first, run());
+  ASSERT_THAT(first, testing::Contains(false));
+  ASSERT_THAT(first, testing::Contains(true));
+}
+
+TEST_F(LoopbackClientTest, FaultInjectionForwardsTimeouts) {
+  SimulatedClock clock;
+  FaultInjectionClient faulty(&client_, 100, FaultInjectionParams());
+  faulty.SetClock(&clock);
+  faulty.SetTimeout(200);
+  AdaptiveTimeoutParams params;
+  params.min_timeout_ms = 50;
+  faulty.EnableAdaptiveTimeouts(params);
+  EXPECT_EQ(client_.TimeoutFor(2), 200);
+
+  // The wrapped client waits out its timeout on the decorator's clock.
+  absl::Time start = clock.Now();
+  EXPECT_EQ(ReadHoldingRegisters(&faulty, 2, 0, 1).status().code(),
+            absl::StatusCode::kDeadlineExceeded);
+  EXPECT_EQ(clock.Now() - start, absl::Milliseconds(200));
+  // Both time requests, and both saw the same round trip.
+  ASSERT_TRUE(ReadHoldingRegisters(&faulty, 1, 0, 1).ok());
+  EXPECT_EQ(client_.TimeoutFor(1), 50);
+  EXPECT_EQ(faulty.TimeoutFor(1), 50);
+}
+
+} // namespace test
+} // namespace modbus
@@ -0,0 +1,180 @@
+#include "src/mbap.h"
+#include "gtest/gtest.h"
+#include "src/modbus_tcp_client.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+namespace modbus {
+namespace test {
+
+// Returns an MBAP frame carrying 'pdu'.
+std::vector<uint8_t> Frame(uint16_t transaction_id, uint8_t unit_id,
+                           const std::vector<uint8_t> &pdu) {
+  std::vector<uint8_t> frame(kMbapHeaderSize);
+  EncodeMbapHeader(
+      {transaction_id, 0, static_cast<uint16_t>(pdu.size() + 1), unit_id},
+      frame.data());
+  frame.insert(frame.end(), pdu.begin(), pdu.end());
+  return frame;
+}
+
+TEST(MbapReceiveBufferTest, SplitsSeveralFramesInOneChunk) {
+  std::vector<uint8_t> stream = Frame(1, 7, {0x03, 0x02, 0x12, 0x34});
+  std::vector<uint8_t> second = Frame(2, 8, {0x06, 0x00, 0x01, 0x00, 0x02});
+  stream.insert(stream.end(), second.begin(), second.end());
+
+  MbapReceiveBuffer buffer;
+  buffer.Append(stream.data(), stream.size());
+  MbapFrame frame;
+  ASSERT_TRUE(buffer.NextFrame(&frame).value());
+  ASSERT_EQ(frame.header.transaction_id, 1);
+  ASSERT_EQ(frame.header.unit_id, 7);
+  ASSERT_EQ(std::vector<uint8_t>(frame.pdu.begin(), frame.pdu.end()),
+            std::vector<uint8_t>({0x03, 0x02, 0x12, 0x34}));
+  ASSERT_TRUE(buffer.NextFrame(&frame).value());
+  ASSERT_EQ(frame.header.transaction_id, 2);
+  ASSERT_EQ(frame.pdu.size(), 5);
+  ASSERT_FALSE(buffer.NextFrame(&frame).value());
+  ASSERT_EQ(buffer.size(), 0);
+}
+
+TEST(MbapReceiveBufferTest, ReassemblesFramesFedByteByByte) {
+  std::vector<uint8_t> stream;
+  for (uint16_t i = 0; i < 3; ++i) {
+    std::vector<uint8_t> frame = Frame(i, 1, {0x04, 0x02, 0x00, 0x2A});
+    stream.insert(stream.end(), frame.begin(), frame.end());
+  }
+
+  MbapReceiveBuffer buffer(16);
+  std::vector<uint16_t> transaction_ids;
+  MbapFrame frame;
+  for (uint8_t byte : stream) {
+    buffer.Append(&byte, 1);
+    while (buffer.NextFrame(&frame).value()) {
+      ASSERT_EQ(frame.pdu.size(), 4);
+      ASSERT_EQ(frame.pdu[3], 0x2A);
+      transaction_ids.push_back(frame.header.transaction_id);
+    }
+  }
+  ASSERT_EQ(transaction_ids, std::vector<uint16_t>({0, 1, 2}));
+}
+
+TEST(MbapReceiveBufferTest, KeepsPartialFrameWhenCompacting) {
+  // A small buffer forces the unparsed tail to be moved and the buffer to
+  // grow while frames straddle chunk boundaries.
+  std::vector<uint8_t> pdu(200, 0x55);
+  pdu[0] = 0x03;
+  std::vector<uint8_t> stream;
+  for (uint16_t i = 0; i < 10; ++i) {
+    std::vector<uint8_t> frame = Frame(i, 1, pdu);
+    stream.insert(stream.end(), frame.begin(), frame.end());
+  }
+
+  MbapReceiveBuffer buffer(64);
+  int frames = 0;
+  MbapFrame frame;
+  for (size_t offset = 0; offset < stream.size(); offset += 150) {
+    size_t size = std::min<size_t>(150, stream.size() - offset);
+    buffer.Append(stream.data() + offset, size);
+    while (buffer.NextFrame(&frame).value()) {
+      ASSERT_EQ(frame.header.transaction_id, frames);
+      ASSERT_EQ(std::vector<uint8_t>(frame.pdu.begin(), frame.pdu.end()), pdu);
+      ++frames;
+    }
+  }
+  ASSERT_EQ(frames, 10);
+}
+
+TEST(MbapReceiveBufferTest, RejectsCorruptHeader) {
+  std::vector<uint8_t> stream = Frame(1, 1, {0x03, 0x00});
+  stream[2] = 0x12; // Protocol ID other than Modbus.
+  MbapReceiveBuffer buffer;
+  buffer.Append(stream.data(), stream.size());
+  MbapFrame frame;
+  ASSERT_EQ(buffer.NextFrame(&frame).status().code(),
+            absl::StatusCode::kInternal);
+  // The corrupt bytes are dropped rather than failing every later call.
+  ASSERT_EQ(buffer.size(), 0);
+  std::vector<uint8_t> next = Frame(2, 1, {0x03, 0x00});
+  buffer.Append(next.data(), next.size());
+  ASSERT_TRUE(buffer.NextFrame(&frame).value());
+  ASSERT_EQ(frame.header.transaction_id, 2);
+}
+
+TEST(MbapReceiveBufferTest, ReceivesFromSocket) {
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  std::vector<uint8_t> stream = Frame(5, 1, {0x03, 0x02, 0x00, 0x01});
+  std::vector<uint8_t> second = Frame(6, 1, {0x03, 0x02, 0x00, 0x02});
+  stream.insert(stream.end(), second.begin(), second.end());
+  ASSERT_EQ(write(fds[1], stream.data(), stream.size()), stream.size());
+
+  MbapReceiveBuffer buffer;
+  ASSERT_EQ(buffer.Receive(fds[0]), stream.size());
+  MbapFrame frame;
+  ASSERT_TRUE(buffer.NextFrame(&frame).value());
+  ASSERT_EQ(frame.header.transaction_id, 5);
+  ASSERT_TRUE(buffer.NextFrame(&frame).value());
+  ASSERT_EQ(frame.header.transaction_id, 6);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST(TcpClientTest, SkipsStaleResponseAndReassemblesSplitOne) {
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  TcpClient client("unused", 0, 1000);
+  ASSERT_TRUE(client.Attach(fds[0]).ok());
+
+  std::thread peer([&] {
+    uint8_t request[260];
+    ssize_t received = read(fds[1], request, sizeof(request));
+    ASSERT_GE(received, kMbapHeaderSize);
+    MbapHeader header = DecodeMbapHeader(request);
+    // A late answer to an earlier request, then the real one in pieces.
+    std::vector<uint8_t> stale =
+        Frame(header.transaction_id - 1, header.unit_id, {0x03, 0x02, 0, 9});
+    write(fds[1], stale.data(), stale.size());
+    std::vector<uint8_t> response =
+        Frame(header.transaction_id, header.unit_id, {0x03, 0x02, 0x00, 0x2A});
+    write(fds[1], response.data(), 3);
+    usleep(1000);
+    write(fds[1], response.data() + 3, response.size() - 3);
+  });
+
+  auto response =
+      client.SendReceive(1, FunctionCode::kReadHoldingRegisters, {0, 0, 0, 1});
+  peer.join();
+  ASSERT_TRUE(response.ok());
+  ASSERT_EQ(response.value(), std::vector<uint8_t>({0x03, 0x02, 0x00, 0x2A}));
+  close(fds[1]);
+}
+
+TEST(TcpClientTest, DisconnectsOnCorruptResponse) {
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  TcpClient client("unused", 0, 1000);
+  ASSERT_TRUE(client.Attach(fds[0]).ok());
+
+  std::thread peer([&] {
+    uint8_t request[260];
+    ASSERT_GE(read(fds[1], request, sizeof(request)), kMbapHeaderSize);
+    std::vector<uint8_t> response = Frame(1, 1, {0x03, 0x02, 0x00, 0x2A});
+    response[2] = 0x12; // Protocol ID other than Modbus.
+    write(fds[1], response.data(), response.size());
+  });
+
+  auto response =
+      client.SendReceive(1, FunctionCode::kReadHoldingRegisters, {0, 0, 0, 1});
+  peer.join();
+  ASSERT_EQ(response.status().code(), absl::StatusCode::kInternal);
+  ASSERT_FALSE(client.connected());
+  close(fds[1]);
+}
+
+} // namespace test
+} // namespace modbus
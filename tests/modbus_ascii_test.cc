@@ -0,0 +1,197 @@
+#include "src/modbus_ascii.h"
+#include "gtest/gtest.h"
+#include "src/ascii_serial_client.h"
+#include "src/loopback_client.h"
+#include "src/modbus_functions.h"
+#include "src/modbus_slave.h"
+
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace modbus {
+namespace test {
+
+std::vector<uint8_t> Bytes(const std::string &text) {
+  return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+TEST(ModbusAsciiTest, CalculatesLrc) {
+  // Read Holding Registers request from the specification's example.
+  std::vector<uint8_t> data = {0x11, 0x03, 0x00, 0x6B, 0x00, 0x03};
+  ASSERT_EQ(CalculateLrc(data.data(), data.size()), 0x7E);
+}
+
+TEST(ModbusAsciiTest, BuildsFrame) {
+  ASSERT_EQ(BuildAsciiFrame(0x11, FunctionCode::kReadHoldingRegisters,
+                            {0x00, 0x6B, 0x00, 0x03}),
+            Bytes(":1103006B00037E\r\n"));
+}
+
+TEST(ModbusAsciiTest, HexRoundTripsAtEveryLength) {
+  for (size_t size = 0; size < 80; ++size) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) {
+      data[i] = static_cast<uint8_t>(i * 37 + size);
+    }
+    std::vector<uint8_t> hex(2 * size);
+    EncodeHex(data.data(), size, hex.data());
+    for (size_t i = 0; i < size; ++i) {
+      ASSERT_EQ(hex[2 * i], "0123456789ABCDEF"[data[i] >> 4]);
+      ASSERT_EQ(hex[2 * i + 1], "0123456789ABCDEF"[data[i] & 0x0F]);
+    }
+    std::vector<uint8_t> decoded(size);
+    ASSERT_TRUE(DecodeHex(hex.data(), size, decoded.data()));
+    ASSERT_EQ(decoded, data);
+
+    // Lower case is accepted too; any other character is not, wherever it
+    // is.
+    std::transform(hex.begin(), hex.end(), hex.begin(),
+                   [](uint8_t c) { return std::tolower(c); });
+    ASSERT_TRUE(DecodeHex(hex.data(), size, decoded.data()));
+    ASSERT_EQ(decoded, data);
+    for (size_t i = 0; i < hex.size(); i += 7) {
+      for (int bad : {int{'G'}, int{'g'}, int{':'}, int{'/'}, 0x80, 0xC6}) {
+        std::vector<uint8_t> corrupt = hex;
+        corrupt[i] = static_cast<uint8_t>(bad);
+        ASSERT_FALSE(DecodeHex(corrupt.data(), size, decoded.data()))
+            << "size " << size << " position " << i;
+      }
+    }
+  }
+}
+
+TEST(AsciiFrameParserTest, ParsesFrameFedByteByByte) {
+  std::vector<uint8_t> stream = Bytes("noise");
+  std::vector<uint8_t> frame =
+      BuildAsciiFrame(0x11, FunctionCode::kReadHoldingRegisters,
+                      std::vector<uint8_t>(200, 0xA5));
+  stream.insert(stream.end(), frame.begin(), frame.end());
+
+  AsciiFrameParser parser;
+  for (size_t i = 0; i < stream.size(); ++i) {
+    ASSERT_FALSE(parser.done());
+    ASSERT_EQ(parser.Feed(&stream[i], 1), 1);
+  }
+  ASSERT_TRUE(parser.done());
+  auto decoded = parser.frame();
+  ASSERT_TRUE(decoded.ok()) << decoded.status();
+  ASSERT_EQ(decoded->size(), 202);
+  ASSERT_EQ((*decoded)[0], 0x11);
+  ASSERT_EQ((*decoded)[201], 0xA5);
+}
+
+TEST(AsciiFrameParserTest, StopsAtEndOfFrame) {
+  std::vector<uint8_t> stream = Bytes(":1103006B00037E\r\n:1106");
+  AsciiFrameParser parser;
+  ASSERT_EQ(parser.Feed(stream.data(), stream.size()), 17);
+  ASSERT_TRUE(parser.done());
+  ASSERT_TRUE(parser.frame().ok());
+}
+
+TEST(AsciiFrameParserTest, ColonRestartsFrame) {
+  std::vector<uint8_t> stream = Bytes(":11030:1103006B00037E\r\n");
+  AsciiFrameParser parser;
+  parser.Feed(stream.data(), stream.size());
+  ASSERT_TRUE(parser.done());
+  ASSERT_EQ(parser.frame()->size(), 6);
+}
+
+TEST(AsciiFrameParserTest, RejectsCorruptFrames) {
+  for (const char *text : {":1103006B00037F\r\n", ":1103006X00037E\r\n",
+                           ":1103006B00037\r\n", ":11\r\n",
+                           ":1103006B00037E\rX"}) {
+    std::vector<uint8_t> stream = Bytes(text);
+    AsciiFrameParser parser;
+    parser.Feed(stream.data(), stream.size());
+    ASSERT_TRUE(parser.done()) << text;
+    ASSERT_EQ(parser.frame().status().code(), absl::StatusCode::kDataLoss)
+        << text;
+  }
+}
+
+// Serial line to an ASCII slave, answering from a LoopbackServer and
+// handing out the response a few bytes per read.
+class FakeAsciiLine : public Serial {
+public:
+  explicit FakeAsciiLine(LoopbackServer *slaves) : slaves_(slaves) {}
+
+  absl::Status Open(const SerialParams & /*params*/) override {
+    return absl::OkStatus();
+  }
+  absl::Status Close() override { return absl::OkStatus(); }
+
+  absl::Status Write(const uint8_t *data, size_t length) override {
+    AsciiFrameParser parser;
+    parser.Feed(data, length);
+    auto request = parser.frame();
+    if (!request.ok()) {
+      return request.status();
+    }
+    auto response = slaves_->HandleRequest(
+        (*request)[0], static_cast<FunctionCode>((*request)[1]),
+        std::vector<uint8_t>(request->begin() + 2, request->end()));
+    if (response.ok()) {
+      std::vector<uint8_t> frame = BuildAsciiFrame(
+          (*request)[0], static_cast<FunctionCode>(response->front()),
+          std::vector<uint8_t>(response->begin() + 1, response->end()));
+      line_.insert(line_.end(), frame.begin(), frame.end());
+    }
+    return absl::OkStatus();
+  }
+
+  absl::StatusOr<size_t> Read(uint8_t *buffer, size_t length,
+                              int /*timeout_ms*/) override {
+    ++reads_;
+    size_t size = std::min({length, line_.size(), size_t{7}});
+    std::copy(line_.begin(), line_.begin() + size, buffer);
+    line_.erase(line_.begin(), line_.begin() + size);
+    return size;
+  }
+
+  // Puts bytes on the line ahead of the next response.
+  void Inject(const std::vector<uint8_t> &bytes) {
+    line_.insert(line_.end(), bytes.begin(), bytes.end());
+  }
+
+  int reads() const { return reads_; }
+
+private:
+  LoopbackServer *slaves_;
+  std::deque<uint8_t> line_;
+  int reads_ = 0;
+};
+
+TEST(AsciiSerialClientTest, ReadsAndWrites) {
+  SlaveDevice device({0, 0, 256, 0});
+  for (size_t i = 0; i < device.holding_registers().size(); ++i) {
+    device.holding_registers()[i] = 1000 + i;
+  }
+  LoopbackServer slaves;
+  slaves.AddSlave(1, &device);
+  auto line = std::make_unique<FakeAsciiLine>(&slaves);
+  FakeAsciiLine *fake = line.get();
+  AsciiSerialClient client(std::move(line), 1000);
+
+  // A late response from another slave is skipped.
+  fake->Inject(BuildAsciiFrame(2, FunctionCode::kReadHoldingRegisters,
+                               {2, 0x00, 0x09}));
+  auto registers = ReadHoldingRegisters(&client, 1, 10, 125);
+  ASSERT_TRUE(registers.ok()) << registers.status();
+  ASSERT_EQ(registers.value()[0], 1010);
+  ASSERT_EQ(registers.value()[124], 1134);
+  // Returned as soon as the frame ended: no read waited for a timeout.
+  ASSERT_EQ(fake->reads(), (17 + 2 * 254 + 2 + 6) / 7);
+
+  ASSERT_TRUE(WriteMultipleRegisters(&client, 1, 3, {7, 8, 9}).ok());
+  ASSERT_EQ(ReadHoldingRegisters(&client, 1, 3, 3).value(),
+            std::vector<uint16_t>({7, 8, 9}));
+  ASSERT_EQ(ReadHoldingRegisters(&client, 2, 0, 1).status().code(),
+            absl::StatusCode::kDeadlineExceeded);
+}
+
+} // namespace test
+} // namespace modbus
@@ -78,5 +78,35 @@ TEST(ModbusClientTest, WriteMultipleRegistersAdu) {
   ASSERT_EQ(expected_adu, calculated_adu);
 }
 
+TEST(PreparedRequestTest, EncodesEveryWireFormat) {
+  PreparedRequest request(0x11, FunctionCode::kReadHoldingRegisters,
+                          {0x00, 0x6B, 0x00, 0x03});
+  ASSERT_EQ(request.slave_id(), 0x11);
+  ASSERT_EQ(request.function_code(), FunctionCode::kReadHoldingRegisters);
+  ASSERT_EQ(request.rtu_frame(),
+            std::vector<uint8_t>(
+                {0x11, 0x03, 0x00, 0x6B, 0x00, 0x03, 0x76, 0x87}));
+  ASSERT_EQ(request.mbap_frame(),
+            std::vector<uint8_t>({0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x11,
+                                  0x03, 0x00, 0x6B, 0x00, 0x03}));
+  ASSERT_EQ(request.response_size(), 8);
+}
+
+TEST(PreparedRequestTest, ChecksResponses) {
+  PreparedRequest read(0x11, FunctionCode::kReadCoils,
+                       {0x00, 0x13, 0x00, 0x13});
+  ASSERT_EQ(read.response_size(), 5);
+  ASSERT_TRUE(read.CheckResponse({0x01, 0x03, 0xCD, 0x6B, 0x05}).ok());
+  ASSERT_FALSE(read.CheckResponse({0x01, 0x02, 0xCD, 0x6B, 0x05}).ok());
+  ASSERT_FALSE(read.CheckResponse({0x01, 0x03, 0xCD, 0x6B}).ok());
+  ASSERT_FALSE(read.CheckResponse({0x02, 0x03, 0xCD, 0x6B, 0x05}).ok());
+  ASSERT_FALSE(read.CheckResponse({0x81, 0x02}).ok());
+  ASSERT_FALSE(read.CheckResponse({}).ok());
+
+  PreparedRequest write(0x11, FunctionCode::kWriteSingleRegister,
+                        {0x00, 0x01, 0x00, 0x03});
+  ASSERT_TRUE(write.CheckResponse({0x06, 0x00, 0x01, 0x00, 0x03}).ok());
+}
+
 } // namespace test
 } // namespace modbus
@@ -21,17 +21,42 @@ TEST(ModbusFunctionsTest, ReadCoils_Success) {
               SendReceive(0x11, FunctionCode::kReadCoils,
                           (std::vector<uint8_t>{0x00, 0x13, 0x00, 0x25})))
       .WillOnce(testing::Return(
-          std::vector<uint8_t>{0x05, 0xCD, 0x6B, 0xB2, 0x0E, 0x1B}));
+          std::vector<uint8_t>{0x01, 0x05, 0xCD, 0x6B, 0xB2, 0x0E, 0x1B}));
 
   auto result = ReadCoils(mock_client.get(), 0x11, 0x0013, 0x0025);
-  std::cout << "SommerkDbg: " << result.status() << std::endl;
-  ASSERT_TRUE(result.ok());
+  ASSERT_TRUE(result.ok()) << result.status();
   ASSERT_THAT(result.value(),
               testing::ElementsAre(
-                  true, true, false, false, true, true, false, true, false,
-                  true, true, false, true, false, true, true, true, false, true,
-                  true, false, false, true, false, false, false, false, false,
-                  true, true, true, false, true, true, false, true, true));
+                  true, false, true, true, false, false, true, true, true, true,
+                  false, true, false, true, true, false, false, true, false,
+                  false, true, true, false, true, false, true, true, true,
+                  false, false, false, false, true, true, false, true, true));
+}
+
+// --- Test prepared reads ---
+TEST(ModbusFunctionsTest, PreparedReads_RejectMalformedMessages) {
+  auto mock_client = std::make_unique<MockClient>(1000);
+  PreparedRequest short_request(0x11, FunctionCode::kReadHoldingRegisters,
+                                {0x00, 0x13});
+  ASSERT_EQ(ReadRegisters(mock_client.get(), short_request).status().code(),
+            absl::StatusCode::kInvalidArgument);
+  PreparedRequest long_request(0x11, FunctionCode::kReadCoils,
+                               {0x00, 0x13, 0x00, 0x25, 0x00});
+  ASSERT_EQ(ReadBits(mock_client.get(), long_request).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  auto request = PrepareRead(0x11, FunctionCode::kReadHoldingRegisters, 0, 2);
+  ASSERT_TRUE(request.ok());
+  EXPECT_CALL(*mock_client,
+              SendReceive(0x11, FunctionCode::kReadHoldingRegisters,
+                          testing::_))
+      .WillOnce(testing::Return(std::vector<uint8_t>{0x03}))
+      .WillOnce(
+          testing::Return(std::vector<uint8_t>{0x03, 0x02, 0x00, 0x01}));
+  ASSERT_EQ(ReadRegisters(mock_client.get(), *request).status().code(),
+            absl::StatusCode::kInternal);
+  ASSERT_EQ(ReadRegisters(mock_client.get(), *request).status().code(),
+            absl::StatusCode::kInternal);
 }
 
 // TEST(ModbusFunctionsTest, ReadCoils_Error) {
@@ -0,0 +1,81 @@
+#include "src/modbus_slave.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/modbus_functions.h"
+
+namespace modbus {
+namespace test {
+
+// Client that hands requests straight to a SlaveDevice.
+class DirectClient : public Client {
+public:
+  explicit DirectClient(SlaveDevice *device) : Client(0), device_(device) {}
+
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t /*slave_id*/, FunctionCode function_code,
+              const std::vector<uint8_t> &request_data) override {
+    return device_->HandleRequest(function_code, request_data);
+  }
+
+private:
+  SlaveDevice *device_;
+};
+
+TEST(SlaveDeviceTest, ReadHoldingRegisters) {
+  SlaveDevice device({0, 0, 10, 0});
+  device.holding_registers()[2] = 0x1234;
+  device.holding_registers()[3] = 0xABCD;
+  std::vector<uint8_t> response = device.HandleRequest(
+      FunctionCode::kReadHoldingRegisters, {0x00, 0x02, 0x00, 0x02});
+  ASSERT_THAT(response, testing::ElementsAre(0x03, 0x04, 0x12, 0x34, 0xAB,
+                                             0xCD));
+}
+
+TEST(SlaveDeviceTest, ReadCoilsPacksLsbFirst) {
+  SlaveDevice device({16, 0, 0, 0});
+  device.coils()[0] = true;
+  device.coils()[2] = true;
+  device.coils()[9] = true;
+  std::vector<uint8_t> response = device.HandleRequest(
+      FunctionCode::kReadCoils, {0x00, 0x00, 0x00, 0x0A});
+  ASSERT_THAT(response, testing::ElementsAre(0x01, 0x02, 0x05, 0x02));
+}
+
+TEST(SlaveDeviceTest, OutOfRangeAddressIsException) {
+  SlaveDevice device({0, 0, 10, 0});
+  std::vector<uint8_t> response = device.HandleRequest(
+      FunctionCode::kReadHoldingRegisters, {0x00, 0x08, 0x00, 0x03});
+  ASSERT_THAT(response, testing::ElementsAre(0x83, 0x02));
+}
+
+TEST(SlaveDeviceTest, InvalidQuantityIsException) {
+  SlaveDevice device({0, 0, 200, 0});
+  std::vector<uint8_t> response = device.HandleRequest(
+      FunctionCode::kReadHoldingRegisters, {0x00, 0x00, 0x00, 0x7E});
+  ASSERT_THAT(response, testing::ElementsAre(0x83, 0x03));
+}
+
+TEST(SlaveDeviceTest, FunctionsRoundTrip) {
+  SlaveDevice device({32, 0, 32, 0});
+  DirectClient client(&device);
+
+  ASSERT_TRUE(WriteSingleRegister(&client, 1, 4, 0xBEEF).ok());
+  ASSERT_TRUE(WriteMultipleRegisters(&client, 1, 5, {1, 2, 3}).ok());
+  auto registers = ReadHoldingRegisters(&client, 1, 4, 4);
+  ASSERT_TRUE(registers.ok());
+  ASSERT_THAT(registers.value(), testing::ElementsAre(0xBEEF, 1, 2, 3));
+
+  ASSERT_TRUE(WriteSingleCoil(&client, 1, 3, true).ok());
+  ASSERT_TRUE(WriteMultipleCoils(&client, 1, 10, {true, false, true}).ok());
+  auto coils = ReadCoils(&client, 1, 3, 10);
+  ASSERT_TRUE(coils.ok());
+  ASSERT_THAT(coils.value(),
+              testing::ElementsAre(true, false, false, false, false, false,
+                                   false, true, false, true));
+
+  auto status = ReadHoldingRegisters(&client, 1, 30, 5);
+  ASSERT_FALSE(status.ok());
+}
+
+} // namespace test
+} // namespace modbus
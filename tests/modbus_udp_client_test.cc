@@ -0,0 +1,101 @@
+#include "src/modbus_udp_client.h"
+#include "gtest/gtest.h"
+#include "src/loopback_client.h"
+#include "src/modbus_functions.h"
+#include "src/modbus_slave.h"
+#include "src/modbus_udp_server.h"
+
+#include <memory>
+#include <vector>
+
+namespace modbus {
+namespace test {
+
+class UdpTest : public testing::Test {
+protected:
+  UdpTest() : device_({0, 0, 256, 0}) {
+    for (size_t i = 0; i < device_.holding_registers().size(); ++i) {
+      device_.holding_registers()[i] = 1000 + i;
+    }
+    slaves_.AddSlave(1, &device_);
+  }
+
+  void SetUp() override {
+    for (int i = 0; i < 4; ++i) {
+      servers_.push_back(std::make_unique<UdpServer>(&slaves_));
+      auto port = servers_.back()->Start();
+      ASSERT_TRUE(port.ok());
+      ports_.push_back(port.value());
+    }
+  }
+
+  static UdpBatchRequest Read(size_t device, uint8_t slave_id,
+                              uint16_t address, uint16_t quantity) {
+    return {device,
+            slave_id,
+            FunctionCode::kReadHoldingRegisters,
+            {static_cast<uint8_t>(address >> 8),
+             static_cast<uint8_t>(address & 0xFF),
+             static_cast<uint8_t>(quantity >> 8),
+             static_cast<uint8_t>(quantity & 0xFF)}};
+  }
+
+  SlaveDevice device_;
+  LoopbackServer slaves_;
+  std::vector<std::unique_ptr<UdpServer>> servers_;
+  std::vector<int> ports_;
+};
+
+TEST_F(UdpTest, ClientReadsAndWrites) {
+  UdpClient client("127.0.0.1", ports_[0], 1000);
+  ASSERT_TRUE(client.Connect().ok());
+  auto registers = ReadHoldingRegisters(&client, 1, 10, 125);
+  ASSERT_TRUE(registers.ok()) << registers.status();
+  ASSERT_EQ(registers.value()[0], 1010);
+  ASSERT_EQ(registers.value()[124], 1134);
+  ASSERT_TRUE(WriteSingleRegister(&client, 1, 5, 42).ok());
+  ASSERT_EQ(device_.holding_registers()[5], 42);
+}
+
+TEST_F(UdpTest, ClientSilentSlaveTimesOut) {
+  UdpClient client("127.0.0.1", ports_[0], 50);
+  ASSERT_TRUE(client.Connect().ok());
+  ASSERT_EQ(ReadHoldingRegisters(&client, 2, 0, 1).status().code(),
+            absl::StatusCode::kDeadlineExceeded);
+  ASSERT_EQ(ReadHoldingRegisters(&client, 1, 0, 1).value()[0], 1000);
+}
+
+TEST_F(UdpTest, BatchPollsManyDevices) {
+  UdpBatchTransport transport;
+  for (int port : ports_) {
+    ASSERT_TRUE(transport.AddDevice("127.0.0.1", port).ok());
+  }
+  for (int batch = 0; batch < 10; ++batch) {
+    std::vector<UdpBatchRequest> requests;
+    for (uint16_t i = 0; i < 400; ++i) {
+      requests.push_back(Read(i % 4, 1, (batch + i) % 128, 1 + i % 8));
+    }
+    auto results = transport.Transact(requests, 2000);
+    ASSERT_EQ(results.size(), requests.size());
+    for (uint16_t i = 0; i < 400; ++i) {
+      ASSERT_TRUE(results[i].ok()) << results[i].status();
+      ASSERT_EQ(results[i].value().size(), 2 + 2 * (1 + i % 8));
+      const std::vector<uint8_t> &pdu = results[i].value();
+      ASSERT_EQ((pdu[2] << 8) | pdu[3], 1000 + (batch + i) % 128);
+    }
+  }
+}
+
+TEST_F(UdpTest, BatchReportsEachFailure) {
+  UdpBatchTransport transport;
+  ASSERT_TRUE(transport.AddDevice("127.0.0.1", ports_[0]).ok());
+  auto results = transport.Transact(
+      {Read(0, 2, 0, 1), Read(0, 1, 7, 1), Read(5, 1, 0, 1)}, 100);
+  ASSERT_EQ(results[0].status().code(), absl::StatusCode::kDeadlineExceeded);
+  ASSERT_TRUE(results[1].ok());
+  ASSERT_EQ(results[1].value()[3], 1007 & 0xFF);
+  ASSERT_EQ(results[2].status().code(), absl::StatusCode::kInvalidArgument);
+}
+
+} // namespace test
+} // namespace modbus
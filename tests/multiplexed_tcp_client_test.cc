@@ -0,0 +1,118 @@
+#include "src/multiplexed_tcp_client.h"
+#include "gtest/gtest.h"
+#include "src/loopback_client.h"
+#include "src/modbus_functions.h"
+#include "src/modbus_slave.h"
+#include "src/modbus_tcp_server.h"
+
+#include <thread>
+#include <vector>
+
+namespace modbus {
+namespace test {
+
+class MultiplexedTcpClientTest : public testing::Test {
+protected:
+  MultiplexedTcpClientTest() : device_({0, 0, 256, 0}), server_(&slaves_) {
+    for (size_t i = 0; i < device_.holding_registers().size(); ++i) {
+      device_.holding_registers()[i] = 1000 + i;
+    }
+    slaves_.AddSlave(1, &device_);
+  }
+
+  void SetUp() override {
+    auto port = server_.Start();
+    ASSERT_TRUE(port.ok());
+    port_ = port.value();
+  }
+
+  SlaveDevice device_;
+  LoopbackServer slaves_;
+  TcpServer server_;
+  int port_ = 0;
+};
+
+TEST_F(MultiplexedTcpClientTest, NotConnected) {
+  MultiplexedTcpClient client("127.0.0.1", port_, 1000);
+  ASSERT_EQ(ReadHoldingRegisters(&client, 1, 0, 1).status().code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+TEST_F(MultiplexedTcpClientTest, ConcurrentCallersGetTheirOwnResponses) {
+  MultiplexedTcpClient client("127.0.0.1", port_, 5000, 8);
+  ASSERT_TRUE(client.Connect().ok());
+
+  constexpr int kThreads = 16;
+  constexpr int kRequestsPerThread = 200;
+  std::vector<int> mismatches(kThreads, 0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < kRequestsPerThread; ++i) {
+        uint16_t address = (t * kRequestsPerThread + i) % 250;
+        uint16_t quantity = 1 + t % 4;
+        auto registers = ReadHoldingRegisters(&client, 1, address, quantity);
+        if (!registers.ok() || registers.value().size() != quantity ||
+            registers.value()[0] != 1000 + address) {
+          ++mismatches[t];
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  for (int t = 0; t < kThreads; ++t) {
+    EXPECT_EQ(mismatches[t], 0) << "thread " << t;
+  }
+  ASSERT_EQ(server_.connections_accepted(), 1);
+}
+
+TEST_F(MultiplexedTcpClientTest, SilentSlaveTimesOutWithoutBlockingOthers) {
+  MultiplexedTcpClient client("127.0.0.1", port_, 200);
+  ASSERT_TRUE(client.Connect().ok());
+
+  std::thread silent([&] {
+    ASSERT_EQ(ReadHoldingRegisters(&client, 2, 0, 1).status().code(),
+              absl::StatusCode::kDeadlineExceeded);
+  });
+  for (int i = 0; i < 10; ++i) {
+    auto registers = ReadHoldingRegisters(&client, 1, 5, 1);
+    ASSERT_TRUE(registers.ok());
+    ASSERT_EQ(registers.value()[0], 1005);
+  }
+  silent.join();
+}
+
+TEST_F(MultiplexedTcpClientTest, ConnectionLossFailsRequests) {
+  MultiplexedTcpClient client("127.0.0.1", port_, 1000);
+  ASSERT_TRUE(client.Connect().ok());
+  ASSERT_TRUE(ReadHoldingRegisters(&client, 1, 0, 1).ok());
+
+  server_.Stop();
+  ASSERT_EQ(ReadHoldingRegisters(&client, 1, 0, 1).status().code(),
+            absl::StatusCode::kUnavailable);
+
+  ASSERT_TRUE(client.Disconnect().ok());
+  ASSERT_EQ(ReadHoldingRegisters(&client, 1, 0, 1).status().code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
+TEST_F(MultiplexedTcpClientTest, ReconnectsAfterConnectionLoss) {
+  MultiplexedTcpClient client("127.0.0.1", port_, 1000);
+  ASSERT_TRUE(client.Connect().ok());
+  ASSERT_EQ(client.Connect().code(), absl::StatusCode::kFailedPrecondition);
+
+  server_.Stop();
+  ASSERT_EQ(ReadHoldingRegisters(&client, 1, 0, 1).status().code(),
+            absl::StatusCode::kUnavailable);
+
+  // The server comes back; connecting again needs no Disconnect first.
+  TcpServer restarted(&slaves_);
+  ASSERT_TRUE(restarted.Start(port_).ok());
+  ASSERT_TRUE(client.Connect().ok());
+  ASSERT_TRUE(ReadHoldingRegisters(&client, 1, 0, 1).ok());
+}
+
+} // namespace test
+} // namespace modbus
@@ -0,0 +1,102 @@
+#include "src/network_scanner.h"
+#include "gtest/gtest.h"
+#include "src/loopback_client.h"
+#include "src/modbus_slave.h"
+#include "src/modbus_tcp_server.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace modbus {
+namespace test {
+
+// Returns a local port nothing listens on.
+int UnusedPort() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address));
+  socklen_t length = sizeof(address);
+  getsockname(fd, reinterpret_cast<struct sockaddr *>(&address), &length);
+  close(fd);
+  return ntohs(address.sin_port);
+}
+
+TEST(ExpandSubnetTest, ListsHostAddresses) {
+  auto targets = ExpandSubnet("10.1.2.77/30", 1502);
+  ASSERT_TRUE(targets.ok());
+  ASSERT_EQ(targets->size(), 2);
+  EXPECT_EQ((*targets)[0].host, "10.1.2.77");
+  EXPECT_EQ((*targets)[1].host, "10.1.2.78");
+  EXPECT_EQ((*targets)[1].port, 1502);
+  EXPECT_EQ(ExpandSubnet("192.168.1.0/24")->size(), 254);
+  EXPECT_EQ(ExpandSubnet("192.168.1.9")->front().host, "192.168.1.9");
+  EXPECT_EQ(ExpandSubnet("192.168.1.8/31")->size(), 2);
+  EXPECT_FALSE(ExpandSubnet("192.168.1.0/33").ok());
+  EXPECT_FALSE(ExpandSubnet("10.0.0.0/8").ok());
+  EXPECT_FALSE(ExpandSubnet("10.0.0/24").ok());
+}
+
+// Scans a simulated site: a gateway with two devices behind it, a single
+// device with coils only, and an address where nothing listens.
+TEST(NetworkScannerTest, FindsDevicesAndRespondingRegisters) {
+  SlaveDevice meter({0, 0, 32, 0});
+  SlaveDevice drive({0, 0, 8, 0});
+  SlaveDevice relay({16, 0, 0, 0});
+  LoopbackServer gateway_slaves;
+  gateway_slaves.AddSlave(3, &meter);
+  gateway_slaves.AddSlave(17, &drive);
+  LoopbackServer relay_slaves;
+  relay_slaves.AddSlave(1, &relay);
+  TcpServer gateway(&gateway_slaves);
+  TcpServer relay_server(&relay_slaves);
+  auto gateway_port = gateway.Start();
+  auto relay_port = relay_server.Start();
+  ASSERT_TRUE(gateway_port.ok());
+  ASSERT_TRUE(relay_port.ok());
+
+  std::vector<ScanTarget> targets = {{"127.0.0.1", *gateway_port},
+                                     {"127.0.0.1", UnusedPort()},
+                                     {"127.0.0.1", *relay_port}};
+  ScanParams params;
+  for (int unit_id = 1; unit_id <= 20; ++unit_id) {
+    params.unit_ids.push_back(unit_id);
+  }
+  params.reads = {{FunctionCode::kReadHoldingRegisters, 10, 2},
+                  {FunctionCode::kReadCoils, 0, 1}};
+  params.max_in_flight = 8;
+  params.response_timeout_ms = 100;
+  auto results = ScanNetwork(targets, params);
+  ASSERT_TRUE(results.ok()) << results.status();
+  ASSERT_EQ(results->size(), 3);
+
+  const TargetScanResult &site = (*results)[0];
+  EXPECT_TRUE(site.status.ok()) << site.status;
+  ASSERT_EQ(site.units.size(), 2);
+  EXPECT_EQ(site.units[0].unit_id, 3);
+  ASSERT_EQ(site.units[0].responses.size(), 2);
+  // The meter has the holding registers but no coils.
+  ASSERT_TRUE(site.units[0].responses[0].ok());
+  EXPECT_EQ((*site.units[0].responses[0])[0], 0x03);
+  EXPECT_EQ((*site.units[0].responses[1])[0], 0x81);
+  // The drive has too few holding registers for the read.
+  EXPECT_EQ(site.units[1].unit_id, 17);
+  EXPECT_EQ((*site.units[1].responses[0])[0], 0x83);
+
+  EXPECT_FALSE((*results)[1].status.ok());
+  EXPECT_TRUE((*results)[1].units.empty());
+
+  const TargetScanResult &relay_result = (*results)[2];
+  ASSERT_EQ(relay_result.units.size(), 1);
+  EXPECT_EQ(relay_result.units[0].unit_id, 1);
+  EXPECT_EQ((*relay_result.units[0].responses[1])[0], 0x01);
+  EXPECT_EQ(gateway.connections_accepted(), 1);
+}
+
+} // namespace test
+} // namespace modbus
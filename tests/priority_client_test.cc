@@ -0,0 +1,165 @@
+#include "src/priority_client.h"
+#include "gtest/gtest.h"
+#include "src/clock.h"
+#include "src/loopback_client.h"
+#include "src/modbus_functions.h"
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+
+namespace modbus {
+namespace test {
+
+// Client that holds requests until opened and records the order in which
+// requests reached it, by the register address they start at.
+class GateClient : public Client {
+public:
+  explicit GateClient(Client *client) : Client(0), client_(client) {}
+
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t slave_id, FunctionCode function_code,
+              const std::vector<uint8_t> &request_data) override {
+    {
+      absl::MutexLock lock(&mu_);
+      addresses_.push_back(request_data[0] << 8 | request_data[1]);
+      mu_.Await(absl::Condition(&open_));
+    }
+    return client_->SendReceive(slave_id, function_code, request_data);
+  }
+
+  void Open() {
+    absl::MutexLock lock(&mu_);
+    open_ = true;
+  }
+
+  std::vector<int> addresses() {
+    absl::MutexLock lock(&mu_);
+    return addresses_;
+  }
+
+private:
+  Client *client_;
+  absl::Mutex mu_;
+  bool open_ ABSL_GUARDED_BY(mu_) = false;
+  std::vector<int> addresses_ ABSL_GUARDED_BY(mu_);
+};
+
+class PriorityClientTest : public testing::Test {
+protected:
+  PriorityClientTest()
+      : device_({16, 0, 64, 0}), loopback_(&server_, 1000),
+        gate_(&loopback_), client_(&gate_, PriorityParams()) {
+    server_.AddSlave(1, &device_);
+  }
+
+  SlaveDevice device_;
+  LoopbackServer server_;
+  LoopbackClient loopback_;
+  GateClient gate_;
+  PriorityClient client_;
+};
+
+TEST_F(PriorityClientTest, ServesControlFirstAndWeighsTheRest) {
+  // Occupies the transport with a background read.
+  std::vector<std::thread> threads;
+  auto read = [&](RequestClass request_class, uint16_t address) {
+    threads.emplace_back([this, request_class, address] {
+      auto request =
+          PrepareRead(1, FunctionCode::kReadHoldingRegisters, address, 1);
+      ASSERT_TRUE(request.ok());
+      EXPECT_TRUE(client_.SendPrepared(request_class, *request).ok());
+    });
+  };
+  read(RequestClass::kBackground, 0);
+  while (gate_.addresses().empty()) {
+    std::this_thread::yield();
+  }
+
+  // Queues background reads at addresses 10 to 15 and interactive ones at
+  // 20 to 22, then an alarm poll and a control write.
+  for (uint16_t i = 0; i < 6; ++i) {
+    read(RequestClass::kBackground, 10 + i);
+    while (client_.queued() != i + 1u) {
+      std::this_thread::yield();
+    }
+  }
+  for (uint16_t i = 0; i < 3; ++i) {
+    read(RequestClass::kInteractive, 20 + i);
+    while (client_.queued() != 7u + i) {
+      std::this_thread::yield();
+    }
+  }
+  read(RequestClass::kAlarm, 30);
+  threads.emplace_back(
+      [this] { EXPECT_TRUE(WriteSingleCoil(&client_, 1, 4, true).ok()); });
+  while (client_.queued() != 11) {
+    std::this_thread::yield();
+  }
+
+  gate_.Open();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(gate_.addresses(),
+            std::vector<int>({0, 4, 30, 20, 21, 10, 22, 11, 12, 13, 14, 15}));
+  EXPECT_EQ(client_.queued(), 0);
+  EXPECT_EQ(client_.stats(RequestClass::kBackground).latency.count(), 7);
+  EXPECT_EQ(client_.stats(RequestClass::kControl).latency.count(), 1);
+}
+
+TEST(PriorityClientSloTest, CountsMissesPerClass) {
+  SimulatedClock clock;
+  SlaveDevice device({0, 0, 16, 0});
+  LoopbackServer server;
+  server.AddSlave(1, &device);
+  LoopbackClient loopback(&server, 1000);
+  loopback.SetClock(&clock);
+  PriorityClient client(&loopback, PriorityParams());
+  client.SetClock(&clock);
+
+  // Requests to the absent slave 2 take the 1 s timeout.
+  EXPECT_FALSE(WriteSingleRegister(&client, 2, 0, 1).ok());
+  EXPECT_FALSE(ReadHoldingRegisters(&client, 2, 0, 1).ok());
+  auto request = PrepareRead(2, FunctionCode::kReadHoldingRegisters, 0, 1);
+  ASSERT_TRUE(request.ok());
+  EXPECT_FALSE(client.SendPrepared(RequestClass::kBackground, *request).ok());
+  EXPECT_TRUE(ReadHoldingRegisters(&client, 1, 0, 1).ok());
+
+  RequestClassStats control = client.stats(RequestClass::kControl);
+  EXPECT_EQ(control.latency.count(), 1);
+  EXPECT_EQ(control.slo_misses, 1);
+  EXPECT_EQ(control.queue_wait.max(), 0);
+  RequestClassStats interactive = client.stats(RequestClass::kInteractive);
+  EXPECT_EQ(interactive.latency.count(), 2);
+  EXPECT_EQ(interactive.slo_misses, 1);
+  RequestClassStats background = client.stats(RequestClass::kBackground);
+  EXPECT_EQ(background.latency.count(), 1);
+  EXPECT_EQ(background.slo_misses, 0);
+}
+
+TEST_F(PriorityClientTest, ForwardsTimeoutsToWrappedClient) {
+  SimulatedClock clock;
+  LoopbackClient loopback(&server_, 1000);
+  PriorityClient client(&loopback, PriorityParams());
+  client.SetClock(&clock);
+  client.SetTimeout(200);
+  AdaptiveTimeoutParams params;
+  params.min_timeout_ms = 50;
+  client.EnableAdaptiveTimeouts(params);
+  EXPECT_EQ(client.TimeoutFor(2), 200);
+
+  // The wrapped client waits out its timeout on the decorator's clock.
+  absl::Time start = clock.Now();
+  EXPECT_EQ(ReadHoldingRegisters(&client, 2, 0, 1).status().code(),
+            absl::StatusCode::kDeadlineExceeded);
+  EXPECT_EQ(clock.Now() - start, absl::Milliseconds(200));
+  ASSERT_TRUE(ReadHoldingRegisters(&client, 1, 0, 1).ok());
+  EXPECT_EQ(loopback.TimeoutFor(1), 50);
+  EXPECT_EQ(client.TimeoutFor(1), 50);
+}
+
+} // namespace test
+} // namespace modbus
@@ -0,0 +1,171 @@
+#include "src/rate_limited_client.h"
+#include "gtest/gtest.h"
+#include "src/clock.h"
+#include "src/loopback_client.h"
+#include "src/modbus_functions.h"
+#include "src/modbus_slave.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace modbus {
+namespace test {
+
+class RateLimitedClientTest : public testing::Test {
+protected:
+  RateLimitedClientTest()
+      : device_({0, 0, 16, 0}), loopback_(&server_, 1000) {
+    server_.AddSlave(1, &device_);
+    server_.AddSlave(2, &device_);
+    loopback_.SetClock(&clock_);
+  }
+
+  // Returns the time 'count' reads of 'slave_id' take.
+  absl::Duration Poll(Client *client, uint8_t slave_id, int count) {
+    absl::Time start = clock_.Now();
+    for (int i = 0; i < count; ++i) {
+      EXPECT_TRUE(ReadHoldingRegisters(client, slave_id, 0, 1).ok());
+    }
+    return clock_.Now() - start;
+  }
+
+  SimulatedClock clock_;
+  SlaveDevice device_;
+  LoopbackServer server_;
+  LoopbackClient loopback_;
+};
+
+TEST_F(RateLimitedClientTest, PacesEachSlave) {
+  RateLimitedClient client(&loopback_, {10, 2, 1});
+  client.SetClock(&clock_);
+  client.SetLimit(2, {0, 1, 1});
+
+  // The burst goes out at once, then one read every 100 ms.
+  EXPECT_EQ(Poll(&client, 1, 2), absl::ZeroDuration());
+  EXPECT_EQ(Poll(&client, 1, 10), absl::Seconds(1));
+  EXPECT_EQ(Poll(&client, 2, 10), absl::ZeroDuration());
+  // Idle time refills the bucket up to the burst only.
+  clock_.AdvanceTime(absl::Seconds(10));
+  EXPECT_EQ(Poll(&client, 1, 3), absl::Milliseconds(100));
+}
+
+// Client that counts the requests it serves at once.
+class ConcurrencyClient : public Client {
+public:
+  ConcurrencyClient() : Client(0) {}
+
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t /*slave_id*/, FunctionCode function_code,
+              const std::vector<uint8_t> & /*request_data*/) override {
+    {
+      absl::MutexLock lock(&mu_);
+      max_concurrent_ = std::max(max_concurrent_, ++concurrent_);
+    }
+    absl::SleepFor(absl::Milliseconds(2));
+    absl::MutexLock lock(&mu_);
+    --concurrent_;
+    return std::vector<uint8_t>{static_cast<uint8_t>(function_code), 2, 0, 0};
+  }
+
+  int max_concurrent() {
+    absl::MutexLock lock(&mu_);
+    return max_concurrent_;
+  }
+
+private:
+  absl::Mutex mu_;
+  int concurrent_ ABSL_GUARDED_BY(mu_) = 0;
+  int max_concurrent_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+TEST(RateLimitedClientConcurrencyTest, CapsRequestsInFlight) {
+  ConcurrencyClient inner;
+  RateLimitedClient client(&inner, {0, 1, 2});
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.emplace_back([&client] {
+      for (int j = 0; j < 5; ++j) {
+        EXPECT_TRUE(ReadHoldingRegisters(&client, 1, 0, 1).ok());
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(inner.max_concurrent(), 2);
+}
+
+// Client for a device that answers busy when polled more often than every
+// 20 ms.
+class SlowDeviceClient : public Client {
+public:
+  explicit SlowDeviceClient(Client *client) : Client(0), client_(client) {}
+
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t slave_id, FunctionCode function_code,
+              const std::vector<uint8_t> &request_data) override {
+    absl::Time now = clock_->Now();
+    bool busy = now - last_ < absl::Milliseconds(20);
+    last_ = now;
+    if (busy) {
+      return BuildExceptionResponse(function_code,
+                                    ExceptionCode::kServerDeviceBusy);
+    }
+    return client_->SendReceive(slave_id, function_code, request_data);
+  }
+
+private:
+  Client *client_;
+  absl::Time last_ = absl::InfinitePast();
+};
+
+TEST_F(RateLimitedClientTest, AutoTunesToDeviceLimit) {
+  SlowDeviceClient device(&loopback_);
+  device.SetClock(&clock_);
+  AutoTuneParams auto_tune;
+  auto_tune.enabled = true;
+  auto_tune.increase = 10;
+  RateLimitedClient client(&device, {5, 1, 1}, auto_tune);
+  client.SetClock(&clock_);
+
+  // Climbs from 5/s and then oscillates below the 50/s the device handles.
+  int busy = 0;
+  for (int i = 0; i < 2000; ++i) {
+    busy += !ReadHoldingRegisters(&client, 1, 0, 1).ok();
+    if (i >= 500) {
+      ASSERT_GT(client.GetRate(1), 20);
+      ASSERT_LT(client.GetRate(1), 60);
+    }
+  }
+  EXPECT_LT(busy, 100);
+  EXPECT_EQ(client.GetRate(2), 5);
+}
+
+TEST_F(RateLimitedClientTest, ForwardsTimeoutsToWrappedClient) {
+  LoopbackClient loopback(&server_, 1000);
+  RateLimitedClient client(&loopback, {0, 1, 1});
+  client.SetClock(&clock_);
+  client.SetTimeout(200);
+  AdaptiveTimeoutParams params;
+  params.min_timeout_ms = 50;
+  client.EnableAdaptiveTimeouts(params);
+  EXPECT_EQ(client.TimeoutFor(3), 200);
+
+  // The wrapped client waits out its timeout on the decorator's clock.
+  absl::Time start = clock_.Now();
+  EXPECT_EQ(ReadHoldingRegisters(&client, 3, 0, 1).status().code(),
+            absl::StatusCode::kDeadlineExceeded);
+  EXPECT_EQ(clock_.Now() - start, absl::Milliseconds(200));
+  ASSERT_TRUE(ReadHoldingRegisters(&client, 1, 0, 1).ok());
+  EXPECT_EQ(loopback.TimeoutFor(1), 50);
+  EXPECT_EQ(client.TimeoutFor(1), 50);
+}
+
+} // namespace test
+} // namespace modbus
@@ -0,0 +1,82 @@
+#include "src/rtt_estimator.h"
+#include "gtest/gtest.h"
+#include "src/clock.h"
+#include "src/loopback_client.h"
+#include "src/modbus_functions.h"
+
+namespace modbus {
+namespace test {
+
+TEST(RttEstimatorTest, StartsAtInitialTimeout) {
+  RttEstimator estimator({10, 5000}, absl::Milliseconds(1000));
+  ASSERT_EQ(estimator.Timeout(), absl::Milliseconds(1000));
+}
+
+TEST(RttEstimatorTest, FollowsSmoothedRttAndVariance) {
+  RttEstimator estimator({1, 5000}, absl::Milliseconds(1000));
+  estimator.AddSample(absl::Milliseconds(40));
+  // SRTT = 40, RTTVAR = 20.
+  ASSERT_EQ(estimator.Timeout(), absl::Milliseconds(120));
+  estimator.AddSample(absl::Milliseconds(80));
+  // RTTVAR = 3/4 * 20 + 1/4 * 40 = 25, SRTT = 7/8 * 40 + 1/8 * 80 = 45.
+  ASSERT_EQ(estimator.smoothed_rtt(), absl::Milliseconds(45));
+  ASSERT_EQ(estimator.rtt_variance(), absl::Milliseconds(25));
+  ASSERT_EQ(estimator.Timeout(), absl::Milliseconds(145));
+}
+
+TEST(RttEstimatorTest, ClampsToBounds) {
+  RttEstimator estimator({50, 400}, absl::Milliseconds(1000));
+  ASSERT_EQ(estimator.Timeout(), absl::Milliseconds(400));
+  estimator.AddSample(absl::Milliseconds(1));
+  ASSERT_EQ(estimator.Timeout(), absl::Milliseconds(50));
+}
+
+TEST(RttEstimatorTest, TimeoutsBackOffUpToInitialTimeout) {
+  RttEstimator estimator({10, 5000}, absl::Milliseconds(1000));
+  estimator.AddSample(absl::Milliseconds(40));
+  estimator.OnTimeout();
+  ASSERT_EQ(estimator.Timeout(), absl::Milliseconds(240));
+  estimator.OnTimeout();
+  estimator.OnTimeout();
+  estimator.OnTimeout();
+  ASSERT_EQ(estimator.Timeout(), absl::Milliseconds(1000));
+
+  // A learned timeout above the initial timeout is not lowered.
+  RttEstimator slow({10, 5000}, absl::Milliseconds(100));
+  slow.AddSample(absl::Milliseconds(400));
+  slow.OnTimeout();
+  ASSERT_EQ(slow.Timeout(), absl::Milliseconds(1200));
+}
+
+TEST(AdaptiveTimeoutTest, RoundsTimeoutUp) {
+  SlaveDevice device({0, 0, 16, 0});
+  LoopbackServer server;
+  server.AddSlave(1, &device);
+  LoopbackClient client(&server, 1000);
+  AdaptiveTimeoutParams params;
+  params.min_timeout_ms = 0;
+  client.EnableAdaptiveTimeouts(params);
+  ASSERT_TRUE(ReadHoldingRegisters(&client, 1, 0, 1).ok());
+  ASSERT_EQ(client.TimeoutFor(1), 1);
+}
+
+TEST(AdaptiveTimeoutTest, DeadSlaveDoesNotSlowDownHealthySlave) {
+  SlaveDevice device({0, 0, 16, 0});
+  LoopbackServer server;
+  server.AddSlave(1, &device);
+  LoopbackClient client(&server, 1000);
+  SimulatedClock clock;
+  client.SetClock(&clock);
+  client.EnableAdaptiveTimeouts({20, 4000});
+
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_TRUE(ReadHoldingRegisters(&client, 1, 0, 1).ok());
+    ASSERT_FALSE(ReadHoldingRegisters(&client, 2, 0, 1).ok());
+  }
+  ASSERT_EQ(client.TimeoutFor(1), 20);
+  // The dead slave costs no more than the static timeout.
+  ASSERT_EQ(client.TimeoutFor(2), 1000);
+}
+
+} // namespace test
+} // namespace modbus
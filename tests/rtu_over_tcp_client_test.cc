@@ -0,0 +1,152 @@
+#include "src/rtu_over_tcp_client.h"
+#include "gtest/gtest.h"
+#include "src/loopback_client.h"
+#include "src/modbus_functions.h"
+#include "src/modbus_slave.h"
+#include "src/modbus_tcp_client.h"
+#include "src/modbus_tcp_server.h"
+#include "src/rtu_framing.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+namespace modbus {
+namespace test {
+
+TEST(RtuFramingTest, InfersFrameSizes) {
+  uint8_t read_response[] = {1, 0x03, 4, 0, 1, 0, 2, 0, 0};
+  ASSERT_EQ(RtuResponseSize(read_response, 1).value(), 0);
+  ASSERT_EQ(RtuResponseSize(read_response, 2).value(), 0);
+  ASSERT_EQ(RtuResponseSize(read_response, 3).value(), 9);
+  uint8_t exception[] = {1, 0x83, 0x02};
+  ASSERT_EQ(RtuResponseSize(exception, 2).value(), 5);
+  uint8_t write_response[] = {1, 0x10};
+  ASSERT_EQ(RtuResponseSize(write_response, 2).value(), 8);
+
+  uint8_t write_request[] = {1, 0x10, 0, 0, 0, 2, 4};
+  ASSERT_EQ(RtuRequestSize(write_request, 6).value(), 0);
+  ASSERT_EQ(RtuRequestSize(write_request, 7).value(), 13);
+  uint8_t unknown[] = {1, 0x2B};
+  ASSERT_EQ(RtuResponseSize(unknown, 2).status().code(),
+            absl::StatusCode::kUnimplemented);
+}
+
+class RtuOverTcpClientTest : public testing::Test {
+protected:
+  RtuOverTcpClientTest()
+      : device_({0, 0, 256, 0}), server_(&slaves_, TcpFraming::kRtu) {
+    for (size_t i = 0; i < device_.holding_registers().size(); ++i) {
+      device_.holding_registers()[i] = 1000 + i;
+    }
+    slaves_.AddSlave(1, &device_);
+  }
+
+  void SetUp() override {
+    auto port = server_.Start();
+    ASSERT_TRUE(port.ok());
+    port_ = port.value();
+  }
+
+  SlaveDevice device_;
+  LoopbackServer slaves_;
+  TcpServer server_;
+  int port_ = 0;
+};
+
+TEST_F(RtuOverTcpClientTest, ReadsAndWrites) {
+  RtuOverTcpClient client("127.0.0.1", port_, 1000);
+  ASSERT_TRUE(client.Connect().ok());
+  auto registers = ReadHoldingRegisters(&client, 1, 10, 125);
+  ASSERT_TRUE(registers.ok()) << registers.status();
+  ASSERT_EQ(registers.value().size(), 125);
+  ASSERT_EQ(registers.value()[0], 1010);
+  ASSERT_EQ(registers.value()[124], 1134);
+
+  ASSERT_TRUE(WriteMultipleRegisters(&client, 1, 3, {7, 8, 9}).ok());
+  ASSERT_EQ(ReadHoldingRegisters(&client, 1, 3, 3).value(),
+            std::vector<uint16_t>({7, 8, 9}));
+  ASSERT_TRUE(WriteSingleRegister(&client, 1, 5, 42).ok());
+  ASSERT_EQ(device_.holding_registers()[5], 42);
+}
+
+TEST_F(RtuOverTcpClientTest, SilentSlaveTimesOutWithoutDesync) {
+  RtuOverTcpClient client("127.0.0.1", port_, 50);
+  ASSERT_TRUE(client.Connect().ok());
+  ASSERT_EQ(ReadHoldingRegisters(&client, 2, 0, 1).status().code(),
+            absl::StatusCode::kDeadlineExceeded);
+  ASSERT_EQ(ReadHoldingRegisters(&client, 1, 0, 1).value()[0], 1000);
+}
+
+TEST(RtuOverTcpClientPeerTest, DiscardsLateResponseAndChecksCrc) {
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  RtuOverTcpClient client("unused", 0, 1000);
+  ASSERT_TRUE(client.Attach(fds[0]).ok());
+
+  // A late response to an earlier request is already waiting.
+  std::vector<uint8_t> late = BuildAdu(1, FunctionCode::kReadHoldingRegisters,
+                                       {2, 0x00, 0x09});
+  ASSERT_EQ(write(fds[1], late.data(), late.size()), late.size());
+
+  std::thread peer([&] {
+    uint8_t request[256];
+    ASSERT_EQ(read(fds[1], request, sizeof(request)), 8);
+    // Answer in pieces; the second response has a corrupt CRC.
+    std::vector<uint8_t> response = BuildAdu(
+        1, FunctionCode::kReadHoldingRegisters, {2, 0x00, 0x2A});
+    write(fds[1], response.data(), 2);
+    usleep(1000);
+    write(fds[1], response.data() + 2, response.size() - 2);
+    ASSERT_EQ(read(fds[1], request, sizeof(request)), 8);
+    response.back() ^= 0xFF;
+    write(fds[1], response.data(), response.size());
+  });
+
+  auto registers = ReadHoldingRegisters(&client, 1, 0, 1);
+  ASSERT_TRUE(registers.ok()) << registers.status();
+  ASSERT_EQ(registers.value()[0], 0x2A);
+  ASSERT_EQ(ReadHoldingRegisters(&client, 1, 0, 1).status().code(),
+            absl::StatusCode::kDataLoss);
+  peer.join();
+  close(fds[1]);
+}
+
+TEST_F(RtuOverTcpClientTest, SendsPreparedRequests) {
+  auto registers =
+      PrepareRead(1, FunctionCode::kReadHoldingRegisters, 10, 3);
+  ASSERT_TRUE(registers.ok());
+  ASSERT_EQ(PrepareRead(1, FunctionCode::kReadHoldingRegisters, 0, 126)
+                .status()
+                .code(),
+            absl::StatusCode::kInvalidArgument);
+
+  // The same request, reused, over RTU and MBAP framing.
+  RtuOverTcpClient rtu_client("127.0.0.1", port_, 1000);
+  ASSERT_TRUE(rtu_client.Connect().ok());
+  TcpServer mbap_server(&slaves_);
+  auto mbap_port = mbap_server.Start();
+  ASSERT_TRUE(mbap_port.ok());
+  TcpClient mbap_client("127.0.0.1", *mbap_port, 1000);
+  ASSERT_TRUE(mbap_client.Connect().ok());
+  for (Client *client : {static_cast<Client *>(&rtu_client),
+                         static_cast<Client *>(&mbap_client)}) {
+    for (int i = 0; i < 3; ++i) {
+      auto values = ReadRegisters(client, *registers);
+      ASSERT_TRUE(values.ok()) << values.status();
+      ASSERT_EQ(values.value(), std::vector<uint16_t>({1010, 1011, 1012}));
+    }
+  }
+
+  auto absent = PrepareRead(7, FunctionCode::kReadHoldingRegisters, 0, 1);
+  rtu_client.SetTimeout(20);
+  ASSERT_EQ(ReadRegisters(&rtu_client, *absent).status().code(),
+            absl::StatusCode::kDeadlineExceeded);
+  ASSERT_EQ(ReadBits(&rtu_client, *registers).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+} // namespace test
+} // namespace modbus
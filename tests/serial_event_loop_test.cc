@@ -0,0 +1,194 @@
+#include "src/serial_event_loop.h"
+#include "gtest/gtest.h"
+#include "src/loopback_client.h"
+#include "src/modbus_pty_server.h"
+#include "src/modbus_slave.h"
+#include "src/serial_posix.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace modbus {
+namespace test {
+
+SerialParams PortParams(const std::string &port) {
+  return {port, 115200, Parity::kNone, 8, 1};
+}
+
+class SerialEventLoopTest : public testing::Test {
+protected:
+  void SetUp() override {
+    for (int i = 0; i < 4; ++i) {
+      devices_.push_back(std::make_unique<SlaveDevice>(
+          RegisterMapParams{0, 0, 16, 0}));
+      for (size_t j = 0; j < 16; ++j) {
+        devices_[i]->holding_registers()[j] = 100 * i + j;
+      }
+      slaves_.push_back(std::make_unique<LoopbackServer>());
+      slaves_[i]->AddSlave(1, devices_[i].get());
+      servers_.push_back(std::make_unique<PtyServer>(slaves_[i].get()));
+      auto path = servers_[i]->Start();
+      ASSERT_TRUE(path.ok()) << path.status();
+      paths_.push_back(path.value());
+    }
+  }
+
+  std::vector<std::unique_ptr<SlaveDevice>> devices_;
+  std::vector<std::unique_ptr<LoopbackServer>> slaves_;
+  std::vector<std::unique_ptr<PtyServer>> servers_;
+  std::vector<std::string> paths_;
+};
+
+TEST_F(SerialEventLoopTest, PollsManyPortsFromOneThread) {
+  SerialEventLoop loop;
+  for (const std::string &path : paths_) {
+    ASSERT_TRUE(loop.AddPort(PortParams(path)).ok());
+  }
+  ASSERT_EQ(loop.size(), 4);
+
+  // Three reads per port, the second of them to an absent slave.
+  std::vector<SerialBatchRequest> requests;
+  for (size_t port = 0; port < 4; ++port) {
+    for (uint8_t slave_id : {1, 2, 1}) {
+      requests.push_back({port, slave_id, FunctionCode::kReadHoldingRegisters,
+                          {0x00, static_cast<uint8_t>(port), 0x00, 0x02}});
+    }
+  }
+  for (int round = 0; round < 3; ++round) {
+    auto results = loop.Transact(requests, 50);
+    ASSERT_EQ(results.size(), requests.size());
+    for (size_t port = 0; port < 4; ++port) {
+      uint16_t first = 100 * port + port;
+      std::vector<uint8_t> expected = {
+          0x03, 4, static_cast<uint8_t>(first >> 8),
+          static_cast<uint8_t>(first), static_cast<uint8_t>((first + 1) >> 8),
+          static_cast<uint8_t>(first + 1)};
+      ASSERT_TRUE(results[3 * port].ok()) << results[3 * port].status();
+      ASSERT_EQ(results[3 * port].value(), expected);
+      ASSERT_EQ(results[3 * port + 1].status().code(),
+                absl::StatusCode::kDeadlineExceeded);
+      ASSERT_EQ(results[3 * port + 2].value(), expected);
+    }
+  }
+  for (auto &server : servers_) {
+    ASSERT_EQ(server->requests_received(), 9);
+  }
+}
+
+// Opens a pseudo terminal in raw mode. Returns the non-blocking slave side
+// and stores the master side, which plays the device, in 'master'.
+int OpenRawPty(int *master) {
+  *master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (*master < 0 || grantpt(*master) != 0 || unlockpt(*master) != 0) {
+    return -1;
+  }
+  int fd = open(ptsname(*master), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  struct termios tty;
+  tcgetattr(fd, &tty);
+  cfmakeraw(&tty);
+  tcsetattr(fd, TCSANOW, &tty);
+  return fd;
+}
+
+// Answers each request read from 'master' with the next of 'replies', split
+// in two writes 'pause' apart.
+void Reply(int master, const std::vector<std::vector<uint8_t>> &replies,
+           absl::Duration pause) {
+  uint8_t request[kMaxRtuFrameSize];
+  for (const auto &reply : replies) {
+    struct pollfd pfd = {master, POLLIN, 0};
+    ASSERT_EQ(poll(&pfd, 1, 1000), 1);
+    ASSERT_EQ(read(master, request, sizeof(request)), 8);
+    size_t half = reply.size() / 2;
+    write(master, reply.data(), half);
+    absl::SleepFor(pause);
+    write(master, reply.data() + half, reply.size() - half);
+  }
+}
+
+TEST(SerialEventLoopFramingTest, EndsFramesOnSilence) {
+  int master;
+  int fd = OpenRawPty(&master);
+  ASSERT_GE(fd, 0);
+  SerialEventLoop loop;
+  ASSERT_TRUE(loop.AddPort(fd, absl::Milliseconds(20)).ok());
+
+  // The third reply has a function code of unknown layout, so only the
+  // silence after it ends it. The writes are 5 ms apart, within the frame
+  // gap.
+  std::vector<std::vector<uint8_t>> replies = {
+      BuildAdu(1, FunctionCode::kReadHoldingRegisters, {2, 0x12, 0x34}),
+      {1, 0x03, 2, 0x12, 0x34, 0x00, 0x00},
+      {1, 0x2B, 0x00},
+      BuildAdu(1, FunctionCode::kReadHoldingRegisters, {2, 0x56, 0x78}),
+  };
+  std::thread device(Reply, master, replies, absl::Milliseconds(5));
+
+  std::vector<SerialBatchRequest> requests(
+      4, {0, 1, FunctionCode::kReadHoldingRegisters, {0x00, 0x00, 0x00, 0x01}});
+  auto results = loop.Transact(requests, 500);
+  device.join();
+  close(master);
+
+  ASSERT_EQ(results[0].value(), std::vector<uint8_t>({0x03, 2, 0x12, 0x34}));
+  ASSERT_EQ(results[1].status().code(), absl::StatusCode::kDataLoss);
+  ASSERT_EQ(results[2].status().code(), absl::StatusCode::kInternal);
+  ASSERT_EQ(results[3].value(), std::vector<uint8_t>({0x03, 2, 0x56, 0x78}));
+}
+
+TEST(SerialEventLoopFramingTest, WaitsForRestOfKnownFrame) {
+  int master;
+  int fd = OpenRawPty(&master);
+  ASSERT_GE(fd, 0);
+  SerialEventLoop loop;
+  ASSERT_TRUE(loop.AddPort(fd, absl::Milliseconds(2)).ok());
+
+  // The halves of each reply are further apart than the frame gap, as USB
+  // adapters deliver them.
+  std::vector<std::vector<uint8_t>> replies = {
+      BuildAdu(1, FunctionCode::kReadHoldingRegisters, {2, 0x12, 0x34}),
+      BuildAdu(1, FunctionCode::kReadHoldingRegisters, {2, 0x56, 0x78}),
+  };
+  std::thread device(Reply, master, replies, absl::Milliseconds(10));
+
+  std::vector<SerialBatchRequest> requests(
+      2, {0, 1, FunctionCode::kReadHoldingRegisters, {0x00, 0x00, 0x00, 0x01}});
+  auto results = loop.Transact(requests, 500);
+  device.join();
+  close(master);
+
+  ASSERT_TRUE(results[0].ok()) << results[0].status();
+  ASSERT_EQ(*results[0], std::vector<uint8_t>({0x03, 2, 0x12, 0x34}));
+  ASSERT_TRUE(results[1].ok()) << results[1].status();
+  ASSERT_EQ(*results[1], std::vector<uint8_t>({0x03, 2, 0x56, 0x78}));
+}
+
+TEST(SerialPosixTest, LowLatencyNeedsSerialDriver) {
+  LoopbackServer slaves;
+  PtyServer server(&slaves);
+  auto path = server.Start();
+  ASSERT_TRUE(path.ok());
+  SerialParams params = PortParams(path.value());
+  params.low_latency = true;
+  // A pseudo-terminal has no serial driver to configure.
+  ASSERT_EQ(OpenSerialPort(params).status().code(),
+            absl::StatusCode::kUnimplemented);
+  params.low_latency = false;
+  auto fd = OpenSerialPort(params);
+  ASSERT_TRUE(fd.ok());
+  close(fd.value());
+}
+
+} // namespace test
+} // namespace modbus
@@ -0,0 +1,104 @@
+#include "src/serial_timing.h"
+#include "gtest/gtest.h"
+#include "src/loopback_client.h"
+#include "src/modbus_functions.h"
+#include "src/modbus_pty_server.h"
+#include "src/modbus_slave.h"
+#include "src/rtu_framing.h"
+#include "src/serial_client_posix.h"
+#include "src/serial_posix.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace modbus {
+namespace test {
+
+TEST(SerialTimingTest, DerivesIntervalsFromLineParameters) {
+  // 8N1: 10 bits per character.
+  SerialTiming slow({"", 9600, Parity::kNone, 8, 1});
+  ASSERT_EQ(slow.character_time(), absl::Seconds(10) / 9600);
+  ASSERT_EQ(slow.t15(), absl::Seconds(15) / 9600);
+  ASSERT_EQ(slow.t35(), absl::Seconds(35) / 9600);
+
+  // 8E1: 11 bits per character.
+  SerialTiming even({"", 19200, Parity::kEven, 8, 1});
+  ASSERT_EQ(even.t35(), absl::Seconds(38.5) / 19200);
+
+  // Fixed intervals above 19200 baud.
+  SerialTiming fast({"", 115200, Parity::kNone, 8, 1});
+  ASSERT_EQ(fast.t15(), absl::Microseconds(750));
+  ASSERT_EQ(fast.t35(), absl::Microseconds(1750));
+}
+
+TEST(SerialTimingTest, PredictsFrameTimes) {
+  SerialTiming timing({"", 9600, Parity::kNone, 8, 1});
+  absl::Duration character = timing.character_time();
+
+  // Read 125 registers: 8 byte request, 255 byte response.
+  std::vector<uint8_t> read = {0x00, 0x00, 0x00, 125};
+  ASSERT_EQ(timing.RequestTime(read), character * 8);
+  ASSERT_EQ(timing.ResponseTime(FunctionCode::kReadHoldingRegisters, read),
+            character * 255);
+  // Read 10 coils: 2 data bytes.
+  std::vector<uint8_t> coils = {0x00, 0x00, 0x00, 10};
+  ASSERT_EQ(timing.ResponseTime(FunctionCode::kReadCoils, coils),
+            character * 7);
+  // A write is echoed in 8 bytes.
+  std::vector<uint8_t> write = {0x00, 0x01, 0x00, 0x02, 4, 0, 1, 0, 2};
+  ASSERT_EQ(timing.WireTime(FunctionCode::kWriteMultipleRegisters, write),
+            character * (13 + 8));
+  // Unknown layouts get the largest frame.
+  ASSERT_EQ(timing.ResponseTime(static_cast<FunctionCode>(0x2B), {0x0E}),
+            character * kMaxRtuFrameSize);
+}
+
+class SerialClientTimingTest : public testing::Test {
+protected:
+  SerialClientTimingTest() : device_({0, 0, 16, 0}), server_(&slaves_) {
+    for (size_t i = 0; i < device_.holding_registers().size(); ++i) {
+      device_.holding_registers()[i] = 1000 + i;
+    }
+    slaves_.AddSlave(1, &device_);
+  }
+
+  std::unique_ptr<SerialClient> Connect(int baud_rate, int timeout_ms) {
+    auto path = server_.Start();
+    EXPECT_TRUE(path.ok());
+    SerialParams params = {path.value(), baud_rate, Parity::kNone, 8, 1};
+    auto serial = std::make_unique<SerialPosix>();
+    EXPECT_TRUE(serial->Open(params).ok());
+    return std::make_unique<SerialClient>(std::move(serial), timeout_ms,
+                                          params);
+  }
+
+  SlaveDevice device_;
+  LoopbackServer slaves_;
+  PtyServer server_;
+};
+
+TEST_F(SerialClientTimingTest, KeepsLineSilentBetweenFrames) {
+  // 3.5 characters at 1200 baud are 29 ms.
+  auto client = Connect(1200, 1000);
+  absl::Time start = absl::Now();
+  for (int i = 0; i < 4; ++i) {
+    auto registers = ReadHoldingRegisters(client.get(), 1, 2, 3);
+    ASSERT_TRUE(registers.ok()) << registers.status();
+    ASSERT_EQ(registers.value(), std::vector<uint16_t>({1002, 1003, 1004}));
+  }
+  ASSERT_GE(absl::Now() - start, absl::Milliseconds(3 * 29));
+}
+
+TEST_F(SerialClientTimingTest, TimeoutCoversWireTime) {
+  // Request and response of a single register read take 125 ms at 1200
+  // baud, on top of the 1 ms the slave is given to answer.
+  auto client = Connect(1200, 1);
+  absl::Time start = absl::Now();
+  ASSERT_EQ(ReadHoldingRegisters(client.get(), 2, 0, 1).status().code(),
+            absl::StatusCode::kDeadlineExceeded);
+  ASSERT_GE(absl::Now() - start, absl::Milliseconds(125));
+}
+
+} // namespace test
+} // namespace modbus
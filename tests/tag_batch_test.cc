@@ -0,0 +1,158 @@
+#include "src/tag_batch.h"
+#include "gtest/gtest.h"
+#include "src/loopback_client.h"
+#include "src/modbus_slave.h"
+#include "src/tag_database.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace modbus {
+namespace test {
+
+class TagBatchTest : public testing::Test {
+protected:
+  TagBatchTest() : device_({0, 0, 16, 0}), client_(&server_, 50) {
+    std::vector<TagDefinition> definitions = {
+        {"a", 1, FunctionCode::kReadHoldingRegisters, 0, TagType::kUint16},
+        {"b", 1, FunctionCode::kReadHoldingRegisters, 1, TagType::kInt16,
+         WordOrder::kHighWordFirst, 0.5},
+        {"c", 2, FunctionCode::kReadHoldingRegisters, 0, TagType::kUint16},
+    };
+    image_ = BuildTagImage(definitions).value();
+    database_ = TagDatabase::FromImage(image_).value();
+    for (const char *name : {"a", "b", "c"}) {
+      tags_.push_back(database_->Find(name).value());
+    }
+    device_.holding_registers()[0] = 7;
+    device_.holding_registers()[1] = static_cast<uint16_t>(-4);
+    server_.AddSlave(1, &device_);
+  }
+
+  std::string image_;
+  std::unique_ptr<TagDatabase> database_;
+  std::vector<uint32_t> tags_;
+  SlaveDevice device_;
+  LoopbackServer server_;
+  LoopbackClient client_;
+};
+
+TEST_F(TagBatchTest, PollsIntoColumns) {
+  auto plan = PlanTagReads(*database_, tags_, 0);
+  ASSERT_TRUE(plan.ok()) << plan.status();
+  TagBatch batch;
+  absl::Status status = PollTags(&client_, *database_, *plan, &batch);
+  EXPECT_EQ(status.code(), absl::StatusCode::kDeadlineExceeded);
+
+  ASSERT_EQ(batch.size(), 3);
+  ASSERT_EQ(batch.null_count(), 1);
+  // Rows follow the plan: slave 1 first, then slave 2.
+  EXPECT_EQ(batch.tag_ids()[0], tags_[0]);
+  EXPECT_EQ(batch.tag_ids()[1], tags_[1]);
+  EXPECT_EQ(batch.tag_ids()[2], tags_[2]);
+  EXPECT_EQ(batch.values()[0], 7);
+  EXPECT_EQ(batch.values()[1], -2);
+  EXPECT_EQ(batch.values()[2], 0);
+  EXPECT_EQ(batch.validity()[0], 0b011);
+  EXPECT_EQ(batch.qualities()[0], 0);
+  EXPECT_EQ(batch.qualities()[2],
+            static_cast<uint8_t>(absl::StatusCode::kDeadlineExceeded));
+  EXPECT_EQ(batch.timestamps()[0], batch.timestamps()[1]);
+  EXPECT_LE(batch.timestamps()[1], batch.timestamps()[2]);
+  for (const void *column :
+       {static_cast<const void *>(batch.timestamps().data()),
+        static_cast<const void *>(batch.values().data())}) {
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(column) % 64, 0);
+  }
+
+  // A second cycle reuses the buffers.
+  const double *values = batch.values().data();
+  batch.Clear();
+  server_.AddSlave(2, &device_);
+  ASSERT_TRUE(PollTags(&client_, *database_, *plan, &batch).ok());
+  ASSERT_EQ(batch.size(), 3);
+  EXPECT_EQ(batch.null_count(), 0);
+  EXPECT_EQ(batch.values().data(), values);
+  EXPECT_EQ(batch.values()[2], 7);
+}
+
+TEST(TagBatchBitmapTest, SetsValidityAcrossBytes) {
+  TagBatch batch;
+  for (uint32_t i = 0; i < 20; ++i) {
+    batch.Append(0, i, i,
+                 i % 3 == 0 ? absl::StatusCode::kUnavailable
+                            : absl::StatusCode::kOk);
+  }
+  ASSERT_EQ(batch.validity().size(), 3);
+  EXPECT_EQ(batch.null_count(), 7);
+  for (size_t i = 0; i < 20; ++i) {
+    bool valid = (batch.validity()[i / 8] >> (i % 8)) & 1;
+    EXPECT_EQ(valid, i % 3 != 0) << i;
+  }
+}
+
+TEST(TagBatchArrowTest, ExportsWithoutCopying) {
+  TagBatch batch;
+  batch.Append(1000, 5, 1.5, absl::StatusCode::kOk);
+  batch.Append(2000, 6, 0, absl::StatusCode::kDeadlineExceeded);
+
+  ArrowSchema schema;
+  ArrowArray array;
+  ExportArrow(batch, &schema, &array);
+
+  EXPECT_STREQ(schema.format, "+s");
+  ASSERT_EQ(schema.n_children, 4);
+  EXPECT_STREQ(schema.children[0]->format, "tsu:");
+  EXPECT_STREQ(schema.children[0]->name, "timestamp");
+  EXPECT_STREQ(schema.children[1]->format, "I");
+  EXPECT_STREQ(schema.children[2]->format, "g");
+  EXPECT_EQ(schema.children[2]->flags, ARROW_FLAG_NULLABLE);
+  EXPECT_STREQ(schema.children[3]->format, "C");
+
+  EXPECT_EQ(array.length, 2);
+  ASSERT_EQ(array.n_children, 4);
+  EXPECT_EQ(array.children[0]->buffers[1], batch.timestamps().data());
+  EXPECT_EQ(array.children[1]->buffers[1], batch.tag_ids().data());
+  EXPECT_EQ(array.children[2]->null_count, 1);
+  EXPECT_EQ(array.children[2]->buffers[0], batch.validity().data());
+  EXPECT_EQ(array.children[2]->buffers[1], batch.values().data());
+  EXPECT_EQ(array.children[3]->buffers[0], nullptr);
+
+  array.release(&array);
+  schema.release(&schema);
+  EXPECT_EQ(array.release, nullptr);
+  EXPECT_EQ(schema.release, nullptr);
+}
+
+TEST(TagBatchArrowTest, MovedChildrenOutliveParent) {
+  TagBatch batch;
+  batch.Append(1000, 5, 1.5, absl::StatusCode::kOk);
+  batch.Append(2000, 6, 0, absl::StatusCode::kDeadlineExceeded);
+  ArrowSchema schema;
+  ArrowArray array;
+  ExportArrow(batch, &schema, &array);
+
+  // Move the value field out, as the C data interface allows, and release
+  // the parents first.
+  ArrowSchema value_schema = *schema.children[2];
+  schema.children[2]->release = nullptr;
+  ArrowArray values = *array.children[2];
+  array.children[2]->release = nullptr;
+  schema.release(&schema);
+  array.release(&array);
+
+  EXPECT_STREQ(value_schema.format, "g");
+  EXPECT_EQ(values.length, 2);
+  EXPECT_EQ(values.null_count, 1);
+  EXPECT_EQ(values.buffers[0], batch.validity().data());
+  EXPECT_EQ(static_cast<const double *>(values.buffers[1])[0], 1.5);
+  values.release(&values);
+  value_schema.release(&value_schema);
+  EXPECT_EQ(values.release, nullptr);
+}
+
+} // namespace test
+} // namespace modbus
@@ -0,0 +1,225 @@
+#include "src/tag_database.h"
+#include "gtest/gtest.h"
+#include "src/loopback_client.h"
+#include "src/modbus_slave.h"
+
+#include <unistd.h>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace modbus {
+namespace test {
+
+std::vector<TagDefinition> ManyTags(size_t count) {
+  std::vector<TagDefinition> tags;
+  for (size_t i = 0; i < count; ++i) {
+    tags.push_back({"site/line" + std::to_string(i % 7) + "/tag" +
+                        std::to_string(i),
+                    static_cast<uint8_t>(1 + i % 3),
+                    FunctionCode::kReadHoldingRegisters,
+                    static_cast<uint16_t>(i % 60000), TagType::kUint16});
+  }
+  return tags;
+}
+
+// Copies 'image' to storage aligned for TagDatabase::FromImage.
+class AlignedImage {
+public:
+  explicit AlignedImage(const std::string &image)
+      : words_((image.size() + 7) / 8) {
+    memcpy(words_.data(), image.data(), image.size());
+    view_ = absl::string_view(reinterpret_cast<const char *>(words_.data()),
+                              image.size());
+  }
+
+  absl::string_view view() const { return view_; }
+
+private:
+  std::vector<uint64_t> words_;
+  absl::string_view view_;
+};
+
+TEST(TagDatabaseTest, ParsesCsv) {
+  auto tags = ParseTagCsv("# name,slave,table,address,type\n"
+                          "\n"
+                          "pump/running, 1, coil, 7, bool\n"
+                          "meter/voltage,2,holding_register,0,float32\n"
+                          "meter/energy,2,input_register,4,uint32,low_first,"
+                          "0.001\n");
+  ASSERT_TRUE(tags.ok()) << tags.status();
+  ASSERT_EQ(tags->size(), 3);
+  EXPECT_EQ((*tags)[0].name, "pump/running");
+  EXPECT_EQ((*tags)[0].function_code, FunctionCode::kReadCoils);
+  EXPECT_EQ((*tags)[0].address, 7);
+  EXPECT_EQ((*tags)[1].type, TagType::kFloat32);
+  EXPECT_EQ((*tags)[1].word_order, WordOrder::kHighWordFirst);
+  EXPECT_EQ((*tags)[2].word_order, WordOrder::kLowWordFirst);
+  EXPECT_EQ((*tags)[2].scale, 0.001);
+
+  EXPECT_FALSE(ParseTagCsv("a,1,coil,7").ok());
+  EXPECT_FALSE(ParseTagCsv("a,256,coil,7,bool").ok());
+  EXPECT_FALSE(ParseTagCsv("a,1,coils,7,bool").ok());
+  EXPECT_FALSE(ParseTagCsv("a,1,coil,7,float32").ok());
+  EXPECT_FALSE(ParseTagCsv("a,1,holding_register,65535,uint32").ok());
+  EXPECT_FALSE(ParseTagCsv("a,1,holding_register,0,uint32,middle").ok());
+}
+
+TEST(TagDatabaseTest, FindsEveryTag) {
+  std::vector<TagDefinition> tags = ManyTags(20000);
+  auto image = BuildTagImage(tags);
+  ASSERT_TRUE(image.ok()) << image.status();
+  AlignedImage aligned(image.value());
+  auto database = TagDatabase::FromImage(aligned.view());
+  ASSERT_TRUE(database.ok()) << database.status();
+  ASSERT_EQ((*database)->size(), tags.size());
+
+  std::vector<bool> seen(tags.size());
+  for (const TagDefinition &tag : tags) {
+    std::optional<uint32_t> index = (*database)->Find(tag.name);
+    ASSERT_TRUE(index.has_value()) << tag.name;
+    ASSERT_FALSE(seen[*index]);
+    seen[*index] = true;
+    ASSERT_EQ((*database)->name(*index), tag.name);
+    const TagRecord &record = (*database)->tag(*index);
+    ASSERT_EQ(record.slave_id, tag.slave_id);
+    ASSERT_EQ(record.address, tag.address);
+  }
+  EXPECT_FALSE((*database)->Find("site/line0/tag20000").has_value());
+  EXPECT_FALSE((*database)->Find("").has_value());
+}
+
+TEST(TagDatabaseTest, RejectsBadInput) {
+  std::vector<TagDefinition> tags = ManyTags(3);
+  tags.push_back(tags[1]);
+  EXPECT_EQ(BuildTagImage(tags).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  auto empty = BuildTagImage({});
+  ASSERT_TRUE(empty.ok());
+  AlignedImage aligned(empty.value());
+  auto database = TagDatabase::FromImage(aligned.view());
+  ASSERT_TRUE(database.ok());
+  EXPECT_FALSE((*database)->Find("a").has_value());
+
+  std::string truncated = BuildTagImage(ManyTags(10)).value();
+  truncated.pop_back();
+  AlignedImage bad(truncated);
+  EXPECT_FALSE(TagDatabase::FromImage(bad.view()).ok());
+
+  // More records than the image holds, with a names size that makes the
+  // end of the names wrap around to the end of the image.
+  std::string overflowing = BuildTagImage(ManyTags(10)).value();
+  uint32_t tag_count;
+  uint64_t names_size;
+  memcpy(&tag_count, &overflowing[16], sizeof(tag_count));
+  memcpy(&names_size, &overflowing[24], sizeof(names_size));
+  tag_count += 1000;
+  names_size -= 1000 * sizeof(TagRecord);
+  memcpy(&overflowing[16], &tag_count, sizeof(tag_count));
+  memcpy(&overflowing[24], &names_size, sizeof(names_size));
+  AlignedImage crafted(overflowing);
+  EXPECT_FALSE(TagDatabase::FromImage(crafted.view()).ok());
+}
+
+TEST(TagDatabaseTest, PlanRejectsCorruptRecords) {
+  std::string image =
+      BuildTagImage({{"a", 1, FunctionCode::kReadHoldingRegisters, 65532,
+                      TagType::kFloat64}})
+          .value();
+  AlignedImage aligned(image);
+  auto database = TagDatabase::FromImage(aligned.view()).value();
+  ASSERT_TRUE(PlanTagReads(*database, {0}, 0).ok());
+  EXPECT_EQ(PlanTagReads(*database, {1}, 0).status().code(),
+            absl::StatusCode::kInvalidArgument);
+
+  // Corrupt the record: a table that is not readable, a type past the last
+  // one, and a range past the last address.
+  size_t record = image.size() - 1 - sizeof(TagRecord);
+  for (auto [field, value] :
+       {std::make_pair(offsetof(TagRecord, function_code), 6),
+        std::make_pair(offsetof(TagRecord, type), 9),
+        std::make_pair(offsetof(TagRecord, address), 0xFF)}) {
+    std::string corrupt = image;
+    corrupt[record + field] = static_cast<char>(value);
+    AlignedImage corrupt_aligned(corrupt);
+    auto corrupt_database =
+        TagDatabase::FromImage(corrupt_aligned.view()).value();
+    EXPECT_EQ(PlanTagReads(*corrupt_database, {0}, 0).status().code(),
+              absl::StatusCode::kInvalidArgument)
+        << field;
+  }
+}
+
+TEST(TagDatabaseTest, MapsImageFile) {
+  std::string path = testing::TempDir() + "/tags.tdb";
+  {
+    std::ofstream out(path, std::ios::binary);
+    std::string image = BuildTagImage(ManyTags(1000)).value();
+    out.write(image.data(), image.size());
+  }
+  auto database = TagDatabase::Open(path);
+  ASSERT_TRUE(database.ok()) << database.status();
+  ASSERT_EQ((*database)->size(), 1000);
+  ASSERT_TRUE((*database)->Find("site/line5/tag999").has_value());
+  unlink(path.c_str());
+  EXPECT_EQ(TagDatabase::Open(path).status().code(),
+            absl::StatusCode::kNotFound);
+}
+
+TEST(TagDatabaseTest, PlansAndReadsTags) {
+  std::vector<TagDefinition> definitions = {
+      {"voltage", 1, FunctionCode::kReadHoldingRegisters, 0,
+       TagType::kFloat32},
+      {"energy", 1, FunctionCode::kReadHoldingRegisters, 4, TagType::kUint32,
+       WordOrder::kLowWordFirst, 0.5},
+      {"far", 1, FunctionCode::kReadHoldingRegisters, 100, TagType::kInt16},
+      {"running", 1, FunctionCode::kReadCoils, 9, TagType::kBool},
+      {"tripped", 1, FunctionCode::kReadCoils, 12, TagType::kBool},
+      {"absent", 2, FunctionCode::kReadHoldingRegisters, 0, TagType::kUint16},
+  };
+  std::string image = BuildTagImage(definitions).value();
+  AlignedImage aligned(image);
+  auto database = TagDatabase::FromImage(aligned.view()).value();
+
+  SlaveDevice device({16, 0, 128, 0});
+  device.holding_registers()[0] = 0x4366;
+  device.holding_registers()[1] = 0x8000;
+  device.holding_registers()[4] = 0x0010;
+  device.holding_registers()[5] = 0x0001;
+  device.holding_registers()[100] = static_cast<uint16_t>(-3);
+  device.coils()[12] = true;
+  LoopbackServer server;
+  server.AddSlave(1, &device);
+  LoopbackClient client(&server, 50);
+
+  std::vector<uint32_t> tags;
+  for (const char *name :
+       {"far", "tripped", "energy", "absent", "voltage", "running"}) {
+    tags.push_back(database->Find(name).value());
+  }
+  auto plan = PlanTagReads(*database, tags, 8);
+  ASSERT_TRUE(plan.ok()) << plan.status();
+  // Registers 0 to 5 and 100 of slave 1, coils 9 to 12 and slave 2.
+  ASSERT_EQ(plan->size(), 4);
+
+  std::vector<double> values(tags.size());
+  absl::Status status = ReadTags(&client, *database, *plan, &values);
+  EXPECT_EQ(status.code(), absl::StatusCode::kDeadlineExceeded);
+  EXPECT_EQ(values[0], -3);
+  EXPECT_EQ(values[1], 1);
+  EXPECT_EQ(values[2], 0x00010010 * 0.5);
+  EXPECT_TRUE(std::isnan(values[3]));
+  EXPECT_EQ(values[4], 230.5);
+  EXPECT_EQ(values[5], 0);
+}
+
+} // namespace test
+} // namespace modbus
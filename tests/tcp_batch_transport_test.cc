@@ -0,0 +1,151 @@
+#include "src/tcp_batch_transport.h"
+#include "gtest/gtest.h"
+#include "src/loopback_client.h"
+#include "src/modbus_slave.h"
+#include "src/modbus_tcp_server.h"
+#include "src/tcp_socket.h"
+
+#include <sys/resource.h>
+
+#include <memory>
+#include <vector>
+
+namespace modbus {
+namespace test {
+
+class TcpBatchTransportTest : public testing::TestWithParam<TcpBackend> {
+protected:
+  TcpBatchTransportTest() : device_({0, 0, 256, 0}) {
+    for (size_t i = 0; i < device_.holding_registers().size(); ++i) {
+      device_.holding_registers()[i] = 1000 + i;
+    }
+    slaves_.AddSlave(1, &device_);
+  }
+
+  void SetUp() override {
+    auto transport = CreateTcpBatchTransport(GetParam());
+    if (!transport.ok()) {
+      GTEST_SKIP() << transport.status();
+    }
+    transport_ = std::move(transport).value();
+    for (int i = 0; i < 4; ++i) {
+      servers_.push_back(std::make_unique<TcpServer>(&slaves_));
+      auto port = servers_.back()->Start();
+      ASSERT_TRUE(port.ok());
+      auto sockfd = ConnectTcpSocket("127.0.0.1", port.value());
+      ASSERT_TRUE(sockfd.ok());
+      ASSERT_TRUE(transport_->AddConnection(sockfd.value()).ok());
+    }
+  }
+
+  static TcpBatchRequest Read(size_t connection, uint8_t slave_id,
+                              uint16_t address, uint16_t quantity) {
+    return {connection,
+            slave_id,
+            FunctionCode::kReadHoldingRegisters,
+            {static_cast<uint8_t>(address >> 8),
+             static_cast<uint8_t>(address & 0xFF),
+             static_cast<uint8_t>(quantity >> 8),
+             static_cast<uint8_t>(quantity & 0xFF)}};
+  }
+
+  // Returns the first register of a Read Holding Registers response.
+  static uint16_t FirstRegister(const std::vector<uint8_t> &pdu) {
+    return (pdu[2] << 8) | pdu[3];
+  }
+
+  SlaveDevice device_;
+  LoopbackServer slaves_;
+  std::vector<std::unique_ptr<TcpServer>> servers_;
+  std::unique_ptr<TcpBatchTransport> transport_;
+};
+
+TEST_P(TcpBatchTransportTest, PipelinesBatchesAcrossConnections) {
+  for (int batch = 0; batch < 20; ++batch) {
+    std::vector<TcpBatchRequest> requests;
+    for (uint16_t i = 0; i < 40; ++i) {
+      requests.push_back(Read(i % 4, 1, batch + i, 1 + i % 8));
+    }
+    auto results = transport_->Transact(requests, 1000);
+    ASSERT_EQ(results.size(), requests.size());
+    for (uint16_t i = 0; i < 40; ++i) {
+      ASSERT_TRUE(results[i].ok()) << results[i].status();
+      ASSERT_EQ(results[i].value().size(), 2 + 2 * (1 + i % 8));
+      ASSERT_EQ(FirstRegister(results[i].value()), 1000 + batch + i);
+    }
+  }
+}
+
+TEST_P(TcpBatchTransportTest, LargeBatch) {
+  std::vector<TcpBatchRequest> requests;
+  for (int i = 0; i < 4000; ++i) {
+    requests.push_back(Read(i % 4, 1, i % 128, 125));
+  }
+  auto results = transport_->Transact(requests, 5000);
+  for (int i = 0; i < 4000; ++i) {
+    ASSERT_TRUE(results[i].ok()) << results[i].status();
+    ASSERT_EQ(FirstRegister(results[i].value()), 1000 + i % 128);
+  }
+}
+
+TEST_P(TcpBatchTransportTest, ZeroCopyLargeBatches) {
+  transport_->SetZeroCopyThreshold(1);
+  for (int batch = 0; batch < 5; ++batch) {
+    std::vector<TcpBatchRequest> requests;
+    for (int i = 0; i < 2000; ++i) {
+      requests.push_back(Read(i % 4, 1, (batch + i) % 128, 4));
+    }
+    auto results = transport_->Transact(requests, 5000);
+    for (int i = 0; i < 2000; ++i) {
+      ASSERT_TRUE(results[i].ok()) << results[i].status();
+      ASSERT_EQ(FirstRegister(results[i].value()), 1000 + (batch + i) % 128);
+    }
+  }
+}
+
+TEST_P(TcpBatchTransportTest, SilentSlaveTimesOut) {
+  auto results =
+      transport_->Transact({Read(0, 2, 0, 1), Read(0, 1, 7, 1)}, 100);
+  ASSERT_EQ(results[0].status().code(), absl::StatusCode::kDeadlineExceeded);
+  ASSERT_TRUE(results[1].ok());
+  ASSERT_EQ(FirstRegister(results[1].value()), 1007);
+}
+
+TEST_P(TcpBatchTransportTest, ClosedConnectionFails) {
+  servers_[1]->Stop();
+  auto results =
+      transport_->Transact({Read(0, 1, 3, 1), Read(1, 1, 3, 1)}, 1000);
+  ASSERT_TRUE(results[0].ok());
+  ASSERT_EQ(results[1].status().code(), absl::StatusCode::kUnavailable);
+  results = transport_->Transact({Read(1, 1, 3, 1), Read(5, 1, 3, 1)}, 1000);
+  ASSERT_EQ(results[0].status().code(), absl::StatusCode::kUnavailable);
+  ASSERT_EQ(results[1].status().code(), absl::StatusCode::kInvalidArgument);
+}
+
+// Returns the CPU time used by the calling thread.
+absl::Duration ThreadCpuTime() {
+  struct rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+  return absl::DurationFromTimeval(usage.ru_utime) +
+         absl::DurationFromTimeval(usage.ru_stime);
+}
+
+TEST_P(TcpBatchTransportTest, FailedConnectionDoesNotSpin) {
+  servers_[1]->Stop();
+  auto results = transport_->Transact({Read(1, 1, 3, 1)}, 1000);
+  ASSERT_EQ(results[0].status().code(), absl::StatusCode::kUnavailable);
+
+  // Waiting for a silent slave must sleep, not poll the failed socket.
+  absl::Duration cpu_time = ThreadCpuTime();
+  results = transport_->Transact({Read(0, 2, 0, 1)}, 500);
+  ASSERT_EQ(results[0].status().code(), absl::StatusCode::kDeadlineExceeded);
+  ASSERT_LT(ThreadCpuTime() - cpu_time, absl::Milliseconds(100));
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, TcpBatchTransportTest,
+                         testing::Values(TcpBackend::kEpoll,
+                                         TcpBackend::kIoUring,
+                                         TcpBackend::kAuto));
+
+} // namespace test
+} // namespace modbus
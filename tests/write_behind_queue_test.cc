@@ -0,0 +1,174 @@
+#include "src/write_behind_queue.h"
+#include "gtest/gtest.h"
+#include "src/clock.h"
+#include "src/loopback_client.h"
+#include "src/modbus_slave.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+
+namespace modbus {
+namespace test {
+
+// Client that records the function code and first address of every request
+// it forwards.
+class RecordingClient : public Client {
+public:
+  explicit RecordingClient(Client *client) : Client(0), client_(client) {}
+
+  absl::StatusOr<std::vector<uint8_t>>
+  SendReceive(uint8_t slave_id, FunctionCode function_code,
+              const std::vector<uint8_t> &request_data) override {
+    {
+      absl::MutexLock lock(&mu_);
+      requests_.push_back(function_code);
+      addresses_.push_back(request_data[0] << 8 | request_data[1]);
+    }
+    return client_->SendReceive(slave_id, function_code, request_data);
+  }
+
+  std::vector<FunctionCode> requests() {
+    absl::MutexLock lock(&mu_);
+    return requests_;
+  }
+
+  std::vector<int> addresses() {
+    absl::MutexLock lock(&mu_);
+    return addresses_;
+  }
+
+private:
+  Client *client_;
+  absl::Mutex mu_;
+  std::vector<FunctionCode> requests_;
+  std::vector<int> addresses_;
+};
+
+class WriteBehindQueueTest : public testing::Test {
+protected:
+  WriteBehindQueueTest()
+      : device_({16, 0, 256, 0}), loopback_(&server_, 50),
+        client_(&loopback_) {
+    server_.AddSlave(1, &device_);
+  }
+
+  SlaveDevice device_;
+  LoopbackServer server_;
+  LoopbackClient loopback_;
+  RecordingClient client_;
+};
+
+TEST_F(WriteBehindQueueTest, MergesAdjacentWritesAndDropsSuperseded) {
+  WriteBehindQueue queue(&client_, {absl::Hours(1), 1000});
+  std::vector<absl::Status> results;
+  auto record = [&](const absl::Status &status) { results.push_back(status); };
+  queue.WriteCoil(1, 5, true, record);
+  queue.WriteCoil(1, 6, true, record);
+  queue.WriteRegister(1, 10, 1, record);
+  queue.WriteRegister(1, 11, 7, record);
+  queue.WriteRegister(1, 11, 2, record);
+  queue.WriteRegister(1, 12, 3, record);
+  queue.WriteRegister(1, 20, 9, record);
+  queue.Flush();
+
+  EXPECT_EQ(client_.requests(),
+            std::vector<FunctionCode>({FunctionCode::kWriteMultipleCoils,
+                                       FunctionCode::kWriteMultipleRegisters,
+                                       FunctionCode::kWriteSingleRegister}));
+  ASSERT_EQ(results.size(), 7);
+  for (const absl::Status &status : results) {
+    EXPECT_TRUE(status.ok()) << status;
+  }
+  EXPECT_EQ(device_.holding_registers()[10], 1);
+  EXPECT_EQ(device_.holding_registers()[11], 2);
+  EXPECT_EQ(device_.holding_registers()[12], 3);
+  EXPECT_EQ(device_.holding_registers()[20], 9);
+  EXPECT_TRUE(device_.coils()[5]);
+  EXPECT_TRUE(device_.coils()[6]);
+
+  WriteBehindStats stats = queue.stats();
+  EXPECT_EQ(stats.writes, 7);
+  EXPECT_EQ(stats.superseded, 1);
+  EXPECT_EQ(stats.transactions, 3);
+}
+
+TEST_F(WriteBehindQueueTest, KeepsQueueOrder) {
+  WriteBehindQueue queue(&client_, {absl::Hours(1), 1000});
+  // A setpoint, a start command at a lower address, then a new setpoint:
+  // neither merging nor replacing the first setpoint may move the start
+  // command before it.
+  queue.WriteRegister(1, 10, 100);
+  queue.WriteRegister(1, 5, 1);
+  queue.WriteRegister(1, 10, 200);
+  queue.WriteRegister(1, 11, 300);
+  queue.Flush();
+
+  EXPECT_EQ(client_.addresses(), std::vector<int>({10, 5, 10}));
+  EXPECT_EQ(device_.holding_registers()[10], 200);
+  EXPECT_EQ(device_.holding_registers()[11], 300);
+  EXPECT_EQ(queue.stats().superseded, 0);
+}
+
+TEST_F(WriteBehindQueueTest, SplitsRunsAtProtocolLimit) {
+  WriteBehindQueue queue(&client_, {absl::Hours(1), 1000});
+  for (uint16_t i = 0; i < 130; ++i) {
+    queue.WriteRegister(1, i, i + 1);
+  }
+  queue.Flush();
+  EXPECT_EQ(queue.stats().transactions, 2);
+  for (uint16_t i = 0; i < 130; ++i) {
+    ASSERT_EQ(device_.holding_registers()[i], i + 1);
+  }
+}
+
+TEST_F(WriteBehindQueueTest, SendsWhenDue) {
+  SimulatedClock clock;
+  WriteBehindQueue queue(&client_, {absl::Milliseconds(20), 1000});
+  queue.SetClock(&clock);
+  absl::Notification done;
+  absl::Status result;
+  queue.WriteRegister(1, 0, 5, [&](const absl::Status &status) {
+    result = status;
+    done.Notify();
+  });
+  // The delay runs on the queue's clock, not in real time.
+  EXPECT_FALSE(done.WaitForNotificationWithTimeout(absl::Milliseconds(50)));
+  clock.AdvanceTime(absl::Milliseconds(19));
+  EXPECT_FALSE(done.WaitForNotificationWithTimeout(absl::Milliseconds(50)));
+  clock.AdvanceTime(absl::Milliseconds(1));
+  ASSERT_TRUE(done.WaitForNotificationWithTimeout(absl::Seconds(5)));
+  EXPECT_TRUE(result.ok());
+  EXPECT_EQ(device_.holding_registers()[0], 5);
+}
+
+TEST_F(WriteBehindQueueTest, SendsWhenFull) {
+  WriteBehindQueue queue(&client_, {absl::Hours(1), 4});
+  absl::Notification done;
+  for (uint16_t address : {0, 2, 4}) {
+    queue.WriteRegister(1, address, 1);
+  }
+  queue.WriteRegister(1, 6, 1, [&](const absl::Status &) { done.Notify(); });
+  ASSERT_TRUE(done.WaitForNotificationWithTimeout(absl::Seconds(5)));
+  // Waits for the send in progress to be counted; nothing is left to send.
+  queue.Flush();
+  EXPECT_EQ(queue.stats().transactions, 4);
+  EXPECT_EQ(client_.requests().size(), 4);
+}
+
+TEST_F(WriteBehindQueueTest, ReportsFailures) {
+  absl::Status result;
+  {
+    WriteBehindQueue queue(&client_, {absl::Hours(1), 1000});
+    queue.WriteRegister(2, 0, 1,
+                        [&](const absl::Status &status) { result = status; });
+  }
+  // Pending writes are sent on destruction.
+  EXPECT_EQ(result.code(), absl::StatusCode::kDeadlineExceeded);
+}
+
+} // namespace test
+} // namespace modbus
@@ -0,0 +1,189 @@
+// Drives a fleet of Modbus TCP devices (e.g. modbus_simulator) at a target
+// request rate and reports achieved throughput and latency percentiles.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "src/connection_pool.h"
+#include "src/latency_histogram.h"
+#include "src/modbus_functions.h"
+
+ABSL_FLAG(std::string, host, "127.0.0.1", "Host of the devices.");
+ABSL_FLAG(int, base_port, 15020,
+          "Port of the first device; device i listens on base_port + i.");
+ABSL_FLAG(int, num_devices, 100, "Number of devices to poll.");
+ABSL_FLAG(int, slave_id, 1, "Unit ID sent with every request.");
+ABSL_FLAG(int, threads, 8,
+          "Number of client threads. Each thread has one outstanding request "
+          "at a time, spread round-robin over its share of the devices.");
+ABSL_FLAG(double, rate, 0,
+          "Target total requests per second, or 0 to run closed-loop as fast "
+          "as possible. With a target rate, latency is measured from each "
+          "request's scheduled start so that stalls are not hidden.");
+ABSL_FLAG(int, duration_s, 10, "Duration of the run in seconds.");
+ABSL_FLAG(std::string, function, "read_holding_registers",
+          "read_coils, read_discrete_inputs, read_holding_registers, "
+          "read_input_registers, write_single_register or "
+          "write_multiple_registers.");
+ABSL_FLAG(int, address, 0, "Starting address of every request.");
+ABSL_FLAG(int, quantity, 10, "Quantity of every request.");
+ABSL_FLAG(int, timeout_ms, 1000, "Response timeout in milliseconds.");
+ABSL_FLAG(int, connect_timeout_ms, 3000,
+          "Connect timeout in milliseconds. Devices are connected in "
+          "parallel at startup and reconnected with backoff after errors.");
+
+namespace modbus {
+namespace {
+
+using SteadyClock = std::chrono::steady_clock;
+
+struct ThreadResult {
+  LatencyHistogram latency;
+  int64_t errors = 0;
+  std::map<std::string, int64_t> error_messages;
+};
+
+// Issues one request of the configured kind.
+absl::Status Issue(Client *client, const std::string &function,
+                   uint8_t slave_id, uint16_t address, uint16_t quantity) {
+  if (function == "read_coils") {
+    return ReadCoils(client, slave_id, address, quantity).status();
+  } else if (function == "read_discrete_inputs") {
+    return ReadDiscreteInputs(client, slave_id, address, quantity).status();
+  } else if (function == "read_holding_registers") {
+    return ReadHoldingRegisters(client, slave_id, address, quantity).status();
+  } else if (function == "read_input_registers") {
+    return ReadInputRegisters(client, slave_id, address, quantity).status();
+  } else if (function == "write_single_register") {
+    return WriteSingleRegister(client, slave_id, address, 0x1234);
+  } else if (function == "write_multiple_registers") {
+    return WriteMultipleRegisters(client, slave_id, address,
+                                  std::vector<uint16_t>(quantity, 0x1234));
+  }
+  return absl::InvalidArgumentError("Unknown function: " + function);
+}
+
+void RunThread(std::vector<Client *> clients,
+               SteadyClock::time_point start, SteadyClock::time_point end,
+               double thread_rate, ThreadResult *result) {
+  const std::string function = absl::GetFlag(FLAGS_function);
+  const uint8_t slave_id = absl::GetFlag(FLAGS_slave_id);
+  const uint16_t address = absl::GetFlag(FLAGS_address);
+  const uint16_t quantity = absl::GetFlag(FLAGS_quantity);
+  const auto interval =
+      thread_rate > 0
+          ? std::chrono::duration_cast<SteadyClock::duration>(
+                std::chrono::duration<double>(1.0 / thread_rate))
+          : SteadyClock::duration::zero();
+
+  size_t next_client = 0;
+  for (int64_t i = 0;; ++i) {
+    auto scheduled = start + i * interval;
+    if (scheduled >= end) {
+      break;
+    }
+    std::this_thread::sleep_until(scheduled);
+    auto sent = SteadyClock::now();
+    if (sent >= end) {
+      break;
+    }
+
+    Client *client = clients[next_client];
+    next_client = (next_client + 1) % clients.size();
+    absl::Status status = Issue(client, function, slave_id, address, quantity);
+    auto done = SteadyClock::now();
+
+    auto latency = done - (thread_rate > 0 ? scheduled : sent);
+    result->latency.Record(
+        std::chrono::duration_cast<std::chrono::microseconds>(latency)
+            .count());
+    if (!status.ok()) {
+      ++result->errors;
+      ++result->error_messages[std::string(status.message())];
+    }
+  }
+}
+
+int Main() {
+  int num_threads = std::max(1, absl::GetFlag(FLAGS_threads));
+  int num_devices = absl::GetFlag(FLAGS_num_devices);
+  num_threads = std::min(num_threads, num_devices);
+
+  ConnectionPoolParams params;
+  params.socket.connect_timeout_ms = absl::GetFlag(FLAGS_connect_timeout_ms);
+  ConnectionPool pool(params, absl::GetFlag(FLAGS_timeout_ms));
+  std::vector<std::vector<Client *>> clients(num_threads);
+  for (int i = 0; i < num_devices; ++i) {
+    clients[i % num_threads].push_back(pool.AddDevice(
+        absl::GetFlag(FLAGS_host), absl::GetFlag(FLAGS_base_port) + i));
+  }
+  auto connect_start = SteadyClock::now();
+  int connected = pool.ConnectAll();
+  printf("connected:  %d of %d devices in %.3f s\n", connected, num_devices,
+         std::chrono::duration<double>(SteadyClock::now() - connect_start)
+             .count());
+  if (connected == 0) {
+    return 1;
+  }
+
+  double thread_rate = absl::GetFlag(FLAGS_rate) / num_threads;
+  std::vector<ThreadResult> results(num_threads);
+  std::vector<std::thread> threads;
+  auto start = SteadyClock::now();
+  auto end = start + std::chrono::seconds(absl::GetFlag(FLAGS_duration_s));
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back(RunThread, std::move(clients[i]), start, end,
+                         thread_rate, &results[i]);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  double elapsed =
+      std::chrono::duration<double>(SteadyClock::now() - start).count();
+
+  ThreadResult total;
+  for (const ThreadResult &result : results) {
+    total.latency.Merge(result.latency);
+    total.errors += result.errors;
+    for (const auto &[message, count] : result.error_messages) {
+      total.error_messages[message] += count;
+    }
+  }
+
+  const LatencyHistogram &latency = total.latency;
+  printf("requests:   %lld (%lld errors)\n",
+         static_cast<long long>(latency.count()),
+         static_cast<long long>(total.errors));
+  printf("throughput: %.1f requests/s (target %.1f)\n",
+         latency.count() / elapsed, absl::GetFlag(FLAGS_rate));
+  printf("latency us: min %lld  mean %.0f  p50 %lld  p90 %lld  p99 %lld  "
+         "p99.9 %lld  max %lld\n",
+         static_cast<long long>(latency.min()), latency.mean(),
+         static_cast<long long>(latency.Percentile(50)),
+         static_cast<long long>(latency.Percentile(90)),
+         static_cast<long long>(latency.Percentile(99)),
+         static_cast<long long>(latency.Percentile(99.9)),
+         static_cast<long long>(latency.max()));
+  for (const auto &[message, count] : total.error_messages) {
+    printf("  %8lld x %s\n", static_cast<long long>(count), message.c_str());
+  }
+  return 0;
+}
+
+} // namespace
+} // namespace modbus
+
+int main(int argc, char **argv) {
+  absl::ParseCommandLine(argc, argv);
+  return modbus::Main();
+}
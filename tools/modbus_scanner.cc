@@ -0,0 +1,160 @@
+// Finds the Modbus TCP devices on a site: connects to every address of the
+// given subnets in parallel, probes the unit IDs behind each one that
+// accepts a connection and reports which reads each unit answers.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "src/network_scanner.h"
+
+ABSL_FLAG(std::string, subnets, "",
+          "Comma-separated IPv4 subnets or addresses to scan, e.g. "
+          "192.168.1.0/24,10.0.0.5.");
+ABSL_FLAG(int, port, 502, "Modbus TCP port.");
+ABSL_FLAG(int, first_unit, 1, "First unit ID to probe.");
+ABSL_FLAG(int, last_unit, 247, "Last unit ID to probe.");
+ABSL_FLAG(std::string, reads, "holding_register:0:1",
+          "Comma-separated reads sent to every unit ID, as "
+          "table:address:quantity, where 'table' is coil, discrete_input, "
+          "holding_register or input_register.");
+ABSL_FLAG(int, max_connects, 256, "Connection attempts in progress at once.");
+ABSL_FLAG(int, connect_timeout_ms, 1000, "Connect timeout in milliseconds.");
+ABSL_FLAG(int, max_in_flight, 4,
+          "Probes outstanding per connection. Use 1 for gateways that do "
+          "not pipeline requests.");
+ABSL_FLAG(int, timeout_ms, 500, "Response timeout in milliseconds.");
+ABSL_FLAG(int, round_interval_ms, 0,
+          "Least time between rounds of probes, in milliseconds.");
+
+namespace modbus {
+namespace {
+
+using SteadyClock = std::chrono::steady_clock;
+
+// Parses a read given as table:address:quantity.
+bool ParseRead(absl::string_view text, ScanRead *read) {
+  std::vector<absl::string_view> fields = absl::StrSplit(text, ':');
+  uint32_t address, quantity;
+  if (fields.size() != 3 || !absl::SimpleAtoi(fields[1], &address) ||
+      !absl::SimpleAtoi(fields[2], &quantity) || address > 0xFFFF ||
+      quantity < 1 || quantity > 125) {
+    return false;
+  }
+  if (fields[0] == "coil") {
+    read->function_code = FunctionCode::kReadCoils;
+  } else if (fields[0] == "discrete_input") {
+    read->function_code = FunctionCode::kReadDiscreteInputs;
+  } else if (fields[0] == "holding_register") {
+    read->function_code = FunctionCode::kReadHoldingRegisters;
+  } else if (fields[0] == "input_register") {
+    read->function_code = FunctionCode::kReadInputRegisters;
+  } else {
+    return false;
+  }
+  read->address = address;
+  read->quantity = quantity;
+  return true;
+}
+
+// Describes the response to a probe.
+std::string Describe(const absl::StatusOr<std::vector<uint8_t>> &response) {
+  if (!response.ok()) {
+    return "no response";
+  }
+  if (response->size() >= 2 && ((*response)[0] & 0x80)) {
+    return "exception " + std::to_string((*response)[1]);
+  }
+  return "ok";
+}
+
+int Main() {
+  std::vector<ScanTarget> targets;
+  for (absl::string_view subnet :
+       absl::StrSplit(absl::GetFlag(FLAGS_subnets), ',', absl::SkipEmpty())) {
+    auto expanded = ExpandSubnet(subnet, absl::GetFlag(FLAGS_port));
+    if (!expanded.ok()) {
+      fprintf(stderr, "%s\n", std::string(expanded.status().message()).c_str());
+      return 1;
+    }
+    targets.insert(targets.end(), expanded->begin(), expanded->end());
+  }
+  if (targets.empty()) {
+    fprintf(stderr, "--subnets is required.\n");
+    return 1;
+  }
+
+  ScanParams params;
+  int first_unit = absl::GetFlag(FLAGS_first_unit);
+  int last_unit = absl::GetFlag(FLAGS_last_unit);
+  if (first_unit < 0 || last_unit > 255 || first_unit > last_unit) {
+    fprintf(stderr, "Invalid unit ID range.\n");
+    return 1;
+  }
+  for (int unit_id = first_unit; unit_id <= last_unit; ++unit_id) {
+    params.unit_ids.push_back(unit_id);
+  }
+  params.reads.clear();
+  for (absl::string_view text :
+       absl::StrSplit(absl::GetFlag(FLAGS_reads), ',', absl::SkipEmpty())) {
+    ScanRead read;
+    if (!ParseRead(text, &read)) {
+      fprintf(stderr, "Invalid read: %s\n", std::string(text).c_str());
+      return 1;
+    }
+    params.reads.push_back(read);
+  }
+  params.max_connects = absl::GetFlag(FLAGS_max_connects);
+  params.connect_timeout_ms = absl::GetFlag(FLAGS_connect_timeout_ms);
+  params.max_in_flight = absl::GetFlag(FLAGS_max_in_flight);
+  params.response_timeout_ms = absl::GetFlag(FLAGS_timeout_ms);
+  params.round_interval =
+      absl::Milliseconds(absl::GetFlag(FLAGS_round_interval_ms));
+
+  auto start = SteadyClock::now();
+  auto results = ScanNetwork(targets, params);
+  if (!results.ok()) {
+    fprintf(stderr, "%s\n", std::string(results.status().message()).c_str());
+    return 1;
+  }
+  int hosts = 0;
+  int units = 0;
+  for (const TargetScanResult &result : *results) {
+    if (result.units.empty()) {
+      continue;
+    }
+    ++hosts;
+    for (const UnitScanResult &unit : result.units) {
+      ++units;
+      printf("%s:%d unit %d:", result.target.host.c_str(), result.target.port,
+             unit.unit_id);
+      for (size_t i = 0; i < unit.responses.size(); ++i) {
+        printf(" %s", Describe(unit.responses[i]).c_str());
+        printf(i + 1 < unit.responses.size() ? "," : "\n");
+      }
+    }
+  }
+  printf("targets:    %zu\n", targets.size());
+  printf("hosts:      %d\n", hosts);
+  printf("units:      %d\n", units);
+  printf("elapsed:    %.3f s\n",
+         std::chrono::duration<double>(SteadyClock::now() - start).count());
+  return 0;
+}
+
+} // namespace
+} // namespace modbus
+
+int main(int argc, char **argv) {
+  absl::ParseCommandLine(argc, argv);
+  return modbus::Main();
+}
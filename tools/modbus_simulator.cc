@@ -0,0 +1,472 @@
+// Simulates many Modbus TCP devices on one host. Device i listens on
+// base_port + i and serves its own register map, with configurable response
+// latency, exception rate and per-connection transaction concurrency.
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "src/mbap.h"
+#include "src/modbus_client.h"
+#include "src/modbus_slave.h"
+
+ABSL_FLAG(std::string, bind_address, "127.0.0.1",
+          "Address the simulated devices listen on.");
+ABSL_FLAG(int, base_port, 15020,
+          "Port of the first device; device i listens on base_port + i.");
+ABSL_FLAG(int, num_devices, 100, "Number of simulated devices.");
+ABSL_FLAG(int, threads, 1, "Number of event loop threads.");
+ABSL_FLAG(int, coils, 2000, "Coils per device.");
+ABSL_FLAG(int, discrete_inputs, 2000, "Discrete inputs per device.");
+ABSL_FLAG(int, holding_registers, 1000, "Holding registers per device.");
+ABSL_FLAG(int, input_registers, 1000, "Input registers per device.");
+ABSL_FLAG(std::string, fill, "address",
+          "Initial register contents: zero, address or random.");
+ABSL_FLAG(std::string, latency, "fixed",
+          "Response latency distribution: fixed, uniform, exponential or "
+          "lognormal.");
+ABSL_FLAG(double, latency_ms, 0, "Mean response latency in milliseconds.");
+ABSL_FLAG(double, latency_spread_ms, 0,
+          "Half-width of the uniform distribution, or standard deviation of "
+          "the lognormal distribution, in milliseconds.");
+ABSL_FLAG(double, exception_rate, 0,
+          "Fraction of requests answered with --exception_code.");
+ABSL_FLAG(int, exception_code, 6, "Exception code for injected exceptions.");
+ABSL_FLAG(int, max_in_flight, 1,
+          "Transactions a device processes concurrently per connection. "
+          "Further pipelined requests wait until a slot frees up.");
+ABSL_FLAG(int, seed, 1, "Seed for latencies, exceptions and random fill.");
+
+namespace modbus {
+namespace {
+
+using SteadyClock = std::chrono::steady_clock;
+
+std::atomic<bool> stop_requested = false;
+
+void HandleSignal(int) { stop_requested = true; }
+
+// Samples response latencies from the configured distribution.
+class LatencySampler {
+public:
+  LatencySampler(const std::string &distribution, double mean_ms,
+                 double spread_ms)
+      : distribution_(distribution), mean_ms_(mean_ms), spread_ms_(spread_ms) {
+    if (distribution_ == "lognormal" && mean_ms_ > 0) {
+      // Parameters of the underlying normal distribution for the requested
+      // mean and standard deviation.
+      double variance = spread_ms_ * spread_ms_;
+      double sigma2 = std::log(1 + variance / (mean_ms_ * mean_ms_));
+      lognormal_ = std::lognormal_distribution<double>(
+          std::log(mean_ms_) - sigma2 / 2, std::sqrt(sigma2));
+    }
+  }
+
+  SteadyClock::duration Sample(std::mt19937_64 &rng) {
+    double ms = mean_ms_;
+    if (distribution_ == "uniform") {
+      ms = std::uniform_real_distribution<double>(mean_ms_ - spread_ms_,
+                                                  mean_ms_ + spread_ms_)(rng);
+    } else if (distribution_ == "exponential" && mean_ms_ > 0) {
+      ms = std::exponential_distribution<double>(1 / mean_ms_)(rng);
+    } else if (distribution_ == "lognormal" && mean_ms_ > 0) {
+      ms = lognormal_(rng);
+    }
+    return std::chrono::microseconds(
+        static_cast<int64_t>(std::max(ms, 0.0) * 1000));
+  }
+
+private:
+  std::string distribution_;
+  double mean_ms_;
+  double spread_ms_;
+  std::lognormal_distribution<double> lognormal_;
+};
+
+// A request received on a connection that has not been answered yet.
+struct PendingRequest {
+  MbapHeader header;
+  FunctionCode function_code;
+  std::vector<uint8_t> data;
+};
+
+struct Device {
+  int listen_fd;
+  SlaveDevice slave;
+};
+
+struct Connection {
+  int fd;
+  uint64_t serial;
+  Device *device;
+  std::vector<uint8_t> in;
+  std::vector<uint8_t> out;
+  std::deque<PendingRequest> queued;
+  int in_flight = 0;
+};
+
+// A response waiting for its simulated latency to elapse.
+struct ScheduledResponse {
+  SteadyClock::time_point due;
+  int fd;
+  uint64_t serial;
+  std::vector<uint8_t> frame;
+
+  bool operator>(const ScheduledResponse &other) const {
+    return due > other.due;
+  }
+};
+
+// Event loop serving a subset of the simulated devices.
+class Worker {
+public:
+  Worker(int index, LatencySampler sampler)
+      : rng_(absl::GetFlag(FLAGS_seed) + index), sampler_(std::move(sampler)) {
+    epoll_fd_ = epoll_create1(0);
+  }
+
+  ~Worker() {
+    for (auto &[fd, connection] : connections_) {
+      close(fd);
+    }
+    for (auto &device : devices_) {
+      close(device->listen_fd);
+    }
+    close(epoll_fd_);
+  }
+
+  void AddDevice(std::unique_ptr<Device> device) {
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = device->listen_fd;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, device->listen_fd, &event);
+    listeners_[device->listen_fd] = device.get();
+    devices_.push_back(std::move(device));
+  }
+
+  void Run() {
+    std::vector<struct epoll_event> events(256);
+    while (!stop_requested) {
+      int timeout_ms = 100;
+      if (!scheduled_.empty()) {
+        auto wait = std::chrono::ceil<std::chrono::milliseconds>(
+            scheduled_.top().due - SteadyClock::now());
+        timeout_ms = std::clamp<int>(wait.count(), 0, timeout_ms);
+      }
+      int n = epoll_wait(epoll_fd_, events.data(), events.size(), timeout_ms);
+      for (int i = 0; i < n; ++i) {
+        int fd = events[i].data.fd;
+        if (auto it = listeners_.find(fd); it != listeners_.end()) {
+          Accept(it->second);
+          continue;
+        }
+        auto it = connections_.find(fd);
+        if (it == connections_.end()) {
+          continue;
+        }
+        Connection *connection = it->second.get();
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+          CloseConnection(connection);
+          continue;
+        }
+        if ((events[i].events & EPOLLOUT) && !Flush(connection)) {
+          continue;
+        }
+        if (events[i].events & EPOLLIN) {
+          Receive(connection);
+        }
+      }
+      SendDueResponses();
+    }
+  }
+
+  uint64_t requests_served() const { return requests_served_; }
+
+private:
+  void Accept(Device *device) {
+    while (true) {
+      int fd = accept4(device->listen_fd, nullptr, nullptr, SOCK_NONBLOCK);
+      if (fd < 0) {
+        return;
+      }
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      auto connection = std::make_unique<Connection>();
+      connection->fd = fd;
+      connection->serial = next_serial_++;
+      connection->device = device;
+      struct epoll_event event = {};
+      event.events = EPOLLIN;
+      event.data.fd = fd;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+      connections_[fd] = std::move(connection);
+    }
+  }
+
+  void CloseConnection(Connection *connection) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection->fd, nullptr);
+    close(connection->fd);
+    connections_.erase(connection->fd);
+  }
+
+  void Receive(Connection *connection) {
+    uint8_t buffer[4096];
+    while (true) {
+      ssize_t received = read(connection->fd, buffer, sizeof(buffer));
+      if (received == 0 || (received < 0 && errno != EAGAIN)) {
+        CloseConnection(connection);
+        return;
+      }
+      if (received < 0) {
+        break;
+      }
+      connection->in.insert(connection->in.end(), buffer, buffer + received);
+    }
+
+    // Split the input into MBAP frames.
+    size_t offset = 0;
+    while (connection->in.size() - offset >= kMbapHeaderSize) {
+      MbapHeader header = DecodeMbapHeader(connection->in.data() + offset);
+      if (header.length < 2 || header.length > kMaxMbapLength) {
+        CloseConnection(connection);
+        return;
+      }
+      size_t frame_size = kMbapHeaderSize + header.length - 1;
+      if (connection->in.size() - offset < frame_size) {
+        break;
+      }
+      const uint8_t *pdu = connection->in.data() + offset + kMbapHeaderSize;
+      connection->queued.push_back(
+          {header, static_cast<FunctionCode>(pdu[0]),
+           std::vector<uint8_t>(pdu + 1, pdu + header.length - 1)});
+      offset += frame_size;
+    }
+    connection->in.erase(connection->in.begin(),
+                         connection->in.begin() + offset);
+    StartQueued(connection);
+  }
+
+  // Starts processing queued requests up to the concurrency limit.
+  void StartQueued(Connection *connection) {
+    static const int max_in_flight = absl::GetFlag(FLAGS_max_in_flight);
+    static const double exception_rate = absl::GetFlag(FLAGS_exception_rate);
+    static const auto exception_code =
+        static_cast<ExceptionCode>(absl::GetFlag(FLAGS_exception_code));
+
+    while (!connection->queued.empty() &&
+           connection->in_flight < max_in_flight) {
+      PendingRequest request = std::move(connection->queued.front());
+      connection->queued.pop_front();
+
+      std::vector<uint8_t> pdu;
+      if (exception_rate > 0 &&
+          std::bernoulli_distribution(exception_rate)(rng_)) {
+        pdu = BuildExceptionResponse(request.function_code, exception_code);
+      } else {
+        pdu = connection->device->slave.HandleRequest(request.function_code,
+                                                      request.data);
+      }
+
+      std::vector<uint8_t> frame(kMbapHeaderSize);
+      MbapHeader header = request.header;
+      header.length = pdu.size() + 1;
+      EncodeMbapHeader(header, frame.data());
+      frame.insert(frame.end(), pdu.begin(), pdu.end());
+
+      ++connection->in_flight;
+      scheduled_.push({SteadyClock::now() + sampler_.Sample(rng_),
+                       connection->fd, connection->serial, std::move(frame)});
+    }
+  }
+
+  void SendDueResponses() {
+    auto now = SteadyClock::now();
+    while (!scheduled_.empty() && scheduled_.top().due <= now) {
+      ScheduledResponse response = scheduled_.top();
+      scheduled_.pop();
+      auto it = connections_.find(response.fd);
+      if (it == connections_.end() ||
+          it->second->serial != response.serial) {
+        continue; // Connection closed in the meantime.
+      }
+      Connection *connection = it->second.get();
+      connection->out.insert(connection->out.end(), response.frame.begin(),
+                             response.frame.end());
+      --connection->in_flight;
+      ++requests_served_;
+      if (Flush(connection)) {
+        StartQueued(connection);
+      }
+    }
+  }
+
+  // Writes buffered output, returning false if the connection was closed.
+  bool Flush(Connection *connection) {
+    while (!connection->out.empty()) {
+      ssize_t sent = write(connection->fd, connection->out.data(),
+                           connection->out.size());
+      if (sent < 0 && errno == EAGAIN) {
+        break;
+      }
+      if (sent < 0) {
+        CloseConnection(connection);
+        return false;
+      }
+      connection->out.erase(connection->out.begin(),
+                            connection->out.begin() + sent);
+    }
+    struct epoll_event event = {};
+    event.events = connection->out.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT;
+    event.data.fd = connection->fd;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection->fd, &event);
+    return true;
+  }
+
+  int epoll_fd_;
+  std::mt19937_64 rng_;
+  LatencySampler sampler_;
+  std::vector<std::unique_ptr<Device>> devices_;
+  std::unordered_map<int, Device *> listeners_;
+  std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+  std::priority_queue<ScheduledResponse, std::vector<ScheduledResponse>,
+                      std::greater<ScheduledResponse>>
+      scheduled_;
+  uint64_t next_serial_ = 0;
+  std::atomic<uint64_t> requests_served_ = 0;
+};
+
+int OpenListener(const std::string &address, int port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1 ||
+      bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      listen(fd, SOMAXCONN) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void FillDevice(SlaveDevice &slave, const std::string &fill,
+                std::mt19937_64 &rng) {
+  auto value = [&](size_t address) -> uint16_t {
+    if (fill == "random") {
+      return static_cast<uint16_t>(rng());
+    }
+    return fill == "address" ? static_cast<uint16_t>(address) : 0;
+  };
+  for (size_t i = 0; i < slave.holding_registers().size(); ++i) {
+    slave.holding_registers()[i] = value(i);
+  }
+  for (size_t i = 0; i < slave.input_registers().size(); ++i) {
+    slave.input_registers()[i] = value(i);
+  }
+  for (size_t i = 0; i < slave.coils().size(); ++i) {
+    slave.coils()[i] = value(i) & 0x01;
+  }
+  for (size_t i = 0; i < slave.discrete_inputs().size(); ++i) {
+    slave.discrete_inputs()[i] = value(i) & 0x01;
+  }
+}
+
+int Main() {
+  // Thousands of devices need thousands of descriptors.
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+  signal(SIGINT, HandleSignal);
+  signal(SIGTERM, HandleSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  int num_threads = std::max(1, absl::GetFlag(FLAGS_threads));
+  std::vector<std::unique_ptr<Worker>> workers;
+  for (int i = 0; i < num_threads; ++i) {
+    workers.push_back(std::make_unique<Worker>(
+        i, LatencySampler(absl::GetFlag(FLAGS_latency),
+                          absl::GetFlag(FLAGS_latency_ms),
+                          absl::GetFlag(FLAGS_latency_spread_ms))));
+  }
+
+  RegisterMapParams params = {
+      static_cast<size_t>(absl::GetFlag(FLAGS_coils)),
+      static_cast<size_t>(absl::GetFlag(FLAGS_discrete_inputs)),
+      static_cast<size_t>(absl::GetFlag(FLAGS_holding_registers)),
+      static_cast<size_t>(absl::GetFlag(FLAGS_input_registers))};
+  std::mt19937_64 fill_rng(absl::GetFlag(FLAGS_seed));
+  int base_port = absl::GetFlag(FLAGS_base_port);
+  int num_devices = absl::GetFlag(FLAGS_num_devices);
+  for (int i = 0; i < num_devices; ++i) {
+    int fd = OpenListener(absl::GetFlag(FLAGS_bind_address), base_port + i);
+    if (fd < 0) {
+      fprintf(stderr, "Failed to listen on port %d.\n", base_port + i);
+      return 1;
+    }
+    auto device = std::make_unique<Device>(Device{fd, SlaveDevice(params)});
+    FillDevice(device->slave, absl::GetFlag(FLAGS_fill), fill_rng);
+    workers[i % num_threads]->AddDevice(std::move(device));
+  }
+  printf("Simulating %d devices on ports %d-%d.\n", num_devices, base_port,
+         base_port + num_devices - 1);
+
+  std::vector<std::thread> threads;
+  for (auto &worker : workers) {
+    threads.emplace_back([&worker] { worker->Run(); });
+  }
+
+  uint64_t last_served = 0;
+  while (!stop_requested) {
+    std::this_thread::sleep_for(std::chrono::seconds(5));
+    uint64_t served = 0;
+    for (auto &worker : workers) {
+      served += worker->requests_served();
+    }
+    printf("%.0f requests/s\n", (served - last_served) / 5.0);
+    fflush(stdout);
+    last_served = served;
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  return 0;
+}
+
+} // namespace
+} // namespace modbus
+
+int main(int argc, char **argv) {
+  absl::ParseCommandLine(argc, argv);
+  return modbus::Main();
+}
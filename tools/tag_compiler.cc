@@ -0,0 +1,73 @@
+// Compiles tag definitions from CSV into a tag database image, which
+// TagDatabase::Open maps into memory at startup instead of parsing the CSV.
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/statusor.h"
+#include "src/tag_database.h"
+
+ABSL_FLAG(std::string, input, "",
+          "CSV file of tag definitions, one per line: "
+          "name,slave_id,table,address,type[,word_order[,scale]].");
+ABSL_FLAG(std::string, output, "", "Tag database image to write.");
+
+namespace modbus {
+namespace {
+
+using SteadyClock = std::chrono::steady_clock;
+
+int Main() {
+  std::string input = absl::GetFlag(FLAGS_input);
+  std::string output = absl::GetFlag(FLAGS_output);
+  if (input.empty() || output.empty()) {
+    fprintf(stderr, "--input and --output are required.\n");
+    return 1;
+  }
+  auto start = SteadyClock::now();
+  std::ifstream in(input, std::ios::binary);
+  if (!in) {
+    fprintf(stderr, "Failed to open %s.\n", input.c_str());
+    return 1;
+  }
+  std::stringstream csv;
+  csv << in.rdbuf();
+
+  absl::StatusOr<std::vector<TagDefinition>> tags = ParseTagCsv(csv.str());
+  if (!tags.ok()) {
+    fprintf(stderr, "%s: %s\n", input.c_str(),
+            std::string(tags.status().message()).c_str());
+    return 1;
+  }
+  absl::StatusOr<std::string> image = BuildTagImage(tags.value());
+  if (!image.ok()) {
+    fprintf(stderr, "%s\n", std::string(image.status().message()).c_str());
+    return 1;
+  }
+  std::ofstream out(output, std::ios::binary | std::ios::trunc);
+  out.write(image->data(), image->size());
+  out.close();
+  if (!out) {
+    fprintf(stderr, "Failed to write %s.\n", output.c_str());
+    return 1;
+  }
+  printf("tags:       %zu\n", tags->size());
+  printf("image:      %zu bytes\n", image->size());
+  printf("elapsed:    %.3f s\n",
+         std::chrono::duration<double>(SteadyClock::now() - start).count());
+  return 0;
+}
+
+} // namespace
+} // namespace modbus
+
+int main(int argc, char **argv) {
+  absl::ParseCommandLine(argc, argv);
+  return modbus::Main();
+}